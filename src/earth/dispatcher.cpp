@@ -0,0 +1,66 @@
+#include "dispatcher.h"
+
+ResponseDispatcher::ResponseDispatcher(timer::TimerService &timers,
+                                       TimeoutHandler on_timeout)
+    : m_timers(timers), m_on_timeout(std::move(on_timeout)) {}
+
+uint32_t ResponseDispatcher::add(std::shared_ptr<PendingRequest> request) {
+  // Skip 0, the batch and bulk markers and any ID still in use after
+  // wrapping around
+  while (m_next_id == 0 || m_next_id == BATCH_REQUEST_ID ||
+         m_next_id == BULK_REQUEST_ID || m_outstanding.count(m_next_id)) {
+    m_next_id++;
+  }
+
+  uint32_t request_id = m_next_id++;
+  request->request_id = request_id;
+  m_outstanding[request_id] = Entry{std::move(request), std::nullopt};
+  return request_id;
+}
+
+void ResponseDispatcher::arm(uint32_t request_id, Clock::duration timeout) {
+  auto it = m_outstanding.find(request_id);
+  if (it == m_outstanding.end()) {
+    return;
+  }
+
+  // Replace the previous deadline, if any
+  if (it->second.deadline) {
+    m_timers.cancel(*it->second.deadline);
+  }
+  it->second.deadline = m_timers.schedule(
+      timeout, [this, request_id]() { on_deadline(request_id); });
+}
+
+std::shared_ptr<PendingRequest>
+ResponseDispatcher::find(uint32_t request_id) const {
+  auto it = m_outstanding.find(request_id);
+  return it != m_outstanding.end() ? it->second.request : nullptr;
+}
+
+std::shared_ptr<PendingRequest> ResponseDispatcher::take(uint32_t request_id) {
+  auto it = m_outstanding.find(request_id);
+  if (it == m_outstanding.end()) {
+    return nullptr;
+  }
+
+  if (it->second.deadline) {
+    m_timers.cancel(*it->second.deadline);
+  }
+
+  auto request = std::move(it->second.request);
+  m_outstanding.erase(it);
+  return request;
+}
+
+void ResponseDispatcher::on_deadline(uint32_t request_id) {
+  auto it = m_outstanding.find(request_id);
+  if (it == m_outstanding.end()) {
+    return;
+  }
+
+  // Copied, the handler may remove the request from the table
+  it->second.deadline.reset();
+  auto request = it->second.request;
+  m_on_timeout(request);
+}
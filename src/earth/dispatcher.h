@@ -0,0 +1,100 @@
+#pragma once
+#include "protocols.h"
+#include "timer/timer_service.h"
+#include "transport/scheduler.h"
+
+#include <asio.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+using asio::ip::udp;
+
+/// @brief How often, and how long between attempts, a request is sent before
+/// giving up
+struct RetryPolicy {
+  int max_attempts = MAX_RETRIES;
+  std::chrono::milliseconds timeout{MAX_TIMEOUT_MS};
+};
+
+/// @brief A request that has been sent to a rover and is awaiting a response
+struct PendingRequest {
+  uint32_t request_id = 0;     // ID echoed back in the rover's response
+  uint32_t rover_idx = 0;      // ID of the rover the request was sent to
+  std::vector<uint8_t> packet; // The encoded request (kept for retransmission)
+  udp::endpoint endpoint;      // Where the request is sent
+  int attempts = 0;            // Number of times the request has been sent
+  RetryPolicy policy;          // When to retransmit and when to give up
+
+  // Decides when the request is sent while the link is busy
+  transport::TrafficClass traffic_class = transport::TrafficClass::INTERACTIVE;
+
+  // Called once with the decoded response, or std::nullopt on failure
+  std::function<void(std::optional<std::vector<uint8_t>>)> on_complete;
+};
+
+/// @brief Table of the requests a worker has outstanding. Each request is
+/// given an ID to tag the outgoing packet with, so responses are matched by ID
+/// rather than by where they come from. Deadlines are kept in a timer wheel,
+/// so arming and answering a request are O(1) however many are outstanding.
+/// Must only be used on the thread running the wheel's io_context.
+class ResponseDispatcher {
+public:
+  using Clock = timer::TimerService::Clock;
+  using TimeoutHandler =
+      std::function<void(const std::shared_ptr<PendingRequest> &)>;
+
+private:
+  struct Entry {
+    std::shared_ptr<PendingRequest> request;
+    std::optional<timer::TimerId> deadline;
+  };
+
+  std::unordered_map<uint32_t, Entry> m_outstanding;
+  timer::TimerService &m_timers;
+  TimeoutHandler m_on_timeout;
+
+  // IDs start at 1, 0 is never a valid request ID
+  uint32_t m_next_id = 1;
+
+  // Hands a request whose deadline passed to the timeout handler
+  void on_deadline(uint32_t request_id);
+
+  // Moves m_next_id to test wrapping around
+  friend class ResponseDispatcherTest;
+
+public:
+  /// @brief Constructor for ResponseDispatcher
+  /// @param timers Timer wheel the deadlines are kept in. Must outlive the
+  /// dispatcher.
+  /// @param on_timeout Called when a request's deadline passes. The request
+  /// stays outstanding until it is removed or armed again.
+  ResponseDispatcher(timer::TimerService &timers, TimeoutHandler on_timeout);
+
+  /// @brief Adds a request to the table, assigning its request_id
+  /// @param request the request to track
+  /// @return the ID assigned to the request
+  uint32_t add(std::shared_ptr<PendingRequest> request);
+
+  /// @brief Sets (or resets) the deadline of an outstanding request
+  /// @param request_id ID of the request
+  /// @param timeout Time from now until the request times out
+  void arm(uint32_t request_id, Clock::duration timeout);
+
+  /// @brief Finds an outstanding request
+  /// @param request_id ID from the response
+  /// @return the request, or nullptr if it is unknown or already answered
+  std::shared_ptr<PendingRequest> find(uint32_t request_id) const;
+
+  /// @brief Removes a request from the table, so later responses to it are
+  /// dropped as stale
+  /// @param request_id ID of the request
+  /// @return the removed request, or nullptr if it was not outstanding
+  std::shared_ptr<PendingRequest> take(uint32_t request_id);
+
+  /// @brief Number of requests awaiting a response
+  size_t outstanding() const { return m_outstanding.size(); }
+};
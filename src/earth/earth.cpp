@@ -1,343 +1,1251 @@
 #include "earth.h"
 #include "error_correction/error_correction.h"
+#include "transport/coalescer.h"
 #include "utils.h"
 
 #include <asio/ts/buffer.hpp>   //memory movement
 #include <asio/ts/internet.hpp> //internet
 #include <iostream>
+#include <mutex>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#endif
-
-EarthBase::EarthBase(asio::io_context &io_context)
-    : m_discovery_socket(io_context,
-                         udp::endpoint(udp::v4(), PORTS::DISCOVERY)),
-      m_movement_socket(io_context,
-                        udp::endpoint(udp::v4(), PORTS::MOVEMENT_RESP)),
-      m_active_rovers() {
-#ifdef _WIN32
-  BOOL bNewBehavior = FALSE;
-  DWORD dwBytesReturned = 0;
-  WSAIoctl(m_discovery_socket.native_handle(), SIO_UDP_CONNRESET, &bNewBehavior,
-           sizeof(bNewBehavior), NULL, 0, &dwBytesReturned, NULL, NULL);
-  WSAIoctl(m_movement_socket.native_handle(), SIO_UDP_CONNRESET, &bNewBehavior,
-           sizeof(bNewBehavior), NULL, 0, &dwBytesReturned, NULL, NULL);
-#endif
-
-  m_discovery_socket.set_option(asio::socket_base::reuse_address(true));
-  m_movement_socket.set_option(asio::socket_base::reuse_address(true));
-
-  std::cout << "Earth base listening on port " << PORTS::DISCOVERY << "..."
-            << std::endl;
+EarthBase::EarthBase(asio::io_context &io_context, transport::Backend backend,
+                     unsigned worker_count, const std::string &telemetry_dir,
+                     const std::string &registry_path,
+                     const transport::SchedulerOptions &scheduler)
+    : m_io_context(io_context),
+      m_telemetry(std::make_unique<telemetry::TelemetryStore>(telemetry_dir)) {
+  if (worker_count == 0) {
+    worker_count = 1;
+  }
+
+  // Without SO_REUSEPORT only one socket can be bound to each port
+  if (worker_count > 1 && !transport::reuse_port_supported(backend)) {
+    std::cerr << "SO_REUSEPORT is not supported by the "
+              << transport::backend_name(backend)
+              << " transport, using a single worker" << std::endl;
+    worker_count = 1;
+  }
+
+  const transport::BindOptions options{true, worker_count > 1,
+                                       RECEIVE_BUFFER_SIZE};
+
+  // Sockets join their SO_REUSEPORT group in the order they are bound, which
+  // is the order the steering filter indexes them by
+  for (unsigned idx = 0; idx < worker_count; ++idx) {
+    asio::io_context *context = &io_context;
+    if (idx > 0) {
+      m_worker_contexts.push_back(std::make_unique<asio::io_context>());
+      context = m_worker_contexts.back().get();
+    }
+
+    auto worker = std::make_unique<EarthWorker>(idx, *context);
+    worker->timers = std::make_unique<timer::TimerService>(*context);
+    worker->dispatcher = std::make_unique<ResponseDispatcher>(
+        *worker->timers, [this, w = worker.get()](
+                      const std::shared_ptr<PendingRequest> &request) {
+          std::cout << "Timeout waiting for response, retrying..." << std::endl;
+          transmit(*w, request);
+        });
+    worker->discovery_io = transport::make_transport(
+        backend, *context, udp::endpoint(udp::v4(), PORTS::DISCOVERY),
+        options);
+    worker->movement_io = transport::make_transport(
+        backend, *context, udp::endpoint(udp::v4(), PORTS::MOVEMENT_RESP),
+        options);
+    worker->status_io = transport::make_transport(
+        backend, *context, udp::endpoint(udp::v4(), PORTS::STATUS), options);
+    worker->scheduler = std::make_unique<transport::SendScheduler>(
+        *context, *worker->movement_io, scheduler);
+    worker->telemetry.emplace(*m_telemetry);
+    m_workers.push_back(std::move(worker));
+  }
+
+  // Responses and alerts start with the rover ID, so the kernel can hand
+  // each one straight to the worker that owns the rover. Discovery requests
+  // are left to the kernel's hash, which keeps each rover on the same worker.
+  if (worker_count > 1) {
+    transport::steer_reuseport_group(*m_workers[0]->movement_io, 0,
+                                     worker_count);
+    transport::steer_reuseport_group(*m_workers[0]->status_io, 0,
+                                     worker_count);
+  }
+
+  // Rovers known before a restart keep their IDs and can rejoin. Every
+  // worker publishes its part straight away, as nothing is written until
+  // all of them have.
+  if (!registry_path.empty()) {
+    if (auto records = registry::load_snapshot(registry_path)) {
+      restore_registry(*records);
+    }
+    m_checkpointer =
+        std::make_unique<RegistryCheckpointer>(registry_path, worker_count);
+    for (auto &worker : m_workers) {
+      m_checkpointer->publish(worker->index, registry_records(*worker));
+    }
+  }
+
+  std::cout << "Earth base listening on port " << PORTS::DISCOVERY << " with "
+            << worker_count << " worker(s)..." << std::endl;
 }
 
-void EarthBase::listen_for_rovers() {
-  char data[MAX_PACKET_SIZE];
-  // This runs on its own thread so no need to worry about blocking
-  while (true) {
-    // Wait for a message
-    asio::ip::udp::endpoint sender_endpoint;
-    size_t length = m_discovery_socket.receive_from(
-        asio::buffer(data, sizeof(data)), sender_endpoint);
+EarthBase::~EarthBase() {
+  for (auto &context : m_worker_contexts) {
+    context->stop();
+  }
+  for (auto &thread : m_worker_threads) {
+    thread.join();
+  }
+}
+
+EarthWorker &EarthBase::owner_of(uint32_t rover_id) {
+  return *m_workers[rover_id % m_workers.size()];
+}
+
+void EarthBase::handle_discovery(EarthWorker &worker,
+                                 std::span<const transport::Datagram> batch) {
+  const uint32_t worker_count = m_workers.size();
+
+  // Decode the whole batch in one pass, queueing a reply for each request
+  for (const auto &datagram : batch) {
+    const udp::endpoint &sender_endpoint = datagram.sender;
 
-    std::cout << "\nReceived from Rover: " << data << std::endl;
+    // Rovers discovered before ask to resume instead
+    if (is_rejoin(datagram.data, datagram.size)) {
+      handle_rejoin(worker, datagram);
+      continue;
+    }
+
+    std::cout << "\nReceived " << datagram.size << " bytes from Rover at "
+              << sender_endpoint.address().to_string() << ":"
+              << sender_endpoint.port() << std::endl;
+
+    // Rovers probe at a level of their choosing, which the size gives away
+    auto probe_level = rs_level_for_size(datagram.size);
+    if (!probe_level) {
+      std::cerr << "Ignoring discovery request of unexpected size "
+                << datagram.size << std::endl;
+      continue;
+    }
 
     // Check if the endpoint is new
-    // RoverEndpoint is a pair of udp::endpoint and uint8_t
-    if (get_rover_by_endpoint(sender_endpoint)) {
-      auto existing_rover = get_rover_by_endpoint(sender_endpoint);
-      // If we already ACKed this rover and it's still sending
-      // discovery packets, we can assume it has a higher RS level
-      if (existing_rover->hasACKed && existing_rover->rs_level != 7) {
+    auto local_it = worker.rover_by_endpoint.find(sender_endpoint);
+    if (local_it != worker.rover_by_endpoint.end()) {
+      auto &existing_rover = worker.rovers[local_it->second];
+      // If we already ACKed this rover and it's still sending discovery
+      // packets, our answer did not get through, so recommend a higher level
+      if (existing_rover->hasACKed &&
+          existing_rover->rs_level < PROBE_RS_LEVEL) {
         existing_rover->rs_level++;
       }
     } else {
-      // Add the endpoint to the list of active rovers
-      m_active_rovers.push_back(RoverEndpoint{sender_endpoint, 0, false, 1});
+      // Add the endpoint to this worker's rovers, and start checking that it
+      // stays in contact
+      local_it = worker.rover_by_endpoint
+                     .emplace(sender_endpoint, worker.rovers.size())
+                     .first;
+      worker.rovers.push_back(RoverEndpoint{sender_endpoint, 0, false, 1});
+      watch_liveness(worker, local_it->second * worker_count + worker.index,
+                     HEARTBEAT_INTERVAL);
     }
 
-    // Get the rover endpoint index
-    auto rover_endpoint = get_rover_by_endpoint(sender_endpoint);
+    // Get the rover endpoint
+    auto &rover_endpoint = worker.rovers[local_it->second];
     if (!rover_endpoint) {
       std::cerr << "Error: Failed to find rover endpoint that should exist"
                 << std::endl;
-      continue; // Skip this iteration and wait for next packet
+      continue; // Skip this packet
     }
+    rover_endpoint->last_heard = std::chrono::steady_clock::now();
+    worker.registry_dirty = true;
 
-    // Decode the packet
+    // Decode the packet, counting the errors the link introduced
+    reed_solomon::DecodeStats stats;
+    worker.decode_buffer.assign(datagram.data, datagram.data + datagram.size);
     std::optional<std::vector<uint8_t>> req_packet =
-        reed_solomon::decode_packet(std::vector<uint8_t>(data, data + length),
-                                    RS_LEVELS[rover_endpoint->rs_level]);
+        reed_solomon::decode_packet(worker.decode_buffer,
+                                    RS_LEVELS[*probe_level], &stats);
+
+    // A rejoin request whose "RJON" was corrupted in transit. The rover
+    // retries it.
+    if (req_packet && is_rejoin(req_packet->data(), req_packet->size())) {
+      continue;
+    }
+
+    // Settle the level straight away from what this request went through.
+    // A request too erroneous to decode at the probe level calls for the
+    // strongest code once one gets through.
+    if (!req_packet.has_value()) {
+      rover_endpoint->rs_level = PROBE_RS_LEVEL;
+    } else {
+      rover_endpoint->rs_level =
+          std::max(rover_endpoint->rs_level,
+                   recommend_rs_level(stats.worst_block));
+    }
 
-    // Fill the response packet
+    // Fill the response packet. IDs are interleaved across workers so the
+    // owner of any ID is its value modulo the worker count.
     DiscoveryResponse d_resp{};
     strncpy(d_resp.status, req_packet.has_value() ? ACK : NAK, 3);
-    d_resp.rover_id = get_rover_itr(sender_endpoint) - m_active_rovers.begin();
+    d_resp.rs_level = rover_endpoint->rs_level;
+    d_resp.rover_id = local_it->second * worker_count + worker.index;
     d_resp.timestamp = util::current_time();
 
-    // Encode the response packet with the current RS level for this rover
-    auto resp_packet = reed_solomon::encode_packet(
-        d_resp, RS_LEVELS[rover_endpoint->rs_level]);
+    // Encode the response packet at the level the rover is listening on
+    worker.discovery_io->queue_send(
+        sender_endpoint,
+        reed_solomon::encode_packet(d_resp, RS_LEVELS[*probe_level]));
 
-    m_discovery_socket.send_to(asio::buffer(resp_packet), sender_endpoint);
+    if (req_packet.has_value()) {
+      rover_endpoint->hasACKed = true;
+      rover_endpoint->restored = false;
 
-    // If the packet was too erroneous to decode, we need to increment the RS
-    // level
-    if (!req_packet.has_value()) {
-      if (rover_endpoint->rs_level != 7) {
-        rover_endpoint->rs_level++;
+      // Rovers that do not listen on the well-known ports say where they do
+      auto d_req = util::bytes_to_struct<DiscoveryRequest>(*req_packet);
+      if (d_req.movement_port != 0) {
+        rover_endpoint->movement_port = d_req.movement_port;
+      }
+      if (d_req.status_port != 0) {
+        rover_endpoint->status_port = d_req.status_port;
       }
-    } else {
-      rover_endpoint->hasACKed = true;
     }
   }
-}
-
-void EarthBase::send_message(const std::vector<uint8_t> &message,
-                             udp::socket &socket, udp::endpoint endpoint) {
-  try {
-    udp::endpoint local_endpoint(endpoint.address().is_v4() ? udp::v4()
-                                                            : udp::v6(),
-                                 socket.local_endpoint().port());
 
-    socket.send_to(asio::buffer(message), endpoint);
-  } catch (const std::exception &e) {
-    std::cerr << "\nError sending message: " << e.what() << std::endl;
-  }
+  // Reply to the whole batch at once
+  worker.discovery_io->flush();
 }
 
 void EarthBase::start() {
-  m_listener_thread = std::thread(&EarthBase::listen_for_rovers, this);
-}
+  // Each worker's sockets are serviced by the thread running its io_context
+  for (auto &worker : m_workers) {
+    EarthWorker *w = worker.get();
 
-std::vector<std::optional<RoverEndpoint>>::iterator
-EarthBase::get_rover_itr(const udp::endpoint &endpoint) {
-  return std::find_if(m_active_rovers.begin(), m_active_rovers.end(),
-                      [&endpoint](const std::optional<RoverEndpoint> &rover) {
-                        return rover.has_value() && rover->endpoint == endpoint;
-                      });
-}
+    w->discovery_io->async_receive(
+        [this, w](std::span<const transport::Datagram> batch) {
+          handle_discovery(*w, batch);
+        });
+
+    w->movement_io->async_receive(
+        [this, w](std::span<const transport::Datagram> batch) {
+          for (const auto &datagram : batch) {
+            handle_response(*w, datagram);
+          }
+        });
+
+    w->status_io->async_receive(
+        [this, w](std::span<const transport::Datagram> batch) {
+          for (const auto &datagram : batch) {
+            handle_alert(*w, datagram);
+          }
+        });
 
-RoverEndpoint *EarthBase::get_rover_by_endpoint(const udp::endpoint &endpoint) {
-  auto rover_it = get_rover_itr(endpoint);
-  if (rover_it != m_active_rovers.end()) {
-    // Return a reference to the value inside the optional
-    return &rover_it->value();
+    // Timers belong to the worker's thread
+    if (m_checkpointer) {
+      asio::post(w->io_context, [this, w]() { schedule_checkpoint(*w); });
+    }
+  }
+
+  // The first worker runs on the caller's io_context
+  for (auto &context : m_worker_contexts) {
+    m_worker_threads.emplace_back([&context]() { context->run(); });
   }
-  return nullptr;
 }
 
-RoverEndpoint *EarthBase::get_rover_endpoint_by_idx(const unsigned int idx) {
+RoverEndpoint *EarthBase::get_rover_endpoint_by_idx(EarthWorker &worker,
+                                                    const unsigned int idx) {
+  const unsigned int worker_count = m_workers.size();
+  const unsigned int local_idx = idx / worker_count;
 
-  // If out of bounds
-  if (idx < 0 || idx >= (unsigned int)m_active_rovers.size()) {
+  // If owned by another worker or out of bounds
+  if (idx % worker_count != worker.index ||
+      local_idx >= (unsigned int)worker.rovers.size()) {
     return nullptr;
   }
 
-  if (!m_active_rovers[idx]) {
+  if (!worker.rovers[local_idx]) {
     return nullptr;
   }
 
   // Return otherwise
-  return &(m_active_rovers[idx].value());
+  return &(worker.rovers[local_idx].value());
 }
 
-size_t EarthBase::send_movment_command(uint32_t rover_idx,
-                                       DIRECTION direction) {
-  // Get the rover's discovery endpoint and change the port to ROVER_MOVEMENT
-  auto rover_endpoint = get_rover_endpoint_by_idx(rover_idx);
-  if (!rover_endpoint) {
-    std::cerr << "Rover not found at index " << rover_idx << std::endl;
-    return 1;
-  }
-
-  MoveRequest req = {rover_idx, direction, util::current_time(),
-                     !rover_endpoint->movement_seq_num};
-
-  // Update the sequence number
-  rover_endpoint->movement_seq_num = req.sequence_num;
-
-  // Copy endpoint and update the rover endpoint to the movement port
-  auto rover_movement_endpoint = *rover_endpoint;
-  rover_movement_endpoint.endpoint.port(PORTS::MOVEMENT_CMD);
-
-  // Encode the request packet with the current RS level for this rover
-  auto request_packet =
-      reed_solomon::encode_packet(req, RS_LEVELS[rover_endpoint->rs_level]);
-
-  for (int attempt = 0; attempt < MAX_RETRIES; attempt++) {
-    std::cout << "Sending movement command (attempt " << (attempt + 1) << "/"
-              << MAX_RETRIES << ") to "
-              << rover_movement_endpoint.endpoint.address().to_string() << ":"
-              << rover_movement_endpoint.endpoint.port() << std::endl;
-
-    // Send move command
-    send_message(request_packet, m_movement_socket,
-                 rover_movement_endpoint.endpoint);
-
-    // Wait for response
-    char data[MAX_PACKET_SIZE];
-    udp::endpoint sender_endpoint;
-
-    // Set to non-blocking mode so we can handle timeouts
-    m_movement_socket.non_blocking(true);
-
-    auto start_time = std::chrono::steady_clock::now();
-    size_t length = 0;
-    bool received = false;
-
-    // Wait for a response or timeout
-    while (std::chrono::duration_cast<std::chrono::milliseconds>(
-               std::chrono::steady_clock::now() - start_time)
-               .count() < MAX_TIMEOUT_MS) {
-      try {
-        length = m_movement_socket.receive_from(
-            asio::buffer(data, sizeof(data)), sender_endpoint);
-        received = true;
-        break;
-      } catch (const asio::system_error &e) {
-        // If no data is available, we can ignore the error
-        if (e.code() == asio::error::would_block) {
-          std::this_thread::sleep_for(std::chrono::milliseconds(10));
-          continue;
-        } else {
-          // Some other error
-          std::cerr << "Error receiving movement response: " << e.what()
-                    << std::endl;
-          break;
+std::vector<uint32_t> EarthBase::active_rover_ids() {
+  const uint32_t worker_count = m_workers.size();
+
+  // Ask every worker for its rovers on its own thread
+  std::vector<std::future<std::vector<uint32_t>>> futures;
+  for (auto &worker : m_workers) {
+    auto promise = std::make_shared<std::promise<std::vector<uint32_t>>>();
+    futures.push_back(promise->get_future());
+
+    asio::post(worker->io_context, [w = worker.get(), worker_count, promise]() {
+      std::vector<uint32_t> ids;
+      for (size_t idx = 0; idx < w->rovers.size(); ++idx) {
+        if (w->rovers[idx] && w->rovers[idx]->hasACKed) {
+          ids.push_back(static_cast<uint32_t>(idx) * worker_count + w->index);
         }
       }
-    }
+      promise->set_value(std::move(ids));
+    });
+  }
+
+  std::vector<uint32_t> ids;
+  for (auto &future : futures) {
+    auto worker_ids = future.get();
+    ids.insert(ids.end(), worker_ids.begin(), worker_ids.end());
+  }
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+bool EarthBase::forward_to_owner(EarthWorker &worker,
+                                 const transport::Datagram &datagram,
+                                 uint32_t rover_id, DatagramHandler handler) {
+  if (rover_id % m_workers.size() == worker.index) {
+    return false;
+  }
+
+  // The datagram only lives until the receive handler returns
+  EarthWorker &owner = owner_of(rover_id);
+  std::vector<uint8_t> copy(datagram.data, datagram.data + datagram.size);
+  asio::post(owner.io_context, [this, &owner, handler, sender = datagram.sender,
+                                copy = std::move(copy)]() {
+    (this->*handler)(owner,
+                     transport::Datagram{sender, copy.data(), copy.size()});
+  });
+  return true;
+}
+
+void EarthBase::handle_rejoin(EarthWorker &worker,
+                              const transport::Datagram &datagram) {
+  const udp::endpoint &sender = datagram.sender;
+
+  // The rover ID and RS level are read before decoding, to find the worker
+  // owning the rover and the code the request was sent with
+  auto hint = peek_rejoin(datagram.data, datagram.size);
+  if (!hint || hint->rs_level >= RS_LEVELS.size() ||
+      forward_to_owner(worker, datagram, hint->rover_id,
+                       &EarthBase::handle_rejoin)) {
+    return;
+  }
+
+  // Undecodable requests go unanswered, the rover retries them
+  worker.decode_buffer.assign(datagram.data, datagram.data + datagram.size);
+  auto packet = reed_solomon::decode_packet(worker.decode_buffer,
+                                            RS_LEVELS[hint->rs_level]);
+  if (!packet) {
+    std::cout << "Could not decode rejoin request from "
+              << sender.address().to_string() << ":" << sender.port()
+              << std::endl;
+    return;
+  }
 
-    // Set socket back to blocking mode
-    m_movement_socket.non_blocking(false);
+  auto req = util::bytes_to_struct<RejoinRequest>(*packet);
+  if (req.rover_id != hint->rover_id || req.rs_level != hint->rs_level) {
+    return; // Fields read before decoding were corrupted in transit
+  }
 
-    if (!received) {
-      std::cout << "Timeout waiting for response, retrying..." << std::endl;
-      continue; // Try again
+  // Only the endpoint a rover was discovered from can resume it. The rover
+  // restates the state it shares with the Earth base, which may have changed
+  // since the snapshot was taken.
+  auto rover = get_rover_endpoint_by_idx(worker, req.rover_id);
+  const bool known = rover && rover->endpoint == sender;
+  if (known) {
+    rover->rs_level = req.rs_level;
+    if (req.movement_port != 0) {
+      rover->movement_port = req.movement_port;
+    }
+    if (req.status_port != 0) {
+      rover->status_port = req.status_port;
     }
 
-    std::cout << "Received " << length << " bytes from "
-              << sender_endpoint.address().to_string() << ":"
-              << sender_endpoint.port() << std::endl;
+    // A command in flight has already moved the sequence number on
+    if (!rover->sending_moves) {
+      rover->movement_seq_num = req.sequence_num;
+    }
+    rover->hasACKed = true;
+    rover->restored = false;
+    rover->last_heard = std::chrono::steady_clock::now();
+    worker.registry_dirty = true;
+
+    std::cout << "Rover " << req.rover_id << " rejoined from "
+              << sender.address().to_string() << ":" << sender.port()
+              << std::endl;
+  } else {
+    std::cout << "Unknown rover " << req.rover_id << " at "
+              << sender.address().to_string() << ":" << sender.port()
+              << " asked to rejoin, it must be discovered again" << std::endl;
+  }
+
+  RejoinResponse resp;
+  strncpy(resp.status, known ? ACK : NAK, 3);
+  resp.rover_id = req.rover_id;
+  resp.timestamp = util::current_time();
+  worker.discovery_io->send(
+      sender, reed_solomon::encode_packet(resp, RS_LEVELS[req.rs_level]));
+}
+
+void EarthBase::handle_response(EarthWorker &worker,
+                                const transport::Datagram &datagram) {
+  const udp::endpoint &sender = datagram.sender;
+
+  // The header can be read before decoding. The steering filter normally
+  // delivers responses to the worker owning the rover already.
+  auto header = peek_header(datagram.data, datagram.size);
+  if (!header || forward_to_owner(worker, datagram, header->rover_id,
+                                  &EarthBase::handle_response)) {
+    return;
+  }
+
+  // The header read before decoding may be corrupt, so it only decides which
+  // rover's RS level to decode with, and what to retransmit if decoding fails.
+  // Rovers answer from any of their sockets, so only the address is checked.
+  auto hint = worker.dispatcher->find(header->request_id);
+  if (hint && hint->endpoint.address() != sender.address()) {
+    hint.reset();
+  }
+
+  const uint32_t rover_idx = hint ? hint->rover_idx : header->rover_id;
+  auto rover = get_rover_endpoint_by_idx(worker, rover_idx);
+  if (!rover) {
+    std::cout << "Ignoring response from unknown rover at "
+              << sender.address().to_string() << ":" << sender.port()
+              << std::endl;
+    return;
+  }
+
+  worker.decode_buffer.assign(datagram.data, datagram.data + datagram.size);
+  std::optional<std::vector<uint8_t>> packet = reed_solomon::decode_packet(
+      worker.decode_buffer, RS_LEVELS[rover->rs_level]);
 
-    // Create string with exact length
-    std::optional<std::vector<uint8_t>> resp_packet =
-        reed_solomon::decode_packet(std::vector<uint8_t>(data, data + length),
-                                    RS_LEVELS[rover_endpoint->rs_level]);
+  // Retransmit straight away rather than waiting for the timeout
+  if (!packet) {
+    if (hint) {
+      std::cout << "Could not decode response, retrying..." << std::endl;
+      transmit(worker, hint);
+    }
+    return;
+  }
+  rover->last_heard = std::chrono::steady_clock::now();
 
-    // Check if packet could be decoded
-    if (!resp_packet) {
-      std::cout << "Could not decode movement response, retrying..."
+  // A batch carries several messages under the one encoding
+  auto decoded = peek_header(packet->data(), packet->size());
+  if (decoded && decoded->request_id == BATCH_REQUEST_ID) {
+    auto messages = transport::unpack_batch(*packet);
+    if (!messages || decoded->rover_id != rover_idx) {
+      std::cout << "Ignoring malformed batch from "
+                << sender.address().to_string() << ":" << sender.port()
                 << std::endl;
-      continue;
+      return;
+    }
+    for (auto &message : *messages) {
+      dispatch_message(worker, sender, rover_idx, std::move(message));
     }
+    return;
+  }
 
-    // Process the movement response
-    MoveResponse resp;
-    std::memcpy(&resp, resp_packet->data(), sizeof(MoveResponse));
+  dispatch_message(worker, sender, rover_idx, std::move(*packet));
+}
+
+void EarthBase::dispatch_message(EarthWorker &worker,
+                                 const udp::endpoint &sender,
+                                 uint32_t rover_idx,
+                                 std::vector<uint8_t> message) {
+  auto header = peek_header(message.data(), message.size());
+
+  if (header && header->request_id == BULK_REQUEST_ID) {
+    handle_bulk(worker, sender, rover_idx, message);
+    return;
+  }
+
+  // Alerts may share a datagram with responses. Like those sent to the
+  // status port, they must come from the address the rover was discovered
+  // from.
+  if (header && header->request_id == 0) {
+    auto rover = get_rover_endpoint_by_idx(worker, rover_idx);
+    if (header->rover_id == rover_idx && rover &&
+        rover->endpoint.address() == sender.address()) {
+      process_alert(worker, util::bytes_to_struct<StatusResponse>(message));
+    }
+    return;
+  }
+
+  // Responses to requests that have completed or timed out are dropped here,
+  // as are late duplicates of a retransmitted request
+  auto request = header ? worker.dispatcher->find(header->request_id) : nullptr;
+  if (!request || request->endpoint.address() != sender.address() ||
+      request->rover_idx != header->rover_id) {
+    std::cout << "Ignoring stale or unexpected response from "
+              << sender.address().to_string() << ":" << sender.port()
+              << std::endl;
+    return;
+  }
+
+  complete_request(worker, request, std::move(message));
+}
+
+void EarthBase::handle_bulk(EarthWorker &worker, const udp::endpoint &sender,
+                            uint32_t rover_idx,
+                            const std::vector<uint8_t> &message) {
+  // Like alerts, segments must come from the address the rover was
+  // discovered from, for a transfer opened with that rover
+  auto header = transport::peek_bulk_header(message);
+  auto rover = get_rover_endpoint_by_idx(worker, rover_idx);
+  auto it = header ? worker.transfers.find(header->transfer_id)
+                   : worker.transfers.end();
+  if (it == worker.transfers.end() || header->rover_id != rover_idx ||
+      !rover || rover->endpoint.address() != sender.address()) {
+    return;
+  }
+
+  switch (header->kind) {
+  case BulkKind::DATA:
+    it->second->handle_segment(message);
+    break;
+  case BulkKind::ABORT:
+    it->second->cancel(false);
+    break;
+  default:
+    break; // The Earth base only receives
+  }
+}
+
+void EarthBase::handle_alert(EarthWorker &worker,
+                             const transport::Datagram &datagram) {
+  const udp::endpoint &sender = datagram.sender;
+
+  // Alerts carry the same header as responses, with a request ID of 0
+  auto header = peek_header(datagram.data, datagram.size);
+  if (!header || forward_to_owner(worker, datagram, header->rover_id,
+                                  &EarthBase::handle_alert)) {
+    return;
+  }
+
+  // Alerts are sent from the rover's status socket, so only the address can
+  // be checked against the one it was discovered from
+  auto rover = get_rover_endpoint_by_idx(worker, header->rover_id);
+  if (!rover || rover->endpoint.address() != sender.address()) {
+    std::cout << "Ignoring alert from unknown rover at "
+              << sender.address().to_string() << ":" << sender.port()
+              << std::endl;
+    return;
+  }
 
-    std::cout << "Movement response:\n\tRover ID = " << resp.rover_id
-              << ",\n\tStatus = " << resp.status
-              << ",\n\tMoved = " << (resp.moved ? "true" : "false")
-              << ",\n\tPosition = (" << resp.x << "," << resp.y << ")"
+  worker.decode_buffer.assign(datagram.data, datagram.data + datagram.size);
+  auto packet = reed_solomon::decode_packet(worker.decode_buffer,
+                                            RS_LEVELS[rover->rs_level]);
+  if (!packet) {
+    std::cout << "Could not decode alert from rover " << header->rover_id
               << std::endl;
+    return;
+  }
+  rover->last_heard = std::chrono::steady_clock::now();
 
-    // Successfully received and decoded response
-    return 0;
+  auto alert = util::bytes_to_struct<StatusResponse>(*packet);
+  if (alert.rover_id != header->rover_id) {
+    return; // Header was corrupted in transit
   }
+  process_alert(worker, alert);
+}
 
+void EarthBase::process_alert(EarthWorker &worker, StatusResponse alert) {
+  alert.message[sizeof(alert.message) - 1] = '\0';
+
+  std::cout << "Alert from rover " << alert.rover_id << ":" << alert.message
+            << std::endl;
+  record_status(worker, alert);
+}
+
+void EarthBase::record_status(EarthWorker &worker,
+                              const StatusResponse &status) {
+  // Stamped with the time of arrival, so the log is ordered by Earth's clock
+  // rather than each rover's
+  telemetry::Sample sample{util::current_time(), status.rover_id,
+                           status.battery_level, status.temperature,
+                           status.error_code};
+  if (!worker.telemetry->record(sample)) {
+    std::cerr << "Telemetry backlog full, dropped sample from rover "
+              << status.rover_id << std::endl;
+  }
+}
+
+void EarthBase::complete_request(
+    EarthWorker &worker, const std::shared_ptr<PendingRequest> &request,
+    std::optional<std::vector<uint8_t>> packet) {
+  if (!worker.dispatcher->take(request->request_id)) {
+    return; // Already completed
+  }
+
+  auto on_complete = std::move(request->on_complete);
+  request->on_complete = nullptr;
+
+  if (on_complete) {
+    on_complete(std::move(packet));
+  }
+}
+
+void EarthBase::transmit(EarthWorker &worker,
+                         const std::shared_ptr<PendingRequest> &request) {
   // All attempts failed
-  std::cout << "Failed to get valid movement response after " << MAX_RETRIES
-            << " attempts" << std::endl;
-  return 1;
-}
-void EarthBase::request_health_report(uint32_t rover_idx)
-{
-  auto rover_endpoint = get_rover_endpoint_by_idx(rover_idx);
-  if (!rover_endpoint)
-  {
+  if (request->attempts >= request->policy.max_attempts) {
+    std::cout << "Failed to get valid response from "
+              << request->endpoint.address().to_string() << ":"
+              << request->endpoint.port() << " after " << request->attempts
+              << " attempts" << std::endl;
+    complete_request(worker, request, std::nullopt);
+    return;
+  }
+
+  request->attempts++;
+  std::cout << "Sending request " << request->request_id << " (attempt "
+            << request->attempts << "/" << request->policy.max_attempts
+            << ") to "
+            << request->endpoint.address().to_string() << ":"
+            << request->endpoint.port() << std::endl;
+
+  // Requests made while handling the same event still share system calls,
+  // as the scheduler sends once the handler returns
+  worker.scheduler->send(request->endpoint, request->packet,
+                         request->traffic_class);
+
+  if (auto rover = get_rover_endpoint_by_idx(worker, request->rover_idx)) {
+    rover->last_sent = std::chrono::steady_clock::now();
+  }
+
+  // Wait for response or timeout
+  worker.dispatcher->arm(request->request_id, request->policy.timeout);
+}
+
+asio::awaitable<std::optional<std::vector<uint8_t>>>
+EarthBase::exchange(uint32_t rover_idx, RequestPort port, RequestEncoder encode,
+                    RetryPolicy policy, transport::TrafficClass traffic_class) {
+  using Packet = std::optional<std::vector<uint8_t>>;
+  EarthWorker &worker = owner_of(rover_idx);
+
+  // The request is started on the rover's worker, and its completion is
+  // handed back to whichever executor the caller is running on
+  auto initiation = [this, &worker, rover_idx, port, policy, traffic_class,
+                     encode = std::move(encode)](auto handler) mutable {
+    using Handler = decltype(handler);
+    auto shared = std::make_shared<Handler>(std::move(handler));
+
+    asio::post(worker.io_context, [this, &worker, rover_idx, port, policy,
+                                   traffic_class, encode = std::move(encode),
+                                   shared]() {
+      auto resume = [shared](Packet packet) {
+        auto executor = asio::get_associated_executor(*shared);
+        asio::post(executor, [shared, packet = std::move(packet)]() mutable {
+          (*shared)(std::move(packet));
+        });
+      };
+
+      auto rover_endpoint = get_rover_endpoint_by_idx(worker, rover_idx);
+      if (!rover_endpoint) {
+        std::cerr << "Rover not found at index " << rover_idx << std::endl;
+        resume(std::nullopt);
+        return;
+      }
+
+      auto request = std::make_shared<PendingRequest>();
+      request->rover_idx = rover_idx;
+      request->policy = policy;
+      request->traffic_class = traffic_class;
+      worker.dispatcher->add(request);
+
+      // Encode the request with the current RS level for this rover
+      request->packet =
+          encode(request->request_id, RS_LEVELS[rover_endpoint->rs_level]);
+
+      // Copy endpoint and update it to the request's port
+      request->endpoint = rover_endpoint->endpoint;
+      request->endpoint.port(port == RequestPort::STATUS
+                                 ? rover_endpoint->status_port
+                                 : rover_endpoint->movement_port);
+
+      request->on_complete = std::move(resume);
+      transmit(worker, request);
+    });
+  };
+
+  co_return co_await asio::async_initiate<decltype(asio::use_awaitable),
+                                          void(Packet)>(std::move(initiation),
+                                                        asio::use_awaitable);
+}
+
+asio::awaitable<void> EarthBase::send_queued_moves(EarthWorker &worker,
+                                                   uint32_t rover_idx) {
+  while (true) {
+    // The registry may grow while a command is in flight, so the rover is
+    // looked up again for each command
+    auto rover_endpoint = get_rover_endpoint_by_idx(worker, rover_idx);
+    if (!rover_endpoint) {
+      co_return;
+    }
+    if (rover_endpoint->queued_moves.empty()) {
+      rover_endpoint->sending_moves = false;
+      co_return;
+    }
+
+    QueuedMove next = std::move(rover_endpoint->queued_moves.front());
+    rover_endpoint->queued_moves.pop_front();
+
+    // Update the sequence number
+    rover_endpoint->movement_seq_num = !rover_endpoint->movement_seq_num;
+    worker.registry_dirty = true;
+
+    co_await next.send(rover_endpoint->movement_seq_num);
+  }
+}
+
+asio::awaitable<void> EarthBase::send_move(uint32_t rover_idx,
+                                           DIRECTION direction,
+                                           bool sequence_num,
+                                           MoveCallback on_complete) {
+  MoveRequest req = {rover_idx, 0, direction, util::current_time(),
+                     sequence_num};
+  auto resp = co_await request<MoveRequest, MoveResponse>(rover_idx, req);
+
+  MoveResult result{rover_idx};
+  if (resp) {
+    // Process the movement response
+    result.success = true;
+    result.response = *resp;
+
+    std::cout << "Movement response:\n\tRover ID = "
+              << result.response.rover_id
+              << ",\n\tStatus = " << std::string(result.response.status, 3)
+              << ",\n\tMoved = " << (result.response.moved ? "true" : "false")
+              << ",\n\tPosition = (" << result.response.x << ","
+              << result.response.y << ")" << std::endl;
+  }
+
+  if (on_complete) {
+    on_complete(result);
+  }
+}
+
+asio::awaitable<void> EarthBase::send_path(uint32_t rover_idx,
+                                           std::vector<PathRun> path,
+                                           bool sequence_num,
+                                           PathCallback on_complete) {
+  PathRequest req;
+  req.sequence_num = sequence_num;
+  req.timestamp = util::current_time();
+  req.run_count = path.size();
+  std::copy(path.begin(), path.end(), req.runs);
+  auto resp = co_await request<PathRequest, PathResponse>(rover_idx, req);
+
+  PathResult result{rover_idx};
+  if (resp) {
+    result.success = true;
+    result.response = *resp;
+
+    std::cout << "Path response:\n\tRover ID = " << result.response.rover_id
+              << ",\n\tStatus = " << std::string(result.response.status, 3)
+              << ",\n\tMoves = " << result.response.steps_taken << " of "
+              << result.response.total_steps << ",\n\tPosition = ("
+              << result.response.x << "," << result.response.y << ")"
+              << std::endl;
+  }
+
+  if (on_complete) {
+    on_complete(result);
+  }
+}
+
+asio::awaitable<void> EarthBase::send_goto(uint32_t rover_idx, int x, int y,
+                                           uint32_t budget, bool sequence_num,
+                                           GotoCallback on_complete) {
+  GotoRequest req;
+  req.sequence_num = sequence_num;
+  req.x = x;
+  req.y = y;
+  req.budget = budget;
+  req.timestamp = util::current_time();
+
+  auto resp = co_await request<GotoRequest, GotoResponse>(rover_idx, req);
+
+  GotoResult result{rover_idx};
+  if (resp) {
+    result.success = true;
+    result.response = *resp;
+    result.response.run_count =
+        std::min<uint8_t>(result.response.run_count, MAX_PATH_RUNS);
+
+    static constexpr const char *outcomes[] = {"reached", "partial",
+                                               "unreachable"};
+    auto outcome = static_cast<size_t>(result.response.outcome);
+    std::cout << "Goto response:\n\tRover ID = " << result.response.rover_id
+              << ",\n\tStatus = " << std::string(result.response.status, 3)
+              << ",\n\tOutcome = "
+              << (outcome < std::size(outcomes) ? outcomes[outcome] : "?")
+              << ",\n\tMoves = " << result.response.steps_taken
+              << " (searched " << result.response.expanded << " tiles)"
+              << ",\n\tPath = " << path_to_string(result.response.runs,
+                                                   result.response.run_count)
+              << ",\n\tPosition = (" << result.response.x << ","
+              << result.response.y << ")" << std::endl;
+  }
+
+  if (on_complete) {
+    on_complete(result);
+  }
+}
+
+void EarthBase::queue_move(EarthWorker &worker, uint32_t rover_idx,
+                           QueuedMove move) {
+  auto rover_endpoint = get_rover_endpoint_by_idx(worker, rover_idx);
+  if (!rover_endpoint) {
     std::cerr << "Rover not found at index " << rover_idx << std::endl;
+    move.abandon();
+    return;
+  }
+  rover_endpoint->queued_moves.push_back(std::move(move));
+
+  // Start the rover's move coroutine unless it is already running
+  if (!rover_endpoint->sending_moves) {
+    rover_endpoint->sending_moves = true;
+    asio::co_spawn(worker.io_context, send_queued_moves(worker, rover_idx),
+                   asio::detached);
+  }
+}
+
+void EarthBase::send_movement_command_async(uint32_t rover_idx,
+                                            DIRECTION direction,
+                                            MoveCallback on_complete) {
+  // All request state is owned by the rover's worker
+  EarthWorker &worker = owner_of(rover_idx);
+  asio::post(worker.io_context, [this, &worker, rover_idx, direction,
+                                 on_complete = std::move(on_complete)]() {
+    queue_move(worker, rover_idx,
+               {[=, this](bool sequence_num) {
+                  return send_move(rover_idx, direction, sequence_num,
+                                   on_complete);
+                },
+                [=] {
+                  if (on_complete) {
+                    on_complete(MoveResult{rover_idx});
+                  }
+                }});
+  });
+}
+
+void EarthBase::send_path_command_async(uint32_t rover_idx,
+                                        const std::vector<DIRECTION> &moves,
+                                        PathCallback on_complete) {
+  auto path = encode_path(moves);
+  if (!path || path->empty()) {
+    std::cerr << (path ? "Path has no moves"
+                       : "Path needs more than " +
+                             std::to_string(MAX_PATH_RUNS) + " runs")
+              << std::endl;
+    if (on_complete) {
+      on_complete(PathResult{rover_idx});
+    }
     return;
   }
 
-  // Set health check port
-  udp::endpoint health_endpoint = rover_endpoint->endpoint;
-  health_endpoint.port(PORTS::STATUS);  // This is usually port 2268
+  EarthWorker &worker = owner_of(rover_idx);
+  asio::post(worker.io_context, [this, &worker, rover_idx,
+                                 path = std::move(*path),
+                                 on_complete = std::move(on_complete)]() {
+    queue_move(worker, rover_idx,
+               {[=, this](bool sequence_num) {
+                  return send_path(rover_idx, path, sequence_num, on_complete);
+                },
+                [=] {
+                  if (on_complete) {
+                    on_complete(PathResult{rover_idx});
+                  }
+                }});
+  });
+}
+
+void EarthBase::send_goto_command_async(uint32_t rover_idx, int x, int y,
+                                        uint32_t budget,
+                                        GotoCallback on_complete) {
+  EarthWorker &worker = owner_of(rover_idx);
+  asio::post(worker.io_context, [this, &worker, rover_idx, x, y, budget,
+                                 on_complete = std::move(on_complete)]() {
+    queue_move(worker, rover_idx,
+               {[=, this](bool sequence_num) {
+                  return send_goto(rover_idx, x, y, budget, sequence_num,
+                                   on_complete);
+                },
+                [=] {
+                  if (on_complete) {
+                    on_complete(GotoResult{rover_idx});
+                  }
+                }});
+  });
+}
+
+std::future<MoveResult>
+EarthBase::send_movement_command_async(uint32_t rover_idx,
+                                       DIRECTION direction) {
+  auto promise = std::make_shared<std::promise<MoveResult>>();
+  auto future = promise->get_future();
+
+  send_movement_command_async(
+      rover_idx, direction,
+      [promise](const MoveResult &result) { promise->set_value(result); });
+
+  return future;
+}
+
+std::future<std::vector<MoveResult>>
+EarthBase::broadcast_movement_command(const std::vector<uint32_t> &rover_ids,
+                                      DIRECTION direction,
+                                      MoveCallback on_each) {
+  // Shared between every command of the broadcast. Rovers owned by
+  // different workers complete on different threads, so results are recorded
+  // under a lock.
+  struct BroadcastState {
+    std::mutex mutex;
+    std::vector<MoveResult> results;
+    size_t remaining;
+    std::promise<std::vector<MoveResult>> promise;
+  };
+
+  auto state = std::make_shared<BroadcastState>();
+  state->results.resize(rover_ids.size());
+  state->remaining = rover_ids.size();
+  auto future = state->promise.get_future();
+
+  if (rover_ids.empty()) {
+    state->promise.set_value({});
+    return future;
+  }
+
+  // Fan out every command before any response is waited on
+  for (size_t i = 0; i < rover_ids.size(); ++i) {
+    send_movement_command_async(
+        rover_ids[i], direction,
+        [state, i, on_each](const MoveResult &result) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->results[i] = result;
+          if (on_each) {
+            on_each(result);
+          }
+          if (--state->remaining == 0) {
+            state->promise.set_value(std::move(state->results));
+          }
+        });
+  }
+
+  return future;
+}
+
+size_t EarthBase::send_movment_command(uint32_t rover_idx,
+                                       DIRECTION direction) {
+  MoveResult result = send_movement_command_async(rover_idx, direction).get();
+  return result.success ? 0 : 1;
+}
+
+asio::awaitable<void>
+EarthBase::send_health_request(uint32_t rover_idx,
+                               HealthCallback on_complete) {
+  std::cout << "Requesting health report from Rover " << rover_idx << "...\n";
 
   StatusRequest req;
-  req.rover_id = rover_idx;
   req.timestamp = util::current_time();
+  auto resp = co_await request<StatusRequest, StatusResponse>(rover_idx, req);
 
-  // Encode the request with RS level
-  auto request_packet = reed_solomon::encode_packet(req, RS_LEVELS[rover_endpoint->rs_level]);
+  HealthResult result{rover_idx};
+  if (resp) {
+    result.success = true;
+    result.response = *resp;
 
-  std::cout << "Requesting health report from Rover " << rover_idx << "...\n";
+    // Resumed on the rover's worker, which records its samples
+    record_status(owner_of(rover_idx), *resp);
+  }
+
+  if (on_complete) {
+    on_complete(result);
+  }
+}
+
+void EarthBase::request_health_report_async(uint32_t rover_idx,
+                                            HealthCallback on_complete) {
+  asio::co_spawn(owner_of(rover_idx).io_context,
+                 send_health_request(rover_idx, std::move(on_complete)),
+                 asio::detached);
+}
 
-  // Send the packet
-  send_message(request_packet, m_movement_socket, health_endpoint);
-
-  char data[MAX_PACKET_SIZE];
-  udp::endpoint sender_endpoint;
-
-  // Set to non-blocking to handle timeout
-  m_movement_socket.non_blocking(true);
-
-  auto start_time = std::chrono::steady_clock::now();
-  size_t length = 0;
-  bool received = false;
-
-  while (std::chrono::duration_cast<std::chrono::milliseconds>(
-             std::chrono::steady_clock::now() - start_time)
-             .count() < MAX_TIMEOUT_MS)
-  {
-    try
-    {
-      length = m_movement_socket.receive_from(
-          asio::buffer(data, sizeof(data)), sender_endpoint);
-      received = true;
-      break;
+void EarthBase::request_health_report(uint32_t rover_idx) {
+  request_health_report_async(rover_idx, [](const HealthResult &result) {
+    if (!result.success) {
+      std::cout << "Health report request for rover " << result.rover_idx
+                << " timed out.\n";
+      return;
     }
-    catch (const asio::system_error &e)
-    {
-      if (e.code() == asio::error::would_block)
-      {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        continue;
-      }
-      else
-      {
-        std::cerr << "Error receiving health response: " << e.what() << "\n";
-        break;
+
+    const StatusResponse &resp = result.response;
+    std::cout << "\n ROVER HEALTH REPORT:\n";
+    std::cout << "Battery     : " << resp.battery_level << "%\n";
+    std::cout << "Temperature : " << resp.temperature << " C\n";
+    std::cout << "Emergency   : " << (resp.emergency ? "YES" : "NO") << "\n";
+    std::cout << "Message     : " << resp.message << "\n";
+    std::cout << "Timestamp   : " << resp.timestamp << "\n";
+  });
+}
+
+void EarthBase::fetch_async(uint32_t rover_idx, BulkContent content,
+                            TransferCallback on_complete) {
+  EarthWorker &worker = owner_of(rover_idx);
+  asio::post(worker.io_context, [this, &worker, rover_idx, content,
+                                 on_complete = std::move(on_complete)]() {
+    auto rover = get_rover_endpoint_by_idx(worker, rover_idx);
+    if (!rover) {
+      std::cerr << "Rover not found at index " << rover_idx << std::endl;
+      if (on_complete) {
+        on_complete(TransferResult{rover_idx});
       }
+      return;
     }
-  }
 
-  m_movement_socket.non_blocking(false);
+    // Never 0, so a zeroed header names no transfer
+    uint32_t transfer_id = worker.next_transfer_id++;
+    if (worker.next_transfer_id == 0) {
+      worker.next_transfer_id = 1;
+    }
+    auto started = std::chrono::steady_clock::now();
+
+    // OPENs and ACKs keep the transfer moving, so they are control traffic
+    auto receiver = std::make_unique<transport::BulkReceiver>(
+        worker.io_context, rover_idx, transfer_id, content,
+        [this, &worker, rover_idx](std::vector<uint8_t> message) {
+          auto rover = get_rover_endpoint_by_idx(worker, rover_idx);
+          if (!rover) {
+            return;
+          }
+          worker.scheduler->send(
+              udp::endpoint(rover->endpoint.address(), rover->movement_port),
+              reed_solomon::encode_bytes(message, RS_LEVELS[rover->rs_level]),
+              transport::TrafficClass::CONTROL);
+          rover->last_sent = std::chrono::steady_clock::now();
+        },
+        [&worker, rover_idx, transfer_id, started,
+         on_complete](std::optional<std::vector<uint8_t>> data) {
+          TransferResult result{rover_idx};
+          result.success = data.has_value();
+          result.elapsed = std::chrono::steady_clock::now() - started;
+          if (data) {
+            result.data = std::move(*data);
+          }
+
+          // Kept a while to acknowledge segments resent after the last ACK
+          worker.timers->schedule(transport::BULK_LINGER,
+                                  [&worker, transfer_id]() {
+                                    worker.transfers.erase(transfer_id);
+                                  });
+          if (on_complete) {
+            on_complete(result);
+          }
+        });
+
+    auto &slot = worker.transfers[transfer_id];
+    slot = std::move(receiver);
+    slot->start();
+  });
+}
 
-  if (!received)
-  {
-    std::cout << "Health report request timed out.\n";
+void EarthBase::request_terrain(uint32_t rover_idx) {
+  std::cout << "Requesting terrain from Rover " << rover_idx << "...\n";
+
+  fetch_async(rover_idx, BulkContent::TERRAIN,
+              [](const TransferResult &result) {
+                if (!result.success ||
+                    result.data.size() < sizeof(TerrainMapHeader)) {
+                  std::cout << "Terrain request for rover " << result.rover_idx
+                            << " failed.\n";
+                  return;
+                }
+
+                auto header =
+                    util::bytes_to_struct<TerrainMapHeader>(result.data);
+                size_t tiles =
+                    static_cast<size_t>(header.width) * header.height;
+                if (result.data.size() < sizeof(header) + (tiles + 7) / 8) {
+                  std::cout << "Terrain map from rover " << result.rover_idx
+                            << " is truncated.\n";
+                  return;
+                }
+
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    result.elapsed);
+                std::cout << "\n TERRAIN AROUND ROVER " << result.rover_idx
+                          << " at (" << header.x << ", " << header.y << "), "
+                          << result.data.size() << " bytes in " << ms.count()
+                          << " ms:\n";
+
+                const uint8_t *packed = result.data.data() + sizeof(header);
+                size_t tile = 0;
+                for (int row = 0; row < header.height; ++row) {
+                  std::string line;
+                  for (int column = 0; column < header.width; ++column) {
+                    bool center =
+                        row == header.height / 2 && column == header.width / 2;
+                    bool rock = (packed[tile / 8] >> (tile % 8)) & 1;
+                    line += center ? 'R' : (rock ? '#' : '.');
+                    tile++;
+                  }
+                  std::cout << line << "\n";
+                }
+              });
+}
+
+void EarthBase::watch_liveness(EarthWorker &worker, uint32_t rover_idx,
+                               std::chrono::steady_clock::duration delay) {
+  // Only one check per rover is ever pending, and it is never cancelled: a
+  // rover heard from in the meantime is simply checked again later
+  worker.timers->schedule(delay, [this, &worker, rover_idx]() {
+    check_liveness(worker, rover_idx);
+  });
+}
+
+void EarthBase::check_liveness(EarthWorker &worker, uint32_t rover_idx) {
+  auto rover_endpoint = get_rover_endpoint_by_idx(worker, rover_idx);
+  if (!rover_endpoint) {
     return;
   }
 
-  auto decoded_packet = reed_solomon::decode_packet(std::vector<uint8_t>(data, data + length),
-                                                    RS_LEVELS[rover_endpoint->rs_level]);
+  auto now = std::chrono::steady_clock::now();
+  auto silence = now - rover_endpoint->last_heard;
+  if (silence >= LIVENESS_TIMEOUT) {
+    expire_rover(worker, rover_idx);
+    return;
+  }
 
-  if (!decoded_packet)
-  {
-    std::cout << "Could not decode health response.\n";
+  // Probe once either direction has been quiet for a heartbeat interval, so
+  // rovers that keep sending alerts still hear from the Earth base before
+  // they decide to rejoin
+  auto quiet = now - std::min(rover_endpoint->last_heard,
+                              rover_endpoint->last_sent);
+  if (quiet < HEARTBEAT_INTERVAL) {
+    watch_liveness(worker, rover_idx, HEARTBEAT_INTERVAL - quiet);
     return;
   }
 
-  StatusResponse resp;
-  std::memcpy(&resp, decoded_packet->data(), sizeof(StatusResponse));
+  // Rovers still negotiating discovery have no ID to address a probe to, and
+  // restored rovers are left to rejoin, which resynchronises them
+  if (rover_endpoint->hasACKed) {
+    asio::co_spawn(worker.io_context, send_heartbeat(rover_idx),
+                   asio::detached);
+  }
+  watch_liveness(worker, rover_idx,
+                 std::min<std::chrono::steady_clock::duration>(
+                     HEARTBEAT_INTERVAL, LIVENESS_TIMEOUT - silence));
+}
+
+asio::awaitable<void> EarthBase::send_heartbeat(uint32_t rover_idx) {
+  StatusRequest req;
+  req.timestamp = util::current_time();
+
+  // Any response counts as contact, and is kept like a health report. Lost
+  // probes are not retried, the next heartbeat takes their place. They keep
+  // the link alive, so they are not held up behind commands.
+  RetryPolicy policy{1, std::chrono::milliseconds(MAX_TIMEOUT_MS)};
+  auto resp = co_await request<StatusRequest, StatusResponse>(
+      rover_idx, req, policy, transport::TrafficClass::CONTROL);
+  if (resp) {
+    record_status(owner_of(rover_idx), *resp);
+  }
+}
+
+void EarthBase::expire_rover(EarthWorker &worker, uint32_t rover_idx) {
+  auto &slot = worker.rovers[rover_idx / m_workers.size()];
+  std::cout << "Rover " << rover_idx << " has been silent for "
+            << LIVENESS_TIMEOUT.count() << "s, removing it" << std::endl;
+
+  // Commands still waiting will never be sent. The one in flight, if any,
+  // completes through its own retries.
+  auto queued = std::move(slot->queued_moves);
+  worker.rover_by_endpoint.erase(slot->endpoint);
+  slot.reset();
+  worker.registry_dirty = true;
+
+  for (auto &move : queued) {
+    move.abandon();
+  }
+}
+
+void EarthBase::restore_registry(const std::vector<RegistryRecord> &records) {
+  const uint32_t worker_count = m_workers.size();
+  const auto now = std::chrono::steady_clock::now();
+  size_t restored = 0;
+
+  // The worker count may differ from the run that wrote the snapshot, so
+  // each rover is placed by its ID
+  for (const auto &record : records) {
+    EarthWorker &worker = owner_of(record.rover_id);
+    const uint32_t local_idx = record.rover_id / worker_count;
+    const udp::endpoint endpoint = record.endpoint();
+
+    if (record.rs_level >= RS_LEVELS.size() ||
+        worker.rover_by_endpoint.count(endpoint)) {
+      continue;
+    }
+    if (local_idx >= worker.rovers.size()) {
+      worker.rovers.resize(local_idx + 1);
+    }
+    if (worker.rovers[local_idx]) {
+      continue;
+    }
+
+    RoverEndpoint rover{endpoint, record.rs_level, false,
+                        (record.flags & RegistryRecord::SEQUENCE) != 0};
+    rover.movement_port = record.movement_port;
+    rover.status_port = record.status_port;
+    rover.restored = true;
+    rover.last_heard = rover.last_sent = now;
+    worker.rovers[local_idx] = std::move(rover);
+    worker.rover_by_endpoint.emplace(endpoint, local_idx);
+
+    // Probed like any other rover once it rejoins, forgotten again if it
+    // does not in time
+    watch_liveness(worker, record.rover_id, HEARTBEAT_INTERVAL);
+    restored++;
+  }
+
+  std::cout << "Restored " << restored
+            << " rover(s) from the registry snapshot" << std::endl;
+}
+
+std::vector<RegistryRecord>
+EarthBase::registry_records(const EarthWorker &worker) {
+  const uint32_t worker_count = m_workers.size();
 
-  std::cout << "\n ROVER HEALTH REPORT:\n";
-  std::cout << "Battery     : " << resp.battery_level << "%\n";
-  std::cout << "Temperature : " << resp.temperature << " C\n";
-  std::cout << "Emergency   : " << (resp.emergency ? "YES" : "NO") << "\n";
-  std::cout << "Message     : " << resp.message << "\n";
-  std::cout << "Timestamp   : " << resp.timestamp << "\n";
+  std::vector<RegistryRecord> records;
+  for (size_t idx = 0; idx < worker.rovers.size(); ++idx) {
+    const auto &rover = worker.rovers[idx];
+
+    // Rovers still negotiating discovery do not know their ID yet
+    if (!rover || !(rover->hasACKed || rover->restored)) {
+      continue;
+    }
+
+    RegistryRecord record{};
+    record.rover_id = static_cast<uint32_t>(idx) * worker_count + worker.index;
+    record.set_endpoint(rover->endpoint);
+    record.movement_port = rover->movement_port;
+    record.status_port = rover->status_port;
+    record.rs_level = rover->rs_level;
+    if (rover->movement_seq_num) {
+      record.flags |= RegistryRecord::SEQUENCE;
+    }
+    records.push_back(record);
+  }
+  return records;
+}
+
+void EarthBase::schedule_checkpoint(EarthWorker &worker) {
+  worker.timers->schedule(CHECKPOINT_INTERVAL, [this, &worker]() {
+    // Publishing only copies the records, the checkpointer's thread writes
+    if (worker.registry_dirty) {
+      worker.registry_dirty = false;
+      m_checkpointer->publish(worker.index, registry_records(worker));
+    }
+    schedule_checkpoint(worker);
+  });
 }
@@ -1,62 +1,443 @@
 #pragma once
+#include "dispatcher.h"
+#include "error_correction/error_correction.h"
 #include "protocols.h"
+#include "registry.h"
+#include "telemetry/telemetry.h"
+#include "timer/timer_service.h"
+#include "transport/bulk.h"
+#include "transport/scheduler.h"
+#include "transport/transport.h"
+#include "utils.h"
 
 #include <asio.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
 #include <optional>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 using asio::ip::udp;
 
+/// @brief Receive buffer of each Earth base socket. Rovers answer a broadcast
+/// all at once, and the default buffer overflows with a few hundred answers.
+constexpr int RECEIVE_BUFFER_SIZE = 1 << 20;
+
+/// @brief Time between registry checkpoints of a worker that has changes
+constexpr std::chrono::seconds CHECKPOINT_INTERVAL{1};
+
+/// @brief Outcome of a movement command sent to a rover
+struct MoveResult {
+  uint32_t rover_idx;      // Index of the rover the command was sent to
+  bool success = false;    // Whether a valid response was received
+  MoveResponse response{}; // The rover's response (only valid on success)
+};
+
+/// @brief Outcome of a path command sent to a rover
+struct PathResult {
+  uint32_t rover_idx;      // Index of the rover the command was sent to
+  bool success = false;    // Whether a valid response was received
+  PathResponse response{}; // The rover's response (only valid on success)
+};
+
+/// @brief Outcome of a goto command sent to a rover
+struct GotoResult {
+  uint32_t rover_idx;      // Index of the rover the command was sent to
+  bool success = false;    // Whether a valid response was received
+  GotoResponse response{}; // The rover's response (only valid on success)
+};
+
+/// @brief Outcome of a health report request sent to a rover
+struct HealthResult {
+  uint32_t rover_idx;        // Index of the rover the request was sent to
+  bool success = false;      // Whether a valid response was received
+  StatusResponse response{}; // The rover's response (only valid on success)
+};
+
+/// @brief Outcome of a bulk transfer from a rover
+struct TransferResult {
+  uint32_t rover_idx;          // Index of the rover the content came from
+  bool success = false;        // Whether all of it arrived
+  std::vector<uint8_t> data{}; // The content (only valid on success)
+  std::chrono::steady_clock::duration elapsed{}; // Time the transfer took
+};
+
+using MoveCallback = std::function<void(const MoveResult &)>;
+using PathCallback = std::function<void(const PathResult &)>;
+using GotoCallback = std::function<void(const GotoResult &)>;
+using HealthCallback = std::function<void(const HealthResult &)>;
+using TransferCallback = std::function<void(const TransferResult &)>;
+
+/// @brief A movement, path or goto command waiting for the rover's in-flight
+/// one to finish
+struct QueuedMove {
+  // Sends the command with the given sequence number and completes it
+  std::function<asio::awaitable<void>(bool sequence_num)> send;
+  // Completes the command without sending it
+  std::function<void()> abandon;
+};
+
 /// @brief Type alias for a rover endpoint
 struct RoverEndpoint {
   udp::endpoint endpoint; // The UDP endpoint of the rover
   uint8_t rs_level;       // The Reed-Solomon error level for this rover
   bool hasACKed; // Whether the earthbase has acknowledged the discovery request
   bool movement_seq_num; // Sequence number for movement command
+
+  // Ports the rover receives movement and status requests on
+  unsigned short movement_port = PORTS::MOVEMENT_CMD;
+  unsigned short status_port = PORTS::STATUS;
+
+  // Movement commands are sent one at a time to keep the sequence number
+  // protocol intact, so later ones wait here for the rover's move coroutine.
+  // Health requests are only tracked by the worker's dispatcher, so any
+  // number can be in flight.
+  std::deque<QueuedMove> queued_moves{};
+  bool sending_moves = false; // Whether the move coroutine is running
+
+  // When anything was last received from the rover, and last sent to it
+  std::chrono::steady_clock::time_point last_heard{};
+  std::chrono::steady_clock::time_point last_sent{};
+
+  // Loaded from a registry snapshot and not heard from since. Restored
+  // rovers are not probed, they are waiting to rejoin.
+  bool restored = false;
+};
+
+/// @brief One ingest worker of the Earth base. Each worker owns a socket per
+/// port (sharing the port with the other workers through SO_REUSEPORT), its
+/// own decode buffers and the rovers it discovered. A worker's state is only
+/// ever touched on its own thread, so no locks are needed.
+struct EarthWorker {
+  unsigned index; // Position of this worker, and its rover IDs modulo count
+
+  // Context the worker's transports and timers run on
+  asio::io_context &io_context;
+
+  // Transports for discovery, movement and unsolicited status alerts
+  std::unique_ptr<transport::Transport> discovery_io, movement_io, status_io;
+
+  // Rovers owned by this worker, by local index (rover ID / worker count)
+  std::vector<std::optional<RoverEndpoint>> rovers;
+
+  // Local index of each rover by its discovery endpoint
+  std::unordered_map<udp::endpoint, uint32_t, transport::EndpointHash>
+      rover_by_endpoint;
+
+  // Retransmit deadlines, heartbeats and liveness checks of this worker
+  std::unique_ptr<timer::TimerService> timers;
+
+  // Requests this worker is waiting on a response for, by request ID
+  std::unique_ptr<ResponseDispatcher> dispatcher;
+
+  // Orders the requests sent through the movement transport by class
+  std::unique_ptr<transport::SendScheduler> scheduler;
+
+  // Bulk transfers from this worker's rovers, by transfer ID. Finished ones
+  // are kept for BULK_LINGER to acknowledge retransmissions.
+  std::unordered_map<uint32_t, std::unique_ptr<transport::BulkReceiver>>
+      transfers;
+  uint32_t next_transfer_id = 1;
+
+  // Reused for every packet decoded on this worker
+  std::vector<uint8_t> decode_buffer;
+
+  // Records health samples of this worker's rovers without blocking
+  std::optional<telemetry::Producer> telemetry;
+
+  // Whether the rovers changed since the worker last published them for the
+  // registry snapshot
+  bool registry_dirty = false;
+
+  EarthWorker(unsigned index, asio::io_context &io_context)
+      : index(index), io_context(io_context) {}
 };
 
 /// @brief Abstraction of Simulated Earth base
 class EarthBase {
 private:
-  // Sockets for discovery and movement
-  udp::socket m_discovery_socket, m_movement_socket;
+  // Context run by the caller, used by the first worker
+  asio::io_context &m_io_context;
+
+  // Contexts owned by the other workers, and the threads running them
+  std::vector<std::unique_ptr<asio::io_context>> m_worker_contexts;
+  std::vector<std::thread> m_worker_threads;
+
+  // Health samples of every rover. Outlives the workers recording into it.
+  std::unique_ptr<telemetry::TelemetryStore> m_telemetry;
+
+  // Writes the registry snapshot, if one is kept. Outlives the workers
+  // publishing to it.
+  std::unique_ptr<RegistryCheckpointer> m_checkpointer;
+
+  // Ingest workers. Rover ID n belongs to worker n % m_workers.size()
+  std::vector<std::unique_ptr<EarthWorker>> m_workers;
+
+  // Gets the worker that owns a rover ID
+  EarthWorker &owner_of(uint32_t rover_id);
+
+  // Get the address of the rover with the given ID on its owning worker
+  RoverEndpoint *get_rover_endpoint_by_idx(EarthWorker &worker,
+                                           const unsigned int idx);
+
+  // Handle a batch of discovery requests and reply to each of them
+  void handle_discovery(EarthWorker &worker,
+                        std::span<const transport::Datagram> batch);
+
+  // Handles one datagram on the worker it was received (or forwarded) to
+  using DatagramHandler = void (EarthBase::*)(EarthWorker &,
+                                              const transport::Datagram &);
 
-  // List of active rovers
-  std::vector<std::optional<RoverEndpoint>> m_active_rovers;
+  // Resume a rover known from before with a single exchange, or tell it to
+  // go through discovery again
+  void handle_rejoin(EarthWorker &worker, const transport::Datagram &datagram);
 
-  // Thread for listening for rover discovery
-  std::thread m_listener_thread;
+  // Hands a datagram about a rover to the worker that owns it, if the kernel
+  // delivered it elsewhere. Returns true if the datagram was handed over.
+  bool forward_to_owner(EarthWorker &worker,
+                        const transport::Datagram &datagram, uint32_t rover_id,
+                        DatagramHandler handler);
 
-  // Get the address of the rover at the given index
-  RoverEndpoint *get_rover_endpoint_by_idx(const unsigned int idx);
+  // Route a response datagram to the request with the ID it carries, handing
+  // it to the owning worker if the kernel delivered it elsewhere
+  void handle_response(EarthWorker &worker,
+                       const transport::Datagram &datagram);
 
-  // Get the rover endpoint by its UDP endpoint
-  RoverEndpoint *get_rover_by_endpoint(const udp::endpoint &endpoint);
+  // Hand one decoded message from a rover to the request it answers, or
+  // record it if it is an alert. Batches are split into messages first.
+  void dispatch_message(EarthWorker &worker, const udp::endpoint &sender,
+                        uint32_t rover_idx, std::vector<uint8_t> message);
 
-  // Get the iterator to the rover endpoint by its UDP endpoint
-  std::vector<std::optional<RoverEndpoint>>::iterator
-  get_rover_itr(const udp::endpoint &endpoint);
+  // Decode and record an unsolicited status alert
+  void handle_alert(EarthWorker &worker, const transport::Datagram &datagram);
 
-  // Blocking function to listen for rover discovery
-  // This runs on its own thread
-  void listen_for_rovers();
+  // Print and record a decoded alert
+  void process_alert(EarthWorker &worker, StatusResponse alert);
 
-  // Send a message to a rover endpoint
-  void send_message(const std::vector<uint8_t> &message, udp::socket &socket,
-                    udp::endpoint endpoint);
+  // Handles a bulk transfer message from a rover
+  void handle_bulk(EarthWorker &worker, const udp::endpoint &sender,
+                   uint32_t rover_idx, const std::vector<uint8_t> &message);
+
+  // Queue a status report for the telemetry store. Never blocks.
+  void record_status(EarthWorker &worker, const StatusResponse &status);
+
+  // (Re)send a pending request and arm its deadline
+  void transmit(EarthWorker &worker,
+                const std::shared_ptr<PendingRequest> &request);
+
+  // Completes a request exactly once, removing it from the dispatcher so
+  // further responses to it are dropped
+  void complete_request(EarthWorker &worker,
+                        const std::shared_ptr<PendingRequest> &request,
+                        std::optional<std::vector<uint8_t>> packet);
+
+  // Which of a rover's ports a request is sent to
+  enum class RequestPort { MOVEMENT, STATUS };
+
+  // Encodes a request with the ID and RS code it is sent with
+  using RequestEncoder =
+      std::function<std::vector<uint8_t>(uint32_t request_id, RSCode code)>;
+
+  // Sends a request to a rover from its worker, retrying as the policy says,
+  // and resumes with the decoded response or std::nullopt on failure
+  asio::awaitable<std::optional<std::vector<uint8_t>>>
+  exchange(uint32_t rover_idx, RequestPort port, RequestEncoder encode,
+           RetryPolicy policy, transport::TrafficClass traffic_class);
+
+  // Sends a rover's queued movement commands one at a time until the queue
+  // is empty. Runs on the rover's worker.
+  asio::awaitable<void> send_queued_moves(EarthWorker &worker,
+                                          uint32_t rover_idx);
+
+  // Send one movement, path or goto command and wait for the answer. Run on
+  // the rover's worker from its move coroutine.
+  asio::awaitable<void> send_move(uint32_t rover_idx, DIRECTION direction,
+                                  bool sequence_num, MoveCallback on_complete);
+  asio::awaitable<void> send_path(uint32_t rover_idx, std::vector<PathRun> path,
+                                  bool sequence_num, PathCallback on_complete);
+  asio::awaitable<void> send_goto(uint32_t rover_idx, int x, int y,
+                                  uint32_t budget, bool sequence_num,
+                                  GotoCallback on_complete);
+
+  // Queues a command for a rover and starts its move coroutine if needed, or
+  // abandons it if there is no such rover. Runs on the rover's worker.
+  void queue_move(EarthWorker &worker, uint32_t rover_idx, QueuedMove move);
+
+  // Requests one health report. Runs on the rover's worker.
+  asio::awaitable<void> send_health_request(uint32_t rover_idx,
+                                            HealthCallback on_complete);
+
+  // Checks on a rover after the given delay
+  void watch_liveness(EarthWorker &worker, uint32_t rover_idx,
+                      std::chrono::steady_clock::duration delay);
+
+  // Probes a rover that has gone quiet, or forgets it once it has been
+  // silent for LIVENESS_TIMEOUT
+  void check_liveness(EarthWorker &worker, uint32_t rover_idx);
+
+  // Sends one status request as a heartbeat, without retries
+  asio::awaitable<void> send_heartbeat(uint32_t rover_idx);
+
+  // Removes a rover from its worker, failing its queued commands
+  void expire_rover(EarthWorker &worker, uint32_t rover_idx);
+
+  // Puts the rovers of a registry snapshot back on the workers owning them
+  void restore_registry(const std::vector<RegistryRecord> &records);
+
+  // Gets the rovers of a worker as registry snapshot records
+  std::vector<RegistryRecord> registry_records(const EarthWorker &worker);
+
+  // Publishes the worker's rovers to the checkpointer every
+  // CHECKPOINT_INTERVAL, if they changed
+  void schedule_checkpoint(EarthWorker &worker);
 
 public:
   /// @brief Default constructor for EarthBase class
-  /// @param io_context Socket context for the Earth base
-  EarthBase(asio::io_context &io_context);
+  /// @param io_context Socket context for the Earth base. It must be run on a
+  /// separate thread for commands to complete.
+  /// @param backend I/O backend used for the Earth base's sockets
+  /// @param worker_count Number of ingest workers. The first runs on
+  /// io_context, the others on their own threads once start() is called.
+  /// @param telemetry_dir Directory the telemetry history is kept in
+  /// @param registry_path File the rover registry is checkpointed to and
+  /// restored from, so rovers can rejoin after a restart. Empty to disable.
+  /// @param scheduler Weights and rate limits of each worker's requests
+  EarthBase(asio::io_context &io_context,
+            transport::Backend backend = transport::Backend::ASIO,
+            unsigned worker_count = 1,
+            const std::string &telemetry_dir = "telemetry",
+            const std::string &registry_path = "registry.bin",
+            const transport::SchedulerOptions &scheduler = {});
+  ~EarthBase();
+
+  /// @brief Sends a request to a rover and waits for its response. Encoding,
+  /// request IDs, retransmission and decoding are handled here, so many
+  /// requests can be awaited at once from any executor.
+  /// @tparam Request MoveRequest, PathRequest or StatusRequest
+  /// @tparam Response The response type the request is answered with
+  /// @param rover_idx ID of the rover to send the request to
+  /// @param req The request. Its rover and request IDs are filled in.
+  /// @param policy When to retransmit and when to give up
+  /// @param traffic_class Decides when the request is sent while the link is
+  /// busy
+  /// @return the response, or std::nullopt if none was received
+  template <typename Request, typename Response>
+  asio::awaitable<std::optional<Response>>
+  request(uint32_t rover_idx, Request req, RetryPolicy policy = {},
+          transport::TrafficClass traffic_class =
+              transport::TrafficClass::INTERACTIVE) {
+    constexpr RequestPort port = std::is_same_v<Request, StatusRequest>
+                                     ? RequestPort::STATUS
+                                     : RequestPort::MOVEMENT;
+    req.rover_id = rover_idx;
+
+    auto packet = co_await exchange(
+        rover_idx, port,
+        [req](uint32_t request_id, RSCode code) mutable {
+          req.request_id = request_id;
+          return reed_solomon::encode_packet(req, code);
+        },
+        policy, traffic_class);
+
+    if (!packet) {
+      co_return std::nullopt;
+    }
+    co_return util::bytes_to_struct<Response>(*packet);
+  }
 
   /// @brief Sends a command to a given rover to move up/down/left/right
+  /// and blocks until it completes. Must not be called on a worker thread.
   /// @param rover_idx ID of the rover to send command to
   /// @param direction Direction to move the rover
   /// @return error code
   size_t send_movment_command(uint32_t rover_idx, DIRECTION direction);
 
+  /// @brief Sends a movement command without blocking. Commands for the same
+  /// rover are sent in order, commands for different rovers run concurrently.
+  /// @param rover_idx ID of the rover to send command to
+  /// @param direction Direction to move the rover
+  /// @param on_complete Called on the rover's worker thread with the result
+  void send_movement_command_async(uint32_t rover_idx, DIRECTION direction,
+                                   MoveCallback on_complete);
+
+  /// @brief Future based overload of send_movement_command_async
+  /// @param rover_idx ID of the rover to send command to
+  /// @param direction Direction to move the rover
+  /// @return future holding the result of the command
+  std::future<MoveResult> send_movement_command_async(uint32_t rover_idx,
+                                                      DIRECTION direction);
+
+  /// @brief Sends the same movement command to several rovers at once
+  /// @param rover_ids IDs of the rovers to command
+  /// @param direction Direction to move the rovers
+  /// @param on_each Optional callback for each result as it arrives. Calls
+  /// are serialized but may come from different worker threads.
+  /// @return future holding every result, in the order of rover_ids
+  std::future<std::vector<MoveResult>>
+  broadcast_movement_command(const std::vector<uint32_t> &rover_ids,
+                             DIRECTION direction, MoveCallback on_each = {});
+
+  /// @brief Sends a sequence of moves as one command without blocking. The
+  /// moves are run-length encoded and the rover takes them in order, stopping
+  /// at the first blocked one, then answers once. Path commands are queued
+  /// with the rover's movement commands.
+  /// @param rover_idx ID of the rover to send command to
+  /// @param moves Moves to make, in order
+  /// @param on_complete Called on the rover's worker thread with the result,
+  /// or straight away if the moves do not fit in MAX_PATH_RUNS runs
+  void send_path_command_async(uint32_t rover_idx,
+                               const std::vector<DIRECTION> &moves,
+                               PathCallback on_complete);
+
+  /// @brief Sends a rover to a tile without blocking. The rover plans a
+  /// shortest path around rocks over its own terrain and follows it, then
+  /// answers once with the path it took. Goto commands are queued with the
+  /// rover's movement commands.
+  /// @param rover_idx ID of the rover to send command to
+  /// @param x horizontal coordinate to go to
+  /// @param y vertical coordinate to go to
+  /// @param budget Most tiles the rover may search, 0 for its default
+  /// @param on_complete Called on the rover's worker thread with the result
+  void send_goto_command_async(uint32_t rover_idx, int x, int y,
+                               uint32_t budget, GotoCallback on_complete);
+
+  /// @brief Requests a health report without blocking
+  /// @param rover_idx ID of the rover to query
+  /// @param on_complete Called on the rover's worker thread with the result
+  void request_health_report_async(uint32_t rover_idx,
+                                   HealthCallback on_complete);
+
+  /// @brief Requests a health report and prints it once it arrives
+  /// @param rover_idx ID of the rover to query
+  void request_health_report(uint32_t rover_idx);
+
+  /// @brief Fetches content from a rover over a bulk transfer without
+  /// blocking. Segments are acknowledged selectively and sent as bulk
+  /// traffic, so commands to the rover are not held up behind them.
+  /// @param rover_idx ID of the rover to fetch from
+  /// @param content What to fetch
+  /// @param on_complete Called on the rover's worker thread with the result
+  void fetch_async(uint32_t rover_idx, BulkContent content,
+                   TransferCallback on_complete);
+
+  /// @brief Fetches the terrain around a rover and prints it once it arrives
+  /// @param rover_idx ID of the rover to query
+  void request_terrain(uint32_t rover_idx);
+
+  /// @brief Gets the store of every health report and alert received. Safe
+  /// to query from any thread.
+  const telemetry::TelemetryStore &telemetry() const { return *m_telemetry; }
+
+  /// @brief Gets the IDs of every rover that has completed discovery.
+  /// Blocks until every worker has answered, so it must not be called on a
+  /// worker thread.
+  std::vector<uint32_t> active_rover_ids();
+
   /// @brief Starts the Earth base networking interactions
   void start();
-  void request_health_report(uint32_t rover_idx);
-};
\ No newline at end of file
+};
@@ -4,8 +4,12 @@
 #include <asio.hpp>
 #include <asio/ts/buffer.hpp>   //memory movement
 #include <asio/ts/internet.hpp> //internet
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <regex>
+#include <sstream>
+#include <thread>
 
 #include "protocols.h"
 using asio::ip::udp;
@@ -24,6 +28,35 @@ DIRECTION get_direction_from_str(std::string &s) {
   return DIRECTION::UP;
 }
 
+// Expands moves written as letters with optional counts, e.g. "u3r2d" for
+// up three times, right twice and down once
+std::vector<DIRECTION> get_moves_from_str(const std::string &s) {
+  std::vector<DIRECTION> moves;
+  for (size_t pos = 0; pos < s.size();) {
+    DIRECTION direction = DIRECTION::UP;
+    switch (std::tolower(s[pos++])) {
+    case 'd':
+      direction = DIRECTION::DOWN;
+      break;
+    case 'l':
+      direction = DIRECTION::LEFT;
+      break;
+    case 'r':
+      direction = DIRECTION::RIGHT;
+      break;
+    }
+
+    size_t digits = 0;
+    while (pos + digits < s.size() && std::isdigit(s[pos + digits])) {
+      digits++;
+    }
+    int count = digits ? std::stoi(s.substr(pos, digits)) : 1;
+    moves.insert(moves.end(), count, direction);
+    pos += digits;
+  }
+  return moves;
+}
+
 // This function takes in the command inputted by the user, and uses regex to
 // parse out the command
 int executeCommand(std::string &command, EarthBase &base) {
@@ -32,8 +65,16 @@ int executeCommand(std::string &command, EarthBase &base) {
   static const std::regex health_command("^(health)\\s+([0-9]+)\\s*$");
   static const std::regex help_command("^help\\s*$");
   static const std::regex move_command(
-      "^(move)\\s+([0-9]+)\\s+(left|right|up|down)\\s*$");
+      "^(move)\\s+(all|[0-9]+(?:\\s*,\\s*[0-9]+)*)\\s+"
+      "(left|right|up|down)\\s*$");
+  static const std::regex path_command(
+      "^(path)\\s+([0-9]+)\\s+((?:[udlrUDLR][0-9]{0,3})+)\\s*$");
+  static const std::regex goto_command(
+      "^(goto)\\s+([0-9]+)\\s+(-?[0-9]{1,9})\\s+(-?[0-9]{1,9})"
+      "(?:\\s+([0-9]{1,7}))?\\s*$");
   static const std::regex terrain_command("^(terrain)\\s+([0-9]+)\\s*$");
+  static const std::regex telemetry_command(
+      "^(telemetry)\\s+([0-9]+)(?:\\s+([0-9]+))?\\s*$");
 
   std::smatch match;
 
@@ -45,30 +86,95 @@ int executeCommand(std::string &command, EarthBase &base) {
               << "help - lists available commands\n"
               << "move [id] [left/right/up/down] - move an available rover a "
                  "given direction\n"
+              << "move [id,id,...|all] [left/right/up/down] - move several "
+                 "rovers at once\n"
+              << "path [id] [moves] - move a rover along a path in one "
+                 "command, e.g. u3r2d for up 3, right 2, down 1. The rover "
+                 "stops at the first rock\n"
+              << "goto [id] [x] [y] [budget] - have a rover find its own way "
+                 "to a tile, searching at most budget tiles\n"
               << "terrain [id] - display the terrain of a given rover\n"
               << "health [id] - check health status of a given rover\n"
+              << "telemetry [id] [seconds] - summarize a rover's health "
+                 "reports and alerts (default: last 60 seconds)\n"
               << "exit - exit the program\n";
   } else if (std::regex_match(command, match, move_command)) { // Move Command
 
     // Parse command
-    uint32_t idx = std::stoi(match[2].str());
+    std::string targets = match[2].str();
     std::string direction = match[3].str();
 
+    std::vector<uint32_t> ids;
+    if (targets == "all") {
+      ids = base.active_rover_ids();
+    } else {
+      std::stringstream ss(targets);
+      std::string id;
+      while (std::getline(ss, id, ',')) {
+        ids.push_back(std::stoi(id));
+      }
+    }
+
+    if (ids.empty()) {
+      std::cout << "No rovers to move\n";
+      return 1;
+    }
+
     // Debug msg
-    std::cout << "Requesting rover " << idx << " to move " << direction << "\n";
+    std::cout << "Requesting " << ids.size() << " rover(s) to move "
+              << direction << "\n";
+
+    // Send requests to every rover at once. Results are printed as they
+    // arrive on the worker threads so the prompt is not blocked. The
+    // broadcast serializes the callbacks, so the tally needs no lock.
+    struct Tally {
+      size_t remaining, answered = 0, moved = 0;
+    };
+    auto tally = std::make_shared<Tally>(Tally{ids.size()});
 
-    // Send request to rover
-    base.send_movment_command(idx, get_direction_from_str(direction));
+    base.broadcast_movement_command(
+        ids, get_direction_from_str(direction),
+        [tally](const MoveResult &result) {
+          tally->answered += result.success;
+          tally->moved += result.success && result.response.moved;
+          if (--tally->remaining == 0) {
+            std::cout << "Move complete: " << tally->answered
+                      << " responded, " << tally->moved << " moved\n";
+          }
+        });
+  } else if (std::regex_match(command, match, path_command)) { // Path Command
+    uint32_t rover_id = std::stoul(match[2].str());
+    auto moves = get_moves_from_str(match[3].str());
+
+    std::cout << "Requesting rover " << rover_id << " to take " << moves.size()
+              << " move(s)\n";
+    base.send_path_command_async(rover_id, moves, [](const PathResult &result) {
+      if (!result.success) {
+        std::cout << "Path command to rover " << result.rover_idx
+                  << " failed\n";
+      }
+    });
+  } else if (std::regex_match(command, match, goto_command)) { // Goto Command
+    uint32_t rover_id = std::stoul(match[2].str());
+    int x = std::stoi(match[3].str()), y = std::stoi(match[4].str());
+    uint32_t budget = match[5].matched ? std::stoul(match[5].str()) : 0;
+
+    std::cout << "Requesting rover " << rover_id << " to go to (" << x << ","
+              << y << ")\n";
+    base.send_goto_command_async(rover_id, x, y, budget,
+                                 [](const GotoResult &result) {
+                                   if (!result.success) {
+                                     std::cout << "Goto command to rover "
+                                               << result.rover_idx
+                                               << " failed\n";
+                                   }
+                                 });
   } else if (std::regex_match(command, match,
                               terrain_command)) { // Terrain Command
 
     // Parse command
     int id = std::stoi(match[2].str());
-
-    // Debug msg
-    std::cout << "Requesting terrain from rover " << id << "\n";
-
-    // TODO: Terrain Logic
+    base.request_terrain(id);
   } else if (std::regex_match(command, match,
                               health_command)) { // Health Command
     int rover_id = std::stoi(match[2].str());
@@ -76,6 +182,45 @@ int executeCommand(std::string &command, EarthBase &base) {
     std::cout << "Requesting health report from rover " << rover_id << "...\n";
     base.request_health_report(rover_id);
 
+  } else if (std::regex_match(command, match,
+                              telemetry_command)) { // Telemetry Command
+    uint32_t rover_id = std::stoul(match[2].str());
+    uint64_t seconds = match[3].matched ? std::stoull(match[3].str()) : 60;
+
+    // Range queries read the history without stopping ingest
+    uint64_t now = util::current_time();
+    uint64_t from = now > seconds * 1000 ? now - seconds * 1000 : 0;
+    auto samples = base.telemetry().query(from, now + 1, rover_id);
+
+    std::cout << "Telemetry for rover " << rover_id << " over the last "
+              << seconds << "s: " << samples.size() << " sample(s)\n";
+    if (samples.empty()) {
+      return 0;
+    }
+
+    float min_battery = samples[0].battery, max_battery = samples[0].battery;
+    float min_temp = samples[0].temperature, max_temp = samples[0].temperature;
+    double battery_sum = 0, temp_sum = 0;
+    size_t emergencies = 0;
+    for (const auto &sample : samples) {
+      min_battery = std::min(min_battery, sample.battery);
+      max_battery = std::max(max_battery, sample.battery);
+      min_temp = std::min(min_temp, sample.temperature);
+      max_temp = std::max(max_temp, sample.temperature);
+      battery_sum += sample.battery;
+      temp_sum += sample.temperature;
+      emergencies += sample.emergency != 0;
+    }
+
+    const auto &last = samples.back();
+    std::cout << "Battery     : " << min_battery << "% - " << max_battery
+              << "% (avg " << battery_sum / samples.size() << "%)\n";
+    std::cout << "Temperature : " << min_temp << " C - " << max_temp
+              << " C (avg " << temp_sum / samples.size() << " C)\n";
+    std::cout << "Emergencies : " << emergencies << "\n";
+    std::cout << "Latest      : " << last.battery << "%, " << last.temperature
+              << " C, code " << static_cast<int>(last.emergency) << " at "
+              << last.timestamp << "\n";
   } else { // The user either typed in a command that doesn't exist, or with bad
            // arguments
     std::cout << "Error: malformed command\n";
@@ -85,13 +230,65 @@ int executeCommand(std::string &command, EarthBase &base) {
   return 0;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+  // Optional "--transport=asio|uring|shm" selects the I/O backend,
+  // "--workers=N" the number of ingest threads, "--telemetry=DIR" where
+  // the telemetry history is kept, "--registry=FILE" where the rover
+  // registry is checkpointed (empty to disable) and "--link-rate=BYTES" the
+  // bytes per second each worker sends requests at (0 for no limit)
+  transport::Backend backend = transport::Backend::ASIO;
+  unsigned workers = 1;
+  std::string telemetry_dir = "telemetry";
+  std::string registry_path = "registry.bin";
+  transport::SchedulerOptions scheduler;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--transport=", 0) == 0) {
+      auto parsed = transport::parse_backend(arg.substr(12));
+      if (!parsed) {
+        std::cerr << "Unknown transport: " << arg.substr(12) << std::endl;
+        return 1;
+      }
+      backend = *parsed;
+    } else if (arg.rfind("--workers=", 0) == 0) {
+      try {
+        workers = std::stoul(arg.substr(10));
+      } catch (const std::exception &) {
+        workers = 0;
+      }
+      if (workers == 0) {
+        std::cerr << "Invalid worker count: " << arg.substr(10) << std::endl;
+        return 1;
+      }
+    } else if (arg.rfind("--telemetry=", 0) == 0) {
+      telemetry_dir = arg.substr(12);
+    } else if (arg.rfind("--registry=", 0) == 0) {
+      registry_path = arg.substr(11);
+    } else if (arg.rfind("--link-rate=", 0) == 0) {
+      try {
+        scheduler.link_rate = std::stod(arg.substr(12));
+      } catch (const std::exception &) {
+        scheduler.link_rate = -1;
+      }
+      if (scheduler.link_rate < 0) {
+        std::cerr << "Invalid link rate: " << arg.substr(12) << std::endl;
+        return 1;
+      }
+    }
+  }
+
   try {
     // Set up networking
     asio::io_context io_context;
-    EarthBase earthBase(io_context);
+    EarthBase earthBase(io_context, backend, workers, telemetry_dir,
+                        registry_path, scheduler);
     earthBase.start();
-    io_context.run();
+
+    // Responses and retransmissions are handled on their own thread so that
+    // commands never block the TUI. This thread runs the first worker, the
+    // others were started by earthBase.start().
+    std::thread network_thread([&io_context]() { io_context.run(); });
+    network_thread.detach();
 
     // TUI
     std::cout << "WELCOME BASE COMMAND OPERATOR\n";
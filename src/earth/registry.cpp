@@ -0,0 +1,230 @@
+#include "registry.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+namespace {
+// Start of every snapshot, followed by the records
+struct SnapshotHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t count;    // Number of records
+  uint32_t checksum; // FNV-1a of the records
+};
+
+constexpr char SNAPSHOT_MAGIC[4] = {'R', 'R', 'E', 'G'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+uint32_t checksum(const std::vector<RegistryRecord> &records) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(records.data());
+  uint32_t hash = 2166136261u;
+  for (size_t idx = 0; idx < records.size() * sizeof(RegistryRecord); ++idx) {
+    hash = (hash ^ bytes[idx]) * 16777619u;
+  }
+  return hash;
+}
+
+// Writes all of a buffer, carrying on after short writes and interruptions
+bool write_all(int fd, const void *data, size_t size) {
+  const auto *bytes = static_cast<const char *>(data);
+  while (size != 0) {
+    ssize_t written = ::write(fd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+// Flushes a directory's entries to disk, so a rename within it survives a
+// crash
+bool sync_directory(const std::filesystem::path &directory) {
+  int fd = ::open(directory.empty() ? "." : directory.c_str(),
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+} // namespace
+
+udp::endpoint RegistryRecord::endpoint() const {
+  if (flags & IPV6) {
+    asio::ip::address_v6::bytes_type bytes;
+    std::memcpy(bytes.data(), address, bytes.size());
+    return udp::endpoint(asio::ip::address_v6(bytes), port);
+  }
+
+  asio::ip::address_v4::bytes_type bytes;
+  std::memcpy(bytes.data(), address, bytes.size());
+  return udp::endpoint(asio::ip::address_v4(bytes), port);
+}
+
+void RegistryRecord::set_endpoint(const udp::endpoint &endpoint) {
+  std::memset(address, 0, sizeof(address));
+  port = endpoint.port();
+
+  if (endpoint.address().is_v6()) {
+    auto bytes = endpoint.address().to_v6().to_bytes();
+    std::memcpy(address, bytes.data(), bytes.size());
+    flags |= IPV6;
+  } else {
+    auto bytes = endpoint.address().to_v4().to_bytes();
+    std::memcpy(address, bytes.data(), bytes.size());
+    flags &= ~IPV6;
+  }
+}
+
+namespace registry {
+
+bool save_snapshot(const std::string &path,
+                   const std::vector<RegistryRecord> &records) {
+  SnapshotHeader header;
+  std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.count = static_cast<uint32_t>(records.size());
+  header.checksum = checksum(records);
+
+  // Written beside the snapshot and renamed over it, so a crash mid-write
+  // leaves the previous snapshot intact. The data is synced before the
+  // rename, or a crash could leave the new name pointing at an empty file.
+  const std::string temp_path = path + ".tmp";
+  int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+  bool written =
+      fd >= 0 && write_all(fd, &header, sizeof(header)) &&
+      write_all(fd, records.data(), records.size() * sizeof(RegistryRecord)) &&
+      ::fsync(fd) == 0;
+  int error = errno;
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  if (!written) {
+    std::cerr << "Failed to write registry snapshot " << temp_path << ": "
+              << std::strerror(error) << std::endl;
+    return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temp_path, path, ec);
+  if (ec) {
+    std::cerr << "Failed to replace registry snapshot " << path << ": "
+              << ec.message() << std::endl;
+    return false;
+  }
+  if (!sync_directory(std::filesystem::path(path).parent_path())) {
+    std::cerr << "Failed to sync the directory of registry snapshot " << path
+              << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::optional<std::vector<RegistryRecord>>
+load_snapshot(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return std::nullopt; // No snapshot yet
+  }
+
+  SnapshotHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SNAPSHOT_VERSION) {
+    std::cerr << "Ignoring registry snapshot " << path
+              << " with an unknown format" << std::endl;
+    return std::nullopt;
+  }
+
+  // The file must hold exactly the records the header counts, checked before
+  // allocating so a corrupt count cannot ask for gigabytes
+  const uint64_t records_size =
+      uint64_t{header.count} * sizeof(RegistryRecord);
+  file.seekg(0, std::ios::end);
+  const auto file_size = static_cast<uint64_t>(file.tellg());
+  file.seekg(sizeof(header), std::ios::beg);
+  if (!file || file_size != sizeof(header) + records_size) {
+    std::cerr << "Ignoring truncated or corrupt registry snapshot " << path
+              << std::endl;
+    return std::nullopt;
+  }
+
+  std::vector<RegistryRecord> records(header.count);
+  file.read(reinterpret_cast<char *>(records.data()),
+            static_cast<std::streamsize>(records_size));
+  if (!file || checksum(records) != header.checksum) {
+    std::cerr << "Ignoring truncated or corrupt registry snapshot " << path
+              << std::endl;
+    return std::nullopt;
+  }
+  return records;
+}
+
+} // namespace registry
+
+RegistryCheckpointer::RegistryCheckpointer(const std::string &path,
+                                           unsigned workers)
+    : m_path(path), m_parts(workers), m_published(workers, false),
+      m_unpublished(workers) {
+  m_writer = std::thread(&RegistryCheckpointer::writer_loop, this);
+}
+
+RegistryCheckpointer::~RegistryCheckpointer() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cv.notify_one();
+  m_writer.join();
+}
+
+void RegistryCheckpointer::publish(unsigned worker,
+                                   std::vector<RegistryRecord> records) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_parts[worker] = std::move(records);
+    if (!m_published[worker]) {
+      m_published[worker] = true;
+      m_unpublished--;
+    }
+    m_dirty = true;
+  }
+  m_cv.notify_one();
+}
+
+void RegistryCheckpointer::writer_loop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_cv.wait(lock, [this]() {
+      return m_stop || (m_dirty && m_unpublished == 0);
+    });
+    if (!m_dirty || m_unpublished != 0) {
+      return; // Stopping with nothing to write
+    }
+
+    // Combine the parts under the lock, then write without holding it
+    std::vector<RegistryRecord> records;
+    for (const auto &part : m_parts) {
+      records.insert(records.end(), part.begin(), part.end());
+    }
+    m_dirty = false;
+
+    // Parts published during the write leave the checkpointer dirty again,
+    // so they are written on the next pass even if it is stopping by then
+    lock.unlock();
+    registry::save_snapshot(m_path, records);
+    lock.lock();
+  }
+}
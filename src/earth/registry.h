@@ -0,0 +1,89 @@
+#pragma once
+#include <asio.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using asio::ip::udp;
+
+/// @brief Saved state of one discovered rover, as stored in a registry
+/// snapshot. Fixed size with no padding, so snapshots are plain arrays.
+struct RegistryRecord {
+  uint32_t rover_id;      // ID the rover was given at discovery
+  uint16_t port;          // Port the rover sends discovery requests from
+  uint16_t movement_port; // Port the rover takes movement commands on
+  uint16_t status_port;   // Port the rover takes status requests on
+  uint8_t rs_level;       // Reed-Solomon level agreed with the rover
+  uint8_t flags;          // See SEQUENCE and IPV6
+  uint8_t address[16];    // IPv4 (first 4 bytes) or IPv6 address
+
+  static constexpr uint8_t SEQUENCE = 1 << 0; // Last movement sequence number
+  static constexpr uint8_t IPV6 = 1 << 1;     // Address is IPv6
+
+  /// @brief Gets the endpoint the rover was discovered from
+  udp::endpoint endpoint() const;
+
+  /// @brief Stores the endpoint the rover was discovered from
+  void set_endpoint(const udp::endpoint &endpoint);
+};
+static_assert(sizeof(RegistryRecord) == 28, "RegistryRecord must not pad");
+
+namespace registry {
+
+/// @brief Writes a snapshot, replacing the previous one atomically
+/// @param path Path of the snapshot file
+/// @param records Every rover in the registry
+/// @return false if the snapshot could not be written
+bool save_snapshot(const std::string &path,
+                   const std::vector<RegistryRecord> &records);
+
+/// @brief Reads a snapshot written by save_snapshot
+/// @param path Path of the snapshot file
+/// @return the records, or std::nullopt if there is no valid snapshot
+std::optional<std::vector<RegistryRecord>>
+load_snapshot(const std::string &path);
+
+} // namespace registry
+
+/// @brief Writes registry snapshots on its own thread. Workers publish their
+/// part of the registry whenever it changes, and the newest parts are
+/// combined and written, so workers never wait on the disk.
+class RegistryCheckpointer {
+private:
+  std::string m_path;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::vector<std::vector<RegistryRecord>> m_parts; // Newest part per worker
+  std::vector<bool> m_published; // Whether each worker has published a part
+  size_t m_unpublished;          // Workers yet to publish their first part
+  bool m_dirty = false;
+  bool m_stop = false;
+
+  std::thread m_writer;
+
+  void writer_loop();
+
+public:
+  /// @brief Constructor for RegistryCheckpointer. Starts the writer thread.
+  /// @param path Path of the snapshot file
+  /// @param workers Number of workers publishing parts
+  RegistryCheckpointer(const std::string &path, unsigned workers);
+
+  /// @brief Writes the last published parts, if not yet written, and stops
+  ~RegistryCheckpointer();
+
+  RegistryCheckpointer(const RegistryCheckpointer &) = delete;
+  RegistryCheckpointer &operator=(const RegistryCheckpointer &) = delete;
+
+  /// @brief Replaces a worker's part of the registry and wakes the writer.
+  /// Nothing is written until every worker has published once, so a snapshot
+  /// never leaves out a worker's rovers.
+  /// @param worker Index of the publishing worker
+  /// @param records Every rover the worker owns
+  void publish(unsigned worker, std::vector<RegistryRecord> records);
+};
@@ -202,9 +202,52 @@ std::vector<uint8_t> compute_parity(const std::vector<uint8_t> &data,
   return parity_bits;
 }
 
+std::vector<uint8_t> encode_bytes(const std::vector<uint8_t> &bytes,
+                                  const RSCode &rscode) {
+  // Unpack the parameters
+  auto [n, k] = rscode;
+
+  if (k > n || k == 0) {
+    throw std::runtime_error("Invalid block size\n 0 <= k <= n\n");
+  }
+
+  // Reserve space for the packet data
+  std::vector<uint8_t> pkt;
+  pkt.reserve(bytes.size() +                     // Original data size
+              (bytes.size() / k) * (n - k) +     // Per-block parity bytes
+              (bytes.size() % k ? (n - k) : 0)); // Last block parity bytes
+
+  // Iterate over data blocks
+  for (size_t offset = 0; offset < bytes.size(); offset += k) {
+    // Calculate the size of the current block (may be smaller for the last
+    // block)
+    size_t block_size = std::min(static_cast<size_t>(k), bytes.size() - offset);
+
+    // Create a temporary vector for the current block
+    std::vector<uint8_t> block(bytes.begin() + offset,
+                               bytes.begin() + offset + block_size);
+
+    // Pad the last block if needed
+    if (block.size() < k) {
+      block.resize(k, 0);
+    }
+
+    // Compute parity for this block
+    std::vector<uint8_t> parity = compute_parity(block, rscode);
+
+    // Append block data and parity to the packet
+    pkt.insert(pkt.end(), block.begin(), block.end());
+    pkt.insert(pkt.end(), parity.begin(), parity.end());
+  }
+
+  return pkt;
+}
+
 std::optional<std::vector<uint8_t>>
-decode_block(const std::vector<uint8_t> &data, const RSCode &rscode) {
+decode_block(const std::vector<uint8_t> &data, const RSCode &rscode,
+             size_t &corrected) {
   auto &[n, k] = rscode;
+  corrected = 0;
 
   // Check for invalid block size
   if (k > n) {
@@ -288,7 +331,8 @@ decode_block(const std::vector<uint8_t> &data, const RSCode &rscode) {
   // Chien Search Algorithm (used to find where the errors are)
   std::vector<uint8_t> error_positions;
 
-  for (size_t i = 0; i < 255; ++i) {
+  // Every non-zero field element is a candidate root, 255 included
+  for (size_t i = 1; i < 256; ++i) {
     if (evaluate_polynomial(error_locator_poly, i) == 0) {
       error_positions.push_back(LOGARITHM_TABLE[divide(1, i)]);
     }
@@ -301,6 +345,14 @@ decode_block(const std::vector<uint8_t> &data, const RSCode &rscode) {
     return std::nullopt;
   }
 
+  // Shortened codes (n < 255) can have locator roots that point outside the
+  // block, which also means there are too many errors to correct
+  for (const auto position : error_positions) {
+    if (position >= data.size()) {
+      return std::nullopt;
+    }
+  }
+
   // Forney Algorithm (used to find the error values)
 
   // Reverse syndromes then multiply by error locator
@@ -335,13 +387,16 @@ decode_block(const std::vector<uint8_t> &data, const RSCode &rscode) {
         add(corrected_data[data.size() - position - 1], error_magnitude);
   }
 
+  corrected = error_positions.size();
+
   // Don't return parity bits with data
   return std::vector<uint8_t>(corrected_data.begin(),
                               corrected_data.begin() + k);
 }
 
 std::optional<std::vector<uint8_t>>
-decode_packet(const std::vector<uint8_t> &data, const RSCode &rscode) {
+decode_packet(const std::vector<uint8_t> &data, const RSCode &rscode,
+              DecodeStats *stats) {
   // Unpack the parameters
   auto &[n, k] = rscode;
   // Check for invalid block size
@@ -374,13 +429,19 @@ decode_packet(const std::vector<uint8_t> &data, const RSCode &rscode) {
                                data.begin() + block_start + n);
 
     // Decode this block
-    auto decoded_block = decode_block(block, rscode);
+    size_t corrected = 0;
+    auto decoded_block = decode_block(block, rscode, corrected);
     if (!decoded_block) {
       // If any block cannot be decoded, entire packet is considered corrupted
       std::cerr << "Failed to decode block " << block_idx << std::endl;
       return std::nullopt;
     }
 
+    if (stats) {
+      stats->corrected += corrected;
+      stats->worst_block = std::max(stats->worst_block, corrected);
+    }
+
     // Append successful block to result
     result.insert(result.end(), decoded_block->begin(), decoded_block->end());
   }
@@ -0,0 +1,141 @@
+#include "navigation.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+namespace navigation {
+
+namespace {
+// Packs a pair of coordinates into one key
+uint64_t key_of(int x, int y) {
+  return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 |
+         static_cast<uint32_t>(y);
+}
+
+// Moves in the order they are tried, and the step each one takes
+constexpr DIRECTION MOVES[] = {DIRECTION::UP, DIRECTION::DOWN,
+                               DIRECTION::LEFT, DIRECTION::RIGHT};
+constexpr int DX[] = {0, 0, -1, 1};
+constexpr int DY[] = {-1, 1, 0, 0};
+
+// Whether a step from a coordinate stays within the int range, past which
+// there are no tiles
+bool can_step(int from, int step) {
+  return step < 0   ? from > std::numeric_limits<int>::min()
+         : step > 0 ? from < std::numeric_limits<int>::max()
+                    : true;
+}
+
+// A tile reached by the search
+struct Node {
+  int x, y;
+  uint32_t cost;     // Moves from the start
+  int32_t parent;    // Index of the tile it was reached from, -1 at the start
+  uint8_t direction; // Move taken from the parent
+  bool closed = false;
+};
+
+// An entry of the open set. Ties on the estimate go to the tile furthest
+// from the start, which is closest to the goal.
+struct Open {
+  uint64_t estimate; // Wide enough for any cost plus any distance
+  uint32_t cost;
+  int32_t node;
+
+  bool operator>(const Open &other) const {
+    return estimate != other.estimate ? estimate > other.estimate
+                                      : cost < other.cost;
+  }
+};
+} // namespace
+
+TileMap::TileMap(TerrainGenerator &terrain) : m_terrain(terrain) {}
+
+Plan plan_path(TileMap &map, int from_x, int from_y, int to_x, int to_y,
+               size_t budget) {
+  // Taken in 64 bits, as tiles can be the whole int range apart on each axis,
+  // and saturated beyond what a uint32_t holds
+  auto distance = [to_x, to_y](int x, int y) {
+    int64_t tiles = std::abs(int64_t{to_x} - x) + std::abs(int64_t{to_y} - y);
+    return static_cast<uint32_t>(std::min<int64_t>(tiles, UINT32_MAX));
+  };
+
+  std::vector<Node> nodes;
+  std::unordered_map<uint64_t, int32_t> index;
+  std::priority_queue<Open, std::vector<Open>, std::greater<Open>> open;
+
+  nodes.push_back({from_x, from_y, 0, -1, 0});
+  index.emplace(key_of(from_x, from_y), 0);
+  open.push({distance(from_x, from_y), 0, 0});
+
+  // The goal if it is reached, otherwise the expanded tile closest to it
+  int32_t best = 0;
+  Plan plan;
+
+  while (!open.empty() && plan.expanded < budget) {
+    Open top = open.top();
+    open.pop();
+
+    // Stale entries are left behind when a tile is reached more cheaply.
+    // nodes may grow below, so the tile is copied out.
+    if (nodes[top.node].closed || top.cost != nodes[top.node].cost) {
+      continue;
+    }
+    nodes[top.node].closed = true;
+    const Node node = nodes[top.node];
+    plan.expanded++;
+
+    uint32_t remaining = distance(node.x, node.y);
+    uint32_t best_remaining = distance(nodes[best].x, nodes[best].y);
+    if (remaining < best_remaining ||
+        (remaining == best_remaining && node.cost < nodes[best].cost)) {
+      best = top.node;
+    }
+    if (remaining == 0) {
+      plan.reached = true;
+      break;
+    }
+
+    for (size_t move = 0; move < std::size(MOVES); ++move) {
+      if (!can_step(node.x, DX[move]) || !can_step(node.y, DY[move])) {
+        continue;
+      }
+      int x = node.x + DX[move], y = node.y + DY[move];
+      if (map.blocked(x, y)) {
+        continue;
+      }
+
+      uint32_t cost = node.cost + 1;
+      auto [it, inserted] =
+          index.try_emplace(key_of(x, y), static_cast<int32_t>(nodes.size()));
+      if (inserted) {
+        nodes.push_back({x, y, cost, top.node, static_cast<uint8_t>(move)});
+      } else if (nodes[it->second].closed || nodes[it->second].cost <= cost) {
+        continue;
+      } else {
+        nodes[it->second].cost = cost;
+        nodes[it->second].parent = top.node;
+        nodes[it->second].direction = static_cast<uint8_t>(move);
+      }
+      open.push({uint64_t{cost} + distance(x, y), cost, it->second});
+    }
+  }
+
+  // Walk back from the tile the plan ends at
+  plan.x = nodes[best].x;
+  plan.y = nodes[best].y;
+  for (int32_t node = best; nodes[node].parent != -1;
+       node = nodes[node].parent) {
+    plan.moves.push_back(MOVES[nodes[node].direction]);
+  }
+  std::reverse(plan.moves.begin(), plan.moves.end());
+  return plan;
+}
+
+} // namespace navigation
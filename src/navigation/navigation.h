@@ -0,0 +1,58 @@
+#pragma once
+#include "protocols.h"
+#include "terrain_gen/terrain_gen.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace navigation {
+
+/// @brief Tiles a search expands unless told otherwise
+constexpr size_t DEFAULT_SEARCH_BUDGET = 20000;
+
+/// @brief Most tiles one search may expand. The search runs on the rover's
+/// event loop, so this bounds how long status requests, alerts and queued
+/// sends wait behind a goto to a few hundred milliseconds.
+constexpr size_t MAX_SEARCH_BUDGET = 50000;
+
+/// @brief Looks up tiles of a TerrainGenerator's world with its point queries,
+/// so chunks the rover has already seen are not generated again
+class TileMap {
+private:
+  TerrainGenerator &m_terrain;
+
+public:
+  /// @brief Constructor for TileMap
+  /// @param terrain Generator of the world to look at
+  explicit TileMap(TerrainGenerator &terrain);
+
+  /// @brief Checks whether a tile has a rock on it
+  /// @param x horizontal coordinate (positive is right)
+  /// @param y vertical coordinate (positive is down)
+  bool blocked(int x, int y) { return m_terrain.isBlocked(x, y); }
+};
+
+/// @brief Moves found by a search, and where they lead
+struct Plan {
+  std::vector<DIRECTION> moves; // From the start, in order
+  int x = 0;                    // Coordinates the moves end at
+  int y = 0;
+  bool reached = false; // Whether they end at the goal
+  size_t expanded = 0;  // Tiles the search expanded
+};
+
+/// @brief Finds a shortest path between two tiles with A*, moving up, down,
+/// left or right around rocks. The search stops once it has expanded the
+/// budgeted number of tiles. If the goal is not reached by then, or cannot be
+/// reached at all, the plan leads to the tile found closest to it instead.
+/// @param map Tiles to search
+/// @param from_x horizontal coordinate of the start
+/// @param from_y vertical coordinate of the start
+/// @param to_x horizontal coordinate of the goal
+/// @param to_y vertical coordinate of the goal
+/// @param budget Most tiles to expand, at least 1
+/// @return the plan
+Plan plan_path(TileMap &map, int from_x, int from_y, int to_x, int to_y,
+               size_t budget = DEFAULT_SEARCH_BUDGET);
+
+} // namespace navigation
@@ -1,8 +1,14 @@
 #pragma once
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <cstddef>
 #include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
 
 /// @brief The maximum allowed packet size (1024)
 constexpr int MAX_PACKET_SIZE = 2 << 9;
@@ -10,6 +16,9 @@ constexpr int MAX_PACKET_SIZE = 2 << 9;
 /// @brief HELO Handshake
 const char HELO[4] = {'H', 'E', 'L', 'O'};
 
+/// @brief Rejoin Handshake
+const char RJON[4] = {'R', 'J', 'O', 'N'};
+
 /// @brief Acknowledgement chars
 const char ACK[3] = {'A', 'C', 'K'};
 /// @brief Negative acknowledgement chars
@@ -28,20 +37,26 @@ enum PORTS {
 /// @brief Rover Direction
 enum DIRECTION { UP = 0, DOWN, LEFT, RIGHT };
 
-/// @brief Request Fields for Discovery Interaction. Consists of "HELO"
+/// @brief Request Fields for Discovery Interaction. Consists of "HELO", then
+/// the ports the rover receives movement and status requests on (0 means the
+/// well-known MOVEMENT_CMD/STATUS port)
 struct DiscoveryRequest {
   char helo[4];
   uint64_t timestamp;
+  uint16_t movement_port = 0;
+  uint16_t status_port = 0;
 
   DiscoveryRequest() { std::memcpy(helo, HELO, sizeof(helo)); }
 };
 
 /// @brief Response Fields for Discovery Interaction. Consists of "HELO",
-/// ACK/NAK, then the rover's designated ID
+/// ACK/NAK, the RS level the rover is to use from now on, then the rover's
+/// designated ID. The response itself is encoded at the level of the request.
 struct DiscoveryResponse {
   char helo[4];
   char status[3];
-  uint8_t rover_id = 0;
+  uint8_t rs_level = 0;
+  uint32_t rover_id = 0;
   uint64_t timestamp;
 
   // I hate this, please somebody find a better way
@@ -51,6 +66,60 @@ struct DiscoveryResponse {
   }
 };
 
+/// @brief Request Fields for Rejoin Interaction. A discovered rover that
+/// has not heard from the Earth base for REJOIN_TIMEOUT sends one of these to
+/// the discovery port, restating what the Earth base knew about it. The
+/// rover ID and RS level are at fixed offsets, so they can be read before
+/// decoding.
+struct RejoinRequest {
+  char rjon[4];
+  uint32_t rover_id = 0;
+  uint8_t rs_level = 0;      // RS level the request is encoded with
+  bool sequence_num = false; // Sequence number of the last movement command
+  uint16_t movement_port = 0;
+  uint16_t status_port = 0;
+  uint64_t timestamp = 0;
+
+  RejoinRequest() { std::memcpy(rjon, RJON, sizeof(rjon)); }
+};
+
+/// @brief Response Fields for Rejoin Interaction. Consists of "RJON", then
+/// ACK if the Earth base knows the rover, or NAK if it has to be discovered
+/// again
+struct RejoinResponse {
+  char rjon[4];
+  char status[3];
+  uint32_t rover_id = 0;
+  uint64_t timestamp = 0;
+
+  RejoinResponse() {
+    std::memcpy(rjon, RJON, sizeof(rjon));
+    std::memcpy(status, ACK, sizeof(status));
+  }
+};
+
+/// @brief Checks whether a packet, encoded or decoded, starts with "RJON"
+/// @param data the packet
+/// @param size size of the packet
+inline bool is_rejoin(const uint8_t *data, size_t size) {
+  return size >= sizeof(RJON) && std::memcmp(data, RJON, sizeof(RJON)) == 0;
+}
+
+/// @brief Reads a Reed-Solomon encoded rejoin request without decoding it.
+/// Like peek_header, the fields may have been corrupted in transit.
+/// @param data the encoded packet
+/// @param size size of the encoded packet
+/// @return the request, or std::nullopt if the packet is not a rejoin request
+inline std::optional<RejoinRequest> peek_rejoin(const uint8_t *data,
+                                                size_t size) {
+  if (size < sizeof(RejoinRequest) || !is_rejoin(data, size)) {
+    return std::nullopt;
+  }
+  RejoinRequest req;
+  std::memcpy(&req, data, sizeof(req));
+  return req;
+}
+
 /// @brief Reed-Solomon Code Parameters (n, k)
 /// @details n = number of symbols in a block
 /// @details k = number of symbols in a block that are data
@@ -83,17 +152,170 @@ constexpr auto RS_LEVELS = []() {
   return levels;
 }();
 
+/// @brief The level with the most parity. Discovery requests are sent at this
+/// level, so the Earth base can decode them over a poor link and measure how
+/// poor it is before a level is agreed.
+constexpr uint8_t PROBE_RS_LEVEL = []() {
+  uint8_t best = 0;
+  for (uint8_t level = 1; level < RS_LEVELS.size(); ++level) {
+    if (RS_LEVELS[level].n - RS_LEVELS[level].k >
+        RS_LEVELS[best].n - RS_LEVELS[best].k) {
+      best = level;
+    }
+  }
+  return best;
+}();
+
+/// @brief Finds the level a single-block packet was encoded at. Every level
+/// up to PROBE_RS_LEVEL has a different block size, and corruption never
+/// changes a datagram's size.
+/// @param size size of the encoded packet
+/// @return the level, or std::nullopt if no level has that block size
+constexpr std::optional<uint8_t> rs_level_for_size(size_t size) {
+  for (uint8_t level = 0; level <= PROBE_RS_LEVEL; ++level) {
+    if (size == RS_LEVELS[level].n) {
+      return level;
+    }
+  }
+  return std::nullopt;
+}
+
+/// @brief Picks the RS level for a link from the errors corrected in one
+/// packet sent over it: the lowest level able to correct twice as many, so
+/// somewhat noisier packets still decode.
+/// @param corrected most symbols corrected in any one block of the packet
+constexpr uint8_t recommend_rs_level(size_t corrected) {
+  for (uint8_t level = 0; level < PROBE_RS_LEVEL; ++level) {
+    size_t correctable = (RS_LEVELS[level].n - RS_LEVELS[level].k) / 2;
+    if (correctable >= 2 * corrected) {
+      return level;
+    }
+  }
+  return PROBE_RS_LEVEL;
+}
+
 /// @brief The maximum number of retries for a packet
 constexpr int MAX_RETRIES = 5;
 
 /// @brief The maximum timeout for a packet
 constexpr int MAX_TIMEOUT_MS = 3000;
 
+/// @brief Silence after which the Earth base sends a rover a heartbeat probe
+constexpr std::chrono::seconds HEARTBEAT_INTERVAL{10};
+
+/// @brief Silence after which the Earth base considers a rover lost and
+/// forgets it
+constexpr std::chrono::seconds LIVENESS_TIMEOUT{30};
+
+/// @brief Silence after which a rover assumes the Earth base has restarted
+/// and rejoins. Longer than a heartbeat interval plus the probe's timeout.
+constexpr std::chrono::seconds REJOIN_TIMEOUT{15};
+
+/// @brief Header that every movement and status message starts with. The
+/// request ID is chosen by the Earth base and echoed in the response, so each
+/// response can be matched to the request it answers.
+struct MessageHeader {
+  uint32_t rover_id;
+  uint32_t request_id;
+};
+
+/// @brief Reads the header of a Reed-Solomon encoded message without decoding
+/// it. The code is systematic, so the header is sent as-is at the start of the
+/// packet, but it may have been corrupted in transit.
+/// @param data the encoded packet
+/// @param size size of the encoded packet
+/// @return the header, or std::nullopt if the packet is too short
+inline std::optional<MessageHeader> peek_header(const uint8_t *data,
+                                                size_t size) {
+  if (size < sizeof(MessageHeader)) {
+    return std::nullopt;
+  }
+  MessageHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  return header;
+}
+
+/// @brief Request ID marking a batch: one datagram carrying several messages
+/// from a rover under a single encoding. The header is followed by frames,
+/// each a 16-bit length and then the message, up to a frame of length 0 or
+/// the end of the packet. The Earth base never gives a request this ID.
+constexpr uint32_t BATCH_REQUEST_ID = 0xFFFFFFFF;
+
+/// @brief Largest payload that fits in one datagram once encoded, at every RS
+/// level. Encoding pads each block to k symbols and adds n - k of parity.
+constexpr size_t MAX_PAYLOAD_SIZE = []() {
+  size_t smallest = MAX_PACKET_SIZE;
+  for (const auto &level : RS_LEVELS) {
+    smallest = std::min<size_t>(smallest, MAX_PACKET_SIZE / level.n * level.k);
+  }
+  return smallest;
+}();
+
+/// @brief Request ID marking a bulk transfer message, see BulkHeader. The
+/// Earth base never gives a request this ID.
+constexpr uint32_t BULK_REQUEST_ID = 0xFFFFFFFE;
+
+/// @brief What a bulk transfer carries
+enum class BulkContent : uint8_t {
+  NONE = 0,
+  TERRAIN, // A TerrainMapHeader followed by the tiles around the rover
+};
+
+/// @brief Kinds of bulk transfer message
+enum class BulkKind : uint8_t {
+  OPEN,  // Receiver asks for a transfer of some content
+  DATA,  // Sender carries one segment of the content
+  ACK,   // Receiver says which segments have arrived
+  ABORT, // Either side gives up on the transfer
+};
+
+/// @brief Header every bulk transfer message starts with. Transfers are named
+/// by the receiver, which opens them, and carry any number of bytes split
+/// into segments that are acknowledged selectively.
+struct BulkHeader {
+  uint32_t rover_id;
+  uint32_t request_id = BULK_REQUEST_ID;
+  uint32_t transfer_id;
+  BulkKind kind;
+  BulkContent content = BulkContent::NONE; // OPEN: what to send
+  uint16_t window = 0; // OPEN and ACK: segments the receiver takes at once
+};
+
+/// @brief Bulk DATA message. Followed by the segment's bytes: a full segment,
+/// or what remains of total_size for the last one.
+struct BulkSegment {
+  BulkHeader header;
+  uint32_t seq;        // Index of the segment
+  uint32_t total_size; // Bytes in the whole transfer
+};
+
+/// @brief Bulk ACK message
+struct BulkAck {
+  BulkHeader header;
+  uint32_t cumulative; // Every segment before this one has arrived
+  uint32_t received;   // Segments that have arrived in all
+  uint64_t sack;       // Bit i is set if segment cumulative + 1 + i has arrived
+};
+
+/// @brief Start of a terrain map. Followed by width * height tiles packed one
+/// bit per tile, row after row from the top left with no padding between
+/// rows. Tile k is bit k % 8 of byte k / 8, set for a rock.
+struct TerrainMapHeader {
+  int32_t x; // Position of the rover, at the center of the map
+  int32_t y;
+  uint16_t width;
+  uint16_t height;
+};
+
+/// @brief Tiles a terrain map reaches out from the rover in each direction
+constexpr int TERRAIN_MAP_RADIUS = 32;
+
 /// @brief Request Fields for Movement Interaction.
-/// Consists of Rover ID, Direction (see DIRECTION), timestamp in 64-bit epoch
-/// time, and sequence number
+/// Consists of Rover ID, request ID, Direction (see DIRECTION), timestamp in
+/// 64-bit epoch time, and sequence number
 struct MoveRequest {
   uint32_t rover_id;
+  uint32_t request_id;
   DIRECTION direction;
   uint64_t timestamp;
   bool sequence_num;
@@ -102,8 +324,9 @@ struct MoveRequest {
 /// @brief Response Fields for Movement Interaction.
 struct MoveResponse {
   uint32_t rover_id;
-  char status[3]; // Was the checksum correct?
-  bool moved;     // Could the rover move?
+  uint32_t request_id = 0; // ID of the request being answered
+  char status[3];          // Was the checksum correct?
+  bool moved;              // Could the rover move?
   bool sequence_num;
   // Coordinates
   int x;
@@ -113,17 +336,196 @@ struct MoveResponse {
   MoveResponse() { std::memcpy(status, ACK, sizeof(status)); }
 };
 
+/// @brief Mark PathRequests and GotoRequests. They are where a MoveRequest
+/// has its direction, which is never one of these values.
+constexpr uint32_t PATH_COMMAND = 0x48544150; // "PATH"
+constexpr uint32_t GOTO_COMMAND = 0x4F544F47; // "GOTO"
+
+/// @brief Most runs one path request carries, so it fits in a single block
+/// at every RS level
+constexpr size_t MAX_PATH_RUNS = 64;
+
+/// @brief Most moves one run stands for
+constexpr size_t MAX_RUN_LENGTH = UINT8_MAX;
+
+/// @brief Moves in the same direction, run-length encoded
+struct PathRun {
+  uint8_t direction; // See DIRECTION
+  uint8_t count;     // Moves in the direction, at least 1
+};
+
+/// @brief Request Fields for a multi-step path. The rover takes the moves in
+/// order and stops at the first one blocked by a rock. Shares the sequence
+/// number of movement commands.
+struct PathRequest {
+  uint32_t rover_id;
+  uint32_t request_id;
+  uint32_t command = PATH_COMMAND;
+  bool sequence_num = false;
+  uint8_t run_count = 0; // Runs used, the rest are zero
+  uint64_t timestamp = 0;
+  PathRun runs[MAX_PATH_RUNS] = {};
+};
+
+static_assert(sizeof(PathRequest) <= RS_LEVELS[0].k,
+              "a path request must fit in one block");
+
+/// @brief Response Fields for a path. Sent once the rover has stopped.
+struct PathResponse {
+  uint32_t rover_id = 0;
+  uint32_t request_id = 0; // ID of the request being answered
+  char status[3];          // Was the checksum correct?
+  bool sequence_num = false;
+  uint16_t steps_taken = 0; // Moves made, the index of any blocked move
+  uint16_t total_steps = 0; // Moves in the path
+  // Coordinates where the rover stopped
+  int x = 0;
+  int y = 0;
+  uint64_t timestamp = 0;
+
+  PathResponse() { std::memcpy(status, ACK, sizeof(status)); }
+};
+
+/// @brief Request Fields for a goto. The rover plans a path to the target
+/// over its own terrain, searching at most budget tiles, then follows it as
+/// far as MAX_PATH_RUNS runs reach. Shares the sequence number of movement
+/// commands.
+struct GotoRequest {
+  uint32_t rover_id;
+  uint32_t request_id;
+  uint32_t command = GOTO_COMMAND;
+  bool sequence_num = false;
+  // Coordinates to go to
+  int x = 0;
+  int y = 0;
+  uint32_t budget = 0; // Most tiles to search, 0 for the rover's default
+  uint64_t timestamp = 0;
+};
+
+static_assert(offsetof(GotoRequest, command) ==
+              offsetof(PathRequest, command));
+
+/// @brief How far a goto got
+enum class GotoOutcome : uint8_t {
+  REACHED = 0, // The rover is at the target
+  PARTIAL,     // The search budget or the path ran out, asking again goes on
+  UNREACHABLE, // The target is a rock or walled off
+};
+
+/// @brief Response Fields for a goto. Sent once the rover has stopped, with
+/// the path it took.
+struct GotoResponse {
+  uint32_t rover_id = 0;
+  uint32_t request_id = 0; // ID of the request being answered
+  char status[3];          // Was the checksum correct?
+  bool sequence_num = false;
+  GotoOutcome outcome = GotoOutcome::PARTIAL;
+  uint8_t run_count = 0;    // Runs of the path taken
+  uint16_t steps_taken = 0; // Moves of the path taken
+  uint32_t expanded = 0;    // Tiles the search expanded
+  // Coordinates where the rover stopped
+  int x = 0;
+  int y = 0;
+  uint64_t timestamp = 0;
+  PathRun runs[MAX_PATH_RUNS] = {}; // The path taken
+
+  GotoResponse() { std::memcpy(status, ACK, sizeof(status)); }
+};
+
+static_assert(sizeof(GotoResponse) <= RS_LEVELS[0].k,
+              "a goto response must fit in one block");
+
+/// @brief Reads which command a decoded movement message carries
+/// @param data the message
+/// @param size size of the message
+/// @return PATH_COMMAND, GOTO_COMMAND, or anything else for a MoveRequest
+inline uint32_t peek_command(const uint8_t *data, size_t size) {
+  constexpr size_t offset = offsetof(PathRequest, command);
+  uint32_t command = 0;
+  if (size >= offset + sizeof(command)) {
+    std::memcpy(&command, data + offset, sizeof(command));
+  }
+  return command;
+}
+
+/// @brief Checks whether a decoded movement message is a path request
+/// @param data the message
+/// @param size size of the message
+inline bool is_path_request(const uint8_t *data, size_t size) {
+  return peek_command(data, size) == PATH_COMMAND;
+}
+
+/// @brief Checks whether a decoded movement message is a goto request
+/// @param data the message
+/// @param size size of the message
+inline bool is_goto_request(const uint8_t *data, size_t size) {
+  return peek_command(data, size) == GOTO_COMMAND;
+}
+
+/// @brief Run-length encodes as many of a sequence of moves as fit in
+/// MAX_PATH_RUNS runs
+/// @param moves the moves, in order
+/// @return the runs
+inline std::vector<PathRun>
+encode_path_prefix(const std::vector<DIRECTION> &moves) {
+  std::vector<PathRun> runs;
+  for (DIRECTION move : moves) {
+    if (runs.empty() || runs.back().direction != move ||
+        runs.back().count == MAX_RUN_LENGTH) {
+      if (runs.size() == MAX_PATH_RUNS) {
+        break;
+      }
+      runs.push_back({static_cast<uint8_t>(move), 0});
+    }
+    runs.back().count++;
+  }
+  return runs;
+}
+
+/// @brief Run-length encodes a sequence of moves
+/// @param moves the moves, in order
+/// @return the runs, or std::nullopt if there are more than MAX_PATH_RUNS
+inline std::optional<std::vector<PathRun>>
+encode_path(const std::vector<DIRECTION> &moves) {
+  auto runs = encode_path_prefix(moves);
+  size_t encoded = 0;
+  for (const PathRun &run : runs) {
+    encoded += run.count;
+  }
+  if (encoded != moves.size()) {
+    return std::nullopt;
+  }
+  return runs;
+}
+
+/// @brief Writes runs of moves as letters followed by counts, e.g. "u3r2"
+/// @param runs the runs
+/// @param run_count number of runs
+inline std::string path_to_string(const PathRun *runs, size_t run_count) {
+  static constexpr char letters[] = {'u', 'd', 'l', 'r'};
+  std::string text;
+  for (size_t idx = 0; idx < run_count; ++idx) {
+    text += runs[idx].direction < sizeof(letters) ? letters[runs[idx].direction]
+                                                  : '?';
+    text += std::to_string(runs[idx].count);
+  }
+  return text;
+}
+
 struct StatusRequest {
   uint32_t rover_id;
+  uint32_t request_id;
   uint64_t timestamp;
 };
 
 struct StatusResponse {
   uint32_t rover_id;
+  uint32_t request_id = 0; // ID of the request answered, 0 for alerts
   char status[3]; // ACK/NAK
   float battery_level;
   float temperature;
   bool emergency;
+  uint8_t error_code = 0; // Rover's error code, 0 when nominal
   char message[64];
   uint64_t timestamp;
 
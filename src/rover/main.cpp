@@ -5,20 +5,78 @@
 
 const char *EARTH_IP = "127.0.0.1";
 
-int main() {
+int main(int argc, char *argv[]) {
+  // Optional "--transport=asio|uring|shm" selects the I/O backend,
+  // "--link-rate=BYTES" the bytes per second sent to Earth (0 for no limit)
+  // "--movement-port=PORT" the port commands are taken on (0 for any) and
+  // "--terrain=hashed|legacy" how terrain is generated (legacy reproduces the
+  // maps of rovers that predate hashed terrain)
+  transport::Backend backend = transport::Backend::ASIO;
+  transport::SchedulerOptions scheduler;
+  unsigned short movement_port = PORTS::MOVEMENT_CMD;
+  TerrainAlgorithm terrain = TerrainAlgorithm::HASHED;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--transport=", 0) == 0) {
+      auto parsed = transport::parse_backend(arg.substr(12));
+      if (!parsed) {
+        std::cerr << "Unknown transport: " << arg.substr(12) << std::endl;
+        return 1;
+      }
+      backend = *parsed;
+    } else if (arg.rfind("--link-rate=", 0) == 0) {
+      try {
+        scheduler.link_rate = std::stod(arg.substr(12));
+      } catch (const std::exception &) {
+        scheduler.link_rate = -1;
+      }
+      if (scheduler.link_rate < 0) {
+        std::cerr << "Invalid link rate: " << arg.substr(12) << std::endl;
+        return 1;
+      }
+    } else if (arg.rfind("--movement-port=", 0) == 0) {
+      unsigned long port = 65536;
+      try {
+        port = std::stoul(arg.substr(16));
+      } catch (const std::exception &) {
+      }
+      if (port > 65535) {
+        std::cerr << "Invalid movement port: " << arg.substr(16) << std::endl;
+        return 1;
+      }
+      movement_port = static_cast<unsigned short>(port);
+    } else if (arg.rfind("--terrain=", 0) == 0) {
+      auto parsed = parseTerrainAlgorithm(arg.substr(10));
+      if (!parsed) {
+        std::cerr << "Unknown terrain: " << arg.substr(10) << std::endl;
+        return 1;
+      }
+      terrain = *parsed;
+    }
+  }
+
   // Initialize Rover Class
   asio::io_context io_context;
-  Rover rover(io_context, EARTH_IP);
+  Rover rover(io_context, EARTH_IP, backend, scheduler, movement_port,
+              terrain);
+
+  // Ctrl-C or a termination request stops the rover, and the loop below
+  // returns once it has closed everything
+  asio::signal_set signals(io_context, SIGINT, SIGTERM);
+  signals.async_wait([&rover](const asio::error_code &ec, int) {
+    if (!ec) {
+      rover.stop();
+    }
+  });
 
   // Start executable loop
   std::cout << "Attempting connection with Houston..." << std::endl;
   rover.start();
   rover.printCurrentTerrain();
-  io_context.run();
 
-  // Keep the program running (all threads are detached)
-  while (1) {
-  }
+  // Everything happens on this thread, which sleeps while there is nothing
+  // to do. Runs until the rover has stopped.
+  io_context.run();
 
   return 0;
 }
@@ -1,219 +1,494 @@
 #include "rover.h"
 #include "error_correction/error_correction.h"
 #include "health/health.h"
+#include "navigation/navigation.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <asio/ts/buffer.hpp>
 #include <asio/ts/internet.hpp>
 #include <iostream>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#endif
-
-Rover::Rover(asio::io_context &io_context, const std::string &server_ip)
-    : m_discovery_socket(io_context), m_movement_socket(io_context),
-      m_terrain_socket(io_context), m_status_socket(io_context),
+Rover::Rover(asio::io_context &io_context, const std::string &server_ip,
+             transport::Backend backend,
+             const transport::SchedulerOptions &scheduler,
+             unsigned short movement_port, TerrainAlgorithm terrain)
+    : m_io_context(io_context),
+      m_discovery_io(transport::make_transport(backend, io_context,
+                                               udp::endpoint(udp::v4(), 0))),
+      m_movement_io(transport::make_transport(
+          backend, io_context, udp::endpoint(udp::v4(), movement_port))),
+      // The Earth base listens for alerts on PORTS::STATUS, so status
+      // requests are taken on whichever port discovery advertises
+      m_status_io(transport::make_transport(backend, io_context,
+                                            udp::endpoint(udp::v4(), 0))),
+      m_scheduler(io_context, *m_movement_io, scheduler),
+      m_responses(io_context,
+                  [this](std::vector<uint8_t> payload, bool urgent) {
+                    m_scheduler.send(
+                        udp::endpoint(m_earthbase_addr, PORTS::MOVEMENT_RESP),
+                        reed_solomon::encode_bytes(payload,
+                                                   RS_LEVELS[m_rscode_level]),
+                        urgent ? transport::TrafficClass::EMERGENCY
+                               : transport::TrafficClass::INTERACTIVE);
+                  }),
+      m_discovery_timer(io_context), m_health_timer(io_context),
+      m_rejoin_timer(io_context),
       m_earthbase_addr(asio::ip::address::from_string(server_ip)), m_id(99),
-      m_x(0), m_y(0), m_movement_seq_num(1) {
-// Windows-specific: Disable connection reset behavior
-#ifdef _WIN32
-  BOOL bNewBehavior = FALSE;
-  DWORD dwBytesReturned = 0;
-  WSAIoctl(m_discovery_socket.native_handle(), SIO_UDP_CONNRESET, &bNewBehavior,
-           sizeof(bNewBehavior), NULL, 0, &dwBytesReturned, NULL, NULL);
-  WSAIoctl(m_movement_socket.native_handle(), SIO_UDP_CONNRESET, &bNewBehavior,
-           sizeof(bNewBehavior), NULL, 0, &dwBytesReturned, NULL, NULL);
-  WSAIoctl(m_terrain_socket.native_handle(), SIO_UDP_CONNRESET, &bNewBehavior,
-           sizeof(bNewBehavior), NULL, 0, &dwBytesReturned, NULL, NULL);
-  WSAIoctl(m_health_socket.native_handle(), SIO_UDP_CONNRESET, &bNewBehavior,
-           sizeof(bNewBehavior), NULL, 0, &dwBytesReturned, NULL, NULL);
-#endif
-  // Open Discovery Socket
-  m_discovery_socket.open(udp::v4());
-
-  // Open Movement Socket
-  m_movement_socket.open(udp::v4());
-  m_movement_socket.bind(udp::endpoint(udp::v4(), PORTS::MOVEMENT_CMD));
-
-  // Open Terrain Socket
-  m_terrain_socket.open(udp::v4());
-
-  // Open Status Socket
-  m_status_socket.open(udp::v4());
-  m_status_socket.bind(udp::endpoint(udp::v4(), PORTS::STATUS));
-}
+      m_x(0), m_y(0), m_movement_seq_num(1),
+      m_tgen(rock_chance, seed, terrain) {}
 
 void Rover::start() {
-  // Create the discovery mutex/cv
-  std::mutex discovery_mutex;
-  std::condition_variable discovery_cv;
-
-  // Start discovery process
-  std::thread discovery_thread([this, &discovery_cv]() {
-    this->wait_for_discovery_response();
-    // Notify main thread when discovery completes
-    discovery_cv.notify_one();
-  });
+  // Listen for the Earth base's answer before asking
+  m_discovery_io->async_receive(
+      [this](std::span<const transport::Datagram> batch) {
+        for (const auto &datagram : batch) {
+          handle_discovery_response(datagram);
+        }
+      });
+
+  // Keep sending discovery requests until discovered
+  asio::co_spawn(m_io_context, discover(), asio::detached);
+}
 
+asio::awaitable<void> Rover::discover() {
   udp::endpoint discovery_endpoint(m_earthbase_addr, PORTS::DISCOVERY);
 
-  // Construct discovery request packet
-  DiscoveryRequest d_req = {};
-  d_req.timestamp = util::current_time();
-  auto pkt = reed_solomon::encode_packet(d_req, RS_LEVELS[m_rscode_level]);
-
-  // Keep sending discovery requests until discovered or timeout
-  while (!m_discovered) {
-    // Send discovery request
-    pkt = reed_solomon::encode_packet(d_req, RS_LEVELS[m_rscode_level]);
-    send_message(pkt, m_discovery_socket, discovery_endpoint);
-
-    // Wait for up to 3 seconds or until notified that discovery is complete
-    std::unique_lock<std::mutex> lock(discovery_mutex);
-    discovery_cv.wait_for(lock, std::chrono::milliseconds(MAX_TIMEOUT_MS),
-                          [this] { return m_discovered.load(); });
-
-    // If discovered during the wait, exit the loop
-    // (This stops us having to wait for the full 3 seconds if we get a
-    // response)
-    if (m_discovered)
-      break;
+  while (!m_discovered && !m_stopping) {
+    // Construct discovery request packet
+    DiscoveryRequest d_req = {};
+    d_req.timestamp = util::current_time();
+    d_req.movement_port = m_movement_io->local_endpoint().port();
+    d_req.status_port = m_status_io->local_endpoint().port();
+    // Sent with the strongest code, the Earth base answers with the level
+    // the link needs
+    auto pkt = reed_solomon::encode_packet(d_req, RS_LEVELS[PROBE_RS_LEVEL]);
+    send_message(pkt, *m_discovery_io, discovery_endpoint);
+
+    // Try again if there is no answer within 3 seconds. An ACK cancels the
+    // wait.
+    asio::error_code ec;
+    m_discovery_timer.expires_after(std::chrono::milliseconds(MAX_TIMEOUT_MS));
+    co_await m_discovery_timer.async_wait(
+        asio::redirect_error(asio::use_awaitable, ec));
   }
+}
+
+void Rover::on_discovered() {
+  m_discovery_timer.cancel();
+  m_last_contact = std::chrono::steady_clock::now();
 
-  // Join the discovery thread
-  discovery_thread.join();
+  // A new registration at the Earth base starts the sequence numbers over
+  m_movement_seq_num = 1;
 
   std::cout << "Discovery complete. Rover ID: " << static_cast<int>(m_id)
             << std::endl;
 
-  // Start threads for movement and terrain commands
-  std::thread movement_thread(&Rover::wait_for_movement, this);
-  std::thread terrain_thread(&Rover::wait_for_terrain, this);
-  std::thread health_thread(&Rover::monitor_health, this);
-  movement_thread.detach();
-  terrain_thread.detach();
-  health_thread.detach();
+  // Discovering again after a rejected rejoin keeps everything running
+  if (m_services_started) {
+    return;
+  }
+  m_services_started = true;
+
+  // Start handling movement commands
+  std::cout << "Rover listening for movement commands on port: "
+            << m_movement_io->local_endpoint().port() << std::endl;
+  m_movement_io->async_receive(
+      [this](std::span<const transport::Datagram> batch) {
+        for (const auto &datagram : batch) {
+          handle_movement(datagram);
+        }
+      });
+
+  // Answer status requests
+  m_status_io->async_receive(
+      [this](std::span<const transport::Datagram> batch) {
+        for (const auto &datagram : batch) {
+          handle_status_request(datagram);
+        }
+      });
+
+  // Start health monitoring
+  asio::co_spawn(m_io_context, monitor_health(), asio::detached);
+  asio::co_spawn(m_io_context, watch_earth(), asio::detached);
 }
 
-void Rover::send_message(const std::vector<uint8_t> &message,
-                         udp::socket &socket, const udp::endpoint &endpoint) {
-  // Check if the socket is open
-  if (!socket.is_open()) {
-    std::cerr << "Error: Socket is not open!" << std::endl;
-    return;
+asio::awaitable<void> Rover::watch_earth() {
+  using Clock = std::chrono::steady_clock;
+  udp::endpoint discovery_endpoint(m_earthbase_addr, PORTS::DISCOVERY);
+  unsigned unanswered = 0;
+
+  while (true) {
+    auto deadline = m_last_contact + REJOIN_TIMEOUT;
+
+    if (!m_discovered) {
+      // Discovery is running again, and takes care of contact itself
+      unanswered = 0;
+      m_rejoin_timer.expires_after(REJOIN_TIMEOUT);
+    } else if (Clock::now() < deadline) {
+      unanswered = 0;
+      m_rejoin_timer.expires_at(deadline);
+    } else {
+      // Requests may be too corrupted to decode at this level. The Earth
+      // base decodes a rejoin at whatever level the rover says it uses.
+      if (unanswered != 0 && unanswered % MAX_RETRIES == 0) {
+        m_rscode_level = std::min<uint8_t>(m_rscode_level + 1, PROBE_RS_LEVEL);
+      }
+      unanswered++;
+
+      // Restate everything the Earth base needs to resume this rover
+      RejoinRequest req;
+      req.rover_id = m_id;
+      req.rs_level = m_rscode_level;
+      req.sequence_num = m_movement_seq_num;
+      req.movement_port = m_movement_io->local_endpoint().port();
+      req.status_port = m_status_io->local_endpoint().port();
+      req.timestamp = util::current_time();
+
+      std::cout << "No contact with the Earth base, asking to rejoin..."
+                << std::endl;
+      auto pkt = reed_solomon::encode_packet(req, RS_LEVELS[req.rs_level]);
+      send_message(pkt, *m_discovery_io, discovery_endpoint);
+      m_rejoin_timer.expires_after(std::chrono::milliseconds(MAX_TIMEOUT_MS));
+    }
+
+    asio::error_code ec;
+    co_await m_rejoin_timer.async_wait(
+        asio::redirect_error(asio::use_awaitable, ec));
+    if (ec) {
+      co_return;
+    }
   }
-  socket.send_to(asio::buffer(message), endpoint);
 }
 
-void Rover::wait_for_terrain() {
-  char data[MAX_PACKET_SIZE];
-  udp::endpoint sender_endpoint;
+void Rover::send_message(const std::vector<uint8_t> &message,
+                         transport::Transport &transport,
+                         const udp::endpoint &endpoint) {
+  // Sends never block, errors are reported by the transport
+  transport.send(endpoint, message);
+}
 
-  try {
-    std::cout << "Waiting for terrain data...\n" << std::endl;
+void Rover::handle_bulk(const std::vector<uint8_t> &message) {
+  auto header = transport::peek_bulk_header(message);
+  if (!header || header->rover_id != m_id) {
+    return;
+  }
+  auto it = m_transfers.find(header->transfer_id);
 
-    if (!m_terrain_socket.is_open()) {
-      std::cerr << "Error: Terrain socket is not open!\n" << std::endl;
+  switch (header->kind) {
+  case BulkKind::OPEN: {
+    // A repeated OPEN is answered by the transfer already running
+    if (it != m_transfers.end()) {
+      return;
     }
 
-    m_terrain_socket.receive_from(asio::buffer(data, sizeof(data)),
-                                  sender_endpoint);
-    std::cout << "Received terrain data: " << data << std::endl;
-  } catch (const std::system_error &e) {
-    std::cerr << "Error receiving terrain data: " << e.what()
-              << " (Error Code: " << e.code().value() << ")" << std::endl;
+    auto content = bulk_content(header->content);
+    if (!content) {
+      BulkHeader abort = *header;
+      abort.kind = BulkKind::ABORT;
+      m_scheduler.send(
+          udp::endpoint(m_earthbase_addr, PORTS::MOVEMENT_RESP),
+          reed_solomon::encode_packet(abort, RS_LEVELS[m_rscode_level]),
+          transport::TrafficClass::CONTROL);
+      return;
+    }
+
+    uint32_t transfer_id = header->transfer_id;
+    auto sender = std::make_unique<transport::BulkSender>(
+        m_io_context, *header, std::move(*content),
+        [this](std::vector<uint8_t> segment) {
+          m_scheduler.send(
+              udp::endpoint(m_earthbase_addr, PORTS::MOVEMENT_RESP),
+              reed_solomon::encode_bytes(segment, RS_LEVELS[m_rscode_level]),
+              transport::TrafficClass::BULK);
+        },
+        [this, transfer_id](bool delivered) {
+          std::cout << "Bulk transfer " << transfer_id
+                    << (delivered ? " delivered" : " failed") << std::endl;
+
+          // Removed once the sender has returned from its own handler
+          asio::post(m_io_context,
+                     [this, transfer_id]() { m_transfers.erase(transfer_id); });
+        });
+    std::cout << "Sending bulk transfer " << transfer_id << " in "
+              << sender->segment_count() << " segments" << std::endl;
+    sender->start();
+    m_transfers.emplace(transfer_id, std::move(sender));
+    return;
   }
+  case BulkKind::ACK:
+    if (it != m_transfers.end()) {
+      it->second->handle_ack(util::bytes_to_struct<BulkAck>(message));
+    }
+    return;
+  case BulkKind::ABORT:
+    if (it != m_transfers.end()) {
+      it->second->cancel();
+    }
+    return;
+  default:
+    return; // The rover never receives segments
+  }
+}
 
-  // TODO: Implement Terrain Interaction
+std::optional<std::vector<uint8_t>> Rover::bulk_content(BulkContent content) {
+  switch (content) {
+  case BulkContent::TERRAIN:
+    return terrain_map();
+  default:
+    return std::nullopt;
+  }
 }
 
-void Rover::wait_for_movement() {
-  char data[MAX_PACKET_SIZE];
-  udp::endpoint sender_endpoint;
-  std::cout << "Rover listening for movement commands on port: "
-            << m_movement_socket.local_endpoint().port() << std::endl;
+std::vector<uint8_t> Rover::terrain_map() {
+  constexpr int size = 2 * TERRAIN_MAP_RADIUS + 1;
+  TerrainMapHeader header{m_x, m_y, size, size};
 
-  // This is running on its own thread, so no need to worry about blocking
-  while (1) {
-    std::memset(data, 0, sizeof(data));
+  auto tiles = m_tgen.getRegion(m_x - TERRAIN_MAP_RADIUS,
+                                m_y - TERRAIN_MAP_RADIUS, size, size)
+                   .pack();
+  auto map = util::struct_to_bytes(header);
+  map.insert(map.end(), tiles.begin(), tiles.end());
+  return map;
+}
 
-    // Wait to receive data from earth base
-    size_t length = m_movement_socket.receive_from(
-        asio::buffer(data, sizeof(data)), sender_endpoint);
+void Rover::handle_movement(const transport::Datagram &datagram) {
+  // A stopping rover takes no more commands, the Earth base times them out
+  if (m_stopping) {
+    return;
+  }
 
-    auto packet = reed_solomon::decode_packet(
-        std::vector<uint8_t>(data, data + length), RS_LEVELS[m_rscode_level]);
+  auto packet = reed_solomon::decode_packet(
+      std::vector<uint8_t>(datagram.data, datagram.data + datagram.size),
+      RS_LEVELS[m_rscode_level]);
 
-    // If not decoded successfully
-    if (!packet) {
-      send_movement_response(false, false);
-      continue;
+  // If not decoded successfully, NAK with the request ID as sent, which is
+  // readable without decoding. Bulk transfers recover by themselves.
+  if (!packet) {
+    auto header = peek_header(datagram.data, datagram.size);
+    if (!header || header->request_id != BULK_REQUEST_ID) {
+      send_movement_response(header ? header->request_id : 0, false, false);
     }
+    return;
+  }
+
+  m_last_contact = std::chrono::steady_clock::now();
+
+  // Bulk transfer messages share the port with movement commands
+  auto header = peek_header(packet->data(), packet->size());
+  if (header && header->request_id == BULK_REQUEST_ID) {
+    handle_bulk(*packet);
+    return;
+  }
 
-    // Process the movement command
-    MoveRequest req;
-    std::memcpy(&req, packet->data(), sizeof(MoveRequest));
+  // Path and goto commands share the port too
+  if (is_path_request(packet->data(), packet->size())) {
+    handle_path(*packet);
+    return;
+  }
+  if (is_goto_request(packet->data(), packet->size())) {
+    handle_goto(*packet);
+    return;
+  }
+
+  // Process the movement command
+  MoveRequest req;
+  packet->resize(std::max(packet->size(), sizeof(MoveRequest)), 0);
+  std::memcpy(&req, packet->data(), sizeof(MoveRequest));
+
+  std::cout << "\nReceived movement command: Rover ID = " << req.rover_id
+            << ", Direction = " << req.direction
+            << ", Sequence = " << (req.sequence_num ? "1" : "0") << std::endl;
+
+  // If this is a duplicate, send response but don't execute movement again
+  if (req.sequence_num == m_movement_seq_num) {
+    send_movement_response(req.request_id, true, false);
+    return;
+  }
 
-    std::cout << "\nReceived movement command: Rover ID = " << req.rover_id
-              << ", Direction = " << req.direction
-              << ", Sequence = " << (req.sequence_num ? "1" : "0") << std::endl;
+  // Update sequence number
+  m_movement_seq_num = req.sequence_num;
 
-    // If this is a duplicate, send response but don't execute movement again
-    if (req.sequence_num == m_movement_seq_num) {
-      send_movement_response(true, false);
-      continue;
+  // Update rover's position based on the direction
+  // (or don't if there's a rock)
+  bool moved = step(req.direction);
+
+  // Print terrain on rover-side
+  if (!moved) {
+    std::cout << "Rock detected! Staying in current position\n";
+  }
+  printCurrentTerrain();
+
+  // Send an ACK response
+  send_movement_response(req.request_id, true, moved);
+}
+
+void Rover::handle_path(std::vector<uint8_t> &packet) {
+  PathRequest req;
+  packet.resize(std::max(packet.size(), sizeof(PathRequest)), 0);
+  std::memcpy(&req, packet.data(), sizeof(PathRequest));
+  size_t run_count = std::min<size_t>(req.run_count, MAX_PATH_RUNS);
+
+  std::cout << "\nReceived path command: Rover ID = " << req.rover_id
+            << ", Runs = " << run_count
+            << ", Sequence = " << (req.sequence_num ? "1" : "0") << std::endl;
+
+  PathResponse resp;
+  resp.rover_id = m_id;
+  resp.request_id = req.request_id;
+  resp.sequence_num = req.sequence_num;
+
+  // If this is a duplicate, resend the answer without moving again
+  if (req.sequence_num == m_movement_seq_num) {
+    if (m_last_path) {
+      resp = *m_last_path;
+      resp.request_id = req.request_id;
+    } else {
+      resp.x = m_x;
+      resp.y = m_y;
+      resp.timestamp = util::current_time();
     }
+    m_responses.push(util::struct_to_bytes(resp));
+    return;
+  }
+  m_movement_seq_num = req.sequence_num;
 
-    // Update sequence number
-    m_movement_seq_num = req.sequence_num;
-
-    // Update rover's position based on the direction
-    // (or don't if there's a rock)
-    bool moved = true;
-    auto terrain = m_tgen.getTerrain(m_x, m_y);
-    switch (req.direction) {
-    case DIRECTION::UP:
-      if (terrain[1][2])
-        moved = false;
-      else
-        m_y--;
-      break;
-    case DIRECTION::DOWN:
-      if (terrain[3][2])
-        moved = false;
-      else
-        m_y++;
-      break;
-    case DIRECTION::LEFT:
-      if (terrain[2][1])
-        moved = false;
-      else
-        m_x--;
-      break;
-    case DIRECTION::RIGHT:
-      if (terrain[2][3])
-        moved = false;
-      else
-        m_x++;
+  for (size_t idx = 0; idx < run_count; ++idx) {
+    resp.total_steps += req.runs[idx].count;
+  }
+  resp.steps_taken = follow(req.runs, run_count);
+
+  if (resp.steps_taken < resp.total_steps) {
+    std::cout << "Path stopped after " << resp.steps_taken << " of "
+              << resp.total_steps << " moves\n";
+  }
+  printCurrentTerrain();
+
+  resp.x = m_x;
+  resp.y = m_y;
+  resp.timestamp = util::current_time();
+  m_last_path = resp;
+  m_responses.push(util::struct_to_bytes(resp));
+}
+
+void Rover::handle_goto(std::vector<uint8_t> &packet) {
+  GotoRequest req;
+  packet.resize(std::max(packet.size(), sizeof(GotoRequest)), 0);
+  std::memcpy(&req, packet.data(), sizeof(GotoRequest));
+
+  std::cout << "\nReceived goto command: Rover ID = " << req.rover_id
+            << ", Target = (" << req.x << "," << req.y << ")"
+            << ", Sequence = " << (req.sequence_num ? "1" : "0") << std::endl;
+
+  GotoResponse resp;
+  resp.rover_id = m_id;
+  resp.request_id = req.request_id;
+  resp.sequence_num = req.sequence_num;
+
+  // If this is a duplicate, resend the answer without moving again
+  if (req.sequence_num == m_movement_seq_num) {
+    if (m_last_goto) {
+      resp = *m_last_goto;
+      resp.request_id = req.request_id;
+    } else {
+      resp.x = m_x;
+      resp.y = m_y;
+      resp.timestamp = util::current_time();
+    }
+    m_responses.push(util::struct_to_bytes(resp));
+    return;
+  }
+  m_movement_seq_num = req.sequence_num;
+
+  // Plan over the rover's own terrain
+  size_t budget = req.budget == 0 ? navigation::DEFAULT_SEARCH_BUDGET
+                                  : std::min<size_t>(
+                                        req.budget,
+                                        navigation::MAX_SEARCH_BUDGET);
+  navigation::TileMap map(m_tgen);
+  auto plan = navigation::plan_path(map, m_x, m_y, req.x, req.y, budget);
+  resp.expanded = plan.expanded;
+
+  // Follow as much of the plan as one response can describe
+  auto runs = encode_path_prefix(plan.moves);
+  resp.steps_taken = follow(runs.data(), runs.size());
+
+  // Report the runs actually taken
+  size_t left = resp.steps_taken;
+  for (const PathRun &run : runs) {
+    if (left == 0) {
       break;
     }
+    resp.runs[resp.run_count] = run;
+    resp.runs[resp.run_count].count = std::min<size_t>(run.count, left);
+    left -= resp.runs[resp.run_count++].count;
+  }
+
+  if (m_x == req.x && m_y == req.y) {
+    resp.outcome = GotoOutcome::REACHED;
+  } else if (map.blocked(req.x, req.y) ||
+             (!plan.reached && plan.expanded < budget)) {
+    // The search ran out of tiles before its budget
+    resp.outcome = GotoOutcome::UNREACHABLE;
+  }
+
+  std::cout << "Goto searched " << plan.expanded << " tiles and took "
+            << resp.steps_taken << " moves\n";
+  printCurrentTerrain();
+
+  resp.x = m_x;
+  resp.y = m_y;
+  resp.timestamp = util::current_time();
+  m_last_goto = resp;
+  m_responses.push(util::struct_to_bytes(resp));
+}
 
-    // Print terrain on rover-side
-    if (!moved) {
-      std::cout << "Rock detected! Staying in current position\n";
+uint16_t Rover::follow(const PathRun *runs, size_t run_count) {
+  uint16_t steps = 0;
+  for (size_t idx = 0; idx < run_count; ++idx) {
+    if (runs[idx].direction > DIRECTION::RIGHT) {
+      return steps;
+    }
+    for (uint8_t count = 0; count < runs[idx].count; ++count) {
+      if (!step(static_cast<DIRECTION>(runs[idx].direction))) {
+        return steps;
+      }
+      steps++;
     }
-    printCurrentTerrain();
+  }
+  return steps;
+}
 
-    // Send an ACK response
-    send_movement_response(true, moved);
+bool Rover::step(DIRECTION direction) {
+  int x = m_x, y = m_y;
+  switch (direction) {
+  case DIRECTION::UP:
+    y--;
+    break;
+  case DIRECTION::DOWN:
+    y++;
+    break;
+  case DIRECTION::LEFT:
+    x--;
+    break;
+  case DIRECTION::RIGHT:
+    x++;
+    break;
   }
+  if (m_tgen.isBlocked(x, y)) {
+    return false;
+  }
+  m_x = x;
+  m_y = y;
+  return true;
 }
 
-void Rover::send_movement_response(bool status, bool moved) {
+void Rover::send_movement_response(uint32_t request_id, bool status,
+                                   bool moved) {
   // Construct response
   MoveResponse resp;
   resp.rover_id = m_id;
+  resp.request_id = request_id;
   strncpy(resp.status, status ? ACK : NAK, 3);
   resp.moved = moved;
   resp.sequence_num = m_movement_seq_num;
@@ -221,85 +496,123 @@ void Rover::send_movement_response(bool status, bool moved) {
   resp.y = m_y;
   resp.timestamp = util::current_time();
 
-  // Encode Packet with Reed-Solomon level
-  auto pkt = reed_solomon::encode_packet(resp, RS_LEVELS[m_rscode_level]);
-
-  // Resolve endpoint
-  auto endpoint = udp::endpoint(m_earthbase_addr, PORTS::MOVEMENT_RESP);
-
-  // Send the message
-  send_message(pkt, m_movement_socket, endpoint);
+  // Queue the response, it may share a datagram with others
+  m_responses.push(util::struct_to_bytes(resp));
 }
 
-void Rover::wait_for_discovery_response() {
-  char data[MAX_PACKET_SIZE];
-  udp::endpoint sender_endpoint;
-
-  // While this rover hasn't been discovered yet
-  while (!m_discovered.load()) {
-    if (!m_discovery_socket.is_open()) {
-      std::cerr << "Socket is not open!" << std::endl;
-      return;
-    }
-
-    std::memset(data, 0, MAX_PACKET_SIZE);
+void Rover::handle_discovery_response(const transport::Datagram &datagram) {
+  // Discovery responses come at the level of the request, rejoin responses
+  // at the agreed level
+  auto packet = reed_solomon::decode_packet(
+      std::vector<uint8_t>(datagram.data, datagram.data + datagram.size),
+      RS_LEVELS[m_discovered ? m_rscode_level : PROBE_RS_LEVEL]);
 
-    // Block this thread until a packet is received
-    m_discovery_socket.non_blocking(false);
-
-    // Wait for a packet from the Earth base
-    size_t length = m_discovery_socket.receive_from(
-        asio::buffer(data, MAX_PACKET_SIZE), sender_endpoint);
-
-    std::cout << "Received " << length << " bytes from "
-              << sender_endpoint.address().to_string() << ":"
-              << sender_endpoint.port() << std::endl;
-
-    auto packet = reed_solomon::decode_packet(
-        std::vector<uint8_t>(data, data + length), RS_LEVELS[m_rscode_level]);
+  // Answers to rejoin requests arrive on the same socket
+  if (packet && is_rejoin(packet->data(), packet->size())) {
+    handle_rejoin_response(*packet);
+    return;
+  }
 
-    // Check if this is a valid response with a valid checksum
-    if (packet.has_value()) {
-      // Process discovery response
-      DiscoveryResponse resp;
-      std::memcpy(&resp, packet->data(), sizeof(DiscoveryResponse));
+  // Ignore stragglers once discovered
+  if (m_discovered) {
+    return;
+  }
 
-      std::cout << "Received discovery response with status: " << resp.status
+  std::cout << "Received " << datagram.size << " bytes from "
+            << datagram.sender.address().to_string() << ":"
+            << datagram.sender.port() << std::endl;
+
+  // Check if this is a valid response with a valid checksum
+  if (packet.has_value()) {
+    // Process discovery response
+    DiscoveryResponse resp;
+    packet->resize(std::max(packet->size(), sizeof(DiscoveryResponse)), 0);
+    std::memcpy(&resp, packet->data(), sizeof(DiscoveryResponse));
+
+    std::cout << "Received discovery response with status: "
+              << std::string(resp.status, 3) << std::endl;
+
+    // Check if it's an ACK, which carries the level to use from now on
+    if (strncmp(resp.status, ACK, 3) == 0) {
+      m_id = resp.rover_id;
+      m_rscode_level = std::min(resp.rs_level, PROBE_RS_LEVEL);
+      std::cout << "Using RS level " << static_cast<int>(m_rscode_level)
                 << std::endl;
-
-      // Check if it's an ACK
-      if (strncmp(resp.status, ACK, 3) == 0) {
-        m_id = resp.rover_id;
-        m_discovered.store(true);
-        break;
-      } else {
-        std::cout << "Received NAK response, will increase RS level."
-                  << std::endl;
-
-        // Increase RS level (max 7)
-        m_rscode_level = m_rscode_level != 7 ? m_rscode_level + 1 : 7;
-      }
+      m_discovered = true;
+      on_discovered();
     } else {
-      std::cout << "Received invalid checksum in discovery response, will "
-                   "increase RS level."
-                << std::endl;
-      m_rscode_level = m_rscode_level != 7 ? m_rscode_level + 1 : 7;
+      std::cout << "Received NAK response, will retry." << std::endl;
     }
+  } else {
+    std::cout << "Received invalid checksum in discovery response, will "
+                 "retry."
+              << std::endl;
   }
 }
 
+void Rover::handle_rejoin_response(const std::vector<uint8_t> &packet) {
+  auto resp = util::bytes_to_struct<RejoinResponse>(packet);
+
+  // Stragglers from before a rediscovery, or answers for another ID
+  if (!m_discovered || resp.rover_id != m_id) {
+    return;
+  }
+
+  if (strncmp(resp.status, ACK, 3) == 0) {
+    m_last_contact = std::chrono::steady_clock::now();
+    std::cout << "Rejoined the Earth base as rover " << m_id << std::endl;
+    return;
+  }
+
+  // The Earth base lost track of this rover, start over
+  std::cout << "Earth base does not know this rover, discovering again..."
+            << std::endl;
+  m_discovered = false;
+  asio::co_spawn(m_io_context, discover(), asio::detached);
+}
+
 void Rover::printCurrentTerrain() {
   std::cout << "\nCoordinates: (" << m_x << ", " << m_y << ")\n";
   m_tgen.printTerrain(m_x, m_y);
 }
 
-void Rover::monitor_health() {
-  udp::endpoint earth_endpoint(
-      m_earthbase_addr,
-      PORTS::STATUS); // Earth listening for unsolicited alerts
+void Rover::handle_status_request(const transport::Datagram &datagram) {
+  auto packet = reed_solomon::decode_packet(
+      std::vector<uint8_t>(datagram.data, datagram.data + datagram.size),
+      RS_LEVELS[m_rscode_level]);
+
+  // The Earth base retransmits requests that go unanswered
+  if (!packet) {
+    return;
+  }
+  auto req = util::bytes_to_struct<StatusRequest>(*packet);
+  m_last_contact = std::chrono::steady_clock::now();
 
+  HealthData health = HealthData::get_current_health();
+  StatusResponse resp;
+  resp.rover_id = m_id;
+  resp.request_id = req.request_id;
+  resp.battery_level = health.battery_level;
+  resp.temperature = health.temperature;
+  resp.emergency = health.emergency;
+  resp.error_code = static_cast<uint8_t>(health.error_code);
+  std::strncpy(resp.message, health.message.c_str(), sizeof(resp.message) - 1);
+  resp.timestamp = util::current_time();
+
+  // Responses go to the same port as movement responses
+  m_responses.push(util::struct_to_bytes(resp));
+}
+
+asio::awaitable<void> Rover::monitor_health() {
   while (true) {
-    std::this_thread::sleep_for(std::chrono::seconds(5)); // check every 5s
+    // check every 5s
+    m_health_timer.expires_after(std::chrono::seconds(5));
+    asio::error_code ec;
+    co_await m_health_timer.async_wait(
+        asio::redirect_error(asio::use_awaitable, ec));
+    if (ec) {
+      co_return;
+    }
 
     HealthData health = HealthData::get_current_health();
     if (health.emergency) {
@@ -309,15 +622,55 @@ void Rover::monitor_health() {
       resp.battery_level = health.battery_level;
       resp.temperature = health.temperature;
       resp.emergency = true;
+      resp.error_code = static_cast<uint8_t>(health.error_code);
       std::strncpy(resp.message, health.message.c_str(),
                    sizeof(resp.message) - 1);
       resp.timestamp = util::current_time();
 
-      auto pkt = reed_solomon::encode_packet(resp, RS_LEVELS[m_rscode_level]);
-      send_message(pkt, m_status_socket, earth_endpoint);
+      // Alerts go out straight away, taking any queued responses with them
+      m_responses.push(util::struct_to_bytes(resp), true);
 
       std::cout << "🚨 Sent emergency alert to Earth: " << health.message
                 << "\n";
     }
   }
 }
+
+void Rover::stop() {
+  if (m_stopping) {
+    return;
+  }
+  m_stopping = true;
+  std::cout << "Rover shutting down..." << std::endl;
+
+  // Ends discovery, health monitoring and the watch on the Earth base
+  m_discovery_timer.cancel();
+  m_health_timer.cancel();
+  m_rejoin_timer.cancel();
+
+  // The Earth base gives up on transfers that stop answering
+  for (auto &[transfer_id, sender] : m_transfers) {
+    sender->cancel();
+  }
+  m_transfers.clear();
+
+  // Only the movement transport has anything left to send
+  m_discovery_io->close();
+  m_status_io->close();
+  m_responses.flush();
+  asio::co_spawn(m_io_context, shut_down(), asio::detached);
+}
+
+asio::awaitable<void> Rover::shut_down() {
+  // The scheduler cuts the grace period short once everything has been sent.
+  // Its handler is dropped before the timer goes, whichever comes first.
+  asio::steady_timer timer(m_io_context, SHUTDOWN_GRACE);
+  m_scheduler.async_wait_drained([&timer]() { timer.cancel(); });
+
+  asio::error_code ec;
+  co_await timer.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+  m_scheduler.async_wait_drained(nullptr);
+
+  m_movement_io->close();
+  std::cout << "Rover stopped." << std::endl;
+}
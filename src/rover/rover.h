@@ -2,53 +2,136 @@
 #include "health/health.h"
 #include "protocols.h"
 #include "terrain_gen/terrain_gen.h"
+#include "transport/bulk.h"
+#include "transport/coalescer.h"
+#include "transport/scheduler.h"
+#include "transport/transport.h"
 
 #include <asio.hpp>
+#include <memory>
+#include <unordered_map>
 
 // This should be the same among all rover instances
 constexpr double rock_chance = 0.2;
 constexpr int seed = 8675309;
 
+// Longest a stopping rover waits for its queued datagrams to go out
+constexpr std::chrono::milliseconds SHUTDOWN_GRACE{MAX_TIMEOUT_MS};
+
 using asio::ip::udp;
 
 /// @brief Abstraction of Simulated Moon Rover
 class Rover {
 private:
   // Sends a message to the Earth Base, includes error-handling
-  void send_message(const std::vector<uint8_t> &message, udp::socket &socket,
+  void send_message(const std::vector<uint8_t> &message,
+                    transport::Transport &transport,
                     const udp::endpoint &endpoint);
 
-  // Blocks main thread until Earth base ACKs discovery
-  void wait_for_discovery_response();
+  // Sends a discovery request, and again every MAX_TIMEOUT_MS until the Earth
+  // base ACKs it
+  asio::awaitable<void> discover();
+
+  // Handles a discovery response from the Earth base
+  void handle_discovery_response(const transport::Datagram &datagram);
+
+  // Handles the Earth base's answer to a rejoin request
+  void handle_rejoin_response(const std::vector<uint8_t> &packet);
+
+  // Called when discovery completes. Starts the other interactions the first
+  // time.
+  void on_discovered();
+
+  // Rejoins the Earth base whenever it has been silent for REJOIN_TIMEOUT,
+  // resending every MAX_TIMEOUT_MS until it answers
+  asio::awaitable<void> watch_earth();
+
+  // Handles a movement command from earth base, then preforms movement
+  void handle_movement(const transport::Datagram &datagram);
+
+  // Sends a reply to the movement command with the given request ID
+  void send_movement_response(uint32_t request_id, bool status, bool moved);
+
+  // Runs a path command, stopping at the first blocked move, and replies once
+  void handle_path(std::vector<uint8_t> &packet);
+
+  // Plans a path to a goto's target and follows it, replying once
+  void handle_goto(std::vector<uint8_t> &packet);
+
+  // Follows runs of moves until one is blocked. Returns the moves made.
+  uint16_t follow(const PathRun *runs, size_t run_count);
+
+  // Moves one tile in the given direction unless a rock is in the way.
+  // Returns whether the rover moved.
+  bool step(DIRECTION direction);
+
+  // Handles a bulk transfer message from the Earth base
+  void handle_bulk(const std::vector<uint8_t> &message);
+
+  // Builds the content asked for by a bulk transfer
+  std::optional<std::vector<uint8_t>> bulk_content(BulkContent content);
+
+  // Builds a map of the terrain around the rover
+  std::vector<uint8_t> terrain_map();
 
-  // Waits for movement command from earth base, then preforms movement
-  void wait_for_movement();
+  // Answers a status request from the Earth base with the current health
+  void handle_status_request(const transport::Datagram &datagram);
 
-  // Sends a reply to the movement
-  void send_movement_response(bool status, bool moved);
+  // Monitors health stats, alerting the Earth base of emergencies
+  asio::awaitable<void> monitor_health();
 
-  // Waits for terrain command from earth base, then sends back terrain
-  void wait_for_terrain();
+  // Closes the transports once everything queued for the Earth base has been
+  // sent, or SHUTDOWN_GRACE has passed
+  asio::awaitable<void> shut_down();
 
-  // Monitor Health Stats
-  void monitor_health();
+  // Context the transports deliver their datagrams on
+  asio::io_context &m_io_context;
 
-  // sockets used for different interactions
-  udp::socket m_discovery_socket, m_movement_socket, m_terrain_socket,
-      m_status_socket;
+  // transports used for different interactions
+  std::unique_ptr<transport::Transport> m_discovery_io, m_movement_io,
+      m_status_io;
+
+  // Orders what is sent from the movement transport, so alerts overtake
+  // responses while the link is busy
+  transport::SendScheduler m_scheduler;
+
+  // Packs responses and alerts for the Earth base into shared datagrams,
+  // sent through the scheduler
+  transport::Coalescer m_responses;
+
+  // Bulk transfers to the Earth base in progress, by transfer ID
+  std::unordered_map<uint32_t, std::unique_ptr<transport::BulkSender>>
+      m_transfers;
+
+  // Resends discovery requests until the Earth base answers
+  asio::steady_timer m_discovery_timer;
+
+  // Paces the health checks
+  asio::steady_timer m_health_timer;
+
+  // Paces the checks for silence from the Earth base, and rejoin requests
+  asio::steady_timer m_rejoin_timer;
 
   // Discovered by earth base
-  std::atomic<bool> m_discovered = false;
+  bool m_discovered = false;
+
+  // Whether stop has been called
+  bool m_stopping = false;
+
+  // Whether the interactions that follow discovery have been started
+  bool m_services_started = false;
+
+  // When a request or answer was last received from the Earth base
+  std::chrono::steady_clock::time_point m_last_contact;
 
   // address of earth base
   asio::ip::address m_earthbase_addr;
 
   // Reed-Solomon error correction level
-  // Atomic to allow for thread-safe updates during negotiation
-  std::atomic<uint8_t> m_rscode_level;
+  uint8_t m_rscode_level = 0;
 
   // ID for this rover instance given by earth base
-  uint8_t m_id;
+  uint32_t m_id;
 
   // Local position of rover on terrain
   int m_x, m_y;
@@ -56,21 +139,37 @@ private:
   // Sequence number for movement command
   bool m_movement_seq_num;
 
-  // Instance of Terrain Generation class
-  TerrainGenerator m_tgen = TerrainGenerator(rock_chance, seed);
+  // Answer to the last path command, resent if the command is repeated
+  std::optional<PathResponse> m_last_path;
+  std::optional<GotoResponse> m_last_goto;
 
-  // Threads for Rover/Base interaction
-  std::thread discovery_thread, movement_thread, terrain_thread, health_thread;
+  // Instance of Terrain Generation class
+  TerrainGenerator m_tgen;
 
 public:
   /// @brief Default constructor for Rover Class
   /// @param io_context Socket context for the rover
   /// @param server_ip IP address of the Earth Base
-  Rover(asio::io_context &io_context, const std::string &server_ip);
-
-  /// @brief Starts the rover's network interactions
+  /// @param backend I/O backend used for the rover's sockets
+  /// @param scheduler Weights and rate limits of what the rover sends
+  /// @param movement_port Port commands are taken on, 0 for any free one so
+  /// several rovers can share a host
+  /// @param terrain How the terrain is generated, the same for every rover
+  Rover(asio::io_context &io_context, const std::string &server_ip,
+        transport::Backend backend = transport::Backend::ASIO,
+        const transport::SchedulerOptions &scheduler = {},
+        unsigned short movement_port = PORTS::MOVEMENT_CMD,
+        TerrainAlgorithm terrain = TerrainAlgorithm::HASHED);
+
+  /// @brief Starts the rover's network interactions. Discovery and commands
+  /// are handled by whichever thread runs the io_context.
   void start();
 
+  /// @brief Stops the rover. Commands are no longer taken, transfers are
+  /// abandoned, and the transports close once what is queued has been sent,
+  /// after which the io_context runs out of work.
+  void stop();
+
   /// @brief Calls the TerrainGenerator to print the current terrain
   void printCurrentTerrain();
 };
\ No newline at end of file
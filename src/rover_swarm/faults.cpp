@@ -0,0 +1,41 @@
+#include "faults.h"
+
+#include <algorithm>
+
+namespace swarm {
+
+FaultInjector::FaultInjector(double loss, double corrupt,
+                             unsigned corrupt_bytes)
+    : m_loss(std::min(loss, 1.0)), m_corrupt(std::min(corrupt, 1.0)),
+      m_corrupt_bytes(corrupt_bytes) {}
+
+bool FaultInjector::drop(std::mt19937 &rng) const {
+  if (m_loss <= 0) {
+    return false;
+  }
+
+  std::bernoulli_distribution drop(m_loss);
+  return drop(rng);
+}
+
+bool FaultInjector::corrupt(std::vector<uint8_t> &datagram,
+                            std::mt19937 &rng) const {
+  if (m_corrupt <= 0 || datagram.empty()) {
+    return false;
+  }
+
+  std::bernoulli_distribution corrupt(m_corrupt);
+  if (!corrupt(rng)) {
+    return false;
+  }
+
+  // Flip random bits in a few random bytes
+  std::uniform_int_distribution<size_t> position(0, datagram.size() - 1);
+  std::uniform_int_distribution<int> bits(1, 255);
+  for (unsigned i = 0; i < m_corrupt_bytes; ++i) {
+    datagram[position(rng)] ^= static_cast<uint8_t>(bits(rng));
+  }
+  return true;
+}
+
+} // namespace swarm
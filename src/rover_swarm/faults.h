@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace swarm {
+
+/// @brief Decides which datagrams are lost or corrupted on their way between
+/// the swarm and the Earth base. Draws nothing from the generator for a
+/// chance of 0, so runs without injection are unaffected by it.
+class FaultInjector {
+private:
+  double m_loss;
+  double m_corrupt;
+  unsigned m_corrupt_bytes;
+
+public:
+  /// @brief Constructor for FaultInjector
+  /// @param loss Chance of dropping each datagram, 0-1
+  /// @param corrupt Chance of corrupting each datagram, 0-1
+  /// @param corrupt_bytes Bytes flipped in a corrupted datagram
+  FaultInjector(double loss, double corrupt, unsigned corrupt_bytes);
+
+  /// @brief Decides whether to drop a datagram
+  /// @param rng Generator to draw from
+  bool drop(std::mt19937 &rng) const;
+
+  /// @brief Flips random bits in a few random bytes, if chosen to
+  /// @param datagram Datagram to corrupt. Empty datagrams are left alone.
+  /// @param rng Generator to draw from
+  /// @return whether the datagram was corrupted
+  bool corrupt(std::vector<uint8_t> &datagram, std::mt19937 &rng) const;
+};
+
+} // namespace swarm
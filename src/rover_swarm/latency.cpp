@@ -0,0 +1,22 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace swarm {
+
+double LatencyRecorder::percentile(double percentile) const {
+  if (m_samples.empty()) {
+    return 0;
+  }
+
+  // Nearest rank on a sorted copy, so recording stays cheap
+  std::vector<double> sorted = m_samples;
+  size_t rank = static_cast<size_t>(
+      std::ceil(percentile / 100.0 * static_cast<double>(sorted.size())));
+  rank = std::clamp<size_t>(rank, 1, sorted.size()) - 1;
+  std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+  return sorted[rank];
+}
+
+} // namespace swarm
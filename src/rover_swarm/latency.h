@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace swarm {
+
+/// @brief Collects latency samples and reports percentiles
+class LatencyRecorder {
+private:
+  std::vector<double> m_samples;
+
+public:
+  /// @brief Records one sample
+  void add(double sample) { m_samples.push_back(sample); }
+
+  /// @brief Number of samples recorded
+  size_t count() const { return m_samples.size(); }
+
+  /// @brief Gets the given percentile of the recorded samples
+  /// @param percentile value between 0 and 100
+  /// @return the sample at that percentile, or 0 if there are none
+  double percentile(double percentile) const;
+};
+
+} // namespace swarm
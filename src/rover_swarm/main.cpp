@@ -0,0 +1,114 @@
+#include "swarm.h"
+
+#include <asio.hpp>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Prints the command line options
+static void print_usage(const char *program) {
+  std::cout
+      << "Usage: " << program << " [options]\n"
+      << "  --earth=IP           address of the Earth base (127.0.0.1)\n"
+      << "  --rovers=N           number of simulated rovers (1000)\n"
+      << "  --loss=P             chance of dropping a datagram, 0-1 (0)\n"
+      << "  --corrupt=P          chance of corrupting a datagram, 0-1 (0)\n"
+      << "  --corrupt-bytes=N    bytes flipped per corrupted datagram (4)\n"
+      << "  --ramp-ms=MS         window discovery is spread over (1000)\n"
+      << "  --duration=S         seconds to run for, 0 runs until killed (0)\n"
+      << "  --report=S           seconds between reports, 0 disables (5)\n"
+      << "  --seed=N             seed for loss, corruption and ramp\n"
+      << "  --transport=BACKEND  asio, uring or shm (asio)\n"
+      << "  --terrain=ALGORITHM  hashed or legacy, as rovers use (hashed)\n";
+}
+
+int main(int argc, char *argv[]) {
+  swarm::SwarmOptions options;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto equals = arg.find('=');
+    std::string name = arg.substr(0, equals);
+    std::string value =
+        equals == std::string::npos ? "" : arg.substr(equals + 1);
+
+    try {
+      if (name == "--earth") {
+        options.earth_ip = value;
+      } else if (name == "--rovers") {
+        options.rovers = std::stoul(value);
+      } else if (name == "--loss") {
+        options.loss = std::stod(value);
+      } else if (name == "--corrupt") {
+        options.corrupt = std::stod(value);
+      } else if (name == "--corrupt-bytes") {
+        options.corrupt_bytes = std::stoul(value);
+      } else if (name == "--ramp-ms") {
+        options.ramp_ms = std::stoul(value);
+      } else if (name == "--duration") {
+        options.duration_s = std::stoul(value);
+      } else if (name == "--report") {
+        options.report_s = std::stoul(value);
+      } else if (name == "--seed") {
+        options.seed = std::stoul(value);
+      } else if (name == "--transport") {
+        auto parsed = transport::parse_backend(value);
+        if (!parsed) {
+          throw std::invalid_argument(value);
+        }
+        options.backend = *parsed;
+      } else if (name == "--terrain") {
+        auto parsed = parseTerrainAlgorithm(value);
+        if (!parsed) {
+          throw std::invalid_argument(value);
+        }
+        options.terrain = *parsed;
+      } else {
+        print_usage(argv[0]);
+        return name == "--help" ? 0 : 1;
+      }
+    } catch (const std::exception &) {
+      std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+      return 1;
+    }
+  }
+
+#ifndef _WIN32
+  // Every rover holds two sockets, so allow as many descriptors as the
+  // system will give us
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+#endif
+
+  try {
+    asio::io_context io_context;
+
+    std::cout << "Starting " << options.rovers << " simulated rovers against "
+              << options.earth_ip << "..." << std::endl;
+    swarm::Swarm swarm(io_context, options);
+
+    // Print the final report on Ctrl+C as well as at the end of the run
+    asio::signal_set signals(io_context, SIGINT, SIGTERM);
+    signals.async_wait([&](const asio::error_code &ec, int) {
+      if (!ec) {
+        swarm.report(true);
+        io_context.stop();
+      }
+    });
+
+    swarm.start();
+    io_context.run();
+  } catch (const std::exception &e) {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
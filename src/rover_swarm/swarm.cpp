@@ -0,0 +1,668 @@
+#include "swarm.h"
+#include "error_correction/error_correction.h"
+#include "navigation/navigation.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace swarm {
+
+// This should be the same as the rovers' terrain
+constexpr double rock_chance = 0.2;
+constexpr int terrain_seed = 8675309;
+
+SimRover::SimRover(Swarm &swarm)
+    : m_swarm(swarm),
+      m_command_io(transport::make_transport(swarm.m_options.backend,
+                                             swarm.m_io_context,
+                                             udp::endpoint(udp::v4(), 0))),
+      m_status_io(transport::make_transport(swarm.m_options.backend,
+                                            swarm.m_io_context,
+                                            udp::endpoint(udp::v4(), 0))),
+      m_responses(swarm.m_io_context,
+                  [this](std::vector<uint8_t> payload, bool) {
+                    m_swarm.m_stats.response_packets++;
+                    m_swarm.send(*m_command_io, m_swarm.m_response_endpoint,
+                                 reed_solomon::encode_bytes(
+                                     payload, RS_LEVELS[m_rscode_level]));
+                  }),
+      m_discovery_timer(swarm.m_io_context),
+      m_rejoin_timer(swarm.m_io_context) {}
+
+void SimRover::start(std::chrono::milliseconds delay) {
+  m_command_io->async_receive(
+      [this](std::span<const transport::Datagram> batch) {
+        for (const auto &datagram : batch) {
+          handle_command(datagram);
+        }
+      });
+
+  m_status_io->async_receive(
+      [this](std::span<const transport::Datagram> batch) {
+        for (const auto &datagram : batch) {
+          handle_status(datagram);
+        }
+      });
+
+  m_discovery_timer.expires_after(delay);
+  m_discovery_timer.async_wait([this](const asio::error_code &ec) {
+    if (!ec) {
+      m_discovery_start = Clock::now();
+      send_discovery_request();
+    }
+  });
+
+  watch_earth();
+}
+
+void SimRover::send_discovery_request() {
+  if (m_discovered) {
+    return;
+  }
+
+  // Tell the Earth base where to send commands, as these are not the
+  // well-known ports
+  DiscoveryRequest d_req = {};
+  d_req.timestamp = util::current_time();
+  d_req.movement_port = m_command_io->local_endpoint().port();
+  d_req.status_port = m_status_io->local_endpoint().port();
+
+  m_swarm.m_stats.discovery_sent++;
+  m_swarm.send(*m_command_io, m_swarm.m_discovery_endpoint,
+               reed_solomon::encode_packet(d_req, RS_LEVELS[PROBE_RS_LEVEL]));
+
+  // Try again if there is no answer in time
+  m_discovery_timer.expires_after(std::chrono::milliseconds(MAX_TIMEOUT_MS));
+  m_discovery_timer.async_wait([this](const asio::error_code &ec) {
+    if (!ec) {
+      send_discovery_request();
+    }
+  });
+}
+
+void SimRover::watch_earth() {
+  auto deadline = m_last_contact + REJOIN_TIMEOUT;
+
+  if (!m_discovered) {
+    m_rejoin_timer.expires_after(REJOIN_TIMEOUT);
+  } else if (Clock::now() < deadline) {
+    m_rejoining = false;
+    m_rejoin_timer.expires_at(deadline);
+  } else {
+    send_rejoin_request();
+    m_rejoin_timer.expires_after(std::chrono::milliseconds(MAX_TIMEOUT_MS));
+  }
+
+  m_rejoin_timer.async_wait([this](const asio::error_code &ec) {
+    if (!ec) {
+      watch_earth();
+    }
+  });
+}
+
+void SimRover::send_rejoin_request() {
+  if (!m_rejoining) {
+    m_rejoining = true;
+    m_rejoin_start = Clock::now();
+    m_rejoin_attempts = 0;
+  } else if (++m_rejoin_attempts % MAX_RETRIES == 0) {
+    raise_rs_level();
+  }
+
+  RejoinRequest req;
+  req.rover_id = m_id;
+  req.rs_level = m_rscode_level;
+  req.sequence_num = m_movement_seq_num;
+  req.movement_port = m_command_io->local_endpoint().port();
+  req.status_port = m_status_io->local_endpoint().port();
+  req.timestamp = util::current_time();
+
+  m_swarm.m_stats.rejoin_sent++;
+  m_swarm.send(*m_command_io, m_swarm.m_discovery_endpoint,
+               reed_solomon::encode_packet(req, RS_LEVELS[m_rscode_level]));
+}
+
+void SimRover::raise_rs_level() {
+  m_rscode_level = std::min<uint8_t>(m_rscode_level + 1, PROBE_RS_LEVEL);
+}
+
+void SimRover::handle_command(const transport::Datagram &datagram) {
+  auto received = m_swarm.receive(datagram);
+  if (!received) {
+    return;
+  }
+
+  // Discovery and rejoin responses come from the discovery port, commands
+  // from the movement port. Discovery responses are sent at the level of the
+  // request.
+  const bool is_discovery = datagram.sender.port() == PORTS::DISCOVERY;
+  const uint8_t level =
+      is_discovery && !m_discovered ? PROBE_RS_LEVEL : m_rscode_level;
+  auto packet = reed_solomon::decode_packet(*received, RS_LEVELS[level]);
+  if (is_discovery && packet && is_rejoin(packet->data(), packet->size())) {
+    handle_rejoin_response(*packet);
+    return;
+  }
+  if (is_discovery && m_discovered) {
+    return; // Ignore stragglers once discovered
+  }
+
+  // Like Rover, undecodable discovery responses are left for the retry,
+  // and commands that cannot be decoded are NAKed at the current level
+  if (!packet) {
+    m_swarm.m_stats.decode_failures++;
+    auto header = peek_header(received->data(), received->size());
+    if (!is_discovery && (!header || header->request_id != BULK_REQUEST_ID)) {
+      send_movement_response(header ? header->request_id : 0, false, false);
+    }
+    return;
+  }
+
+  auto header = peek_header(packet->data(), packet->size());
+  if (is_discovery) {
+    handle_discovery_response(*packet);
+  } else if (header && header->request_id == BULK_REQUEST_ID) {
+    handle_bulk(*packet);
+  } else if (is_path_request(packet->data(), packet->size())) {
+    handle_path(*packet);
+  } else if (is_goto_request(packet->data(), packet->size())) {
+    handle_goto(*packet);
+  } else {
+    handle_movement(*packet);
+  }
+}
+
+void SimRover::handle_discovery_response(const std::vector<uint8_t> &packet) {
+  auto resp = util::bytes_to_struct<DiscoveryResponse>(packet);
+
+  if (strncmp(resp.status, ACK, 3) != 0) {
+    m_swarm.m_stats.naks++;
+    return;
+  }
+
+  m_id = resp.rover_id;
+  m_rscode_level = std::min(resp.rs_level, PROBE_RS_LEVEL);
+  m_swarm.m_stats.rs_levels[m_rscode_level]++;
+  m_discovered = true;
+  m_discovery_timer.cancel();
+  m_last_contact = Clock::now();
+  m_movement_seq_num = 1; // The Earth base starts the sequence over
+
+  m_swarm.m_stats.discovered++;
+  m_swarm.m_stats.discovery_rtt.add(
+      std::chrono::duration<double, std::milli>(Clock::now() -
+                                                m_discovery_start)
+          .count());
+}
+
+void SimRover::handle_rejoin_response(const std::vector<uint8_t> &packet) {
+  auto resp = util::bytes_to_struct<RejoinResponse>(packet);
+  if (!m_discovered || !m_rejoining || resp.rover_id != m_id) {
+    return; // Straggler, or miscorrected
+  }
+  m_rejoining = false;
+
+  if (strncmp(resp.status, ACK, 3) == 0) {
+    m_last_contact = Clock::now();
+    m_swarm.m_stats.rejoined++;
+    m_swarm.m_stats.rejoin_rtt.add(
+        std::chrono::duration<double, std::milli>(Clock::now() -
+                                                  m_rejoin_start)
+            .count());
+    return;
+  }
+
+  // The Earth base does not know this rover, discover it again
+  m_swarm.m_stats.rejoin_naks++;
+  m_swarm.m_stats.discovered--;
+  m_discovered = false;
+  m_discovery_start = Clock::now();
+  send_discovery_request();
+}
+
+void SimRover::handle_movement(const std::vector<uint8_t> &packet) {
+  auto req = util::bytes_to_struct<MoveRequest>(packet);
+
+  // A command for another rover means the decoder miscorrected the packet
+  if (req.rover_id != m_id) {
+    m_swarm.m_stats.decode_failures++;
+    send_movement_response(req.request_id, false, false);
+    return;
+  }
+  m_last_contact = Clock::now();
+
+  // Both clocks are the same wall clock when run on the Earth base's host.
+  // Low RS levels can let a corrupted timestamp through, and the Earth base
+  // never retries a command for longer than the bound below.
+  uint64_t now = util::current_time();
+  if (req.timestamp <= now &&
+      now - req.timestamp <= uint64_t(MAX_RETRIES) * MAX_TIMEOUT_MS) {
+    m_swarm.m_stats.command_delay.add(static_cast<double>(now - req.timestamp));
+  }
+
+  // If this is a duplicate, send response but don't execute movement again
+  if (req.sequence_num == m_movement_seq_num) {
+    m_swarm.m_stats.duplicate_moves++;
+    send_movement_response(req.request_id, true, false);
+    return;
+  }
+  m_movement_seq_num = req.sequence_num;
+  m_swarm.m_stats.moves++;
+
+  // Move unless there's a rock in the way
+  send_movement_response(req.request_id, true, step(req.direction));
+}
+
+void SimRover::handle_path(const std::vector<uint8_t> &packet) {
+  auto req = util::bytes_to_struct<PathRequest>(packet);
+
+  // A command for another rover means the decoder miscorrected the packet,
+  // and the Earth base retries it
+  if (req.rover_id != m_id) {
+    m_swarm.m_stats.decode_failures++;
+    return;
+  }
+  m_last_contact = Clock::now();
+
+  // Like a movement command, a duplicate is answered without moving again
+  if (req.sequence_num == m_movement_seq_num) {
+    m_swarm.m_stats.duplicate_moves++;
+    m_last_path.rover_id = m_id;
+    m_last_path.request_id = req.request_id;
+    m_last_path.x = m_x;
+    m_last_path.y = m_y;
+    send_response(util::struct_to_bytes(m_last_path));
+    return;
+  }
+  m_movement_seq_num = req.sequence_num;
+  m_swarm.m_stats.moves++;
+
+  PathResponse resp;
+  resp.rover_id = m_id;
+  resp.request_id = req.request_id;
+  resp.sequence_num = m_movement_seq_num;
+
+  size_t run_count = std::min<size_t>(req.run_count, MAX_PATH_RUNS);
+  for (size_t idx = 0; idx < run_count; ++idx) {
+    resp.total_steps += req.runs[idx].count;
+  }
+  resp.steps_taken = follow(req.runs, run_count);
+
+  resp.x = m_x;
+  resp.y = m_y;
+  resp.timestamp = util::current_time();
+  m_last_path = resp;
+  send_response(util::struct_to_bytes(resp));
+}
+
+void SimRover::handle_goto(const std::vector<uint8_t> &packet) {
+  auto req = util::bytes_to_struct<GotoRequest>(packet);
+  if (req.rover_id != m_id) {
+    m_swarm.m_stats.decode_failures++;
+    return;
+  }
+  m_last_contact = Clock::now();
+
+  if (req.sequence_num == m_movement_seq_num) {
+    m_swarm.m_stats.duplicate_moves++;
+    m_last_goto.rover_id = m_id;
+    m_last_goto.request_id = req.request_id;
+    m_last_goto.x = m_x;
+    m_last_goto.y = m_y;
+    send_response(util::struct_to_bytes(m_last_goto));
+    return;
+  }
+  m_movement_seq_num = req.sequence_num;
+  m_swarm.m_stats.moves++;
+
+  GotoResponse resp;
+  resp.rover_id = m_id;
+  resp.request_id = req.request_id;
+  resp.sequence_num = m_movement_seq_num;
+
+  // Like Rover, follows as much of the plan as one response describes
+  size_t budget = req.budget == 0 ? navigation::DEFAULT_SEARCH_BUDGET
+                                  : std::min<size_t>(
+                                        req.budget,
+                                        navigation::MAX_SEARCH_BUDGET);
+  navigation::TileMap map(m_swarm.m_tgen);
+  auto plan = navigation::plan_path(map, m_x, m_y, req.x, req.y, budget);
+  auto runs = encode_path_prefix(plan.moves);
+  resp.expanded = plan.expanded;
+  resp.steps_taken = follow(runs.data(), runs.size());
+  resp.run_count = runs.size();
+  std::copy(runs.begin(), runs.end(), resp.runs);
+
+  if (m_x == req.x && m_y == req.y) {
+    resp.outcome = GotoOutcome::REACHED;
+  } else if (map.blocked(req.x, req.y) ||
+             (!plan.reached && plan.expanded < budget)) {
+    resp.outcome = GotoOutcome::UNREACHABLE;
+  }
+
+  resp.x = m_x;
+  resp.y = m_y;
+  resp.timestamp = util::current_time();
+  m_last_goto = resp;
+  send_response(util::struct_to_bytes(resp));
+}
+
+uint16_t SimRover::follow(const PathRun *runs, size_t run_count) {
+  uint16_t steps = 0;
+  for (size_t idx = 0; idx < run_count; ++idx) {
+    if (runs[idx].direction > DIRECTION::RIGHT) {
+      return steps;
+    }
+    for (uint8_t count = 0; count < runs[idx].count; ++count) {
+      if (!step(static_cast<DIRECTION>(runs[idx].direction))) {
+        return steps;
+      }
+      steps++;
+    }
+  }
+  return steps;
+}
+
+bool SimRover::step(DIRECTION direction) {
+  int dx = 0, dy = 0;
+  switch (direction) {
+  case DIRECTION::UP:
+    dy = -1;
+    break;
+  case DIRECTION::DOWN:
+    dy = 1;
+    break;
+  case DIRECTION::LEFT:
+    dx = -1;
+    break;
+  case DIRECTION::RIGHT:
+    dx = 1;
+    break;
+  }
+
+  if (m_swarm.m_tgen.isBlocked(m_x + dx, m_y + dy)) {
+    return false;
+  }
+  m_x += dx;
+  m_y += dy;
+  return true;
+}
+
+void SimRover::send_movement_response(uint32_t request_id, bool status,
+                                      bool moved) {
+  MoveResponse resp;
+  resp.rover_id = m_id;
+  resp.request_id = request_id;
+  strncpy(resp.status, status ? ACK : NAK, 3);
+  resp.moved = moved;
+  resp.sequence_num = m_movement_seq_num;
+  resp.x = m_x;
+  resp.y = m_y;
+  resp.timestamp = util::current_time();
+
+  send_response(util::struct_to_bytes(resp));
+}
+
+void SimRover::handle_status(const transport::Datagram &datagram) {
+  auto received = m_swarm.receive(datagram);
+  if (!received) {
+    return;
+  }
+
+  // An undecodable request is left for the Earth base to retransmit
+  auto packet =
+      reed_solomon::decode_packet(*received, RS_LEVELS[m_rscode_level]);
+  if (!packet) {
+    m_swarm.m_stats.decode_failures++;
+    return;
+  }
+
+  m_swarm.m_stats.status_requests++;
+  m_last_contact = Clock::now();
+  auto req = util::bytes_to_struct<StatusRequest>(*packet);
+
+  // Simulated rovers are always healthy
+  StatusResponse resp;
+  resp.rover_id = m_id;
+  resp.request_id = req.request_id;
+  resp.battery_level = 100.0f;
+  resp.temperature = 20.0f;
+  resp.emergency = false;
+  std::strncpy(resp.message, "Simulated rover", sizeof(resp.message) - 1);
+  resp.timestamp = util::current_time();
+
+  send_response(util::struct_to_bytes(resp));
+}
+
+void SimRover::handle_bulk(const std::vector<uint8_t> &packet) {
+  auto header = transport::peek_bulk_header(packet);
+  if (!header || header->rover_id != m_id) {
+    return;
+  }
+  auto it = m_transfers.find(header->transfer_id);
+
+  if (header->kind == BulkKind::ACK && it != m_transfers.end()) {
+    it->second->handle_ack(util::bytes_to_struct<BulkAck>(packet));
+  } else if (header->kind == BulkKind::ABORT && it != m_transfers.end()) {
+    it->second->cancel();
+  }
+  if (header->kind != BulkKind::OPEN || it != m_transfers.end()) {
+    return;
+  }
+
+  // Only terrain is simulated, from the terrain shared by the swarm
+  std::vector<uint8_t> content;
+  if (header->content == BulkContent::TERRAIN) {
+    constexpr int size = 2 * TERRAIN_MAP_RADIUS + 1;
+    TerrainMapHeader map{m_x, m_y, size, size};
+    content = util::struct_to_bytes(map);
+    auto tiles = m_swarm.m_tgen
+                     .getRegion(m_x - TERRAIN_MAP_RADIUS,
+                                m_y - TERRAIN_MAP_RADIUS, size, size)
+                     .pack();
+    content.insert(content.end(), tiles.begin(), tiles.end());
+  } else {
+    BulkHeader abort = *header;
+    abort.kind = BulkKind::ABORT;
+    m_swarm.send(*m_command_io, m_swarm.m_response_endpoint,
+                 reed_solomon::encode_packet(abort, RS_LEVELS[m_rscode_level]));
+    return;
+  }
+
+  uint32_t transfer_id = header->transfer_id;
+  auto sender = std::make_unique<transport::BulkSender>(
+      m_swarm.m_io_context, *header, std::move(content),
+      [this](std::vector<uint8_t> segment) {
+        m_swarm.m_stats.bulk_segments++;
+        m_swarm.send(*m_command_io, m_swarm.m_response_endpoint,
+                     reed_solomon::encode_bytes(segment,
+                                                RS_LEVELS[m_rscode_level]));
+      },
+      [this, transfer_id](bool delivered) {
+        auto &stats = m_swarm.m_stats;
+        (delivered ? stats.bulk_delivered : stats.bulk_failed)++;
+        stats.bulk_retransmits += m_transfers.at(transfer_id)->retransmits();
+        asio::post(m_swarm.m_io_context,
+                   [this, transfer_id]() { m_transfers.erase(transfer_id); });
+      });
+  auto &slot = m_transfers[transfer_id];
+  slot = std::move(sender);
+  slot->start();
+}
+
+void SimRover::send_response(std::vector<uint8_t> message) {
+  m_swarm.m_stats.responses++;
+  m_responses.push(std::move(message));
+}
+
+Swarm::Swarm(asio::io_context &io_context, const SwarmOptions &options)
+    : m_io_context(io_context), m_options(options),
+      m_discovery_endpoint(asio::ip::address::from_string(options.earth_ip),
+                           PORTS::DISCOVERY),
+      m_response_endpoint(asio::ip::address::from_string(options.earth_ip),
+                          PORTS::MOVEMENT_RESP),
+      m_rng(options.seed),
+      m_faults(options.loss, options.corrupt, options.corrupt_bytes),
+      m_tgen(rock_chance, terrain_seed, options.terrain),
+      m_report_timer(io_context), m_stop_timer(io_context) {
+  m_rovers.reserve(options.rovers);
+  for (size_t idx = 0; idx < options.rovers; ++idx) {
+    m_rovers.push_back(std::make_unique<SimRover>(*this));
+  }
+}
+
+void Swarm::start() {
+  m_start = Clock::now();
+  m_last_report = m_start;
+
+  // Spread discovery out so the Earth base sees a ramp, not a single burst
+  std::uniform_int_distribution<unsigned> offset(0, m_options.ramp_ms);
+  for (auto &rover : m_rovers) {
+    rover->start(std::chrono::milliseconds(offset(m_rng)));
+  }
+
+  schedule_report();
+
+  if (m_options.duration_s != 0) {
+    m_stop_timer.expires_after(std::chrono::seconds(m_options.duration_s));
+    m_stop_timer.async_wait([this](const asio::error_code &ec) {
+      if (!ec) {
+        report(true);
+        m_io_context.stop();
+      }
+    });
+  }
+}
+
+bool Swarm::should_drop() {
+  if (m_faults.drop(m_rng)) {
+    m_stats.dropped++;
+    return true;
+  }
+  return false;
+}
+
+void Swarm::maybe_corrupt(std::vector<uint8_t> &datagram) {
+  if (m_faults.corrupt(datagram, m_rng)) {
+    m_stats.corrupted++;
+  }
+}
+
+std::optional<std::vector<uint8_t>>
+Swarm::receive(const transport::Datagram &datagram) {
+  if (should_drop()) {
+    return std::nullopt;
+  }
+
+  std::vector<uint8_t> bytes(datagram.data, datagram.data + datagram.size);
+  maybe_corrupt(bytes);
+  return bytes;
+}
+
+void Swarm::send(transport::Transport &transport,
+                 const udp::endpoint &endpoint, std::vector<uint8_t> datagram) {
+  if (should_drop()) {
+    return;
+  }
+  maybe_corrupt(datagram);
+
+  transport.queue_send(endpoint, std::move(datagram));
+
+  // Flush every transport used by this handler once it returns
+  if (m_dirty.empty()) {
+    asio::post(m_io_context, [this]() {
+      auto dirty = std::move(m_dirty);
+      m_dirty.clear();
+      for (auto *pending : dirty) {
+        pending->flush();
+      }
+    });
+  }
+  if (std::find(m_dirty.begin(), m_dirty.end(), &transport) == m_dirty.end()) {
+    m_dirty.push_back(&transport);
+  }
+}
+
+void Swarm::schedule_report() {
+  if (m_options.report_s == 0) {
+    return;
+  }
+
+  m_report_timer.expires_after(std::chrono::seconds(m_options.report_s));
+  m_report_timer.async_wait([this](const asio::error_code &ec) {
+    if (!ec) {
+      report();
+      schedule_report();
+    }
+  });
+}
+
+void Swarm::report(bool final) {
+  auto now = Clock::now();
+  double elapsed = std::chrono::duration<double>(now - m_start).count();
+  double interval = std::chrono::duration<double>(now - m_last_report).count();
+
+  // Movement throughput since the last report, or over the whole run
+  uint64_t moves = m_stats.moves + m_stats.duplicate_moves;
+  double rate = final ? moves / std::max(elapsed, 1e-9)
+                      : (moves - m_moves_at_last_report) /
+                            std::max(interval, 1e-9);
+  m_moves_at_last_report = moves;
+  m_last_report = now;
+
+  const auto &rtt = m_stats.discovery_rtt;
+  const auto &delay = m_stats.command_delay;
+
+  std::cout << std::fixed << std::setprecision(1) << (final ? "\nFinal " : "")
+            << "[" << elapsed << "s] discovered " << m_stats.discovered << "/"
+            << m_rovers.size() << " (" << m_stats.discovery_sent
+            << " requests, " << m_stats.naks << " NAKs)\n"
+            << "  discovery RTT ms: p50 " << rtt.percentile(50) << ", p90 "
+            << rtt.percentile(90) << ", p99 " << rtt.percentile(99)
+            << ", max " << rtt.percentile(100) << "\n"
+            << "  movement: " << m_stats.moves << " executed, "
+            << m_stats.duplicate_moves << " retransmitted, " << rate
+            << " commands/s" << (final ? " overall" : "") << "\n"
+            << "  command delay ms: p50 " << delay.percentile(50) << ", p99 "
+            << delay.percentile(99) << ", max " << delay.percentile(100)
+            << "\n";
+
+  // Levels the Earth base settled on, for the levels in use
+  std::cout << "  RS levels:";
+  for (size_t level = 0; level < m_stats.rs_levels.size(); ++level) {
+    if (m_stats.rs_levels[level] != 0) {
+      std::cout << " " << level << ":" << m_stats.rs_levels[level];
+    }
+  }
+  std::cout << "\n";
+
+  // Only shown once the Earth base has gone quiet on some rover
+  if (m_stats.rejoin_sent != 0) {
+    const auto &rejoin = m_stats.rejoin_rtt;
+    std::cout << "  rejoin: " << m_stats.rejoined << " rejoined ("
+              << m_stats.rejoin_sent << " requests, " << m_stats.rejoin_naks
+              << " NAKs), RTT ms: p50 " << rejoin.percentile(50) << ", p99 "
+              << rejoin.percentile(99) << ", max " << rejoin.percentile(100)
+              << "\n";
+  }
+
+  std::cout << "  responses: " << m_stats.responses << " in "
+            << m_stats.response_packets << " datagrams\n";
+
+  // Only shown once the Earth base has fetched something
+  if (m_stats.bulk_delivered + m_stats.bulk_failed != 0) {
+    std::cout << "  bulk: " << m_stats.bulk_delivered << " delivered, "
+              << m_stats.bulk_failed << " failed, " << m_stats.bulk_segments
+              << " segments sent (" << m_stats.bulk_retransmits
+              << " resent)\n";
+  }
+
+  std::cout << "  status requests: " << m_stats.status_requests
+            << ", undecodable: " << m_stats.decode_failures
+            << ", injected loss: " << m_stats.dropped
+            << ", injected corruption: " << m_stats.corrupted << std::endl;
+}
+
+} // namespace swarm
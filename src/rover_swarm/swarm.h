@@ -0,0 +1,199 @@
+#pragma once
+#include "faults.h"
+#include "latency.h"
+#include "protocols.h"
+#include "terrain_gen/terrain_gen.h"
+#include "transport/bulk.h"
+#include "transport/coalescer.h"
+#include "transport/transport.h"
+
+#include <array>
+#include <asio.hpp>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using asio::ip::udp;
+
+namespace swarm {
+
+using Clock = std::chrono::steady_clock;
+
+/// @brief Settings for a swarm run
+struct SwarmOptions {
+  std::string earth_ip = "127.0.0.1"; // Address of the Earth base
+  size_t rovers = 1000;               // Number of simulated rovers
+  double loss = 0.0;    // Chance of dropping each datagram, in and out
+  double corrupt = 0.0; // Chance of corrupting each datagram, in and out
+  unsigned corrupt_bytes = 4; // Bytes flipped in a corrupted datagram
+  unsigned ramp_ms = 1000;    // Discovery requests are spread over this window
+  unsigned duration_s = 0;    // Stop after this many seconds (0 = never)
+  unsigned report_s = 5;      // Seconds between progress reports
+  uint32_t seed = 8675309;    // Seed for loss, corruption and ramp offsets
+  transport::Backend backend = transport::Backend::ASIO;
+  TerrainAlgorithm terrain = TerrainAlgorithm::HASHED; // As the rovers use
+};
+
+/// @brief Counters kept for the whole swarm
+struct SwarmStats {
+  uint64_t discovery_sent = 0;   // Discovery requests sent (with retries)
+  uint64_t discovered = 0;       // Rovers that received an ACK
+  uint64_t naks = 0;             // NAKs received during discovery
+  uint64_t decode_failures = 0;  // Datagrams the rovers could not decode
+  uint64_t moves = 0;            // Movement commands executed
+  uint64_t duplicate_moves = 0;  // Retransmitted movement commands
+  uint64_t status_requests = 0;  // Status requests answered
+  uint64_t responses = 0;        // Responses sent, including NAKs
+  uint64_t response_packets = 0; // Datagrams the responses were packed in
+  uint64_t dropped = 0;          // Datagrams dropped by loss injection
+  uint64_t corrupted = 0;        // Datagrams corrupted by injection
+  uint64_t rejoin_sent = 0;      // Rejoin requests sent (with retries)
+  uint64_t rejoined = 0;         // Rejoins the Earth base ACKed
+  uint64_t rejoin_naks = 0;      // Rejoins NAKed, followed by rediscovery
+  uint64_t bulk_delivered = 0;   // Bulk transfers every segment arrived for
+  uint64_t bulk_failed = 0;      // Bulk transfers given up on
+  uint64_t bulk_segments = 0;    // Bulk segments sent, including resends
+  uint64_t bulk_retransmits = 0; // Bulk segments sent again
+  std::array<uint64_t, RS_LEVELS.size()> rs_levels{}; // Rovers discovered
+                                                      // at each RS level
+  LatencyRecorder discovery_rtt; // Discovery round trip in ms, from the first
+                                 // attempt to the ACK
+  LatencyRecorder rejoin_rtt;    // Rejoin round trip in ms, from the first
+                                 // attempt to the ACK
+  LatencyRecorder command_delay; // Movement request timestamp to arrival, ms
+};
+
+class Swarm;
+
+/// @brief A simulated rover. It speaks the same protocol as Rover, but on
+/// ephemeral ports and without any threads of its own, so thousands can share
+/// one io_context.
+class SimRover {
+private:
+  Swarm &m_swarm;
+
+  // Discovery and movement share a socket, status requests get their own
+  std::unique_ptr<transport::Transport> m_command_io, m_status_io;
+
+  // Like Rover, packs every response into shared datagrams sent from the
+  // command socket
+  transport::Coalescer m_responses;
+
+  // Bulk transfers to the Earth base in progress, by transfer ID
+  std::unordered_map<uint32_t, std::unique_ptr<transport::BulkSender>>
+      m_transfers;
+
+  // Resends discovery requests until the Earth base answers
+  asio::steady_timer m_discovery_timer;
+  Clock::time_point m_discovery_start;
+
+  // Like Rover, rejoins once the Earth base has been silent for
+  // REJOIN_TIMEOUT
+  asio::steady_timer m_rejoin_timer;
+  Clock::time_point m_last_contact, m_rejoin_start;
+  bool m_rejoining = false;
+  unsigned m_rejoin_attempts = 0;
+
+  bool m_discovered = false;
+  uint32_t m_id = 0;
+  uint8_t m_rscode_level = 0;
+  bool m_movement_seq_num = 1;
+  int m_x = 0, m_y = 0;
+  PathResponse m_last_path; // Resent if a path command is repeated
+  GotoResponse m_last_goto; // Resent if a goto command is repeated
+
+  void send_discovery_request();
+  void handle_command(const transport::Datagram &datagram);
+  void handle_discovery_response(const std::vector<uint8_t> &packet);
+  void watch_earth();
+  void send_rejoin_request();
+  void handle_rejoin_response(const std::vector<uint8_t> &packet);
+  void handle_movement(const std::vector<uint8_t> &packet);
+  void send_movement_response(uint32_t request_id, bool status, bool moved);
+  void handle_path(const std::vector<uint8_t> &packet);
+  void handle_goto(const std::vector<uint8_t> &packet);
+  uint16_t follow(const PathRun *runs, size_t run_count);
+  bool step(DIRECTION direction);
+  void handle_status(const transport::Datagram &datagram);
+
+  // Like Rover, sends the content asked for over a bulk transfer
+  void handle_bulk(const std::vector<uint8_t> &packet);
+
+  // Queues a response for the Earth base
+  void send_response(std::vector<uint8_t> message);
+
+  // Raises the RS level after rejoin requests went unanswered
+  void raise_rs_level();
+
+public:
+  /// @brief Constructor for SimRover. Binds both sockets straight away.
+  /// @param swarm The swarm the rover belongs to
+  SimRover(Swarm &swarm);
+
+  /// @brief Starts discovery after the given delay
+  void start(std::chrono::milliseconds delay);
+};
+
+/// @brief Runs many simulated rovers against one Earth base and reports what
+/// it observes of the Earth base's throughput and latency
+class Swarm {
+private:
+  friend class SimRover;
+
+  asio::io_context &m_io_context;
+  SwarmOptions m_options;
+  udp::endpoint m_discovery_endpoint, m_response_endpoint;
+
+  std::vector<std::unique_ptr<SimRover>> m_rovers;
+  std::mt19937 m_rng;
+  FaultInjector m_faults;
+  SwarmStats m_stats;
+
+  // Shared by every rover, it is deterministic for a given seed
+  TerrainGenerator m_tgen;
+
+  // Transports with datagrams queued since the last flush
+  std::vector<transport::Transport *> m_dirty;
+
+  asio::steady_timer m_report_timer, m_stop_timer;
+  Clock::time_point m_start;
+  uint64_t m_moves_at_last_report = 0;
+  Clock::time_point m_last_report;
+
+  // Decides whether to drop a datagram
+  bool should_drop();
+
+  // Corrupts the datagram if chosen to
+  void maybe_corrupt(std::vector<uint8_t> &datagram);
+
+  // Passes a received datagram through loss and corruption injection
+  // @return the datagram to process, or std::nullopt if it was dropped
+  std::optional<std::vector<uint8_t>>
+  receive(const transport::Datagram &datagram);
+
+  // Queues a datagram through loss and corruption injection, flushing at the
+  // end of the current handler
+  void send(transport::Transport &transport, const udp::endpoint &endpoint,
+            std::vector<uint8_t> datagram);
+
+  void schedule_report();
+
+public:
+  /// @brief Constructor for Swarm. Creates and binds every simulated rover.
+  /// @param io_context Context every rover runs on
+  /// @param options Settings for the run
+  Swarm(asio::io_context &io_context, const SwarmOptions &options);
+
+  /// @brief Starts discovery for every rover, spread over the ramp window
+  void start();
+
+  /// @brief Prints a report of the run so far
+  /// @param final Whether this is the report for the end of the run
+  void report(bool final = false);
+};
+
+} // namespace swarm
@@ -0,0 +1,202 @@
+#include "columnar_log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace telemetry {
+
+namespace {
+// Creates the log's directory if needed and gets the path of a file in it
+std::string log_file(const std::string &directory, const char *name) {
+  std::filesystem::create_directories(directory);
+  return directory + "/" + name;
+}
+} // namespace
+
+MappedColumn::MappedColumn(const std::string &path, size_t bytes) {
+#ifndef _WIN32
+  m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    throw std::runtime_error("Failed to open " + path + ": " +
+                             std::strerror(errno));
+  }
+
+  // Keep whatever an earlier run left in the file
+  struct stat st;
+  if (::fstat(m_fd, &st) == 0) {
+    bytes = std::max(bytes, static_cast<size_t>(st.st_size));
+  }
+#endif
+
+  if (!resize(bytes)) {
+    unmap();
+    throw std::runtime_error("Failed to map " + path);
+  }
+}
+
+MappedColumn::~MappedColumn() { unmap(); }
+
+void MappedColumn::unmap() {
+#ifndef _WIN32
+  if (m_data) {
+    ::munmap(m_data, m_bytes);
+    m_data = nullptr;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+#endif
+}
+
+bool MappedColumn::resize(size_t bytes) {
+  // Nothing to map until the first row is reserved
+  if (bytes <= m_bytes) {
+    return true;
+  }
+
+#ifdef _WIN32
+  m_buffer.resize(bytes);
+  m_data = m_buffer.data();
+  m_bytes = bytes;
+  return true;
+#else
+  if (::ftruncate(m_fd, static_cast<off_t>(bytes)) != 0) {
+    return false;
+  }
+
+  // Remap the whole file, the kernel keeps the pages already written
+  void *data = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      m_fd, 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  if (m_data) {
+    ::munmap(m_data, m_bytes);
+  }
+  m_data = static_cast<uint8_t *>(data);
+  m_bytes = bytes;
+  return true;
+#endif
+}
+
+ColumnarLog::ColumnarLog(const std::string &directory)
+    : m_header(log_file(directory, "header.col"), sizeof(Header)),
+      m_timestamp(log_file(directory, "timestamp.col"), 0),
+      m_rover_id(log_file(directory, "rover_id.col"), 0),
+      m_battery(log_file(directory, "battery.col"), 0),
+      m_temperature(log_file(directory, "temperature.col"), 0),
+      m_emergency(log_file(directory, "emergency.col"), 0) {
+  Header &hdr = header();
+  if (hdr.magic == 0 && hdr.rows == 0) {
+    hdr.magic = MAGIC; // New log
+  } else if (hdr.magic != MAGIC) {
+    throw std::runtime_error(directory + " is not a telemetry log");
+  }
+
+  // Capacity is what every column can hold, a crash may have left some
+  // columns longer than others
+  m_capacity = std::min({m_timestamp.size() / sizeof(uint64_t),
+                         m_rover_id.size() / sizeof(uint32_t),
+                         m_battery.size() / sizeof(float),
+                         m_temperature.size() / sizeof(float),
+                         m_emergency.size() / sizeof(uint8_t)});
+  if (hdr.rows > m_capacity) {
+    throw std::runtime_error(directory + " is truncated");
+  }
+}
+
+bool ColumnarLog::reserve(size_t rows) {
+  if (rows <= m_capacity) {
+    return true;
+  }
+
+  size_t capacity = (rows + GROWTH_ROWS - 1) / GROWTH_ROWS * GROWTH_ROWS;
+  if (!m_timestamp.resize(capacity * sizeof(uint64_t)) ||
+      !m_rover_id.resize(capacity * sizeof(uint32_t)) ||
+      !m_battery.resize(capacity * sizeof(float)) ||
+      !m_temperature.resize(capacity * sizeof(float)) ||
+      !m_emergency.resize(capacity * sizeof(uint8_t))) {
+    return false;
+  }
+  m_capacity = capacity;
+  return true;
+}
+
+uint64_t ColumnarLog::last_timestamp() const {
+  size_t rows = size();
+  return rows ? m_timestamp.data<uint64_t>()[rows - 1] : 0;
+}
+
+bool ColumnarLog::append(Sample sample) {
+  size_t rows = size();
+  if (!reserve(rows + 1)) {
+    return false;
+  }
+
+  sample.timestamp = std::max(sample.timestamp, last_timestamp());
+
+  m_timestamp.data<uint64_t>()[rows] = sample.timestamp;
+  m_rover_id.data<uint32_t>()[rows] = sample.rover_id;
+  m_battery.data<float>()[rows] = sample.battery;
+  m_temperature.data<float>()[rows] = sample.temperature;
+  m_emergency.data<uint8_t>()[rows] = sample.emergency;
+
+  // Only count the row once every column holds it
+  header().rows = rows + 1;
+  return true;
+}
+
+size_t ColumnarLog::lower_bound(uint64_t timestamp) const {
+  const uint64_t *begin = m_timestamp.data<uint64_t>();
+  return std::lower_bound(begin, begin + size(), timestamp) - begin;
+}
+
+Sample ColumnarLog::row(size_t row) const {
+  return Sample{m_timestamp.data<uint64_t>()[row],
+                m_rover_id.data<uint32_t>()[row],
+                m_battery.data<float>()[row],
+                m_temperature.data<float>()[row],
+                m_emergency.data<uint8_t>()[row]};
+}
+
+std::vector<Sample> ColumnarLog::query(uint64_t from, uint64_t to,
+                                       std::optional<uint32_t> rover_id) const {
+  std::vector<Sample> samples;
+  if (from >= to) {
+    return samples;
+  }
+
+  size_t first = lower_bound(from), last = lower_bound(to);
+
+  // Without a rover filter every row in the range is returned
+  if (!rover_id) {
+    samples.reserve(last - first);
+    for (size_t idx = first; idx < last; ++idx) {
+      samples.push_back(row(idx));
+    }
+    return samples;
+  }
+
+  // Otherwise only the rover ID column is scanned, the rest are read for
+  // matching rows only
+  const uint32_t *ids = m_rover_id.data<uint32_t>();
+  for (size_t idx = first; idx < last; ++idx) {
+    if (ids[idx] == *rover_id) {
+      samples.push_back(row(idx));
+    }
+  }
+  return samples;
+}
+
+} // namespace telemetry
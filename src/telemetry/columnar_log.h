@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace telemetry {
+
+/// @brief One health sample from a rover
+struct Sample {
+  uint64_t timestamp = 0; // ms since epoch when the Earth base received it
+  uint32_t rover_id = 0;  // ID of the rover that sent it
+  float battery = 0;      // Battery level in %
+  float temperature = 0;  // Temperature in C
+  uint8_t emergency = 0;  // Rover's error code, 0 when nominal
+};
+
+/// @brief File backed column of fixed-size values. The file is mapped into
+/// memory and grown in whole chunks, so appends are plain stores.
+class MappedColumn {
+private:
+  int m_fd = -1;
+  uint8_t *m_data = nullptr;
+  size_t m_bytes = 0;
+
+#ifdef _WIN32
+  // No mmap, the column lives on the heap and is not persisted
+  std::vector<uint8_t> m_buffer;
+#endif
+
+  void unmap();
+
+public:
+  /// @brief Opens (creating if needed) the file backing a column
+  /// @param path Path of the column's file
+  /// @param bytes Minimum size to map. Existing files are never shrunk.
+  /// @throws std::runtime_error if the file cannot be opened or mapped
+  MappedColumn(const std::string &path, size_t bytes);
+  ~MappedColumn();
+
+  MappedColumn(const MappedColumn &) = delete;
+  MappedColumn &operator=(const MappedColumn &) = delete;
+
+  /// @brief Grows the file and the mapping. Previously returned pointers are
+  /// invalidated.
+  /// @param bytes New size in bytes
+  /// @return false if the file could not be grown
+  bool resize(size_t bytes);
+
+  /// @brief Size of the mapping in bytes
+  size_t size() const { return m_bytes; }
+
+  /// @brief Mapped contents of the column
+  template <typename T> T *data() { return reinterpret_cast<T *>(m_data); }
+  template <typename T> const T *data() const {
+    return reinterpret_cast<const T *>(m_data);
+  }
+};
+
+/// @brief Append-only store of samples, kept as one memory-mapped file per
+/// field so a query only touches the columns it needs. Rows are appended in
+/// timestamp order, which lets range queries binary search the timestamp
+/// column. Not thread-safe: the caller serializes appends and queries.
+class ColumnarLog {
+public:
+  // Rows the files grow by at a time
+  static constexpr size_t GROWTH_ROWS = 1 << 16;
+
+private:
+  // Row count and format version, kept in its own file so rows are only
+  // counted once every column has been written
+  struct Header {
+    uint64_t magic;
+    uint64_t rows;
+  };
+  static constexpr uint64_t MAGIC = 0x314d454c4554; // "TELEM1"
+
+  MappedColumn m_header;
+  MappedColumn m_timestamp, m_rover_id, m_battery, m_temperature, m_emergency;
+  size_t m_capacity = 0;
+
+  Header &header() { return *m_header.data<Header>(); }
+  const Header &header() const { return *m_header.data<Header>(); }
+
+  // Grows every column to hold at least the given number of rows
+  bool reserve(size_t rows);
+
+  // First row with a timestamp not before the given one
+  size_t lower_bound(uint64_t timestamp) const;
+
+public:
+  /// @brief Opens the log in a directory, creating it if needed. Rows already
+  /// in the directory are kept and appended to.
+  /// @param directory Directory holding the column files
+  /// @throws std::runtime_error if the files cannot be created or are not a
+  /// telemetry log
+  ColumnarLog(const std::string &directory);
+
+  /// @brief Number of rows in the log
+  size_t size() const { return header().rows; }
+
+  /// @brief Timestamp of the newest row, or 0 if the log is empty
+  uint64_t last_timestamp() const;
+
+  /// @brief Appends a row. Samples older than the newest row are stamped with
+  /// its timestamp instead, so the column stays sorted.
+  /// @param sample the sample to append
+  /// @return false if the files could not be grown
+  bool append(Sample sample);
+
+  /// @brief Gets the rows received within a time range
+  /// @param from Start of the range in ms since epoch, inclusive
+  /// @param to End of the range in ms since epoch, exclusive
+  /// @param rover_id Only return rows from this rover if given
+  /// @return the rows, oldest first
+  std::vector<Sample> query(uint64_t from, uint64_t to,
+                            std::optional<uint32_t> rover_id = {}) const;
+
+  /// @brief Reads one row
+  /// @param row Index of the row, must be less than size()
+  Sample row(size_t row) const;
+};
+
+} // namespace telemetry
@@ -0,0 +1,65 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+namespace telemetry {
+
+/// @brief Fixed-size lock-free queue for exactly one producer thread and one
+/// consumer thread. Neither side ever blocks: pushing to a full ring fails and
+/// popping from an empty ring returns nothing.
+/// @tparam T Element type, copied in and out of the ring
+/// @tparam Capacity Number of slots, must be a power of two
+template <typename T, size_t Capacity> class SpscRing {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+
+private:
+  // The indices only ever grow; the slot is the index modulo the capacity.
+  // They live on separate cache lines so the two threads do not contend.
+  alignas(64) std::atomic<size_t> m_head{0}; // Next slot to pop (consumer)
+  alignas(64) std::atomic<size_t> m_tail{0}; // Next slot to push (producer)
+  alignas(64) std::array<T, Capacity> m_slots;
+
+public:
+  /// @brief Adds an element. Must only be called by the producer thread.
+  /// @param value the element to add
+  /// @return false if the ring is full and the element was not added
+  bool try_push(const T &value) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+
+    m_slots[tail & (Capacity - 1)] = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// @brief Removes the oldest element. Must only be called by the consumer
+  /// thread.
+  /// @return the element, or std::nullopt if the ring is empty
+  std::optional<T> try_pop() {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+
+    T value = m_slots[head & (Capacity - 1)];
+    m_head.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+  /// @brief Number of elements in the ring. Exact only when called from one
+  /// of the two threads while the other is idle.
+  size_t size() const {
+    return m_tail.load(std::memory_order_acquire) -
+           m_head.load(std::memory_order_acquire);
+  }
+
+  /// @brief Number of slots in the ring
+  static constexpr size_t capacity() { return Capacity; }
+};
+
+} // namespace telemetry
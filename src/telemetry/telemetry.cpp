@@ -0,0 +1,121 @@
+#include "telemetry.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace telemetry {
+
+bool Producer::record(const Sample &sample) {
+  auto it = m_rings.find(sample.rover_id);
+  if (it == m_rings.end()) {
+    // First sample from this rover on this thread
+    auto ring = new RoverRing{sample.rover_id, {}, nullptr};
+    m_store->add_ring(ring);
+    it = m_rings.emplace(sample.rover_id, ring).first;
+  }
+
+  if (!it->second->ring.try_push(sample)) {
+    m_store->m_dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+TelemetryStore::TelemetryStore(const std::string &directory)
+    : m_log(directory) {
+  m_writer = std::thread([this]() { writer_loop(); });
+}
+
+TelemetryStore::~TelemetryStore() {
+  {
+    std::lock_guard<std::mutex> lock(m_stop_mutex);
+    m_stop = true;
+  }
+  m_stop_cv.notify_one();
+  m_writer.join();
+
+  flush();
+
+  RoverRing *ring = m_rings.load();
+  while (ring) {
+    RoverRing *next = ring->next;
+    delete ring;
+    ring = next;
+  }
+}
+
+void TelemetryStore::add_ring(RoverRing *ring) {
+  ring->next = m_rings.load(std::memory_order_relaxed);
+  while (!m_rings.compare_exchange_weak(ring->next, ring,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+void TelemetryStore::drain() {
+  // Gather everything first, so samples from different rovers are written
+  // in the order they were received
+  std::vector<Sample> batch;
+  for (RoverRing *ring = m_rings.load(std::memory_order_acquire); ring;
+       ring = ring->next) {
+    while (auto sample = ring->ring.try_pop()) {
+      batch.push_back(*sample);
+    }
+  }
+
+  if (batch.empty()) {
+    return;
+  }
+
+  std::stable_sort(batch.begin(), batch.end(),
+                   [](const Sample &a, const Sample &b) {
+                     return a.timestamp < b.timestamp;
+                   });
+
+  for (const Sample &sample : batch) {
+    if (!m_log.append(sample)) {
+      std::cerr << "Failed to grow telemetry log, dropping sample from rover "
+                << sample.rover_id << std::endl;
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    m_latest[sample.rover_id] = sample;
+  }
+}
+
+void TelemetryStore::writer_loop() {
+  std::unique_lock<std::mutex> stop_lock(m_stop_mutex);
+  while (!m_stop_cv.wait_for(stop_lock, DRAIN_INTERVAL,
+                             [this]() { return m_stop; })) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    drain();
+  }
+}
+
+void TelemetryStore::flush() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  drain();
+}
+
+std::vector<Sample>
+TelemetryStore::query(uint64_t from, uint64_t to,
+                      std::optional<uint32_t> rover_id) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_log.query(from, to, rover_id);
+}
+
+std::optional<Sample> TelemetryStore::latest(uint32_t rover_id) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_latest.find(rover_id);
+  if (it == m_latest.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+size_t TelemetryStore::size() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_log.size();
+}
+
+} // namespace telemetry
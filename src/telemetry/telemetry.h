@@ -0,0 +1,124 @@
+#pragma once
+#include "columnar_log.h"
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace telemetry {
+
+/// @brief Samples buffered per rover between a network thread and the writer
+constexpr size_t RING_CAPACITY = 64;
+
+/// @brief Ring carrying one rover's samples from one producer to the writer
+struct RoverRing {
+  uint32_t rover_id;
+  SpscRing<Sample, RING_CAPACITY> ring;
+  RoverRing *next = nullptr; // Next ring in the store's list
+};
+
+class TelemetryStore;
+
+/// @brief Ingest handle for one network thread. Each producer gets its own
+/// ring per rover, so recording never takes a lock and never waits on the
+/// writer. Must only be used on one thread.
+class Producer {
+private:
+  TelemetryStore *m_store;
+
+  // Rings this producer has created, by rover ID
+  std::unordered_map<uint32_t, RoverRing *> m_rings;
+
+public:
+  /// @brief Constructor for Producer
+  /// @param store The store samples are recorded into
+  Producer(TelemetryStore &store) : m_store(&store) {}
+
+  /// @brief Queues a sample for the writer. Never blocks.
+  /// @param sample the sample to record
+  /// @return false if the rover's ring was full and the sample was dropped
+  bool record(const Sample &sample);
+};
+
+/// @brief Earth side store of rover health samples. Network threads record
+/// samples through a Producer into per-rover rings, and a writer thread
+/// drains the rings into a ColumnarLog for history.
+class TelemetryStore {
+private:
+  friend class Producer;
+
+  // Rings are pushed to the front by producers and only freed by the
+  // destructor, so the writer can walk the list without a lock
+  std::atomic<RoverRing *> m_rings{nullptr};
+
+  // Samples dropped because a ring was full or the log could not grow
+  std::atomic<uint64_t> m_dropped{0};
+
+  // Guards the log and the latest samples. Held by the writer while it
+  // drains, and by queries, never by producers.
+  mutable std::mutex m_mutex;
+  ColumnarLog m_log;
+  std::unordered_map<uint32_t, Sample> m_latest;
+
+  std::mutex m_stop_mutex;
+  std::condition_variable m_stop_cv;
+  bool m_stop = false;
+  std::thread m_writer;
+
+  // Adds a ring to the list the writer drains
+  void add_ring(RoverRing *ring);
+
+  // Moves every queued sample into the log. Must hold m_mutex.
+  void drain();
+
+  void writer_loop();
+
+public:
+  /// @brief How often the writer drains the rings
+  static constexpr std::chrono::milliseconds DRAIN_INTERVAL{50};
+
+  /// @brief Constructor for TelemetryStore. Opens the log and starts the
+  /// writer thread.
+  /// @param directory Directory holding the log's files
+  /// @throws std::runtime_error if the log cannot be opened
+  TelemetryStore(const std::string &directory);
+
+  /// @brief Stops the writer after draining whatever is still queued
+  ~TelemetryStore();
+
+  TelemetryStore(const TelemetryStore &) = delete;
+  TelemetryStore &operator=(const TelemetryStore &) = delete;
+
+  /// @brief Writes every queued sample to the log now, rather than waiting
+  /// for the writer
+  void flush();
+
+  /// @brief Gets the samples received within a time range
+  /// @param from Start of the range in ms since epoch, inclusive
+  /// @param to End of the range in ms since epoch, exclusive
+  /// @param rover_id Only return samples from this rover if given
+  /// @return the samples, oldest first
+  std::vector<Sample> query(uint64_t from, uint64_t to,
+                            std::optional<uint32_t> rover_id = {}) const;
+
+  /// @brief Gets the newest sample written for a rover
+  /// @param rover_id ID of the rover
+  /// @return the sample, or std::nullopt if the rover has not reported
+  std::optional<Sample> latest(uint32_t rover_id) const;
+
+  /// @brief Number of samples in the log
+  size_t size() const;
+
+  /// @brief Number of samples dropped since the store was opened
+  uint64_t dropped() const { return m_dropped.load(); }
+};
+
+} // namespace telemetry
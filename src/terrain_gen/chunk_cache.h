@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <utility>
+#include <unordered_map>
+
+/// @brief Chunks kept by a TerrainGenerator unless told otherwise. The view window
+/// needs at most four at a time, the rest let a rover wander back over old ground.
+constexpr size_t DEFAULT_CHUNK_CACHE_CAPACITY = 1024;
+
+/// @brief Generated chunks keyed by their chunk coordinates, evicting the least
+/// recently used one once the capacity is reached
+/// @tparam Chunk type of a chunk's tiles
+template <typename Chunk>
+class ChunkCache
+{
+private:
+    struct Entry
+    {
+        uint64_t key;
+        Chunk chunk;
+    };
+
+    size_t capacity;
+    std::list<Entry> entries; // Most recently used first
+    std::unordered_map<uint64_t, typename std::list<Entry>::iterator> index;
+    size_t hits = 0, misses = 0;
+
+    static uint64_t keyOf(int chunk_x, int chunk_y)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(chunk_x)) << 32) | static_cast<uint32_t>(chunk_y);
+    }
+
+public:
+    /// @brief Constructor for ChunkCache
+    /// @param capacity most chunks to keep, at least 1
+    explicit ChunkCache(size_t capacity) : capacity(std::max<size_t>(capacity, 1))
+    {
+        index.reserve(this->capacity);
+    }
+
+    /// @brief Gets a chunk, generating it on a miss
+    /// @param chunk_x horizontal chunk coordinate
+    /// @param chunk_y vertical chunk coordinate
+    /// @param generate called as generate(chunk_x, chunk_y) if the chunk is not cached
+    /// @return the chunk, valid until the next call
+    template <typename Generate>
+    const Chunk &get(int chunk_x, int chunk_y, Generate &&generate)
+    {
+        uint64_t key = keyOf(chunk_x, chunk_y);
+        auto found = index.find(key);
+        if (found != index.end())
+        {
+            hits++;
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->chunk;
+        }
+
+        // Generate before touching the cache so a throwing generator leaves it
+        // as it was, then reuse the least recently used entry once full
+        misses++;
+        Chunk chunk = generate(chunk_x, chunk_y);
+        if (entries.size() == capacity)
+        {
+            index.erase(entries.back().key);
+            entries.splice(entries.begin(), entries, std::prev(entries.end()));
+            entries.front() = Entry{key, std::move(chunk)};
+        }
+        else
+        {
+            entries.push_front(Entry{key, std::move(chunk)});
+        }
+        index.emplace(key, entries.begin());
+        return entries.front().chunk;
+    }
+
+    /// @brief Whether a chunk is cached, without counting as a use
+    bool contains(int chunk_x, int chunk_y) const { return index.count(keyOf(chunk_x, chunk_y)) != 0; }
+
+    size_t size() const { return entries.size(); }
+    size_t getCapacity() const { return capacity; }
+
+    /// @brief Lookups answered from the cache
+    size_t getHits() const { return hits; }
+
+    /// @brief Lookups that had to generate their chunk
+    size_t getMisses() const { return misses; }
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+/// @brief Generated chunks shared by every generator of one world, safe to use from
+/// many threads at once. Chunks are spread over shards, each behind its own
+/// reader-writer lock, so lookups of different chunks rarely wait on each other and
+/// lookups of chunks already generated only ever share a lock. Each chunk is generated
+/// exactly once, however many threads ask for it at the same time. Chunks are kept
+/// for the life of the store, so the world it holds grows as it is explored.
+/// @tparam Chunk type of a chunk's tiles
+/// @tparam Shards number of shards, a power of two
+template <typename Chunk, size_t Shards = 64>
+class SharedChunkStore
+{
+    static_assert(Shards > 0 && (Shards & (Shards - 1)) == 0);
+
+private:
+    struct Entry
+    {
+        std::once_flag generated;
+        Chunk chunk{};
+    };
+
+    // Each shard on its own cache line, so threads locking neighbours do not contend
+    struct alignas(64) Shard
+    {
+        std::shared_mutex mutex;
+        std::unordered_map<uint64_t, std::unique_ptr<Entry>> entries;
+    };
+
+    std::array<Shard, Shards> shards;
+    std::atomic<size_t> generated{0};
+    std::atomic<uint64_t> world{0};
+
+    static uint64_t keyOf(int chunk_x, int chunk_y)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(chunk_x)) << 32) | static_cast<uint32_t>(chunk_y);
+    }
+
+    // Neighbouring chunks land in different shards
+    Shard &shardOf(uint64_t key) { return shards[((key * 0x9E3779B97F4A7C15) >> 32) & (Shards - 1)]; }
+
+public:
+    SharedChunkStore() = default;
+    SharedChunkStore(const SharedChunkStore &other) = delete;
+
+    /// @brief Ties the store to one world. The first call claims it and later ones
+    /// must name the same world, so generators of different worlds cannot mix chunks.
+    /// @param id nonzero identifier of the world, such as a hash of its seed and settings
+    /// @throws std::invalid_argument if the store already holds another world
+    void attach(uint64_t id)
+    {
+        uint64_t expected = 0;
+        if (!world.compare_exchange_strong(expected, id) && expected != id)
+        {
+            throw std::invalid_argument("terrain store already holds another world");
+        }
+    }
+
+    /// @brief Gets a chunk, generating it if no thread has yet. Threads asking for
+    /// a chunk while it is generated wait for it rather than generate it again.
+    /// @param chunk_x horizontal chunk coordinate
+    /// @param chunk_y vertical chunk coordinate
+    /// @param generate called as generate(chunk_x, chunk_y) at most once per chunk
+    /// @return the chunk, valid for the life of the store
+    template <typename Generate>
+    const Chunk &get(int chunk_x, int chunk_y, Generate &&generate)
+    {
+        uint64_t key = keyOf(chunk_x, chunk_y);
+        Shard &shard = shardOf(key);
+
+        Entry *entry = nullptr;
+        {
+            std::shared_lock lock(shard.mutex);
+            auto found = shard.entries.find(key);
+            if (found != shard.entries.end())
+            {
+                entry = found->second.get();
+            }
+        }
+        if (!entry)
+        {
+            std::unique_lock lock(shard.mutex);
+            auto &slot = shard.entries[key];
+            if (!slot)
+            {
+                slot = std::make_unique<Entry>();
+            }
+            entry = slot.get();
+        }
+
+        // Generated outside the lock, so other chunks of the shard are not held up
+        std::call_once(entry->generated, [&]
+        {
+            entry->chunk = generate(chunk_x, chunk_y);
+            generated.fetch_add(1, std::memory_order_relaxed);
+        });
+        return entry->chunk;
+    }
+
+    /// @brief Number of chunks generated so far
+    size_t getGenerated() const { return generated.load(std::memory_order_relaxed); }
+};
@@ -1,49 +1,548 @@
 #pragma once
-#include <array>
+#include "chunk_cache.h"
+#include "chunk_store.h"
+#include "tiles.h"
 
-/// @brief Determines the side-length of each terrain chunk
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/// @brief Determines the side-length of each terrain chunk the rovers generate
 constexpr int CHUNK_SIZE = 5;
 
-// The code breaks if chunk size isn't an odd number
-static_assert(CHUNK_SIZE % 2 == 1);
+/// @brief Number of tiles the rovers see in each direction around themselves
+constexpr int VIEW_RADIUS = 2;
+
+/// @brief How tiles are decided from the seed
+enum class TerrainAlgorithm
+{
+    HASHED,           // Each tile is a hash of the seed and its coordinates
+    MERSENNE_TWISTER, // Each chunk is drawn from a Mersenne Twister seeded with it, as maps were before
+};
+
+/// @brief Parses a terrain algorithm name ("hashed" or "legacy")
+/// @return the algorithm, or std::nullopt if the name is not known
+std::optional<TerrainAlgorithm> parseTerrainAlgorithm(const std::string &name);
+
+namespace terrain_detail
+{
+// SplitMix64 finalizer. Every input gives a different output, and neighbouring inputs give unrelated ones.
+constexpr uint64_t mix(uint64_t z)
+{
+    z += 0x9E3779B97F4A7C15;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+// Draws the rows of a chunk from a Mersenne Twister seeded with the world seed and the chunk
+void legacyChunkRows(int seed, double rockProbability, int chunk_x, int chunk_y, int size, uint64_t *rows);
+}
 
-/// @brief Generates terrain using a seeded, uniformly random generation technique (Mersenne-Twister)
-class TerrainGenerator
+/// @brief Generates terrain using a seeded, uniformly random generation technique. By default
+/// every tile is a counter-based hash of the seed and its coordinates, so any tile costs the same
+/// handful of multiplications on every platform. The original Mersenne Twister maps can still be
+/// generated for worlds that must stay as they were.
+///
+/// A generator keeps recently used chunks in a cache of its own and is not safe to share
+/// between threads. Generators built on a shared store keep their chunks there instead,
+/// so many rovers of one world generate each chunk once, and each such generator may be
+/// used from any number of threads at once.
+/// @tparam ChunkSize side length of the chunks terrain is generated and cached in, at most 64.
+/// Powers of two find chunks with shifts and masks rather than divisions.
+/// @tparam ViewRadius tiles seen in each direction by getTerrain, at most 31
+template <int ChunkSize, int ViewRadius>
+class BasicTerrainGenerator
 {
+    static_assert(ViewRadius >= 0 && 2 * ViewRadius + 1 <= 64, "a window row must fit in a word");
+
+public:
+    /// @brief Tiles of one chunk, read as chunk[row][column]
+    using Chunk = TileSquare<ChunkSize>;
+
+    /// @brief Tiles around a position, read as window[row][column]
+    using Window = TileSquare<2 * ViewRadius + 1>;
+
+    static constexpr int CHUNK = ChunkSize;
+    static constexpr int RADIUS = ViewRadius;
+    static constexpr int WINDOW = 2 * ViewRadius + 1;
+
+    /// @brief Chunks shared by generators of one world
+    using Store = SharedChunkStore<Chunk>;
+
 private:
+    static constexpr bool POWER_OF_TWO = std::has_single_bit(static_cast<unsigned>(ChunkSize));
+    static constexpr int SHIFT = std::countr_zero(static_cast<unsigned>(ChunkSize));
+
     double rockProbability;
     int seed;
+    TerrainAlgorithm algorithm;
+
+    // For hashed terrain: key mixed from the seed, and the hash values below which a tile is a rock
+    uint64_t hashKey;
+    uint64_t rockThreshold;
+
+    // Chunks recently used by getTerrain and the point queries, unless they are kept in a shared store
+    ChunkCache<Chunk> cache;
+    std::shared_ptr<Store> store;
+
+    // Chunk holding a coordinate, rounding down for negatives
+    static int chunkOf(int coordinate)
+    {
+        if constexpr (POWER_OF_TWO)
+        {
+            return coordinate >> SHIFT;
+        }
+        return (coordinate < 0) ? ((coordinate + 1) / ChunkSize) - 1 : (coordinate / ChunkSize);
+    }
+
+    // Position of a coordinate within its chunk
+    static int localOf(int coordinate)
+    {
+        if constexpr (POWER_OF_TWO)
+        {
+            return coordinate & (ChunkSize - 1);
+        }
+        return coordinate - chunkOf(coordinate) * ChunkSize;
+    }
+
+    // Decides a tile of hashed terrain
+    bool hashedTile(int x, int y) const
+    {
+        uint64_t counter = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+        return (terrain_detail::mix(hashKey ^ counter) >> 11) < rockThreshold;
+    }
 
-    // Internal terrain generation cache variables
-    bool terrain_initialized = false;
-    int prev_chunk_x = 0, prev_chunk_y = 0;
-    std::array<std::array<bool, CHUNK_SIZE>, CHUNK_SIZE>
-        chunk_top_left, chunk_top_middle, chunk_top_right,
-        chunk_middle_left, chunk_middle_middle, chunk_middle_right,
-        chunk_bottom_left, chunk_bottom_middle, chunk_bottom_right = {};
+    // Decides 64 consecutive tiles of a row of hashed terrain, tile x + j in bit j. The threshold
+    // test is a separate loop over independent lanes with no branches, so the compiler can
+    // vectorize it for the target's instruction set; the bits are gathered afterwards.
+    uint64_t hashedWord(int x, int y) const
+    {
+        const uint64_t counter = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+        uint64_t rocks[64];
+        for (int j = 0; j < 64; ++j)
+        {
+            uint64_t lane = counter + (static_cast<uint64_t>(j) << 32);
+            rocks[j] = (terrain_detail::mix(hashKey ^ lane) >> 11) < rockThreshold;
+        }
 
-    // Gets chunk of terrain by chunk coordinates
-    std::array<std::array<bool, CHUNK_SIZE>, CHUNK_SIZE> getChunk(int chunk_x, int chunk_y);
+        uint64_t word = 0;
+        for (int j = 0; j < 64; ++j)
+        {
+            word |= rocks[j] << j;
+        }
+        return word;
+    }
+
+    // Fills rows [first, last) of a region laid out as a TileGrid
+    void fillRegionRows(int x0, int y0, int width, int first, int last, uint64_t *bits) const;
+
+    // Identifies the world for a shared store. Never 0, which stores take as no world.
+    uint64_t worldId() const
+    {
+        uint64_t settings = rockThreshold ^ (static_cast<uint64_t>(algorithm) << 56) ^ (uint64_t{ChunkSize} << 48);
+        return terrain_detail::mix(hashKey ^ terrain_detail::mix(settings)) | 1;
+    }
+
+    // Gets a chunk through the cache or store. A cached chunk is valid until the cache is next used.
+    const Chunk &cachedChunk(int chunk_x, int chunk_y)
+    {
+        auto generate = [this](int x, int y) { return getChunk(x, y); };
+        if (store)
+        {
+            return store->get(chunk_x, chunk_y, generate);
+        }
+        return cache.get(chunk_x, chunk_y, generate);
+    }
 
 public:
     /// @brief Constructor for Terrain Generator
     /// @param rockProbability Percent chance of a rock appearing on the terrain, clamped between 0 and 1
     /// @param seed Seed for terrain generation
-    TerrainGenerator(double rockProbability, int seed);
+    /// @param algorithm How tiles are decided from the seed. Every generator of one world must use the same.
+    /// @param cacheCapacity Most chunks kept for getTerrain, at least 1
+    BasicTerrainGenerator(double rockProbability, int seed, TerrainAlgorithm algorithm = TerrainAlgorithm::HASHED,
+                          size_t cacheCapacity = DEFAULT_CHUNK_CACHE_CAPACITY)
+        : rockProbability(std::clamp(rockProbability, 0.0, 1.0)), seed(seed), algorithm(algorithm),
+          hashKey(terrain_detail::mix(static_cast<uint32_t>(seed))),
+          // Hashes are compared on their top 53 bits, which a double holds exactly, so a probability of 1 is all rocks
+          rockThreshold(static_cast<uint64_t>(std::ldexp(this->rockProbability, 53))), cache(cacheCapacity) {};
+
+    /// @brief Constructor for a Terrain Generator keeping its chunks in a store shared with
+    /// other generators of the same world
+    /// @param rockProbability Percent chance of a rock appearing on the terrain, clamped between 0 and 1
+    /// @param seed Seed for terrain generation
+    /// @param algorithm How tiles are decided from the seed
+    /// @param store Store to keep chunks in. If null, the generator keeps its own cache.
+    /// @throws std::invalid_argument if the store holds a world with another seed or settings
+    BasicTerrainGenerator(double rockProbability, int seed, TerrainAlgorithm algorithm, std::shared_ptr<Store> store)
+        : BasicTerrainGenerator(rockProbability, seed, algorithm, store ? 1 : DEFAULT_CHUNK_CACHE_CAPACITY)
+    {
+        if (store)
+        {
+            store->attach(worldId());
+        }
+        this->store = std::move(store);
+    }
 
     /// @brief getTerrain generates a n by n grid of "terrain" which either has
-    /// a rock (true) or flat ground (false). Subsequent calls to getTerrain
-    /// can take advantage of internal cache variables to avoid constant
-    /// regeneration of terrain.
+    /// a rock (true) or flat ground (false). The chunks it covers are kept in a
+    /// least recently used cache, so moving back and forth or returning to old
+    /// ground does not regenerate them, and any position may follow any other.
     /// @param x horizontal coordinate (positive is right)
     /// @param y vertical coordinate (positive is down)
-    /// @return a square grid of a given random chunk
-    std::array<std::array<bool, CHUNK_SIZE>, CHUNK_SIZE> getTerrain(int x, int y);
+    /// @return a square grid of side 2 * ViewRadius + 1 centred on the coordinates, read as terrain[row][column]
+    Window getTerrain(int x, int y);
 
-    /// @brief prints a CHUNK_SIZE long, square grid of the current terrain. Calls getTerrain()
+    /// @brief getTile decides a single tile without generating its chunk (hashed terrain)
+    /// or by generating it (Mersenne Twister terrain). The cache used by getTerrain is left alone.
+    /// @param x horizontal coordinate (positive is right)
+    /// @param y vertical coordinate (positive is down)
+    /// @return whether the tile has a rock
+    bool getTile(int x, int y) const;
+
+    /// @brief isBlocked checks a single tile without building a window around it.
+    /// Hashed terrain decides the tile on its own; Mersenne Twister terrain reads it
+    /// from the chunk cache, generating the chunk on a miss.
+    /// @param x horizontal coordinate (positive is right)
+    /// @param y vertical coordinate (positive is down)
+    /// @return whether the tile has a rock
+    bool isBlocked(int x, int y);
+
+    /// @brief queryTiles checks many tiles at once, as isBlocked does. Consecutive
+    /// tiles in the same chunk share one cache lookup.
+    /// @param tiles coordinates to check
+    /// @param blocked set to whether each tile has a rock, at least as long as tiles
+    void queryTiles(std::span<const TileCoord> tiles, std::span<bool> blocked);
+
+    /// @brief getChunk generates one chunk of terrain. The chunk holding (0, 0) is
+    /// kept clear for the rovers to start on. The cache used by getTerrain is left alone.
+    /// @param chunk_x horizontal chunk coordinate, covering tiles from chunk_x * ChunkSize
+    /// @param chunk_y vertical chunk coordinate, covering tiles from chunk_y * ChunkSize
+    /// @return the chunk's tiles, read as chunk[row][column]
+    Chunk getChunk(int chunk_x, int chunk_y) const;
+
+    /// @brief getRegion generates a rectangle of terrain, for example to send
+    /// a map of it, on the calling thread. The cache used by getTerrain is left alone.
+    /// @param x0 horizontal coordinate of the top left tile
+    /// @param y0 vertical coordinate of the top left tile
+    /// @param width number of tiles across
+    /// @param height number of tiles down
+    /// @return the tiles, with (0, 0) at (x0, y0)
+    TileGrid getRegion(int x0, int y0, int width, int height) const;
+
+    /// @brief generateRegion generates a rectangle of terrain into a buffer the caller
+    /// provides, sharing bands of rows between worker threads. Hashed terrain is decided 64
+    /// tiles at a time; Mersenne Twister terrain is copied from chunks, each generated by one
+    /// worker. The cache used by getTerrain is left alone.
+    /// @param x0 horizontal coordinate of the top left tile
+    /// @param y0 vertical coordinate of the top left tile
+    /// @param width number of tiles across, negative counts as 0
+    /// @param height number of tiles down, negative counts as 0
+    /// @param bits at least TileGrid::rowWords(width) * height words, overwritten with the tiles
+    /// laid out as TileGrid::data() lays them out
+    /// @param threads most threads to use, including the calling one. 0 uses one per hardware thread.
+    /// @throws std::invalid_argument if the buffer is too small
+    void generateRegion(int x0, int y0, int width, int height, std::span<uint64_t> bits,
+                        unsigned threads = 0) const;
+
+    /// @brief prints the current view window of the terrain. Calls getTerrain()
     /// @param x horizontal coordinate (positive is right)
     /// @param y vertical coordinate (positive is down)
     void printTerrain(int x, int y);
 
-    TerrainGenerator(const TerrainGenerator &other) = delete;
-};
\ No newline at end of file
+    /// @brief The chunks kept for getTerrain, for example to check how often they are reused.
+    /// Unused when the generator has a shared store.
+    const ChunkCache<Chunk> &getCache() const { return cache; }
+
+    /// @brief The store shared with other generators, or null if the generator keeps its own cache
+    const std::shared_ptr<Store> &getStore() const { return store; }
+
+    BasicTerrainGenerator(const BasicTerrainGenerator &other) = delete;
+};
+
+template <int ChunkSize, int ViewRadius>
+bool BasicTerrainGenerator<ChunkSize, ViewRadius>::getTile(int x, int y) const
+{
+    int chunk_x = chunkOf(x), chunk_y = chunkOf(y);
+    if (chunk_x == 0 && chunk_y == 0)
+    {
+        return false;
+    }
+    if (algorithm == TerrainAlgorithm::HASHED)
+    {
+        return hashedTile(x, y);
+    }
+    return getChunk(chunk_x, chunk_y)[localOf(y)][localOf(x)];
+}
+
+template <int ChunkSize, int ViewRadius>
+bool BasicTerrainGenerator<ChunkSize, ViewRadius>::isBlocked(int x, int y)
+{
+    if (algorithm == TerrainAlgorithm::HASHED)
+    {
+        return getTile(x, y);
+    }
+    return cachedChunk(chunkOf(x), chunkOf(y))[localOf(y)][localOf(x)];
+}
+
+template <int ChunkSize, int ViewRadius>
+void BasicTerrainGenerator<ChunkSize, ViewRadius>::queryTiles(std::span<const TileCoord> tiles,
+                                                              std::span<bool> blocked)
+{
+    if (algorithm == TerrainAlgorithm::HASHED)
+    {
+        for (size_t i = 0; i < tiles.size(); ++i)
+        {
+            blocked[i] = getTile(tiles[i].x, tiles[i].y);
+        }
+        return;
+    }
+
+    // The chunk stays valid as nothing else uses the cache until the next lookup
+    const Chunk *chunk = nullptr;
+    int chunk_x = 0, chunk_y = 0;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        auto [x, y] = tiles[i];
+        if (!chunk || chunkOf(x) != chunk_x || chunkOf(y) != chunk_y)
+        {
+            chunk_x = chunkOf(x), chunk_y = chunkOf(y);
+            chunk = &cachedChunk(chunk_x, chunk_y);
+        }
+        blocked[i] = (*chunk)[localOf(y)][localOf(x)];
+    }
+}
+
+template <int ChunkSize, int ViewRadius>
+typename BasicTerrainGenerator<ChunkSize, ViewRadius>::Chunk
+BasicTerrainGenerator<ChunkSize, ViewRadius>::getChunk(int chunk_x, int chunk_y) const
+{
+    Chunk chunk{};
+
+    // Clear out area around spawn
+    if (chunk_x == 0 && chunk_y == 0)
+    {
+        return chunk;
+    }
+
+    if (algorithm == TerrainAlgorithm::HASHED)
+    {
+        // Tiles are independent, so each row is a plain loop over its columns
+        for (int i = 0; i < ChunkSize; ++i)
+        {
+            int y = chunk_y * ChunkSize + i;
+            uint64_t row = 0;
+            for (int j = 0; j < ChunkSize; ++j)
+            {
+                row |= uint64_t{hashedTile(chunk_x * ChunkSize + j, y)} << j;
+            }
+            chunk.setRow(i, row);
+        }
+        return chunk;
+    }
+
+    uint64_t rows[ChunkSize];
+    terrain_detail::legacyChunkRows(seed, rockProbability, chunk_x, chunk_y, ChunkSize, rows);
+    for (int i = 0; i < ChunkSize; ++i)
+    {
+        chunk.setRow(i, rows[i]);
+    }
+    return chunk;
+}
+
+template <int ChunkSize, int ViewRadius>
+typename BasicTerrainGenerator<ChunkSize, ViewRadius>::Window
+BasicTerrainGenerator<ChunkSize, ViewRadius>::getTerrain(int x, int y)
+{
+    Window terrain{};
+    const int left = x - ViewRadius;
+
+    for (int i = 0; i < WINDOW; ++i)
+    {
+        int source_y = y - ViewRadius + i;
+        int chunk_y = chunkOf(source_y), local_y = localOf(source_y);
+
+        // Join the chunk rows the window row spans. Each is read as soon as its
+        // chunk is looked up, as a small cache may evict it on the next lookup.
+        uint64_t row = 0;
+        for (int column = 0; column < WINDOW;)
+        {
+            int local_x = localOf(left + column);
+            uint64_t bits = cachedChunk(chunkOf(left + column), chunk_y).getRow(local_y) >> local_x;
+            row |= bits << column;
+            column += ChunkSize - local_x;
+        }
+        terrain.setRow(i, row);
+    }
+
+    return terrain;
+}
+
+template <int ChunkSize, int ViewRadius>
+TileGrid BasicTerrainGenerator<ChunkSize, ViewRadius>::getRegion(int x0, int y0, int width, int height) const
+{
+    TileGrid region(width, height);
+    generateRegion(x0, y0, region.getWidth(), region.getHeight(), region.data(), 1);
+    return region;
+}
+
+template <int ChunkSize, int ViewRadius>
+void BasicTerrainGenerator<ChunkSize, ViewRadius>::generateRegion(int x0, int y0, int width, int height,
+                                                                  std::span<uint64_t> bits, unsigned threads) const
+{
+    width = std::max(width, 0);
+    height = std::max(height, 0);
+    if (bits.size() < TileGrid::rowWords(width) * height)
+    {
+        throw std::invalid_argument("region buffer is too small");
+    }
+    if (width == 0 || height == 0)
+    {
+        return;
+    }
+
+    // Bands of rows for the workers to take in turn. Mersenne Twister bands are one row of
+    // chunks, so no chunk is generated twice; hashed bands are as tall as suits the workers.
+    const int first_chunk = chunkOf(y0);
+    auto band_start = [&](int band) -> int
+    {
+        if (algorithm == TerrainAlgorithm::HASHED)
+        {
+            return std::min(band * 32, height);
+        }
+        return std::clamp((first_chunk + band) * ChunkSize - y0, 0, height);
+    };
+    const int bands = algorithm == TerrainAlgorithm::HASHED ? (height + 31) / 32 : chunkOf(y0 + height - 1) - first_chunk + 1;
+
+    std::atomic<int> next{0};
+    auto work = [&]
+    {
+        for (int band = next++; band < bands; band = next++)
+        {
+            fillRegionRows(x0, y0, width, band_start(band), band_start(band + 1), bits.data());
+        }
+    };
+
+    unsigned workers = threads != 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+    workers = std::min(workers, static_cast<unsigned>(bands));
+    // Helpers join when they go out of scope, even if the calling thread throws. Should a
+    // thread fail to start, the ones already running share its bands.
+    std::vector<std::jthread> helpers;
+    for (unsigned i = 1; i < workers; ++i)
+    {
+        try
+        {
+            helpers.emplace_back(work);
+        }
+        catch (const std::system_error &)
+        {
+            break;
+        }
+    }
+    work();
+}
+
+template <int ChunkSize, int ViewRadius>
+void BasicTerrainGenerator<ChunkSize, ViewRadius>::fillRegionRows(int x0, int y0, int width, int first, int last,
+                                                                  uint64_t *bits) const
+{
+    const size_t stride = TileGrid::rowWords(width);
+    std::fill(bits + first * stride, bits + last * stride, 0);
+
+    if (algorithm == TerrainAlgorithm::HASHED)
+    {
+        for (int row = first; row < last; ++row)
+        {
+            uint64_t *words = bits + row * stride;
+            for (size_t word = 0; word < stride; ++word)
+            {
+                int column = static_cast<int>(word) * 64;
+                words[word] = hashedWord(x0 + column, y0 + row) & lowBits(width - column);
+            }
+
+            // Clear out area around spawn
+            if (chunkOf(y0 + row) == 0)
+            {
+                for (int column = std::max(-x0, 0); column < std::min(ChunkSize - x0, width); ++column)
+                {
+                    words[column / 64] &= ~(uint64_t{1} << (column % 64));
+                }
+            }
+        }
+        return;
+    }
+
+    // Copy the part of each chunk of the band that lies in the region
+    const int chunk_y = chunkOf(y0 + first);
+    for (int chunk_x = chunkOf(x0); chunk_x <= chunkOf(x0 + width - 1); ++chunk_x)
+    {
+        auto chunk = getChunk(chunk_x, chunk_y);
+
+        // Columns of the chunk inside the region
+        int column = chunk_x * ChunkSize - x0;
+        int skip = std::max(-column, 0);
+        int count = std::min(ChunkSize, width - column) - skip;
+
+        for (int row = first; row < last; ++row)
+        {
+            uint64_t bits_in = chunk.getRow(y0 + row - chunk_y * ChunkSize) >> skip;
+            int x = column + skip;
+            uint64_t *words = bits + row * stride;
+
+            // The tiles may straddle two words of the row
+            bits_in &= lowBits(count);
+            words[x / 64] |= bits_in << (x % 64);
+            if (x % 64 + count > 64)
+            {
+                words[x / 64 + 1] |= bits_in >> (64 - x % 64);
+            }
+        }
+    }
+}
+
+template <int ChunkSize, int ViewRadius>
+void BasicTerrainGenerator<ChunkSize, ViewRadius>::printTerrain(int x, int y)
+{
+    auto terrain = getTerrain(x, y);
+
+    for (int i = 0; i < WINDOW; ++i)
+    {
+        for (int j = 0; j < WINDOW; ++j)
+        {
+            if (i == ViewRadius && j == ViewRadius)
+            {
+                std::cout << "R ";
+            }
+            else
+            {
+                std::cout << (terrain[i][j] ? "#" : ".") << " ";
+            }
+        }
+        std::cout << "\n";
+    }
+    std::cout << "\n";
+}
+
+// The rovers' world is compiled once, in terrain_gen.cpp
+extern template class BasicTerrainGenerator<CHUNK_SIZE, VIEW_RADIUS>;
+
+/// @brief The terrain generator the rovers use
+using TerrainGenerator = BasicTerrainGenerator<CHUNK_SIZE, VIEW_RADIUS>;
+
+/// @brief A chunk of the rovers' terrain, one bit per tile
+using TerrainChunk = TerrainGenerator::Chunk;
+
+/// @brief The window around a rover, one bit per tile
+using TerrainWindow = TerrainGenerator::Window;
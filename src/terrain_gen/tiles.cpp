@@ -0,0 +1,83 @@
+#include "tiles.h"
+
+#include <algorithm>
+
+TileGrid::TileGrid(int width, int height)
+    : width(std::max(width, 0)), height(std::max(height, 0)), stride(rowWords(width)),
+      words(stride * this->height, 0) {}
+
+void TileGrid::set(int x, int y, bool rock)
+{
+    uint64_t &word = words[y * stride + x / 64];
+    uint64_t mask = uint64_t{1} << (x % 64);
+    word = rock ? word | mask : word & ~mask;
+}
+
+void TileGrid::orBits(int x, int y, uint64_t bits, int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    bits &= lowBits(count);
+
+    // The tiles may straddle two words of the row
+    size_t word = y * stride + x / 64;
+    int shift = x % 64;
+    words[word] |= bits << shift;
+    if (shift + count > 64)
+    {
+        words[word + 1] |= bits >> (64 - shift);
+    }
+}
+
+size_t TileGrid::count() const
+{
+    size_t rocks = 0;
+    for (uint64_t word : words)
+    {
+        rocks += std::popcount(word);
+    }
+    return rocks;
+}
+
+std::vector<uint8_t> TileGrid::pack() const
+{
+    std::vector<uint8_t> packed;
+    packed.reserve((static_cast<size_t>(width) * height + 7) / 8);
+
+    // Bits waiting to be written, filled from bit 0
+    uint64_t pending = 0;
+    int filled = 0;
+    auto put = [&](uint64_t bits, int count)
+    {
+        pending |= bits << filled;
+        int room = 64 - filled;
+        if (count < room)
+        {
+            filled += count;
+            return;
+        }
+        for (int byte = 0; byte < 8; ++byte)
+        {
+            packed.push_back(static_cast<uint8_t>(pending >> (8 * byte)));
+        }
+        pending = room == 64 ? 0 : bits >> room;
+        filled = count - room;
+    };
+
+    // Whole words of each row, then what is left of it
+    for (int y = 0; y < height; ++y)
+    {
+        const uint64_t *row = words.data() + y * stride;
+        for (int x = 0; x < width; x += 64)
+        {
+            put(row[x / 64], std::min(64, width - x));
+        }
+    }
+    for (int byte = 0; byte * 8 < filled; ++byte)
+    {
+        packed.push_back(static_cast<uint8_t>(pending >> (8 * byte)));
+    }
+    return packed;
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// @brief Coordinates of one tile of the world
+struct TileCoord
+{
+    int x; // Horizontal (positive is right)
+    int y; // Vertical (positive is down)
+};
+
+/// @brief Mask of the lowest count bits of a word
+constexpr uint64_t lowBits(int count)
+{
+    return count >= 64 ? ~uint64_t{0} : (uint64_t{1} << count) - 1;
+}
+
+/// @brief A square of tiles packed one bit per tile, row after row, set for a rock.
+/// Bit j of a row is the tile in column j. A 5 by 5 square fits in one word.
+/// @tparam Size side length, at most 64 so a row fits in a word
+template <int Size>
+class TileSquare
+{
+    static_assert(Size > 0 && Size <= 64);
+
+private:
+    std::array<uint64_t, (Size * Size + 63) / 64> words{};
+
+public:
+    /// @brief One row of a square, so tiles can be read as square[row][column]
+    class Row
+    {
+    private:
+        uint64_t rowBits;
+
+    public:
+        explicit constexpr Row(uint64_t bits) : rowBits(bits) {}
+
+        /// @brief Whether the tile in the given column has a rock
+        constexpr bool operator[](int column) const { return (rowBits >> column) & 1; }
+
+        /// @brief The row's tiles, column j in bit j
+        constexpr uint64_t bits() const { return rowBits; }
+    };
+
+    /// @brief Gets a row's tiles, column j in bit j
+    uint64_t getRow(int row) const
+    {
+        int offset = row * Size;
+        int word = offset / 64, shift = offset % 64;
+        uint64_t bits = words[word] >> shift;
+        if (shift + Size > 64)
+        {
+            bits |= words[word + 1] << (64 - shift);
+        }
+        return bits & lowBits(Size);
+    }
+
+    /// @brief Replaces a row's tiles, column j in bit j
+    void setRow(int row, uint64_t bits)
+    {
+        bits &= lowBits(Size);
+        int offset = row * Size;
+        int word = offset / 64, shift = offset % 64;
+        words[word] = (words[word] & ~(lowBits(Size) << shift)) | (bits << shift);
+        if (shift + Size > 64)
+        {
+            words[word + 1] = (words[word + 1] & ~(lowBits(Size) >> (64 - shift))) | (bits >> (64 - shift));
+        }
+    }
+
+    Row operator[](int row) const { return Row(getRow(row)); }
+
+    /// @brief Sets whether a tile has a rock
+    void set(int row, int column, bool rock)
+    {
+        int offset = row * Size + column;
+        uint64_t mask = uint64_t{1} << (offset % 64);
+        words[offset / 64] = rock ? words[offset / 64] | mask : words[offset / 64] & ~mask;
+    }
+
+    /// @brief Number of tiles with a rock
+    int count() const
+    {
+        int rocks = 0;
+        for (uint64_t word : words)
+        {
+            rocks += std::popcount(word);
+        }
+        return rocks;
+    }
+
+    bool operator==(const TileSquare &other) const = default;
+};
+
+/// @brief A rectangle of tiles packed one bit per tile, set for a rock. Each row
+/// starts on a new word so rows can be filled and read a word at a time.
+class TileGrid
+{
+private:
+    int width, height;
+    size_t stride; // Words per row
+    std::vector<uint64_t> words;
+
+public:
+    /// @brief Constructor for TileGrid, with no rocks
+    /// @param width number of tiles across, negative counts as 0
+    /// @param height number of tiles down, negative counts as 0
+    TileGrid(int width, int height);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    /// @brief Words each row of a grid of the given width takes
+    static size_t rowWords(int width) { return (static_cast<size_t>(std::max(width, 0)) + 63) / 64; }
+
+    /// @brief The grid's words, row after row, each row starting on a new word. Tile
+    /// (x, y) is bit x % 64 of word y * rowWords(width) + x / 64.
+    std::span<uint64_t> data() { return words; }
+
+    /// @brief Whether a tile has a rock
+    /// @param x column, from the left
+    /// @param y row, from the top
+    bool get(int x, int y) const { return (words[y * stride + x / 64] >> (x % 64)) & 1; }
+
+    /// @brief Sets whether a tile has a rock
+    /// @param x column, from the left
+    /// @param y row, from the top
+    void set(int x, int y, bool rock);
+
+    /// @brief Adds rocks to consecutive tiles of a row
+    /// @param x column of the first tile
+    /// @param y row
+    /// @param bits tiles from column x on, in bit 0 on. Bits past count are ignored.
+    /// @param count number of tiles, at most 64, and x + count at most the width
+    void orBits(int x, int y, uint64_t bits, int count);
+
+    /// @brief Number of tiles with a rock
+    size_t count() const;
+
+    /// @brief Packs the tiles for sending, row after row from the top left with no
+    /// padding between rows. Tile k is bit k % 8 of byte k / 8.
+    /// @return (width * height + 7) / 8 bytes
+    std::vector<uint8_t> pack() const;
+};
@@ -0,0 +1,67 @@
+#include "timer_service.h"
+
+namespace timer {
+
+TimerService::TimerService(asio::io_context &io_context,
+                           Clock::duration tick)
+    : m_timer(io_context), m_tick(tick), m_epoch(Clock::now()) {}
+
+uint64_t TimerService::tick_at(Clock::time_point time) const {
+  if (time <= m_epoch) {
+    return 0;
+  }
+  return static_cast<uint64_t>((time - m_epoch) / m_tick);
+}
+
+TimerId TimerService::schedule(Clock::duration delay,
+                               TimerWheel::Callback callback) {
+  auto now = Clock::now();
+
+  // An idle wheel has not been advanced, catch it up without walking every
+  // tick it missed
+  m_wheel.skip_to(tick_at(now));
+
+  // Round up, so the timer never fires before the delay has passed
+  auto due = now + delay - m_epoch;
+  uint64_t expires = static_cast<uint64_t>((due + m_tick - Clock::duration(1)) /
+                                           m_tick);
+
+  TimerId id = m_wheel.schedule(expires, std::move(callback));
+  arm();
+  return id;
+}
+
+bool TimerService::cancel(TimerId id) {
+  // The steady_timer is left armed, waking once more costs less than
+  // finding the new earliest tick
+  return m_wheel.cancel(id);
+}
+
+void TimerService::arm() {
+  if (m_wheel.size() == 0) {
+    return;
+  }
+
+  uint64_t next = m_wheel.next_tick();
+  if (m_armed_tick && *m_armed_tick <= next) {
+    return; // Already waking in time
+  }
+
+  m_armed_tick = next;
+  m_timer.expires_at(m_epoch + m_tick * next);
+  m_timer.async_wait([this](const asio::error_code &ec) {
+    // Cancelled because the timer was re-armed
+    if (ec) {
+      return;
+    }
+    on_timer();
+  });
+}
+
+void TimerService::on_timer() {
+  m_armed_tick.reset();
+  m_wheel.advance(tick_at(Clock::now()));
+  arm();
+}
+
+} // namespace timer
@@ -0,0 +1,59 @@
+#pragma once
+#include "timer_wheel.h"
+
+#include <asio.hpp>
+#include <chrono>
+#include <optional>
+
+namespace timer {
+
+/// @brief Runs a TimerWheel on an io_context. One steady_timer wakes the
+/// wheel only when a root slot is due or an outer wheel needs cascading, so
+/// thousands of pending timers cost one wait. Must only be used on the thread
+/// running its io_context.
+class TimerService {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  asio::steady_timer m_timer;
+  Clock::duration m_tick;
+  Clock::time_point m_epoch; // Time of tick 0
+  TimerWheel m_wheel;
+
+  // Tick the steady_timer is waiting for, if it is waiting
+  std::optional<uint64_t> m_armed_tick;
+
+  // Tick a time point falls in
+  uint64_t tick_at(Clock::time_point time) const;
+
+  // Waits for the wheel's next tick with work, if any timers are pending
+  void arm();
+
+  void on_timer();
+
+public:
+  /// @brief Constructor for TimerService
+  /// @param io_context Context the timers fire on
+  /// @param tick Resolution of the timers. Timers fire up to one tick late,
+  /// never early.
+  TimerService(asio::io_context &io_context,
+               Clock::duration tick = std::chrono::milliseconds(10));
+
+  /// @brief Schedules a callback
+  /// @param delay Time from now until the callback is called
+  /// @param callback Called once on the io_context's thread. It may schedule
+  /// and cancel timers.
+  /// @return handle to cancel the timer with
+  TimerId schedule(Clock::duration delay, TimerWheel::Callback callback);
+
+  /// @brief Cancels a pending timer
+  /// @param id Handle returned by schedule
+  /// @return true if the timer was pending and will no longer fire
+  bool cancel(TimerId id);
+
+  /// @brief Number of pending timers
+  size_t size() const { return m_wheel.size(); }
+};
+
+} // namespace timer
@@ -0,0 +1,206 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+namespace timer {
+
+TimerWheel::TimerWheel(uint64_t start) : m_current(start) {
+  // Each sentinel starts as an empty circular list
+  m_nodes.resize(SENTINELS);
+  for (uint32_t idx = 0; idx < SENTINELS; ++idx) {
+    m_nodes[idx].prev = m_nodes[idx].next = m_nodes[idx].slot = idx;
+  }
+}
+
+void TimerWheel::link(uint32_t node, uint32_t slot) {
+  // Append, so timers in one slot fire in the order they were scheduled
+  uint32_t tail = m_nodes[slot].prev;
+  m_nodes[node].prev = tail;
+  m_nodes[node].next = slot;
+  m_nodes[node].slot = slot;
+  m_nodes[tail].next = node;
+  m_nodes[slot].prev = node;
+
+  if (slot < ROOT_SLOTS) {
+    m_root_size++;
+  }
+}
+
+void TimerWheel::unlink(uint32_t node) {
+  Node &n = m_nodes[node];
+  m_nodes[n.prev].next = n.next;
+  m_nodes[n.next].prev = n.prev;
+
+  if (n.slot < ROOT_SLOTS) {
+    m_root_size--;
+  }
+  n.prev = n.next = n.slot = node;
+}
+
+void TimerWheel::place(uint32_t node) {
+  uint64_t expires = std::max(m_nodes[node].expires, m_current);
+  uint64_t delta = expires - m_current;
+
+  if (delta < ROOT_SLOTS) {
+    link(node, expires & (ROOT_SLOTS - 1));
+    return;
+  }
+
+  // Too far out for any wheel, park it as far out as possible. It is placed
+  // again when that slot is cascaded.
+  if (delta > MAX_DELAY) {
+    expires = m_current + MAX_DELAY;
+    delta = MAX_DELAY;
+  }
+
+  // Pick the innermost outer wheel whose span covers the delay
+  unsigned level = 1;
+  unsigned shift = ROOT_BITS;
+  while (level < LEVELS - 1 && delta >= (uint64_t{1} << (shift + LEVEL_BITS))) {
+    level++;
+    shift += LEVEL_BITS;
+  }
+
+  size_t index = (expires >> shift) & (LEVEL_SLOTS - 1);
+  link(node, ROOT_SLOTS + (level - 1) * LEVEL_SLOTS + index);
+}
+
+void TimerWheel::cascade(unsigned level, size_t index) {
+  uint32_t slot = ROOT_SLOTS + (level - 1) * LEVEL_SLOTS + index;
+
+  // Every timer in the slot is now within reach of an inner wheel
+  while (m_nodes[slot].next != slot) {
+    uint32_t node = m_nodes[slot].next;
+    unlink(node);
+    place(node);
+  }
+}
+
+void TimerWheel::release(uint32_t node) {
+  Node &n = m_nodes[node];
+  n.active = false;
+  n.generation++;
+  n.callback = nullptr;
+  m_free.push_back(node);
+  m_size--;
+}
+
+TimerId TimerWheel::schedule(uint64_t expires, Callback callback) {
+  uint32_t node;
+  if (!m_free.empty()) {
+    node = m_free.back();
+    m_free.pop_back();
+  } else {
+    node = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+  }
+
+  Node &n = m_nodes[node];
+  n.expires = expires;
+  n.active = true;
+  n.callback = std::move(callback);
+  m_size++;
+
+  place(node);
+  return (static_cast<TimerId>(n.generation) << 32) | node;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+  uint32_t node = static_cast<uint32_t>(id);
+  uint32_t generation = static_cast<uint32_t>(id >> 32);
+
+  if (node < SENTINELS || node >= m_nodes.size() ||
+      m_nodes[node].generation != generation || !m_nodes[node].active) {
+    return false;
+  }
+
+  unlink(node);
+  release(node);
+  return true;
+}
+
+size_t TimerWheel::process_tick() {
+  uint64_t tick = m_current;
+  size_t index = tick & (ROOT_SLOTS - 1);
+
+  // When the root wheel wraps, pull the next slot of the first outer wheel
+  // inwards, and of the wheel beyond it whenever that one wraps too
+  if (index == 0) {
+    unsigned shift = ROOT_BITS;
+    for (unsigned level = 1; level < LEVELS; ++level, shift += LEVEL_BITS) {
+      size_t outer = (tick >> shift) & (LEVEL_SLOTS - 1);
+      cascade(level, outer);
+      if (outer != 0) {
+        break;
+      }
+    }
+  }
+
+  // Move the due timers aside before firing any, so callbacks can schedule
+  // into the slot or cancel timers that have not fired yet
+  while (m_nodes[index].next != index) {
+    uint32_t node = m_nodes[index].next;
+    unlink(node);
+    link(node, EXPIRED);
+  }
+  m_current = tick + 1;
+
+  size_t fired = 0;
+  while (m_nodes[EXPIRED].next != EXPIRED) {
+    uint32_t node = m_nodes[EXPIRED].next;
+    unlink(node);
+
+    // The node may be reused by a timer the callback schedules
+    Callback callback = std::move(m_nodes[node].callback);
+    release(node);
+
+    callback();
+    fired++;
+  }
+  return fired;
+}
+
+size_t TimerWheel::advance(uint64_t now) {
+  size_t fired = 0;
+  while (m_current <= now) {
+    // Nothing left to fire, so the remaining ticks can be skipped
+    if (m_size == 0) {
+      m_current = now + 1;
+      break;
+    }
+
+    // With the root wheel empty, nothing fires before the next cascade
+    if (m_root_size == 0 && (m_current & (ROOT_SLOTS - 1)) != 0) {
+      m_current = std::min(now + 1, next_tick());
+      continue;
+    }
+    fired += process_tick();
+  }
+  return fired;
+}
+
+void TimerWheel::skip_to(uint64_t now) {
+  if (m_size == 0 && now > m_current) {
+    m_current = now;
+  }
+}
+
+uint64_t TimerWheel::next_tick() const {
+  // Processing a tick at the start of a root turn cascades the outer wheels
+  uint64_t boundary = (m_current | (ROOT_SLOTS - 1)) + 1;
+  if ((m_current & (ROOT_SLOTS - 1)) == 0) {
+    return m_current;
+  }
+
+  if (m_root_size > 0) {
+    for (uint64_t tick = m_current; tick < boundary; ++tick) {
+      uint32_t slot = tick & (ROOT_SLOTS - 1);
+      if (m_nodes[slot].next != slot) {
+        return tick;
+      }
+    }
+  }
+  return boundary;
+}
+
+} // namespace timer
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace timer {
+
+/// @brief Handle of a scheduled timer. Cancelling a handle whose timer has
+/// already fired or been cancelled does nothing.
+using TimerId = uint64_t;
+
+/// @brief Hierarchical timing wheel. Time is counted in ticks. Timers due
+/// within 256 ticks sit in a slot of the root wheel, later ones in coarser
+/// outer wheels that are cascaded inwards as time reaches them. Scheduling
+/// and cancelling are O(1) however many timers are pending, and each timer is
+/// moved at most once per wheel before it fires. Not thread-safe.
+class TimerWheel {
+public:
+  using Callback = std::function<void()>;
+
+  static constexpr unsigned ROOT_BITS = 8;  // Root wheel has 256 slots
+  static constexpr unsigned LEVEL_BITS = 6; // Outer wheels have 64 slots
+  static constexpr unsigned LEVELS = 4;     // Root wheel plus 3 outer wheels
+
+  /// @brief Longest delay the wheels can represent, in ticks. Timers further
+  /// out are parked in the outermost wheel until they come into range.
+  static constexpr uint64_t MAX_DELAY =
+      (uint64_t{1} << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS)) - 1;
+
+private:
+  static constexpr size_t ROOT_SLOTS = size_t{1} << ROOT_BITS;
+  static constexpr size_t LEVEL_SLOTS = size_t{1} << LEVEL_BITS;
+
+  // Every slot is a circular list threaded through m_nodes, starting at a
+  // sentinel node. Timers being fired are moved to the EXPIRED list first.
+  static constexpr uint32_t EXPIRED = ROOT_SLOTS + (LEVELS - 1) * LEVEL_SLOTS;
+  static constexpr uint32_t SENTINELS = EXPIRED + 1;
+
+  struct Node {
+    uint64_t expires = 0;    // Tick the timer fires on
+    uint32_t prev = 0;       // Neighbours in the slot's list
+    uint32_t next = 0;
+    uint32_t slot = 0;       // Sentinel of the list the node is in
+    uint32_t generation = 0; // Bumped on every reuse, so stale IDs miss
+    bool active = false;     // Whether the node holds a pending timer
+    Callback callback;
+  };
+
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_free; // Nodes available for reuse
+
+  uint64_t m_current = 0; // Next tick to process
+  size_t m_size = 0;      // Pending timers
+  size_t m_root_size = 0; // Pending timers in the root wheel
+
+  void link(uint32_t node, uint32_t slot);
+  void unlink(uint32_t node);
+
+  // Links a node into the slot its expiry falls in, relative to m_current
+  void place(uint32_t node);
+
+  // Re-places every timer of an outer wheel slot
+  void cascade(unsigned level, size_t index);
+
+  // Processes one tick: cascades if the root wheel wrapped, then fires
+  size_t process_tick();
+
+  void release(uint32_t node);
+
+public:
+  /// @brief Constructor for TimerWheel
+  /// @param start Tick the wheel starts at
+  TimerWheel(uint64_t start = 0);
+
+  /// @brief Schedules a timer
+  /// @param expires Tick the timer fires on. Ticks already processed fire
+  /// on the next one.
+  /// @param callback Called once when the timer fires. It may schedule and
+  /// cancel timers, but must not advance the wheel.
+  /// @return handle to cancel the timer with
+  TimerId schedule(uint64_t expires, Callback callback);
+
+  /// @brief Cancels a pending timer
+  /// @param id Handle returned by schedule
+  /// @return true if the timer was pending and will no longer fire
+  bool cancel(TimerId id);
+
+  /// @brief Fires every timer due up to and including the given tick
+  /// @param now The current tick
+  /// @return number of timers fired
+  size_t advance(uint64_t now);
+
+  /// @brief Moves an empty wheel forward without processing the ticks in
+  /// between. Does nothing if timers are pending.
+  /// @param now The current tick
+  void skip_to(uint64_t now);
+
+  /// @brief Earliest tick at which advance may have work to do: the next
+  /// non-empty root slot, or the next cascade of the outer wheels. Looks at
+  /// no more than one turn of the root wheel.
+  uint64_t next_tick() const;
+
+  /// @brief Next tick to be processed
+  uint64_t current() const { return m_current; }
+
+  /// @brief Number of pending timers
+  size_t size() const { return m_size; }
+};
+
+} // namespace timer
@@ -0,0 +1,246 @@
+#include "batch_socket.h"
+
+#include <cerrno>
+#include <iostream>
+
+namespace transport {
+
+BatchSocket::BatchSocket(udp::socket &socket, size_t batch_size,
+                         bool use_mmsg)
+    : m_socket(socket), m_batch_size(batch_size == 0 ? 1 : batch_size),
+      m_buffer_pool(m_batch_size * MAX_PACKET_SIZE) {
+  m_batch.reserve(m_batch_size);
+
+#ifdef __linux__
+  m_use_mmsg = use_mmsg;
+  m_msgs.resize(m_batch_size);
+  m_iovecs.resize(m_batch_size);
+  m_addrs.resize(m_batch_size);
+#else
+  (void)use_mmsg;
+  m_use_mmsg = false;
+#endif
+}
+
+#ifdef __linux__
+size_t BatchSocket::receive_mmsg(asio::error_code &ec) {
+  // Point each message header at its slot in the buffer pool. The address
+  // length is overwritten by the kernel so it has to be reset every call.
+  for (size_t i = 0; i < m_batch_size; ++i) {
+    m_iovecs[i].iov_base = &m_buffer_pool[i * MAX_PACKET_SIZE];
+    m_iovecs[i].iov_len = MAX_PACKET_SIZE;
+
+    msghdr &hdr = m_msgs[i].msg_hdr;
+    hdr = msghdr{};
+    hdr.msg_name = &m_addrs[i];
+    hdr.msg_namelen = sizeof(sockaddr_storage);
+    hdr.msg_iov = &m_iovecs[i];
+    hdr.msg_iovlen = 1;
+  }
+
+  int count = ::recvmmsg(m_socket.native_handle(), m_msgs.data(),
+                         static_cast<unsigned int>(m_batch_size), MSG_DONTWAIT,
+                         nullptr);
+  if (count < 0) {
+    if (errno == ENOSYS) {
+      // Old kernel, use the portable path from now on
+      m_use_mmsg = false;
+      return receive_fallback(ec);
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      ec = asio::error_code(errno, asio::error::get_system_category());
+    }
+    return 0;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    udp::endpoint sender;
+    std::memcpy(sender.data(), &m_addrs[i], m_msgs[i].msg_hdr.msg_namelen);
+    sender.resize(m_msgs[i].msg_hdr.msg_namelen);
+
+    m_batch.push_back(Datagram{sender, &m_buffer_pool[i * MAX_PACKET_SIZE],
+                               m_msgs[i].msg_len});
+  }
+
+  return static_cast<size_t>(count);
+}
+
+size_t BatchSocket::send_mmsg(asio::error_code &ec) {
+  size_t sent = 0;
+
+  while (!m_send_queue.empty()) {
+    size_t count = std::min(m_send_queue.size(), m_batch_size);
+
+    for (size_t i = 0; i < count; ++i) {
+      auto &[endpoint, message] = m_send_queue[i];
+      m_iovecs[i].iov_base = message.data();
+      m_iovecs[i].iov_len = message.size();
+
+      msghdr &hdr = m_msgs[i].msg_hdr;
+      hdr = msghdr{};
+      hdr.msg_name = endpoint.data();
+      hdr.msg_namelen = static_cast<socklen_t>(endpoint.size());
+      hdr.msg_iov = &m_iovecs[i];
+      hdr.msg_iovlen = 1;
+    }
+
+    int result = ::sendmmsg(m_socket.native_handle(), m_msgs.data(),
+                            static_cast<unsigned int>(count), MSG_DONTWAIT);
+    if (result < 0) {
+      if (errno == ENOSYS) {
+        m_use_mmsg = false;
+        return sent + send_fallback(ec);
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        // Drop the datagram the kernel refused so the queue keeps moving
+        ec = asio::error_code(errno, asio::error::get_system_category());
+        m_send_queue.pop_front();
+        continue;
+      }
+      ec = asio::error::would_block;
+      break;
+    }
+
+    m_send_queue.erase(m_send_queue.begin(), m_send_queue.begin() + result);
+    sent += static_cast<size_t>(result);
+  }
+
+  return sent;
+}
+#endif
+
+size_t BatchSocket::receive_fallback(asio::error_code &ec) {
+  m_socket.non_blocking(true);
+
+  size_t count = 0;
+  while (count < m_batch_size) {
+    udp::endpoint sender;
+    uint8_t *slot = &m_buffer_pool[count * MAX_PACKET_SIZE];
+
+    size_t length = m_socket.receive_from(asio::buffer(slot, MAX_PACKET_SIZE),
+                                          sender, 0, ec);
+    if (ec) {
+      // Nothing left to read is not an error
+      if (ec == asio::error::would_block || ec == asio::error::try_again) {
+        ec.clear();
+      }
+      break;
+    }
+
+    m_batch.push_back(Datagram{sender, slot, length});
+    count++;
+  }
+
+  return count;
+}
+
+size_t BatchSocket::send_fallback(asio::error_code &ec) {
+  m_socket.non_blocking(true);
+
+  size_t sent = 0;
+  while (!m_send_queue.empty()) {
+    auto &[endpoint, message] = m_send_queue.front();
+
+    m_socket.send_to(asio::buffer(message), endpoint, 0, ec);
+    if (ec == asio::error::would_block || ec == asio::error::try_again) {
+      break;
+    }
+
+    // Sent, or failed in a way retrying won't fix
+    m_send_queue.pop_front();
+    if (!ec) {
+      sent++;
+    }
+  }
+
+  return sent;
+}
+
+std::span<const Datagram> BatchSocket::receive_batch(asio::error_code &ec) {
+  m_batch.clear();
+  ec.clear();
+
+#ifdef __linux__
+  if (m_use_mmsg) {
+    receive_mmsg(ec);
+    return m_batch;
+  }
+#endif
+
+  receive_fallback(ec);
+  return m_batch;
+}
+
+void BatchSocket::async_receive(BatchHandler handler) {
+  m_socket.async_wait(
+      udp::socket::wait_read,
+      [this, handler = std::move(handler)](const asio::error_code &ec) mutable {
+        // Socket was closed
+        if (ec == asio::error::operation_aborted || !m_socket.is_open()) {
+          return;
+        }
+
+        if (ec) {
+          std::cerr << "Error waiting for datagrams: " << ec.message()
+                    << std::endl;
+        } else {
+          asio::error_code receive_ec;
+          auto batch = receive_batch(receive_ec);
+          if (receive_ec) {
+            std::cerr << "Error receiving datagrams: " << receive_ec.message()
+                      << std::endl;
+          }
+          if (!batch.empty()) {
+            handler(batch);
+          }
+        }
+
+        // Wait for the next batch
+        async_receive(std::move(handler));
+      });
+}
+
+void BatchSocket::queue_send(const udp::endpoint &endpoint,
+                             std::vector<uint8_t> message) {
+  m_send_queue.emplace_back(endpoint, std::move(message));
+}
+
+size_t BatchSocket::flush() {
+  // A previous flush is already waiting for room in the send buffer
+  if (m_waiting_to_send || m_send_queue.empty()) {
+    return 0;
+  }
+
+  asio::error_code ec;
+  size_t sent;
+
+#ifdef __linux__
+  if (m_use_mmsg) {
+    sent = send_mmsg(ec);
+  } else {
+    sent = send_fallback(ec);
+  }
+#else
+  sent = send_fallback(ec);
+#endif
+
+  if (ec && ec != asio::error::would_block && ec != asio::error::try_again) {
+    std::cerr << "Error sending datagrams: " << ec.message() << std::endl;
+  }
+
+  // Send the rest once the socket has room again
+  if (!m_send_queue.empty()) {
+    m_waiting_to_send = true;
+    m_socket.async_wait(udp::socket::wait_write,
+                        [this](const asio::error_code &ec) {
+                          m_waiting_to_send = false;
+                          if (!ec) {
+                            flush();
+                          }
+                        });
+  }
+
+  return sent;
+}
+
+} // namespace transport
@@ -0,0 +1,105 @@
+#pragma once
+#include "protocols.h"
+
+#include <asio.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <span>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+using asio::ip::udp;
+
+namespace transport {
+
+/// @brief The default number of datagrams read or written per system call
+constexpr size_t DEFAULT_BATCH_SIZE = 32;
+
+/// @brief A received datagram. The data points into a pooled buffer owned by
+/// the socket and is only valid until the next receive.
+struct Datagram {
+  udp::endpoint sender;
+  const uint8_t *data;
+  size_t size;
+};
+
+/// @brief Called with every datagram drained in one batch
+using BatchHandler = std::function<void(std::span<const Datagram>)>;
+
+/// @brief Wraps a UDP socket so that several datagrams are read or written per
+/// system call. Uses recvmmsg/sendmmsg on Linux and falls back to one
+/// receive_from/send_to per datagram elsewhere.
+class BatchSocket {
+private:
+  // The wrapped socket
+  udp::socket &m_socket;
+
+  // Maximum number of datagrams per system call
+  size_t m_batch_size;
+
+  // Pool of receive buffers, one MAX_PACKET_SIZE slot per batch entry
+  std::vector<uint8_t> m_buffer_pool;
+
+  // Datagrams from the latest receive, pointing into m_buffer_pool
+  std::vector<Datagram> m_batch;
+
+  // Replies waiting for the next flush
+  std::deque<std::pair<udp::endpoint, std::vector<uint8_t>>> m_send_queue;
+
+  // Whether a flush is waiting for the socket to become writable
+  bool m_waiting_to_send = false;
+
+  // Cleared if the kernel turns out not to support the batched calls
+  bool m_use_mmsg;
+
+#ifdef __linux__
+  // Message headers reused across recvmmsg/sendmmsg calls
+  std::vector<mmsghdr> m_msgs;
+  std::vector<iovec> m_iovecs;
+  std::vector<sockaddr_storage> m_addrs;
+
+  size_t receive_mmsg(asio::error_code &ec);
+  size_t send_mmsg(asio::error_code &ec);
+#endif
+
+  size_t receive_fallback(asio::error_code &ec);
+  size_t send_fallback(asio::error_code &ec);
+
+public:
+  /// @brief Constructor for BatchSocket
+  /// @param socket An open UDP socket, which must outlive this object
+  /// @param batch_size Maximum number of datagrams per system call
+  /// @param use_mmsg Whether to try recvmmsg/sendmmsg. If false, or off Linux,
+  /// the socket makes one system call per datagram.
+  BatchSocket(udp::socket &socket, size_t batch_size = DEFAULT_BATCH_SIZE,
+              bool use_mmsg = true);
+
+  /// @brief Reads up to batch_size datagrams without blocking
+  /// @param ec Set if the socket reported an error
+  /// @return the datagrams read, valid until the next call
+  std::span<const Datagram> receive_batch(asio::error_code &ec);
+
+  /// @brief Repeatedly waits for the socket to become readable, drains a
+  /// batch and passes it to handler. Stops when the socket is closed.
+  /// @param handler Called on the io_context thread with each batch
+  void async_receive(BatchHandler handler);
+
+  /// @brief Queues a datagram to be sent on the next flush
+  /// @param endpoint Destination of the datagram
+  /// @param message Bytes to send
+  void queue_send(const udp::endpoint &endpoint, std::vector<uint8_t> message);
+
+  /// @brief Sends every queued datagram, batching where possible. If the
+  /// socket's send buffer is full, the rest are sent once it is writable.
+  /// @return the number of datagrams sent by this call
+  size_t flush();
+
+  /// @brief Number of datagrams waiting to be sent
+  size_t queued() const { return m_send_queue.size(); }
+};
+
+} // namespace transport
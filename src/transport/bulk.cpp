@@ -0,0 +1,418 @@
+#include "bulk.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace transport {
+
+namespace {
+// Segments acknowledged after a missing one, counted in the order they were
+// sent, before it is taken as lost
+constexpr uint64_t DUP_THRESHOLD = 3;
+} // namespace
+
+std::optional<BulkHeader>
+peek_bulk_header(const std::vector<uint8_t> &message) {
+  auto header = peek_header(message.data(), message.size());
+  if (!header || header->request_id != BULK_REQUEST_ID) {
+    return std::nullopt;
+  }
+  return util::bytes_to_struct<BulkHeader>(message);
+}
+
+BulkSender::BulkSender(asio::io_context &io_context, const BulkHeader &open,
+                       std::vector<uint8_t> data, Sink sink,
+                       Completion on_complete, const BulkOptions &options)
+    : m_timer(io_context), m_sink(std::move(sink)),
+      m_on_complete(std::move(on_complete)), m_options(options),
+      m_header(open), m_data(std::move(data)),
+      m_segments(bulk_segment_count(static_cast<uint32_t>(m_data.size()))),
+      m_window(std::clamp<uint16_t>(open.window, 1, MAX_BULK_WINDOW)),
+      m_rto(options.initial_rto) {
+  m_header.kind = BulkKind::DATA;
+  m_header.window = 0;
+}
+
+void BulkSender::start() { pump(); }
+
+void BulkSender::pump() {
+  while (!m_done && m_in_flight < m_window) {
+    // Lost segments are resent before anything new, oldest first
+    std::optional<uint32_t> seq;
+    for (uint32_t idx = m_cumulative; idx < m_next; ++idx) {
+      if (m_segments[idx].lost) {
+        seq = idx;
+        break;
+      }
+    }
+    if (!seq && m_next < m_segments.size() &&
+        m_next < m_cumulative + m_window) {
+      seq = m_next++;
+    }
+    if (!seq) {
+      break;
+    }
+    send_segment(*seq);
+  }
+
+  if (m_in_flight != 0 && !m_timer_armed) {
+    arm_timer();
+  }
+}
+
+void BulkSender::send_segment(uint32_t seq) {
+  Segment &segment = m_segments[seq];
+  if (segment.tx != 0) {
+    segment.retransmitted = true;
+    m_retransmits++;
+  }
+  segment.tx = ++m_tx;
+  segment.sent_at = Clock::now();
+  segment.lost = false;
+  m_in_flight++;
+  m_sent++;
+
+  BulkSegment header{m_header, seq, static_cast<uint32_t>(m_data.size())};
+  size_t offset = static_cast<size_t>(seq) * BULK_SEGMENT_SIZE;
+  size_t length = std::min(BULK_SEGMENT_SIZE, m_data.size() - offset);
+
+  std::vector<uint8_t> message = util::struct_to_bytes(header);
+  message.insert(message.end(), m_data.begin() + offset,
+                 m_data.begin() + offset + length);
+  m_sink(std::move(message));
+}
+
+void BulkSender::acknowledge(uint32_t seq, Clock::time_point now,
+                             std::optional<Clock::duration> &rtt) {
+  Segment &segment = m_segments[seq];
+  if (segment.acked || segment.tx == 0) {
+    return; // Already known, or an ACK of something never sent is corrupt
+  }
+
+  segment.acked = true;
+  if (!segment.lost) {
+    m_in_flight--;
+  }
+  segment.lost = false;
+  m_acked_tx = std::max(m_acked_tx, segment.tx);
+
+  // Only segments sent once give an unambiguous round trip (Karn's rule)
+  if (!segment.retransmitted) {
+    auto sample = now - segment.sent_at;
+    rtt = rtt ? std::min(*rtt, sample) : sample;
+  }
+}
+
+void BulkSender::handle_ack(const BulkAck &ack) {
+  if (m_done || ack.header.transfer_id != m_header.transfer_id) {
+    return;
+  }
+
+  auto now = Clock::now();
+  uint32_t cumulative_before = m_cumulative;
+  std::optional<Clock::duration> rtt;
+
+  uint32_t cumulative =
+      std::min<uint32_t>(ack.cumulative, static_cast<uint32_t>(m_next));
+  for (uint32_t seq = m_cumulative; seq < cumulative; ++seq) {
+    acknowledge(seq, now, rtt);
+  }
+  for (uint32_t bit = 0; bit < 64; ++bit) {
+    uint64_t seq = static_cast<uint64_t>(cumulative) + 1 + bit;
+    if (seq >= m_next) {
+      break;
+    }
+    if (ack.sack & (uint64_t{1} << bit)) {
+      acknowledge(static_cast<uint32_t>(seq), now, rtt);
+    }
+  }
+  while (m_cumulative < m_segments.size() && m_segments[m_cumulative].acked) {
+    m_cumulative++;
+  }
+
+  m_window = std::clamp<uint16_t>(ack.header.window, 1, MAX_BULK_WINDOW);
+  if (rtt) {
+    sample_rtt(*rtt);
+  }
+
+  if (m_cumulative == m_segments.size()) {
+    finish(true);
+    return;
+  }
+
+  // A segment is lost once enough of those sent after it have arrived
+  for (uint32_t seq = m_cumulative; seq < m_next; ++seq) {
+    Segment &segment = m_segments[seq];
+    if (!segment.acked && !segment.lost &&
+        segment.tx + DUP_THRESHOLD <= m_acked_tx) {
+      segment.lost = true;
+      m_in_flight--;
+    }
+  }
+
+  // Progress restarts the timer from the current timeout
+  if (m_cumulative != cumulative_before || rtt) {
+    m_timeouts = 0;
+    arm_timer();
+  }
+  pump();
+}
+
+void BulkSender::sample_rtt(Clock::duration rtt) {
+  if (!m_srtt) {
+    m_srtt = rtt;
+    m_rttvar = rtt / 2;
+  } else {
+    auto error = *m_srtt > rtt ? *m_srtt - rtt : rtt - *m_srtt;
+    m_rttvar = (3 * m_rttvar + error) / 4;
+    m_srtt = (7 * *m_srtt + rtt) / 8;
+  }
+
+  Clock::duration rto = *m_srtt + 4 * m_rttvar;
+  m_rto = std::clamp<Clock::duration>(rto, m_options.min_rto,
+                                      m_options.max_rto);
+}
+
+void BulkSender::arm_timer() {
+  m_timer_armed = true;
+
+  // Replacing the expiry cancels the previous wait
+  m_timer.expires_after(m_rto);
+  m_timer.async_wait([this](const asio::error_code &ec) {
+    if (!ec) {
+      m_timer_armed = false;
+      on_timeout();
+    }
+  });
+}
+
+void BulkSender::on_timeout() {
+  if (m_done || m_in_flight == 0) {
+    return;
+  }
+
+  if (++m_timeouts >= m_options.max_attempts) {
+    BulkHeader abort = m_header;
+    abort.kind = BulkKind::ABORT;
+    m_sink(util::struct_to_bytes(abort));
+    finish(false);
+    return;
+  }
+
+  // Everything in flight is presumed lost, and the timeout backs off
+  for (uint32_t seq = m_cumulative; seq < m_next; ++seq) {
+    Segment &segment = m_segments[seq];
+    if (!segment.acked && !segment.lost) {
+      segment.lost = true;
+    }
+  }
+  m_in_flight = 0;
+  m_rto = std::min<Clock::duration>(2 * m_rto, m_options.max_rto);
+  pump();
+}
+
+void BulkSender::cancel() { finish(false); }
+
+void BulkSender::finish(bool delivered) {
+  if (m_done) {
+    return;
+  }
+  m_done = true;
+  m_timer_armed = false;
+  m_timer.cancel();
+
+  if (m_on_complete) {
+    auto on_complete = std::move(m_on_complete);
+    m_on_complete = nullptr;
+    on_complete(delivered);
+  }
+}
+
+BulkReceiver::BulkReceiver(asio::io_context &io_context, uint32_t rover_id,
+                           uint32_t transfer_id, BulkContent content, Sink sink,
+                           Completion on_complete, const BulkOptions &options)
+    : m_idle_timer(io_context), m_ack_timer(io_context),
+      m_sink(std::move(sink)), m_on_complete(std::move(on_complete)),
+      m_options(options), m_open_timeout(options.initial_rto) {
+  m_options.window =
+      std::clamp<uint16_t>(m_options.window, 1, MAX_BULK_WINDOW);
+  m_header.rover_id = rover_id;
+  m_header.transfer_id = transfer_id;
+  m_header.content = content;
+}
+
+void BulkReceiver::start() { send_open(); }
+
+void BulkReceiver::send_open() {
+  BulkHeader open = m_header;
+  open.kind = BulkKind::OPEN;
+  open.window = m_options.window;
+  m_attempts++;
+  m_sink(util::struct_to_bytes(open));
+  arm_idle_timer(m_open_timeout);
+}
+
+void BulkReceiver::arm_idle_timer(Clock::duration timeout) {
+  // Replacing the expiry cancels the previous wait
+  m_idle_timer.expires_after(timeout);
+  m_idle_timer.async_wait([this](const asio::error_code &ec) {
+    if (!ec) {
+      on_idle();
+    }
+  });
+}
+
+void BulkReceiver::on_idle() {
+  if (m_done) {
+    return;
+  }
+
+  // Until a segment arrives the OPEN may have been lost, so it is resent.
+  // After that the sender retransmits, and silence means it gave up.
+  if (!m_total_size && m_attempts < m_options.max_attempts) {
+    m_open_timeout =
+        std::min<Clock::duration>(2 * m_open_timeout, m_options.max_rto);
+    send_open();
+    return;
+  }
+  cancel(true);
+}
+
+void BulkReceiver::handle_segment(const std::vector<uint8_t> &message) {
+  auto segment = util::bytes_to_struct<BulkSegment>(message);
+  if (segment.header.kind != BulkKind::DATA ||
+      segment.header.transfer_id != m_header.transfer_id) {
+    return;
+  }
+
+  // Once complete, every ACK says so
+  if (m_done) {
+    if (m_total_size) {
+      send_ack();
+    }
+    return;
+  }
+
+  // The first segment gives the size of the whole transfer. Later segments
+  // disagreeing with it were corrupted.
+  if (!m_total_size) {
+    if (segment.total_size > m_options.max_size) {
+      cancel(true);
+      return;
+    }
+    m_total_size = segment.total_size;
+    m_data.assign(segment.total_size, 0);
+    m_arrived.assign(bulk_segment_count(segment.total_size), false);
+  } else if (segment.total_size != *m_total_size) {
+    return;
+  }
+  if (segment.seq >= m_arrived.size()) {
+    return;
+  }
+
+  // The sender only needs an ACK after a gap or a duplicate straight away
+  const bool in_order = segment.seq == m_cumulative;
+  if (m_arrived[segment.seq]) {
+    m_duplicates++;
+    send_ack();
+    return;
+  }
+
+  // Bytes missing from the end of the message were zeros, as is the buffer
+  size_t offset = static_cast<size_t>(segment.seq) * BULK_SEGMENT_SIZE;
+  size_t length = std::min(BULK_SEGMENT_SIZE, m_data.size() - offset);
+  if (message.size() > sizeof(BulkSegment)) {
+    size_t available = std::min(length, message.size() - sizeof(BulkSegment));
+    std::memcpy(m_data.data() + offset, message.data() + sizeof(BulkSegment),
+                available);
+  }
+  m_arrived[segment.seq] = true;
+  m_received++;
+  while (m_cumulative < m_arrived.size() && m_arrived[m_cumulative]) {
+    m_cumulative++;
+  }
+
+  // The sender gives up after max_attempts timeouts, so wait that long
+  arm_idle_timer(m_options.max_rto * m_options.max_attempts);
+
+  if (m_cumulative == m_arrived.size()) {
+    send_ack();
+    m_done = true;
+    m_idle_timer.cancel();
+    finish(std::move(m_data));
+    return;
+  }
+
+  m_unacked++;
+  if (!in_order || m_cumulative != segment.seq + 1 ||
+      m_unacked >= m_options.ack_every) {
+    send_ack();
+    return;
+  }
+
+  if (!m_ack_armed) {
+    m_ack_armed = true;
+    m_ack_timer.expires_after(m_options.ack_delay);
+    m_ack_timer.async_wait([this](const asio::error_code &ec) {
+      if (!ec && m_ack_armed) {
+        m_ack_armed = false;
+        send_ack();
+      }
+    });
+  }
+}
+
+void BulkReceiver::send_ack() {
+  if (m_ack_armed) {
+    m_ack_armed = false;
+    m_ack_timer.cancel();
+  }
+  m_unacked = 0;
+
+  BulkAck ack{};
+  ack.header = m_header;
+  ack.header.kind = BulkKind::ACK;
+  ack.header.window = m_options.window;
+  ack.cumulative = m_cumulative;
+  ack.received = m_received;
+  for (uint32_t bit = 0; bit < 64; ++bit) {
+    uint64_t seq = static_cast<uint64_t>(m_cumulative) + 1 + bit;
+    if (seq >= m_arrived.size()) {
+      break;
+    }
+    if (m_arrived[seq]) {
+      ack.sack |= uint64_t{1} << bit;
+    }
+  }
+  m_sink(util::struct_to_bytes(ack));
+}
+
+void BulkReceiver::cancel(bool notify) {
+  if (m_done) {
+    return;
+  }
+  if (notify) {
+    BulkHeader abort = m_header;
+    abort.kind = BulkKind::ABORT;
+    m_sink(util::struct_to_bytes(abort));
+  }
+  m_done = true;
+  m_total_size.reset(); // Later segments get no ACK
+  m_idle_timer.cancel();
+  finish(std::nullopt);
+}
+
+void BulkReceiver::finish(std::optional<std::vector<uint8_t>> data) {
+  if (m_ack_armed) {
+    m_ack_armed = false;
+    m_ack_timer.cancel();
+  }
+  if (m_on_complete) {
+    auto on_complete = std::move(m_on_complete);
+    m_on_complete = nullptr;
+    on_complete(std::move(data));
+  }
+}
+
+} // namespace transport
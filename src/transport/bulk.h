@@ -0,0 +1,263 @@
+#pragma once
+#include "protocols.h"
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace transport {
+
+/// @brief Bytes of content carried by each bulk segment, so a segment fits in
+/// one datagram at every RS level
+constexpr size_t BULK_SEGMENT_SIZE = MAX_PAYLOAD_SIZE - sizeof(BulkSegment);
+
+/// @brief Most segments a receiver takes past the first missing one. Each of
+/// them has a bit in an ACK's bitmap.
+constexpr uint16_t MAX_BULK_WINDOW = 64;
+
+/// @brief How long a finished transfer's receiver keeps answering segments,
+/// in case its last ACK was lost and the sender is still retransmitting
+constexpr std::chrono::milliseconds BULK_LINGER{MAX_TIMEOUT_MS *
+                                                MAX_RETRIES};
+
+/// @brief Settings shared by both ends of a bulk transfer
+struct BulkOptions {
+  // Segments the receiver takes past the first missing one
+  uint16_t window = MAX_BULK_WINDOW;
+
+  // Retransmission timeout before the round trip has been measured, and the
+  // bounds it is kept within once it has
+  std::chrono::milliseconds initial_rto{1000};
+  std::chrono::milliseconds min_rto{20};
+  std::chrono::milliseconds max_rto{MAX_TIMEOUT_MS};
+
+  // Timeouts in a row, without any progress, before giving up
+  int max_attempts = MAX_RETRIES;
+
+  // The receiver acknowledges every ack_every segments that arrive in order,
+  // and any other segment straight away. The rest wait at most ack_delay.
+  unsigned ack_every = 2;
+  std::chrono::milliseconds ack_delay{2};
+
+  // Largest transfer a receiver accepts
+  uint32_t max_size = 64 << 20;
+};
+
+/// @brief Number of segments a transfer of the given size is split into. Even
+/// an empty transfer has one, so the receiver learns its size.
+constexpr uint32_t bulk_segment_count(uint32_t total_size) {
+  return std::max<uint32_t>(
+      1, (total_size + BULK_SEGMENT_SIZE - 1) / BULK_SEGMENT_SIZE);
+}
+
+/// @brief Sending end of a selective-repeat bulk transfer. Segments are sent
+/// while fewer than the receiver's window are unacknowledged. A segment is
+/// resent once three segments sent after it have been acknowledged, or when
+/// the retransmission timer, which follows the measured round trip, expires.
+/// Pacing is left to the sink, e.g. a SendScheduler's bulk class. All methods
+/// must be called on the io_context's thread.
+class BulkSender {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// @brief Encodes and sends one message to the receiver
+  using Sink = std::function<void(std::vector<uint8_t> message)>;
+
+  /// @brief Called once, with whether every segment was acknowledged. The
+  /// sender must not be destroyed from within it.
+  using Completion = std::function<void(bool delivered)>;
+
+private:
+  struct Segment {
+    Clock::time_point sent_at;
+    uint64_t tx = 0;            // Order it was last sent in, 0 if never sent
+    bool acked = false;         // Whether the receiver has it
+    bool lost = false;          // Whether it needs sending again
+    bool retransmitted = false; // Whether it has been sent more than once
+  };
+
+  asio::steady_timer m_timer;
+  Sink m_sink;
+  Completion m_on_complete;
+  BulkOptions m_options;
+  BulkHeader m_header;
+
+  std::vector<uint8_t> m_data;
+  std::vector<Segment> m_segments;
+  uint32_t m_cumulative = 0; // First segment not yet acknowledged
+  uint32_t m_next = 0;       // First segment never sent
+  uint16_t m_window;         // Last window the receiver advertised
+  size_t m_in_flight = 0;    // Sent, and neither acknowledged nor lost
+
+  // Order of the last send, and of the latest send acknowledged
+  uint64_t m_tx = 0;
+  uint64_t m_acked_tx = 0;
+
+  // Round trip estimate and retransmission timeout, as in RFC 6298
+  std::optional<Clock::duration> m_srtt;
+  Clock::duration m_rttvar{0};
+  Clock::duration m_rto;
+  int m_timeouts = 0;
+
+  bool m_timer_armed = false;
+  bool m_done = false;
+  uint64_t m_sent = 0;
+  uint64_t m_retransmits = 0;
+
+  // Sends lost segments, then new ones, while the window allows
+  void pump();
+
+  // Sends one segment and notes when
+  void send_segment(uint32_t seq);
+
+  // Marks a segment as acknowledged
+  void acknowledge(uint32_t seq, Clock::time_point now,
+                   std::optional<Clock::duration> &rtt);
+
+  // Updates the round trip estimate with a sample
+  void sample_rtt(Clock::duration rtt);
+
+  // (Re)starts the retransmission timer
+  void arm_timer();
+
+  // Resends everything in flight, or gives up after too many timeouts
+  void on_timeout();
+
+  // Completes the transfer
+  void finish(bool delivered);
+
+public:
+  /// @brief Constructor for BulkSender
+  /// @param io_context Context the retransmission timer runs on
+  /// @param open The receiver's OPEN message, naming the transfer
+  /// @param data Content to send
+  /// @param sink Called with each message for the receiver
+  /// @param on_complete Called once the transfer succeeds or fails
+  /// @param options Timeouts and limits
+  BulkSender(asio::io_context &io_context, const BulkHeader &open,
+             std::vector<uint8_t> data, Sink sink, Completion on_complete,
+             const BulkOptions &options = {});
+
+  BulkSender(const BulkSender &) = delete;
+  BulkSender &operator=(const BulkSender &) = delete;
+
+  /// @brief Sends the first window of segments
+  void start();
+
+  /// @brief Handles an ACK from the receiver
+  void handle_ack(const BulkAck &ack);
+
+  /// @brief Gives up on the transfer without telling the receiver, e.g.
+  /// because it has aborted
+  void cancel();
+
+  /// @brief Whether the transfer has completed either way
+  bool done() const { return m_done; }
+
+  /// @brief Number of segments the content is split into
+  size_t segment_count() const { return m_segments.size(); }
+
+  /// @brief Number of segments sent, first sends and retransmissions
+  uint64_t segments_sent() const { return m_sent; }
+
+  /// @brief Number of segments sent again
+  uint64_t retransmits() const { return m_retransmits; }
+
+  /// @brief Current retransmission timeout
+  Clock::duration rto() const { return m_rto; }
+};
+
+/// @brief Receiving end of a bulk transfer. Opens the transfer, reassembles
+/// segments arriving in any order and acknowledges them with a cumulative
+/// count and a bitmap of the segments after it. All methods must be called
+/// on the io_context's thread.
+class BulkReceiver {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// @brief Encodes and sends one message to the sender
+  using Sink = std::function<void(std::vector<uint8_t> message)>;
+
+  /// @brief Called once with the content, or std::nullopt if the transfer
+  /// failed. The receiver must not be destroyed from within it.
+  using Completion = std::function<void(std::optional<std::vector<uint8_t>>)>;
+
+private:
+  asio::steady_timer m_idle_timer, m_ack_timer;
+  Sink m_sink;
+  Completion m_on_complete;
+  BulkOptions m_options;
+  BulkHeader m_header;
+
+  std::vector<uint8_t> m_data;
+  std::vector<bool> m_arrived;
+  std::optional<uint32_t> m_total_size; // Known once a segment arrives
+  uint32_t m_cumulative = 0;            // First segment not yet arrived
+  uint32_t m_received = 0;              // Segments arrived in all
+  uint64_t m_duplicates = 0;
+
+  unsigned m_unacked = 0; // Segments arrived since the last ACK
+  bool m_ack_armed = false;
+  int m_attempts = 0; // OPENs sent without an answer
+  Clock::duration m_open_timeout;
+  bool m_done = false;
+
+  // Sends the OPEN message
+  void send_open();
+
+  // Sends an ACK of everything that has arrived
+  void send_ack();
+
+  // Restarts the wait for the sender
+  void arm_idle_timer(Clock::duration timeout);
+
+  // Resends the OPEN, or gives up once the sender is silent for too long
+  void on_idle();
+
+  // Completes the transfer
+  void finish(std::optional<std::vector<uint8_t>> data);
+
+public:
+  /// @brief Constructor for BulkReceiver
+  /// @param io_context Context the timers run on
+  /// @param rover_id Rover the transfer is with
+  /// @param transfer_id ID naming the transfer, unique to the receiver
+  /// @param content What to ask the sender for
+  /// @param sink Called with each message for the sender
+  /// @param on_complete Called once the transfer succeeds or fails
+  /// @param options Window, timeouts and limits
+  BulkReceiver(asio::io_context &io_context, uint32_t rover_id,
+               uint32_t transfer_id, BulkContent content, Sink sink,
+               Completion on_complete, const BulkOptions &options = {});
+
+  BulkReceiver(const BulkReceiver &) = delete;
+  BulkReceiver &operator=(const BulkReceiver &) = delete;
+
+  /// @brief Opens the transfer, resending until the sender answers
+  void start();
+
+  /// @brief Handles a DATA message. Once the transfer is complete, segments
+  /// are still acknowledged so a sender that missed the last ACK can finish.
+  /// @param message The decoded message, which may have lost trailing zeros
+  void handle_segment(const std::vector<uint8_t> &message);
+
+  /// @brief Gives up on the transfer
+  /// @param notify Whether to tell the sender
+  void cancel(bool notify);
+
+  /// @brief Whether the transfer has completed either way
+  bool done() const { return m_done; }
+
+  /// @brief Number of segments that arrived more than once
+  uint64_t duplicates() const { return m_duplicates; }
+};
+
+/// @brief Reads a bulk transfer message's header
+/// @param message The decoded message
+/// @return the header, or std::nullopt if the message is not a bulk message
+std::optional<BulkHeader> peek_bulk_header(const std::vector<uint8_t> &message);
+
+} // namespace transport
@@ -0,0 +1,138 @@
+#include "coalescer.h"
+
+namespace transport {
+
+namespace {
+// Bytes in front of each message in a batch, holding its length
+constexpr size_t FRAME_HEADER_SIZE = sizeof(uint16_t);
+
+// Whether two messages are from the same rover
+bool same_rover(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+  constexpr size_t id_size = sizeof(MessageHeader::rover_id);
+  return a.size() >= id_size && b.size() >= id_size &&
+         std::memcmp(a.data(), b.data(), id_size) == 0;
+}
+} // namespace
+
+Coalescer::Coalescer(asio::io_context &io_context, Sink sink,
+                     Clock::duration delay, size_t max_payload)
+    : m_timer(io_context), m_sink(std::move(sink)), m_delay(delay),
+      m_max_payload(max_payload) {}
+
+void Coalescer::push(std::vector<uint8_t> message, bool urgent) {
+  // A batch header names one rover, and a batch must fit in one datagram
+  if (!m_pending.empty() &&
+      (m_batch_size + FRAME_HEADER_SIZE + message.size() > m_max_payload ||
+       !same_rover(m_pending.front(), message))) {
+    flush();
+  }
+
+  if (m_pending.empty()) {
+    m_batch_size = sizeof(MessageHeader);
+  }
+  m_batch_size += FRAME_HEADER_SIZE + message.size();
+  m_pending.push_back(std::move(message));
+
+  // A full batch has nothing to wait for. A message too big to share a
+  // datagram is sent on its own.
+  if (urgent || m_batch_size >= m_max_payload) {
+    send_pending(urgent);
+    return;
+  }
+
+  if (!m_timer_armed) {
+    m_timer_armed = true;
+    m_timer.expires_after(m_delay);
+    m_timer.async_wait([this](const asio::error_code &ec) {
+      if (!ec) {
+        m_timer_armed = false;
+        flush();
+      }
+    });
+  }
+}
+
+void Coalescer::flush() { send_pending(false); }
+
+void Coalescer::send_pending(bool urgent) {
+  if (m_timer_armed) {
+    m_timer_armed = false;
+    m_timer.cancel();
+  }
+  if (m_pending.empty()) {
+    return;
+  }
+
+  m_messages_sent += m_pending.size();
+  m_datagrams_sent++;
+
+  // A lone message needs no framing
+  if (m_pending.size() == 1) {
+    std::vector<uint8_t> message = std::move(m_pending.front());
+    m_pending.clear();
+    m_sink(std::move(message), urgent);
+    return;
+  }
+
+  MessageHeader header;
+  std::memcpy(&header.rover_id, m_pending.front().data(),
+              sizeof(header.rover_id));
+  header.request_id = BATCH_REQUEST_ID;
+
+  std::vector<uint8_t> payload(sizeof(header));
+  payload.reserve(m_batch_size);
+  std::memcpy(payload.data(), &header, sizeof(header));
+
+  // Lengths are little-endian, and never 0 as every message has a header
+  for (const auto &message : m_pending) {
+    payload.push_back(static_cast<uint8_t>(message.size() & 0xFF));
+    payload.push_back(static_cast<uint8_t>(message.size() >> 8));
+    payload.insert(payload.end(), message.begin(), message.end());
+  }
+  m_pending.clear();
+
+  m_sink(std::move(payload), urgent);
+}
+
+std::optional<std::vector<std::vector<uint8_t>>>
+unpack_batch(const std::vector<uint8_t> &packet) {
+  auto header = peek_header(packet.data(), packet.size());
+  if (!header || header->request_id != BATCH_REQUEST_ID) {
+    return std::nullopt;
+  }
+
+  // Trailing zeros were stripped by decoding, so reading past the end gives 0
+  auto byte_at = [&packet](size_t offset) -> uint8_t {
+    return offset < packet.size() ? packet[offset] : 0;
+  };
+
+  // A length is never all zeros, so every frame leaves at least one byte
+  // behind even if the rest of it was stripped
+  std::vector<std::vector<uint8_t>> messages;
+  size_t offset = sizeof(MessageHeader);
+  while (offset < packet.size()) {
+    size_t length = byte_at(offset) | (byte_at(offset + 1) << 8);
+    offset += FRAME_HEADER_SIZE;
+    if (length == 0) {
+      break;
+    }
+    if (offset + length > MAX_PAYLOAD_SIZE) {
+      return std::nullopt; // Could not have been sent in one datagram
+    }
+
+    std::vector<uint8_t> message(length, 0);
+    if (offset < packet.size()) {
+      size_t available = std::min(length, packet.size() - offset);
+      std::memcpy(message.data(), packet.data() + offset, available);
+    }
+    messages.push_back(std::move(message));
+    offset += length;
+  }
+
+  if (messages.empty()) {
+    return std::nullopt;
+  }
+  return messages;
+}
+
+} // namespace transport
@@ -0,0 +1,87 @@
+#pragma once
+#include "protocols.h"
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace transport {
+
+/// @brief How long a message waits for others to share its datagram
+constexpr std::chrono::milliseconds COALESCE_DELAY{1};
+
+/// @brief Packs the messages sent to one peer into as few datagrams as
+/// possible. Messages are held until the batch would outgrow one datagram,
+/// the oldest has waited the coalescing delay, or an urgent message arrives.
+/// A message sent alone goes out as-is, otherwise the batch is framed as
+/// described for BATCH_REQUEST_ID. Every message must start with a
+/// MessageHeader. All methods must be called on the io_context's thread.
+class Coalescer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// @brief Encodes and sends the payload of one datagram. It is urgent if an
+  /// urgent message is in it.
+  using Sink = std::function<void(std::vector<uint8_t> payload, bool urgent)>;
+
+private:
+  asio::steady_timer m_timer;
+  Sink m_sink;
+  Clock::duration m_delay;
+  size_t m_max_payload;
+
+  // Messages waiting to be sent, and their size once framed as a batch
+  std::vector<std::vector<uint8_t>> m_pending;
+  size_t m_batch_size = 0;
+  bool m_timer_armed = false;
+
+  uint64_t m_messages_sent = 0;
+  uint64_t m_datagrams_sent = 0;
+
+  // Hands the queued messages to the sink as one datagram
+  void send_pending(bool urgent);
+
+public:
+  /// @brief Constructor for Coalescer
+  /// @param io_context Context the coalescing delay is timed on
+  /// @param sink Called with the payload of each datagram to send, and
+  /// whether it is urgent
+  /// @param delay Longest a message is held back, unless urgent
+  /// @param max_payload Largest payload of one datagram before encoding
+  Coalescer(asio::io_context &io_context, Sink sink,
+            Clock::duration delay = COALESCE_DELAY,
+            size_t max_payload = MAX_PAYLOAD_SIZE);
+
+  Coalescer(const Coalescer &) = delete;
+  Coalescer &operator=(const Coalescer &) = delete;
+
+  /// @brief Queues a message for the peer
+  /// @param message The message, starting with its MessageHeader
+  /// @param urgent Whether to send it, and everything queued before it, now
+  void push(std::vector<uint8_t> message, bool urgent = false);
+
+  /// @brief Sends every queued message now
+  void flush();
+
+  /// @brief Number of messages waiting to be sent
+  size_t pending() const { return m_pending.size(); }
+
+  /// @brief Number of messages handed to the sink so far
+  uint64_t messages_sent() const { return m_messages_sent; }
+
+  /// @brief Number of datagrams handed to the sink so far
+  uint64_t datagrams_sent() const { return m_datagrams_sent; }
+};
+
+/// @brief Splits a decoded batch into its messages. Decoding strips trailing
+/// zeros, so bytes missing from the end of the packet are read as zeros.
+/// @param packet The decoded packet, starting with a MessageHeader whose
+/// request ID is BATCH_REQUEST_ID
+/// @return the messages, or std::nullopt if the packet is not a valid batch
+std::optional<std::vector<std::vector<uint8_t>>>
+unpack_batch(const std::vector<uint8_t> &packet);
+
+} // namespace transport
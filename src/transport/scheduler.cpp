@@ -0,0 +1,267 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+namespace transport {
+
+namespace {
+// How often a transport whose backlog is full is checked for room
+constexpr std::chrono::milliseconds BACKLOG_POLL{1};
+
+constexpr size_t index_of(TrafficClass traffic_class) {
+  return static_cast<size_t>(traffic_class);
+}
+} // namespace
+
+const char *traffic_class_name(TrafficClass traffic_class) {
+  switch (traffic_class) {
+  case TrafficClass::EMERGENCY:
+    return "emergency";
+  case TrafficClass::CONTROL:
+    return "control";
+  case TrafficClass::INTERACTIVE:
+    return "interactive";
+  case TrafficClass::BULK:
+    return "bulk";
+  }
+  return "unknown";
+}
+
+TokenBucket::TokenBucket(double rate, double burst, Clock::time_point now)
+    : m_rate(rate), m_burst(burst), m_tokens(burst), m_last(now) {}
+
+void TokenBucket::refill(Clock::time_point now) {
+  if (now <= m_last) {
+    return;
+  }
+  double elapsed = std::chrono::duration<double>(now - m_last).count();
+  m_tokens = std::min(m_burst, m_tokens + elapsed * m_rate);
+  m_last = now;
+}
+
+bool TokenBucket::ready(Clock::time_point now) {
+  if (m_rate <= 0) {
+    return true;
+  }
+  refill(now);
+  return m_tokens > 0;
+}
+
+void TokenBucket::consume(size_t bytes) {
+  if (m_rate > 0) {
+    m_tokens -= static_cast<double>(bytes);
+  }
+}
+
+TokenBucket::Clock::duration TokenBucket::wait(Clock::time_point now) {
+  if (ready(now)) {
+    return Clock::duration::zero();
+  }
+
+  // Rounded up, so the bucket is out of debt when the wait is over
+  auto debt = std::chrono::duration<double>((1 - m_tokens) / m_rate);
+  return std::chrono::ceil<Clock::duration>(debt);
+}
+
+SendScheduler::SendScheduler(asio::io_context &io_context,
+                             Transport &transport,
+                             const SchedulerOptions &options)
+    : m_io_context(io_context), m_transport(transport), m_options(options),
+      m_link(options.link_rate, static_cast<double>(options.link_burst)),
+      m_timer(io_context) {}
+
+void SendScheduler::send(const udp::endpoint &endpoint,
+                         std::vector<uint8_t> datagram,
+                         TrafficClass traffic_class) {
+  auto now = Clock::now();
+  Entry entry{endpoint, std::move(datagram), now, traffic_class};
+
+  if (traffic_class == TrafficClass::BULK) {
+    auto [it, inserted] = m_bulk_peers.try_emplace(
+        endpoint,
+        BulkPeer{{},
+                 TokenBucket(m_options.bulk_rate,
+                             static_cast<double>(m_options.bulk_burst), now)});
+    if (it->second.queue.empty()) {
+      m_bulk_turns.push_back(endpoint);
+    }
+    it->second.queue.push_back(std::move(entry));
+    m_bulk_queued++;
+  } else {
+    m_queues[index_of(traffic_class)].push_back(std::move(entry));
+  }
+
+  post_pump();
+}
+
+void SendScheduler::async_wait_drained(std::function<void()> handler) {
+  m_drained = std::move(handler);
+  if (m_drained) {
+    post_pump();
+  }
+}
+
+size_t SendScheduler::queued(TrafficClass traffic_class) const {
+  if (traffic_class == TrafficClass::BULK) {
+    return m_bulk_queued;
+  }
+  return m_queues[index_of(traffic_class)].size();
+}
+
+size_t SendScheduler::queued() const {
+  size_t waiting = m_bulk_queued;
+  for (const auto &queue : m_queues) {
+    waiting += queue.size();
+  }
+  return waiting;
+}
+
+void SendScheduler::post_pump() {
+  if (m_pump_posted) {
+    return;
+  }
+  m_pump_posted = true;
+  asio::post(m_io_context, [this]() { pump(); });
+}
+
+void SendScheduler::pump_after(Clock::duration delay) {
+  // Replacing the expiry cancels the previous wait
+  m_timer.expires_after(delay);
+  m_timer.async_wait([this](const asio::error_code &ec) {
+    if (!ec) {
+      pump();
+    }
+  });
+}
+
+std::optional<size_t> SendScheduler::ready_bulk_peer(Clock::time_point now,
+                                                     Clock::duration &wait) {
+  for (size_t turn = 0; turn < m_bulk_turns.size(); ++turn) {
+    TokenBucket &bucket = m_bulk_peers.at(m_bulk_turns[turn]).bucket;
+    if (bucket.ready(now)) {
+      return turn;
+    }
+    wait = std::min(wait, bucket.wait(now));
+  }
+  return std::nullopt;
+}
+
+std::optional<SendScheduler::Entry>
+SendScheduler::next(Clock::time_point now, Clock::duration &wait) {
+  // Emergencies are never held back by the other classes
+  auto &emergency = m_queues[index_of(TrafficClass::EMERGENCY)];
+  if (!emergency.empty()) {
+    Entry entry = std::move(emergency.front());
+    emergency.pop_front();
+    return entry;
+  }
+
+  // Of the classes with a datagram that may be sent, the one with the
+  // earliest virtual start time goes next
+  std::optional<size_t> bulk_turn;
+  if (m_bulk_queued != 0) {
+    bulk_turn = ready_bulk_peer(now, wait);
+  }
+
+  std::optional<size_t> chosen;
+  for (size_t idx = index_of(TrafficClass::CONTROL); idx < TRAFFIC_CLASSES;
+       ++idx) {
+    bool ready = idx == index_of(TrafficClass::BULK) ? bulk_turn.has_value()
+                                                     : !m_queues[idx].empty();
+    if (!ready) {
+      // A class with nothing to send saves up no share for later
+      m_start[idx] = std::max(m_start[idx], m_virtual_time);
+      continue;
+    }
+    if (!chosen || m_start[idx] < m_start[*chosen]) {
+      chosen = idx;
+    }
+  }
+  if (!chosen) {
+    return std::nullopt;
+  }
+
+  Entry entry;
+  if (*chosen == index_of(TrafficClass::BULK)) {
+    // The peer goes to the back of the turns if it has more to send
+    udp::endpoint endpoint = m_bulk_turns[*bulk_turn];
+    m_bulk_turns.erase(m_bulk_turns.begin() + *bulk_turn);
+
+    BulkPeer &peer = m_bulk_peers.at(endpoint);
+    entry = std::move(peer.queue.front());
+    peer.queue.pop_front();
+    peer.bucket.consume(entry.datagram.size());
+    m_bulk_queued--;
+    if (!peer.queue.empty()) {
+      m_bulk_turns.push_back(endpoint);
+    }
+  } else {
+    entry = std::move(m_queues[*chosen].front());
+    m_queues[*chosen].pop_front();
+  }
+
+  m_virtual_time = m_start[*chosen];
+  m_start[*chosen] += static_cast<double>(entry.datagram.size()) /
+                      std::max(1u, m_options.weights[*chosen]);
+  return entry;
+}
+
+void SendScheduler::pump() {
+  m_pump_posted = false;
+  auto now = Clock::now();
+  auto wait = Clock::duration::max();
+
+  // Only as much as the transport can pass on is released, so the rest waits
+  // here where a later emergency can still overtake it
+  size_t released = 0;
+  while (m_transport.backlog() < m_options.max_backlog) {
+    if (!m_link.ready(now)) {
+      wait = m_link.wait(now);
+      break;
+    }
+    auto entry = next(now, wait);
+    if (!entry) {
+      break;
+    }
+
+    ClassStats &stats = m_stats[index_of(entry->traffic_class)];
+    stats.sent++;
+    stats.bytes += entry->datagram.size();
+    stats.max_wait = std::max(stats.max_wait, now - entry->queued_at);
+
+    m_link.consume(entry->datagram.size());
+    m_transport.queue_send(entry->endpoint, std::move(entry->datagram));
+    released++;
+  }
+  if (released != 0) {
+    m_transport.flush();
+  }
+
+  if (queued() == 0) {
+    // Whoever waits for the drain is told once the kernel has taken the rest.
+    // Transports do not report when sends complete, so until then the
+    // backlog is polled, as it is while it is full.
+    if (!m_drained) {
+      return;
+    }
+    if (m_transport.backlog() != 0) {
+      pump_after(BACKLOG_POLL);
+      return;
+    }
+    std::function<void()> drained = std::move(m_drained);
+    m_drained = nullptr;
+    drained();
+    return;
+  }
+
+  // Carry on once the kernel takes the backlog, or once the link or a peer's
+  // bucket allows. Short of a full backlog, datagrams are only held back by
+  // the link or the buckets, and each of those sets the wait.
+  if (m_transport.backlog() >= m_options.max_backlog) {
+    pump_after(BACKLOG_POLL);
+  } else {
+    pump_after(wait);
+  }
+}
+
+} // namespace transport
@@ -0,0 +1,196 @@
+#pragma once
+#include "transport.h"
+
+#include <array>
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace transport {
+
+/// @brief Classes of outgoing traffic, most urgent first
+enum class TrafficClass : uint8_t {
+  EMERGENCY,   // Always sent first, e.g. emergency alerts
+  CONTROL,     // Keeps the link alive, e.g. heartbeats and handshakes
+  INTERACTIVE, // Commands and their responses
+  BULK         // Large transfers, rate limited per peer
+};
+
+/// @brief Number of traffic classes
+constexpr size_t TRAFFIC_CLASSES = 4;
+
+/// @brief Gets the printable name of a traffic class
+const char *traffic_class_name(TrafficClass traffic_class);
+
+/// @brief Meters bytes out at a steady rate, allowing bursts up to a limit.
+/// The bucket may go into debt by one datagram, so datagrams of any size pass
+/// and the debt is repaid before the next one.
+class TokenBucket {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  double m_rate;   // Bytes per second, 0 for no limit
+  double m_burst;  // Most bytes that can be saved up
+  double m_tokens; // Bytes that can be sent now, negative when in debt
+  Clock::time_point m_last;
+
+  void refill(Clock::time_point now);
+
+public:
+  /// @brief Constructor for TokenBucket. The bucket starts full.
+  /// @param rate Bytes per second, 0 for no limit
+  /// @param burst Most bytes that can be sent at once after a quiet spell
+  /// @param now Current time
+  TokenBucket(double rate = 0, double burst = 0,
+              Clock::time_point now = Clock::now());
+
+  /// @brief Whether a datagram may be sent now
+  bool ready(Clock::time_point now);
+
+  /// @brief Takes a sent datagram's bytes from the bucket
+  void consume(size_t bytes);
+
+  /// @brief Time until a datagram may be sent, 0 if one may be sent now
+  Clock::duration wait(Clock::time_point now);
+};
+
+/// @brief Settings for a SendScheduler
+struct SchedulerOptions {
+  // Share of the link each class gets while several are waiting. Emergency
+  // traffic has strict priority, so its weight is unused.
+  std::array<unsigned, TRAFFIC_CLASSES> weights = {0, 4, 2, 1};
+
+  // Bytes per second the link carries, 0 for no limit, and the most bytes
+  // sent at once after a quiet spell
+  double link_rate = 0;
+  size_t link_burst = 4 * MAX_PACKET_SIZE;
+
+  // Bulk bytes per second to each peer, and the most sent at once
+  double bulk_rate = 256 * 1024;
+  size_t bulk_burst = 16 * MAX_PACKET_SIZE;
+
+  // Datagrams handed to the transport while it has this many the kernel has
+  // not taken. Bounds how long an emergency datagram waits behind others.
+  size_t max_backlog = DEFAULT_BATCH_SIZE;
+};
+
+/// @brief Orders the datagrams sent through a transport by traffic class.
+/// Emergency datagrams go first, the other classes share the link by weight,
+/// and bulk datagrams to each peer are limited by a token bucket so they
+/// cannot crowd out commands. Datagrams are held here rather than in the
+/// transport's FIFO while the link is busy, so priorities apply under load.
+/// All methods must be called on the io_context's thread.
+class SendScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// @brief What a traffic class has been through so far
+  struct ClassStats {
+    uint64_t sent = 0;           // Datagrams handed to the transport
+    uint64_t bytes = 0;          // Bytes handed to the transport
+    Clock::duration max_wait{0}; // Longest a datagram waited to be sent
+  };
+
+private:
+  struct Entry {
+    udp::endpoint endpoint;
+    std::vector<uint8_t> datagram;
+    Clock::time_point queued_at;
+    TrafficClass traffic_class;
+  };
+
+  // Bulk datagrams for one peer, metered by its own bucket
+  struct BulkPeer {
+    std::deque<Entry> queue;
+    TokenBucket bucket;
+  };
+
+  asio::io_context &m_io_context;
+  Transport &m_transport;
+  SchedulerOptions m_options;
+
+  // Queues of every class but bulk, by class. The bulk slot is unused.
+  std::array<std::deque<Entry>, TRAFFIC_CLASSES> m_queues;
+
+  // Bulk queues by peer, and the peers with datagrams waiting in turn order
+  std::unordered_map<udp::endpoint, BulkPeer, EndpointHash> m_bulk_peers;
+  std::deque<udp::endpoint> m_bulk_turns;
+  size_t m_bulk_queued = 0;
+
+  // Weighted fair queuing: each class's virtual start time, advanced by its
+  // datagrams' sizes over its weight, and the start time last served
+  std::array<double, TRAFFIC_CLASSES> m_start{};
+  double m_virtual_time = 0;
+
+  TokenBucket m_link;
+  asio::steady_timer m_timer;
+  bool m_pump_posted = false;
+
+  std::array<ClassStats, TRAFFIC_CLASSES> m_stats;
+
+  // Called once nothing is left here or in the transport's backlog
+  std::function<void()> m_drained;
+
+  // Sends what the link and transport have room for, then waits for more
+  void pump();
+
+  // Takes the next datagram to send, or std::nullopt if none may be sent yet
+  std::optional<Entry> next(Clock::time_point now, Clock::duration &wait);
+
+  // Finds the first peer in turn whose bucket allows a bulk datagram
+  std::optional<size_t> ready_bulk_peer(Clock::time_point now,
+                                        Clock::duration &wait);
+
+  // Posts a pump to run once the current handler returns
+  void post_pump();
+
+  // Pumps again after the given delay
+  void pump_after(Clock::duration delay);
+
+public:
+  /// @brief Constructor for SendScheduler
+  /// @param io_context Context the transport runs on
+  /// @param transport Transport the datagrams are sent through. It must
+  /// outlive the scheduler.
+  /// @param options Weights and rate limits
+  SendScheduler(asio::io_context &io_context, Transport &transport,
+                const SchedulerOptions &options = {});
+
+  SendScheduler(const SendScheduler &) = delete;
+  SendScheduler &operator=(const SendScheduler &) = delete;
+
+  /// @brief Queues a datagram. It is handed to the transport once the current
+  /// handler returns, or later if the link is busy, so datagrams queued
+  /// together share system calls.
+  /// @param endpoint Destination of the datagram
+  /// @param datagram Bytes to send
+  /// @param traffic_class Class deciding when it is sent
+  void send(const udp::endpoint &endpoint, std::vector<uint8_t> datagram,
+            TrafficClass traffic_class);
+
+  /// @brief Calls a handler once every queued datagram has been handed to the
+  /// transport and its backlog is empty. The handler is never called from
+  /// inside this method, and is called once.
+  /// @param handler Called when drained. Replaces any handler not yet called,
+  /// and an empty one stops the wait.
+  void async_wait_drained(std::function<void()> handler);
+
+  /// @brief Number of datagrams of a class waiting to be sent
+  size_t queued(TrafficClass traffic_class) const;
+
+  /// @brief Number of datagrams of every class waiting to be sent
+  size_t queued() const;
+
+  /// @brief What a traffic class has been through so far
+  const ClassStats &stats(TrafficClass traffic_class) const {
+    return m_stats[static_cast<size_t>(traffic_class)];
+  }
+};
+
+} // namespace transport
@@ -0,0 +1,643 @@
+#include "shm_transport.h"
+
+#ifdef __linux__
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace transport {
+
+static_assert((SHM_RING_BYTES & (SHM_RING_BYTES - 1)) == 0,
+              "SHM_RING_BYTES must be a power of 2");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared rings need lock-free atomics");
+
+/// @brief Ring shared by one sending and one receiving transport. Only the
+/// sender moves head and writes the bytes past it, and only the receiver moves
+/// tail, so neither side takes a lock. Both count bytes from the start and
+/// never wrap; the offset into data is taken modulo its size.
+struct ShmRing {
+  alignas(64) std::atomic<uint64_t> head{0};
+  alignas(64) std::atomic<uint64_t> tail{0};
+
+  // Set by the receiver before it sleeps, cleared by the sender that wakes it
+  alignas(64) std::atomic<uint32_t> waiting{1};
+
+  alignas(64) uint8_t data[SHM_RING_BYTES];
+};
+
+namespace {
+// Precedes each datagram in a ring. Records are 8-byte aligned and never
+// split, so one that would run past the end is preceded by a wrap marker.
+struct RecordHeader {
+  uint32_t size;
+  uint32_t reserved;
+};
+
+constexpr uint32_t WRAP_MARKER = UINT32_MAX;
+
+// Largest datagram taken, so a ring always holds several
+constexpr size_t MAX_DATAGRAM = SHM_RING_BYTES / 4;
+
+// First message on a connection, sent along with the ring's descriptor
+struct Hello {
+  uint32_t magic;
+  uint32_t ring_bytes;
+  uint16_t port; // Port the sender listens on
+};
+
+constexpr uint32_t HELLO_MAGIC = 0x53484d31; // "SHM1"
+
+// How often datagrams that did not fit in a ring are tried again
+constexpr std::chrono::microseconds RETRY_INTERVAL{100};
+
+// Range ports are picked from when the endpoint's port is 0
+constexpr unsigned short EPHEMERAL_FIRST = 49152;
+constexpr unsigned short EPHEMERAL_LAST = 65535;
+
+std::system_error last_error(const char *what) {
+  return std::system_error(errno, std::system_category(), what);
+}
+
+size_t record_size(size_t size) {
+  return (sizeof(RecordHeader) + size + 7) & ~size_t{7};
+}
+
+// Builds the abstract socket address standing in for a port
+socklen_t socket_address(unsigned short port, sockaddr_un &address) {
+  address = {};
+  address.sun_family = AF_UNIX;
+  int length = std::snprintf(address.sun_path + 1, sizeof(address.sun_path) - 1,
+                             "%s%u", SHM_SOCKET_PREFIX, port);
+  return offsetof(sockaddr_un, sun_path) + 1 + length;
+}
+
+int open_socket() {
+  return ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+}
+} // namespace
+
+ShmTransport::Mapping::~Mapping() {
+  if (ring) {
+    munmap(ring, sizeof(ShmRing));
+  }
+}
+
+ShmTransport::ShmTransport(asio::io_context &io_context,
+                           const udp::endpoint &endpoint,
+                           const BindOptions &options)
+    : m_io_context(io_context), m_endpoint(endpoint), m_listener(io_context),
+      m_retry_timer(io_context) {
+  // Every process would need to hand out rings to the same port's group
+  if (options.reuse_port) {
+    throw std::system_error(std::make_error_code(std::errc::not_supported),
+                            "SO_REUSEPORT over shared memory");
+  }
+
+  listen();
+  accept();
+}
+
+ShmTransport::~ShmTransport() { release(); }
+
+void ShmTransport::listen() {
+  int fd = open_socket();
+  if (fd < 0) {
+    throw last_error("socket");
+  }
+  m_listener.assign(fd);
+
+  // Binding the name claims the port, and the kernel frees it however the
+  // process exits
+  auto try_bind = [fd](unsigned short port) {
+    sockaddr_un address;
+    socklen_t length = socket_address(port, address);
+    return ::bind(fd, reinterpret_cast<sockaddr *>(&address), length) == 0;
+  };
+
+  unsigned short port = m_endpoint.port();
+  if (port != 0) {
+    if (!try_bind(port)) {
+      throw last_error("bind");
+    }
+  } else {
+    const unsigned range = EPHEMERAL_LAST - EPHEMERAL_FIRST + 1;
+    unsigned start = std::random_device()() % range;
+    bool bound = false;
+    for (unsigned idx = 0; idx < range && !bound; ++idx) {
+      port = EPHEMERAL_FIRST + (start + idx) % range;
+      bound = try_bind(port);
+      if (!bound && errno != EADDRINUSE) {
+        throw last_error("bind");
+      }
+    }
+    if (!bound) {
+      throw std::system_error(EADDRINUSE, std::system_category(),
+                              "no free shared memory port");
+    }
+  }
+  m_endpoint.port(port);
+
+  if (::listen(fd, SOMAXCONN) < 0) {
+    throw last_error("listen");
+  }
+}
+
+void ShmTransport::accept() {
+  m_listener.async_wait(
+      asio::posix::stream_descriptor::wait_read,
+      [this](const asio::error_code &ec) {
+        if (ec == asio::error::operation_aborted || m_closed) {
+          return;
+        }
+
+        while (true) {
+          int fd = ::accept4(m_listener.native_handle(), nullptr, nullptr,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+          if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+              continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+              std::cerr << "Error accepting shared memory sender: "
+                        << std::strerror(errno) << std::endl;
+            }
+            break;
+          }
+
+          auto inbound = std::make_shared<Inbound>(m_io_context);
+          inbound->socket.assign(fd);
+          m_inbound.push_back(inbound);
+          read_inbound(inbound);
+        }
+
+        accept();
+      });
+}
+
+void ShmTransport::watch_inbound(const std::shared_ptr<Inbound> &inbound) {
+  inbound->socket.async_wait(
+      asio::posix::stream_descriptor::wait_read,
+      [this, inbound](const asio::error_code &ec) {
+        if (ec == asio::error::operation_aborted || m_closed) {
+          return;
+        }
+        read_inbound(inbound);
+      });
+}
+
+void ShmTransport::read_inbound(const std::shared_ptr<Inbound> &inbound) {
+  int fd = inbound->socket.native_handle();
+  bool woken = false;
+
+  while (true) {
+    Hello hello{};
+    iovec iov{&hello, sizeof(hello)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t received = ::recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (received <= 0) {
+      inbound->closed = true;
+      break;
+    }
+    woken = true;
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    int ring_fd;
+    std::memcpy(&ring_fd, CMSG_DATA(cmsg), sizeof(ring_fd));
+
+    // Only the first ring on a connection is taken, and only if it is as
+    // big as ours, as a short one would fault when touched
+    struct stat info;
+    if (!inbound->mapping && received == sizeof(hello) &&
+        hello.magic == HELLO_MAGIC && hello.ring_bytes == SHM_RING_BYTES &&
+        ::fstat(ring_fd, &info) == 0 &&
+        static_cast<size_t>(info.st_size) >= sizeof(ShmRing)) {
+      void *ring = mmap(nullptr, sizeof(ShmRing), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, ring_fd, 0);
+      if (ring == MAP_FAILED) {
+        std::cerr << "Error mapping shared memory ring: "
+                  << std::strerror(errno) << std::endl;
+      } else {
+        inbound->mapping = std::make_shared<Mapping>();
+        inbound->mapping->ring = static_cast<ShmRing *>(ring);
+        inbound->port = hello.port;
+      }
+    }
+    ::close(ring_fd);
+  }
+
+  // A sender that has gone is dropped once its ring is drained
+  if (inbound->closed) {
+    post_drain();
+    return;
+  }
+  if (woken) {
+    post_drain();
+  }
+  watch_inbound(inbound);
+}
+
+void ShmTransport::post_drain() {
+  if (m_drain_posted) {
+    return;
+  }
+  m_drain_posted = true;
+  asio::post(m_io_context, [this] { drain(); });
+}
+
+void ShmTransport::drain() {
+  m_drain_posted = false;
+  if (m_closed || !m_handler) {
+    return;
+  }
+
+  // Datagrams are handed over where they lie in the rings, which are only
+  // given back once the handler returns
+  m_batch.clear();
+  m_consumed.clear();
+  const size_t count = m_inbound.size();
+  size_t stopped_at = count;
+  for (size_t step = 0; step < count && m_batch.size() < DEFAULT_BATCH_SIZE;
+       ++step) {
+    size_t idx = (m_next_inbound + step) % count;
+    const auto &inbound = m_inbound[idx];
+    if (!inbound->mapping) {
+      continue;
+    }
+
+    ShmRing *ring = inbound->mapping->ring;
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    udp::endpoint sender(asio::ip::address_v4::loopback(), inbound->port);
+
+    // The sender can write anywhere in the ring, so a record is only taken
+    // once it is known to lie within what was published and within the ring
+    bool corrupt = head - tail > SHM_RING_BYTES || tail % 8 != 0;
+    while (!corrupt && tail != head && m_batch.size() < DEFAULT_BATCH_SIZE) {
+      size_t offset = tail % SHM_RING_BYTES;
+      size_t available = head - tail;
+      RecordHeader header;
+      std::memcpy(&header, ring->data + offset, sizeof(header));
+      if (header.size == WRAP_MARKER) {
+        corrupt = SHM_RING_BYTES - offset > available;
+        if (!corrupt) {
+          tail += SHM_RING_BYTES - offset;
+        }
+        continue;
+      }
+      size_t size = record_size(header.size);
+      if (header.size > MAX_DATAGRAM || size > available ||
+          size > SHM_RING_BYTES - offset) {
+        corrupt = true;
+        continue;
+      }
+      m_batch.push_back(
+          {sender, ring->data + offset + sizeof(header), header.size});
+      tail += size;
+    }
+
+    m_consumed.emplace_back(inbound->mapping, tail);
+    if (corrupt) {
+      // What came before is still handed over, but nothing more is read from
+      // a sender that broke the ring
+      std::cerr << "Dropping shared memory sender on port " << inbound->port
+                << " with a corrupt ring" << std::endl;
+      inbound->mapping.reset();
+      inbound->closed = true;
+      asio::error_code ec;
+      inbound->socket.close(ec);
+      continue;
+    }
+    if (tail != head) {
+      stopped_at = idx;
+    }
+  }
+
+  if (!m_batch.empty()) {
+    m_handler(m_batch);
+  }
+
+  // Mappings are kept alive by m_consumed, even if the handler closed us
+  for (auto &[mapping, tail] : m_consumed) {
+    mapping->ring->tail.store(tail, std::memory_order_release);
+  }
+  m_consumed.clear();
+  if (m_closed) {
+    return;
+  }
+
+  // Senders that have gone are dropped once nothing of theirs is left
+  std::erase_if(m_inbound, [](const std::shared_ptr<Inbound> &inbound) {
+    if (!inbound->closed) {
+      return false;
+    }
+    if (!inbound->mapping) {
+      return true;
+    }
+    ShmRing *ring = inbound->mapping->ring;
+    return ring->head.load(std::memory_order_acquire) ==
+           ring->tail.load(std::memory_order_relaxed);
+  });
+
+  // Start after the ring that filled the batch next time, so a busy sender
+  // cannot starve the others
+  if (stopped_at != count) {
+    m_next_inbound = stopped_at + 1;
+    post_drain();
+    return;
+  }
+  m_next_inbound = 0;
+
+  // Every ring is empty. Ask senders for a wakeup, then look once more in
+  // case one wrote before it could see the request.
+  for (const auto &inbound : m_inbound) {
+    if (inbound->mapping) {
+      inbound->mapping->ring->waiting.store(1, std::memory_order_seq_cst);
+    }
+  }
+  for (const auto &inbound : m_inbound) {
+    if (inbound->mapping) {
+      ShmRing *ring = inbound->mapping->ring;
+      if (ring->head.load(std::memory_order_seq_cst) !=
+          ring->tail.load(std::memory_order_relaxed)) {
+        post_drain();
+        return;
+      }
+    }
+  }
+}
+
+std::shared_ptr<ShmTransport::Outbound>
+ShmTransport::connect(unsigned short port) {
+  int fd = open_socket();
+  if (fd < 0) {
+    std::cerr << "Error opening shared memory connection: "
+              << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+  auto outbound = std::make_shared<Outbound>(m_io_context);
+  outbound->socket.assign(fd);
+
+  // Nobody listening is not an error, as with UDP
+  sockaddr_un address;
+  socklen_t length = socket_address(port, address);
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&address), length) < 0) {
+    return nullptr;
+  }
+
+  // The name is only needed until the descriptor is passed on, so the ring
+  // is freed once both ends have unmapped it
+  static std::atomic<unsigned> counter{0};
+  char name[64];
+  std::snprintf(name, sizeof(name), "/%s%d-%u", SHM_SOCKET_PREFIX,
+                static_cast<int>(::getpid()), counter.fetch_add(1));
+  int ring_fd = ::shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (ring_fd < 0) {
+    std::cerr << "Error creating shared memory ring: " << std::strerror(errno)
+              << std::endl;
+    return nullptr;
+  }
+  ::shm_unlink(name);
+
+  void *memory = MAP_FAILED;
+  if (::ftruncate(ring_fd, sizeof(ShmRing)) == 0) {
+    memory = mmap(nullptr, sizeof(ShmRing), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, ring_fd, 0);
+  }
+  if (memory == MAP_FAILED) {
+    std::cerr << "Error mapping shared memory ring: " << std::strerror(errno)
+              << std::endl;
+    ::close(ring_fd);
+    return nullptr;
+  }
+  outbound->mapping = std::make_shared<Mapping>();
+  outbound->mapping->ring = new (memory) ShmRing;
+
+  Hello hello{HELLO_MAGIC, SHM_RING_BYTES, m_endpoint.port()};
+  iovec iov{&hello, sizeof(hello)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &ring_fd, sizeof(ring_fd));
+
+  ssize_t sent = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+  ::close(ring_fd);
+  if (sent != sizeof(hello)) {
+    std::cerr << "Error handing over shared memory ring: "
+              << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+  return outbound;
+}
+
+void ShmTransport::watch_outbound(unsigned short port,
+                                  const std::shared_ptr<Outbound> &outbound) {
+  // Receivers never write, so the connection only becomes readable once the
+  // receiver has gone. Whatever it had not read is lost with it.
+  outbound->socket.async_wait(
+      asio::posix::stream_descriptor::wait_read,
+      [this, port, outbound](const asio::error_code &ec) {
+        if (ec == asio::error::operation_aborted || m_closed) {
+          return;
+        }
+        m_backlog -= outbound->pending.size();
+        outbound->pending.clear();
+        auto it = m_outbound.find(port);
+        if (it != m_outbound.end() && it->second == outbound) {
+          m_outbound.erase(it);
+        }
+        asio::error_code close_ec;
+        outbound->socket.close(close_ec);
+      });
+}
+
+bool ShmTransport::write(Outbound &outbound,
+                         const std::vector<uint8_t> &message) {
+  ShmRing *ring = outbound.mapping->ring;
+  size_t size = record_size(message.size());
+  size_t offset = outbound.head % SHM_RING_BYTES;
+  size_t padding = SHM_RING_BYTES - offset < size ? SHM_RING_BYTES - offset : 0;
+
+  uint64_t tail = ring->tail.load(std::memory_order_acquire);
+  if (outbound.head + padding + size - tail > SHM_RING_BYTES) {
+    return false;
+  }
+
+  if (padding > 0) {
+    RecordHeader wrap{WRAP_MARKER, 0};
+    std::memcpy(ring->data + offset, &wrap, sizeof(wrap));
+    outbound.head += padding;
+    offset = 0;
+  }
+  RecordHeader header{static_cast<uint32_t>(message.size()), 0};
+  std::memcpy(ring->data + offset, &header, sizeof(header));
+  std::memcpy(ring->data + offset + sizeof(header), message.data(),
+              message.size());
+  outbound.head += size;
+  return true;
+}
+
+void ShmTransport::publish(Outbound &outbound) {
+  while (!outbound.pending.empty() &&
+         write(outbound, outbound.pending.front())) {
+    outbound.pending.pop_front();
+    m_backlog--;
+  }
+
+  ShmRing *ring = outbound.mapping->ring;
+  if (ring->head.load(std::memory_order_relaxed) == outbound.head) {
+    return;
+  }
+  ring->head.store(outbound.head, std::memory_order_seq_cst);
+
+  // Only one sender wakes a waiting receiver. A full connection means a
+  // wakeup is already on its way.
+  if (ring->waiting.load(std::memory_order_seq_cst) &&
+      ring->waiting.exchange(0, std::memory_order_seq_cst)) {
+    char wakeup = 0;
+    ::send(outbound.socket.native_handle(), &wakeup, sizeof(wakeup),
+           MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+}
+
+void ShmTransport::async_receive(BatchHandler handler) {
+  m_handler = std::move(handler);
+  post_drain();
+}
+
+void ShmTransport::queue_send(const udp::endpoint &endpoint,
+                              std::vector<uint8_t> message) {
+  if (m_closed) {
+    return;
+  }
+  if (message.size() > MAX_DATAGRAM) {
+    std::cerr << "Datagram of " << message.size()
+              << " bytes is too big for shared memory" << std::endl;
+    return;
+  }
+
+  std::shared_ptr<Outbound> outbound;
+  auto it = m_outbound.find(endpoint.port());
+  if (it != m_outbound.end()) {
+    outbound = it->second;
+  } else {
+    outbound = connect(endpoint.port());
+    if (!outbound) {
+      return;
+    }
+    m_outbound.emplace(endpoint.port(), outbound);
+    watch_outbound(endpoint.port(), outbound);
+  }
+
+  // Datagrams go straight into the ring unless earlier ones are waiting
+  if (outbound->pending.empty() && write(*outbound, message)) {
+    // Written, to be published on the next flush
+  } else {
+    outbound->pending.push_back(std::move(message));
+    m_backlog++;
+  }
+  if (!outbound->listed) {
+    outbound->listed = true;
+    m_unflushed.push_back(std::move(outbound));
+  }
+}
+
+void ShmTransport::flush() {
+  if (m_closed) {
+    return;
+  }
+
+  // Peers whose rings are full stay listed until the receiver makes room
+  size_t kept = 0;
+  for (auto &outbound : m_unflushed) {
+    if (outbound->socket.is_open()) {
+      publish(*outbound);
+    }
+    if (!outbound->pending.empty()) {
+      m_unflushed[kept++] = std::move(outbound);
+    } else {
+      outbound->listed = false;
+    }
+  }
+  m_unflushed.resize(kept);
+
+  if (!m_unflushed.empty() && !m_retry_armed) {
+    m_retry_armed = true;
+    m_retry_timer.expires_after(RETRY_INTERVAL);
+    m_retry_timer.async_wait([this](const asio::error_code &ec) {
+      if (ec == asio::error::operation_aborted) {
+        return;
+      }
+      m_retry_armed = false;
+      flush();
+    });
+  }
+}
+
+size_t ShmTransport::backlog() const { return m_backlog; }
+
+udp::endpoint ShmTransport::local_endpoint() const { return m_endpoint; }
+
+udp::socket::native_handle_type ShmTransport::native_handle() {
+  return m_listener.native_handle();
+}
+
+void ShmTransport::close() {
+  m_closed = true;
+  release();
+}
+
+void ShmTransport::release() {
+  // Closing the sockets tells every peer we have gone. The rings are
+  // unmapped once nothing here refers to them.
+  asio::error_code ec;
+  m_retry_timer.cancel();
+  m_listener.close(ec);
+  for (auto &inbound : m_inbound) {
+    inbound->socket.close(ec);
+  }
+  for (auto &[port, outbound] : m_outbound) {
+    outbound->socket.close(ec);
+  }
+  m_inbound.clear();
+  m_outbound.clear();
+  m_unflushed.clear();
+  m_backlog = 0;
+}
+
+} // namespace transport
+#endif
@@ -0,0 +1,141 @@
+#pragma once
+#include "transport.h"
+
+#ifdef __linux__
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace transport {
+
+/// @brief Bytes of datagrams each shared memory ring holds (a power of 2)
+constexpr size_t SHM_RING_BYTES = 64 * 1024;
+
+/// @brief Prefix of the abstract socket names shared memory transports listen
+/// on, followed by the port
+constexpr const char *SHM_SOCKET_PREFIX = "rover-shm-";
+
+struct ShmRing;
+
+/// @brief Transport between processes on the same host that never touches the
+/// network stack. Each sender creates a single-producer single-consumer ring
+/// in POSIX shared memory for every peer it sends to and hands it over on an
+/// abstract Unix socket named after the peer's port, which stands in for the
+/// bound UDP port. Datagrams are then copied straight into the ring and
+/// received in place. The socket only carries a wakeup while the receiver has
+/// run dry, and tells each side when the other has gone. Datagrams keep their
+/// framing, so the RS path is unchanged. Every sender appears to come from
+/// the loopback address.
+class ShmTransport : public Transport {
+private:
+  // A ring mapped into this process, unmapped once nothing refers to it
+  struct Mapping {
+    ShmRing *ring = nullptr;
+    ~Mapping();
+  };
+
+  // A sender's connection and the ring it fills
+  struct Inbound {
+    asio::posix::stream_descriptor socket;
+    std::shared_ptr<Mapping> mapping;
+    unsigned short port = 0; // Port the sender listens on
+    bool closed = false;     // Whether the sender has gone
+
+    explicit Inbound(asio::io_context &io_context) : socket(io_context) {}
+  };
+
+  // The connection and ring to a peer. Datagrams are written into the ring as
+  // they are queued and published on the next flush. Those that did not fit
+  // wait here.
+  struct Outbound {
+    asio::posix::stream_descriptor socket;
+    std::shared_ptr<Mapping> mapping;
+    uint64_t head = 0;   // End of the datagrams written so far
+    bool listed = false; // Whether it is in m_unflushed
+    std::deque<std::vector<uint8_t>> pending;
+
+    explicit Outbound(asio::io_context &io_context) : socket(io_context) {}
+  };
+
+  asio::io_context &m_io_context;
+  udp::endpoint m_endpoint;
+
+  // Listening socket standing in for the bound port
+  asio::posix::stream_descriptor m_listener;
+
+  std::vector<std::shared_ptr<Inbound>> m_inbound;
+  size_t m_next_inbound = 0; // Ring drained first next time, for fairness
+  bool m_drain_posted = false;
+  BatchHandler m_handler;
+  std::vector<Datagram> m_batch;
+
+  // Rings the batch came from, and how far it reaches in each
+  std::vector<std::pair<std::shared_ptr<Mapping>, uint64_t>> m_consumed;
+
+  std::unordered_map<unsigned short, std::shared_ptr<Outbound>> m_outbound;
+  std::vector<std::shared_ptr<Outbound>> m_unflushed;
+  size_t m_backlog = 0; // Datagrams waiting for room in a ring
+  asio::steady_timer m_retry_timer;
+  bool m_retry_armed = false;
+  bool m_closed = false;
+
+  // Binds the listening socket, picking a free port if the endpoint's is 0
+  void listen();
+
+  // Accepts senders as they connect
+  void accept();
+
+  // Reads a sender's ring, wakeups and departure
+  void watch_inbound(const std::shared_ptr<Inbound> &inbound);
+  void read_inbound(const std::shared_ptr<Inbound> &inbound);
+
+  // Hands the next batch of datagrams to the handler
+  void drain();
+  void post_drain();
+
+  // Connects to a peer and hands it a new ring, or returns nullptr if no
+  // transport listens on the port
+  std::shared_ptr<Outbound> connect(unsigned short port);
+
+  // Notices when a peer goes away
+  void watch_outbound(unsigned short port,
+                      const std::shared_ptr<Outbound> &outbound);
+
+  // Writes a datagram into a peer's ring without publishing it
+  bool write(Outbound &outbound, const std::vector<uint8_t> &message);
+
+  // Writes what fits of a peer's pending datagrams and publishes everything
+  // written, waking the peer if it is waiting
+  void publish(Outbound &outbound);
+
+  void release();
+
+public:
+  /// @brief Constructor for ShmTransport
+  /// @param io_context Context the transport runs on
+  /// @param endpoint Local endpoint to stand in for. Only the port matters, and
+  /// 0 picks a free one.
+  /// @param options Socket options. SO_REUSEPORT is not supported, and the
+  /// rest do not apply.
+  /// @throws std::system_error if the port is taken or shared memory is
+  /// unavailable
+  ShmTransport(asio::io_context &io_context, const udp::endpoint &endpoint,
+               const BindOptions &options = {});
+  ~ShmTransport() override;
+
+  ShmTransport(const ShmTransport &other) = delete;
+  ShmTransport &operator=(const ShmTransport &other) = delete;
+
+  void async_receive(BatchHandler handler) override;
+  void queue_send(const udp::endpoint &endpoint,
+                  std::vector<uint8_t> message) override;
+  void flush() override;
+  size_t backlog() const override;
+  udp::endpoint local_endpoint() const override;
+  udp::socket::native_handle_type native_handle() override;
+  void close() override;
+};
+
+} // namespace transport
+#endif
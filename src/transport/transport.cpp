@@ -0,0 +1,211 @@
+#include "transport.h"
+#include "shm_transport.h"
+#include "uring_transport.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+#ifdef __linux__
+#include <linux/filter.h>
+#include <sys/socket.h>
+#endif
+
+namespace transport {
+
+std::optional<Backend> parse_backend(std::string_view name) {
+  if (name == "asio") {
+    return Backend::ASIO;
+  }
+  if (name == "uring" || name == "io_uring") {
+    return Backend::IO_URING;
+  }
+  if (name == "shm") {
+    return Backend::SHM;
+  }
+  return std::nullopt;
+}
+
+const char *backend_name(Backend backend) {
+  switch (backend) {
+  case Backend::ASIO:
+    return "asio";
+  case Backend::IO_URING:
+    return "io_uring";
+  case Backend::SHM:
+    return "shm";
+  }
+  return "unknown";
+}
+
+bool reuse_port_supported(Backend backend) {
+#ifdef SO_REUSEPORT
+  return backend != Backend::SHM;
+#else
+  return false;
+#endif
+}
+
+size_t EndpointHash::operator()(const udp::endpoint &endpoint) const {
+  size_t hash = std::hash<unsigned short>()(endpoint.port());
+  if (endpoint.address().is_v4()) {
+    hash ^= std::hash<uint32_t>()(endpoint.address().to_v4().to_uint()) << 1;
+  } else {
+    for (uint8_t byte : endpoint.address().to_v6().to_bytes()) {
+      hash = hash * 31 + byte;
+    }
+  }
+  return hash;
+}
+
+void apply_bind_options(udp::socket &socket, const BindOptions &options) {
+  if (options.reuse_address) {
+    socket.set_option(asio::socket_base::reuse_address(true));
+  }
+
+  if (options.reuse_port) {
+#ifdef SO_REUSEPORT
+    using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                            SO_REUSEPORT>;
+    socket.set_option(reuse_port(true));
+#else
+    throw std::system_error(std::make_error_code(std::errc::not_supported),
+                            "SO_REUSEPORT");
+#endif
+  }
+
+  // The kernel caps the size at its configured maximum
+  if (options.receive_buffer > 0) {
+    socket.set_option(
+        asio::socket_base::receive_buffer_size(options.receive_buffer));
+  }
+}
+
+AsioTransport::AsioTransport(asio::io_context &io_context,
+                             const udp::endpoint &endpoint,
+                             const BindOptions &options)
+    : m_socket(io_context, endpoint.protocol()), m_batch(m_socket) {
+// Windows-specific: Disable connection reset behavior
+#ifdef _WIN32
+  BOOL bNewBehavior = FALSE;
+  DWORD dwBytesReturned = 0;
+  WSAIoctl(m_socket.native_handle(), SIO_UDP_CONNRESET, &bNewBehavior,
+           sizeof(bNewBehavior), NULL, 0, &dwBytesReturned, NULL, NULL);
+#endif
+
+  apply_bind_options(m_socket, options);
+  m_socket.bind(endpoint);
+}
+
+void AsioTransport::async_receive(BatchHandler handler) {
+  m_batch.async_receive(std::move(handler));
+}
+
+void AsioTransport::queue_send(const udp::endpoint &endpoint,
+                               std::vector<uint8_t> message) {
+  // A closed transport drops what it is given, as UDP would
+  if (m_socket.is_open()) {
+    m_batch.queue_send(endpoint, std::move(message));
+  }
+}
+
+void AsioTransport::flush() {
+  if (m_socket.is_open()) {
+    m_batch.flush();
+  }
+}
+
+size_t AsioTransport::backlog() const { return m_batch.queued(); }
+
+udp::endpoint AsioTransport::local_endpoint() const {
+  return m_socket.local_endpoint();
+}
+
+udp::socket::native_handle_type AsioTransport::native_handle() {
+  return m_socket.native_handle();
+}
+
+void AsioTransport::close() {
+  asio::error_code ec;
+  m_socket.close(ec);
+}
+
+std::unique_ptr<Transport> make_transport(Backend backend,
+                                          asio::io_context &io_context,
+                                          const udp::endpoint &endpoint,
+                                          const BindOptions &options) {
+  if (backend == Backend::SHM) {
+#ifdef __linux__
+    return std::make_unique<ShmTransport>(io_context, endpoint, options);
+#else
+    std::cerr << "Shared memory transport is only available on Linux, falling "
+                 "back to asio"
+              << std::endl;
+#endif
+  }
+
+  if (backend == Backend::IO_URING) {
+#ifdef __linux__
+    try {
+      return std::make_unique<UringTransport>(io_context, endpoint, options);
+    } catch (const std::system_error &e) {
+      std::cerr << "io_uring transport unavailable (" << e.what()
+                << "), falling back to asio" << std::endl;
+    }
+#else
+    std::cerr << "io_uring transport is only available on Linux, falling back "
+                 "to asio"
+              << std::endl;
+#endif
+  }
+
+  return std::make_unique<AsioTransport>(io_context, endpoint, options);
+}
+
+bool steer_reuseport_group(Transport &transport, uint32_t payload_offset,
+                           uint32_t group_size) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+  if (group_size == 0) {
+    return false;
+  }
+
+  // The filter runs with the packet positioned at the UDP payload. Classic
+  // BPF loads are big-endian, so the value is assembled a byte at a time,
+  // most significant first, then reduced modulo the group size.
+  sock_filter code[] = {
+      {BPF_LD | BPF_B | BPF_ABS, 0, 0, payload_offset + 3},
+      {BPF_ALU | BPF_LSH | BPF_K, 0, 0, 8},
+      {BPF_MISC | BPF_TAX, 0, 0, 0},
+      {BPF_LD | BPF_B | BPF_ABS, 0, 0, payload_offset + 2},
+      {BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0},
+      {BPF_ALU | BPF_LSH | BPF_K, 0, 0, 8},
+      {BPF_MISC | BPF_TAX, 0, 0, 0},
+      {BPF_LD | BPF_B | BPF_ABS, 0, 0, payload_offset + 1},
+      {BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0},
+      {BPF_ALU | BPF_LSH | BPF_K, 0, 0, 8},
+      {BPF_MISC | BPF_TAX, 0, 0, 0},
+      {BPF_LD | BPF_B | BPF_ABS, 0, 0, payload_offset},
+      {BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0},
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size},
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  sock_fprog program{static_cast<unsigned short>(std::size(code)), code};
+
+  if (setsockopt(transport.native_handle(), SOL_SOCKET,
+                 SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+    std::cerr << "Could not attach SO_REUSEPORT steering filter: "
+              << std::strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+#else
+  (void)transport;
+  (void)payload_offset;
+  (void)group_size;
+  return false;
+#endif
+}
+
+} // namespace transport
@@ -0,0 +1,139 @@
+#pragma once
+#include "batch_socket.h"
+
+#include <asio.hpp>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+using asio::ip::udp;
+
+namespace transport {
+
+/// @brief The I/O backends a transport can be built on
+enum class Backend {
+  ASIO,    // Readiness based asio sockets, batched with recvmmsg/sendmmsg
+  IO_URING, // Completion based io_uring ring (Linux only)
+  SHM       // Shared memory rings to processes on this host (Linux only)
+};
+
+/// @brief Parses a backend name ("asio", "uring" or "shm")
+/// @param name the name given on the command line
+/// @return the backend, or std::nullopt if the name is unknown
+std::optional<Backend> parse_backend(std::string_view name);
+
+/// @brief Gets the printable name of a backend
+const char *backend_name(Backend backend);
+
+/// @brief Socket options applied before a transport binds
+struct BindOptions {
+  bool reuse_address = false; // SO_REUSEADDR
+  bool reuse_port = false;    // SO_REUSEPORT, lets several sockets share a port
+  int receive_buffer = 0;     // SO_RCVBUF in bytes, 0 keeps the default
+};
+
+/// @brief Whether SO_REUSEPORT load balancing is available to a backend on
+/// this system
+bool reuse_port_supported(Backend backend);
+
+/// @brief Hash for using UDP endpoints as unordered container keys
+struct EndpointHash {
+  size_t operator()(const udp::endpoint &endpoint) const;
+};
+
+/// @brief A bound UDP endpoint that delivers received datagrams in batches and
+/// sends without blocking. All methods must be called on the thread running
+/// the io_context the transport was created with.
+class Transport {
+public:
+  virtual ~Transport() = default;
+
+  /// @brief Starts delivering received datagrams to handler until the
+  /// transport is closed
+  /// @param handler Called on the io_context thread with each batch
+  virtual void async_receive(BatchHandler handler) = 0;
+
+  /// @brief Queues a datagram to be sent on the next flush
+  /// @param endpoint Destination of the datagram
+  /// @param message Bytes to send
+  virtual void queue_send(const udp::endpoint &endpoint,
+                          std::vector<uint8_t> message) = 0;
+
+  /// @brief Hands every queued datagram to the kernel without blocking
+  virtual void flush() = 0;
+
+  /// @brief Number of datagrams queued or sent that the kernel has not yet
+  /// taken, so senders can hold back while the socket is congested
+  virtual size_t backlog() const = 0;
+
+  /// @brief Queues a datagram and flushes straight away
+  void send(const udp::endpoint &endpoint, std::vector<uint8_t> message) {
+    queue_send(endpoint, std::move(message));
+    flush();
+  }
+
+  /// @brief Gets the local endpoint the transport is bound to
+  virtual udp::endpoint local_endpoint() const = 0;
+
+  /// @brief Gets the underlying socket descriptor
+  virtual udp::socket::native_handle_type native_handle() = 0;
+
+  /// @brief Stops receiving and releases the socket
+  virtual void close() = 0;
+};
+
+/// @brief Transport built on an asio socket with batched system calls
+class AsioTransport : public Transport {
+private:
+  udp::socket m_socket;
+  BatchSocket m_batch;
+
+public:
+  /// @brief Constructor for AsioTransport
+  /// @param io_context Context that runs the socket's asynchronous operations
+  /// @param endpoint Local endpoint to bind to
+  /// @param options Socket options to apply before binding
+  AsioTransport(asio::io_context &io_context, const udp::endpoint &endpoint,
+                const BindOptions &options = {});
+
+  void async_receive(BatchHandler handler) override;
+  void queue_send(const udp::endpoint &endpoint,
+                  std::vector<uint8_t> message) override;
+  void flush() override;
+  size_t backlog() const override;
+  udp::endpoint local_endpoint() const override;
+  udp::socket::native_handle_type native_handle() override;
+  void close() override;
+};
+
+/// @brief Creates a transport bound to the given endpoint. If the requested
+/// backend is not supported by this system, the asio backend is used instead.
+/// A shared memory transport only reaches peers using shared memory too, so
+/// it does not fall back where it is supported.
+/// @param backend The preferred I/O backend
+/// @param io_context Context the transport delivers its completions on
+/// @param endpoint Local endpoint to bind to
+/// @param options Socket options to apply before binding
+/// @return the transport
+std::unique_ptr<Transport> make_transport(Backend backend,
+                                          asio::io_context &io_context,
+                                          const udp::endpoint &endpoint,
+                                          const BindOptions &options = {});
+
+/// @brief Applies the options to a socket that has been opened but not bound
+/// @param socket the socket to configure
+/// @param options the options to apply
+void apply_bind_options(udp::socket &socket, const BindOptions &options);
+
+/// @brief Steers datagrams arriving on a SO_REUSEPORT group to the socket
+/// whose index (in the order the sockets were bound) equals a little-endian
+/// 32-bit value in the payload, modulo the group size. Datagrams the filter
+/// cannot steer fall back to the kernel's hash.
+/// @param transport any member of the group
+/// @param payload_offset offset of the value within each datagram
+/// @param group_size number of sockets in the group
+/// @return whether the filter was attached (Linux only)
+bool steer_reuseport_group(Transport &transport, uint32_t payload_offset,
+                           uint32_t group_size);
+
+} // namespace transport
@@ -0,0 +1,513 @@
+#include "uring_transport.h"
+
+#ifdef __linux__
+#include <atomic>
+#include <cerrno>
+#include <iostream>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace transport {
+
+/// @brief Number of submission queue entries in the ring
+constexpr unsigned RING_ENTRIES = 256;
+
+/// @brief Number of buffers in the provided buffer ring (must be a power of 2)
+constexpr unsigned BUFFER_COUNT = 128;
+
+/// @brief Buffer group the multishot receive selects from
+constexpr uint16_t BUFFER_GROUP = 0;
+
+/// @brief Size of each provided buffer. Multishot recvmsg writes a header and
+/// the sender's address in front of the payload.
+constexpr size_t BUFFER_SIZE =
+    sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage) + MAX_PACKET_SIZE;
+
+/// @brief user_data of the multishot receive. Sends use the address of their
+/// SendOp, which can never be 1.
+constexpr uint64_t RECV_TAG = 1;
+
+static std::system_error last_error(const char *what) {
+  return std::system_error(errno, std::system_category(), what);
+}
+
+UringTransport::UringTransport(asio::io_context &io_context,
+                               const udp::endpoint &endpoint,
+                               const BindOptions &options)
+    : m_socket(io_context, endpoint.protocol()), m_event(io_context) {
+  apply_bind_options(m_socket, options);
+  m_socket.bind(endpoint);
+
+  // Every received buffer is laid out for an address of this size
+  m_recv_msg.msg_namelen = sizeof(sockaddr_storage);
+
+  try {
+    setup_ring(RING_ENTRIES);
+    probe_features();
+  } catch (...) {
+    release();
+    throw;
+  }
+
+  wait_for_completions();
+}
+
+UringTransport::~UringTransport() { release(); }
+
+void UringTransport::setup_ring(unsigned entries) {
+  io_uring_params params{};
+  int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (fd < 0) {
+    throw last_error("io_uring_setup");
+  }
+  m_ring_fd = fd;
+
+  // Map the submission and completion rings. Newer kernels allow both to be
+  // mapped with a single call.
+  m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    m_sq_ring_size = m_cq_ring_size =
+        std::max(m_sq_ring_size, m_cq_ring_size);
+  }
+
+  m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (m_sq_ring == MAP_FAILED) {
+    m_sq_ring = nullptr;
+    throw last_error("mmap submission ring");
+  }
+
+  if (single_mmap) {
+    m_cq_ring = m_sq_ring;
+  } else {
+    m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (m_cq_ring == MAP_FAILED) {
+      m_cq_ring = nullptr;
+      throw last_error("mmap completion ring");
+    }
+  }
+
+  m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    throw last_error("mmap submission entries");
+  }
+  m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+  auto *sq = static_cast<uint8_t *>(m_sq_ring);
+  m_sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  m_sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  m_sq_entries = params.sq_entries;
+
+  auto *cq = static_cast<uint8_t *>(m_cq_ring);
+  m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  m_cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  // Register the provided buffer ring (Linux 5.19+). It has to be page
+  // aligned, so it gets its own anonymous mapping.
+  m_buf_ring_size = BUFFER_COUNT * sizeof(io_uring_buf);
+  m_buf_ring = mmap(nullptr, m_buf_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (m_buf_ring == MAP_FAILED) {
+    m_buf_ring = nullptr;
+    throw last_error("mmap buffer ring");
+  }
+
+  io_uring_buf_reg reg{};
+  reg.ring_addr = reinterpret_cast<uint64_t>(m_buf_ring);
+  reg.ring_entries = BUFFER_COUNT;
+  reg.bgid = BUFFER_GROUP;
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg,
+              1) < 0) {
+    throw last_error("io_uring_register(PBUF_RING)");
+  }
+
+  m_buffers.resize(BUFFER_COUNT * BUFFER_SIZE);
+  for (unsigned bid = 0; bid < BUFFER_COUNT; ++bid) {
+    recycle_buffer(static_cast<uint16_t>(bid));
+  }
+
+  // Signal completions through an eventfd so the io_context can wait on them
+  int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd < 0) {
+    throw last_error("eventfd");
+  }
+  m_event.assign(event_fd);
+
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD, &event_fd,
+              1) < 0) {
+    throw last_error("io_uring_register(EVENTFD)");
+  }
+}
+
+void UringTransport::probe_features() {
+  // Kernel versions say little, as distributions backport io_uring features,
+  // so the operations are asked for by name
+  std::vector<uint8_t> storage(sizeof(io_uring_probe) +
+                               256 * sizeof(io_uring_probe_op));
+  auto *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+  if (syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PROBE, probe,
+              256) < 0) {
+    throw last_error("io_uring_register(PROBE)");
+  }
+  for (uint8_t op : {uint8_t{IORING_OP_RECVMSG}, uint8_t{IORING_OP_SENDMSG}}) {
+    if (op > probe->last_op ||
+        !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      throw std::system_error(ENOSYS, std::system_category(),
+                              "io_uring recvmsg/sendmsg not supported");
+    }
+  }
+
+  // The probe does not cover the multishot flag. A kernel without it fails
+  // the receive as soon as it is submitted, while one with it leaves the
+  // receive posted without completing.
+  arm_receive();
+  submit();
+  unsigned tail =
+      std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire);
+  for (unsigned head = *m_cq_head; head != tail; ++head) {
+    const io_uring_cqe &cqe = m_cqes[head & *m_cq_mask];
+    if (cqe.user_data == RECV_TAG && cqe.res == -EINVAL) {
+      throw std::system_error(ENOSYS, std::system_category(),
+                              "multishot recvmsg not supported");
+    }
+  }
+}
+
+void UringTransport::release() {
+  asio::error_code ec;
+  m_event.close(ec);
+  m_socket.close(ec);
+
+  // Closing the ring cancels the multishot receive and any pending sends
+  if (m_ring_fd >= 0) {
+    ::close(m_ring_fd);
+    m_ring_fd = -1;
+  }
+
+  if (m_sqes) {
+    munmap(m_sqes, m_sqes_size);
+    m_sqes = nullptr;
+  }
+  if (m_cq_ring && m_cq_ring != m_sq_ring) {
+    munmap(m_cq_ring, m_cq_ring_size);
+  }
+  m_cq_ring = nullptr;
+  if (m_sq_ring) {
+    munmap(m_sq_ring, m_sq_ring_size);
+    m_sq_ring = nullptr;
+  }
+  if (m_buf_ring) {
+    munmap(m_buf_ring, m_buf_ring_size);
+    m_buf_ring = nullptr;
+  }
+
+  m_handler = nullptr;
+  m_batch.clear();
+  m_batch_buffers.clear();
+  m_recv_armed = false;
+  m_send_queue.clear();
+  m_in_flight.clear();
+}
+
+void UringTransport::recycle_buffer(uint16_t buffer_id) {
+  auto *bufs = static_cast<io_uring_buf *>(m_buf_ring);
+
+  // Fields are written one at a time because the ring's tail overlays the
+  // reserved field of the first entry
+  io_uring_buf &buf = bufs[m_buf_tail & (BUFFER_COUNT - 1)];
+  buf.addr = reinterpret_cast<uint64_t>(&m_buffers[buffer_id * BUFFER_SIZE]);
+  buf.len = BUFFER_SIZE;
+  buf.bid = buffer_id;
+  m_buf_tail++;
+
+  // Publish the buffer to the kernel
+  std::atomic_ref<uint16_t>(bufs[0].resv)
+      .store(static_cast<uint16_t>(m_buf_tail), std::memory_order_release);
+}
+
+io_uring_sqe *UringTransport::get_sqe() {
+  unsigned head =
+      std::atomic_ref<unsigned>(*m_sq_head).load(std::memory_order_acquire);
+  unsigned tail = *m_sq_tail;
+  if (tail - head >= m_sq_entries) {
+    return nullptr;
+  }
+
+  unsigned idx = tail & *m_sq_mask;
+  io_uring_sqe *sqe = &m_sqes[idx];
+  std::memset(sqe, 0, sizeof(*sqe));
+  m_sq_array[idx] = idx;
+
+  // The kernel only reads the entry on io_uring_enter, so the tail can be
+  // published before the caller fills it in
+  std::atomic_ref<unsigned>(*m_sq_tail).store(tail + 1,
+                                              std::memory_order_release);
+  return sqe;
+}
+
+void UringTransport::submit() {
+  unsigned head =
+      std::atomic_ref<unsigned>(*m_sq_head).load(std::memory_order_acquire);
+  unsigned to_submit = *m_sq_tail - head;
+
+  while (to_submit > 0) {
+    int submitted = static_cast<int>(syscall(
+        __NR_io_uring_enter, m_ring_fd, to_submit, 0, 0, nullptr, 0));
+    if (submitted < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // EAGAIN/EBUSY: the kernel is out of resources or the completion queue
+      // is full. Entries stay queued and are submitted on the next flush.
+      if (errno != EAGAIN && errno != EBUSY) {
+        std::cerr << "io_uring_enter failed: " << std::strerror(errno)
+                  << std::endl;
+      }
+      return;
+    }
+    to_submit -= static_cast<unsigned>(submitted);
+  }
+}
+
+void UringTransport::arm_receive() {
+  io_uring_sqe *sqe = get_sqe();
+  if (!sqe) {
+    submit();
+    sqe = get_sqe();
+    if (!sqe) {
+      return; // Retried after the next batch of completions
+    }
+  }
+
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = m_socket.native_handle();
+  sqe->addr = reinterpret_cast<uint64_t>(&m_recv_msg);
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BUFFER_GROUP;
+  sqe->user_data = RECV_TAG;
+
+  m_recv_armed = true;
+}
+
+void UringTransport::wait_for_completions() {
+  m_event.async_wait(asio::posix::stream_descriptor::wait_read,
+                     [this](const asio::error_code &ec) {
+                       // Transport was closed
+                       if (ec) {
+                         return;
+                       }
+
+                       // Reset the eventfd counter before reaping
+                       uint64_t count;
+                       if (::read(m_event.native_handle(), &count,
+                                  sizeof(count)) < 0 &&
+                           errno != EAGAIN) {
+                         std::cerr << "Error reading io_uring eventfd: "
+                                   << std::strerror(errno) << std::endl;
+                       }
+
+                       reap_completions();
+                       wait_for_completions();
+                     });
+}
+
+void UringTransport::reap_completions() {
+  unsigned head = *m_cq_head;
+  unsigned tail =
+      std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire);
+
+  for (; head != tail; ++head) {
+    const io_uring_cqe &cqe = m_cqes[head & *m_cq_mask];
+
+    // Send completion
+    if (cqe.user_data != RECV_TAG) {
+      auto *op = reinterpret_cast<SendOp *>(cqe.user_data);
+      if (cqe.res < 0) {
+        std::cerr << "Error sending datagram: " << std::strerror(-cqe.res)
+                  << std::endl;
+      }
+      m_in_flight.erase(op);
+      continue;
+    }
+
+    // The kernel stops a multishot receive on error or when it runs out of
+    // buffers, in which case it is re-posted below
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      m_recv_armed = false;
+    }
+
+    if (cqe.res < 0) {
+      if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+        std::cerr << "Error receiving datagrams: " << std::strerror(-cqe.res)
+                  << std::endl;
+      }
+      continue;
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+      continue;
+    }
+
+    auto buffer_id =
+        static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    uint8_t *buffer = &m_buffers[buffer_id * BUFFER_SIZE];
+    auto *out = reinterpret_cast<io_uring_recvmsg_out *>(buffer);
+
+    // Oversized datagrams are dropped, like the asio path would truncate them
+    if (out->flags & MSG_TRUNC) {
+      recycle_buffer(buffer_id);
+      continue;
+    }
+
+    udp::endpoint sender;
+    size_t name_length = std::min<size_t>(out->namelen, sender.capacity());
+    std::memcpy(sender.data(), out + 1, name_length);
+    sender.resize(name_length);
+
+    // The payload follows the space reserved for the address and control data
+    const uint8_t *payload = reinterpret_cast<const uint8_t *>(out + 1) +
+                             m_recv_msg.msg_namelen +
+                             m_recv_msg.msg_controllen;
+
+    m_batch.push_back(Datagram{sender, payload, out->payloadlen});
+    m_batch_buffers.push_back(buffer_id);
+  }
+
+  std::atomic_ref<unsigned>(*m_cq_head).store(head, std::memory_order_release);
+
+  // Until there is a handler, datagrams wait in the buffers they arrived in,
+  // as they would in the socket's buffer. Once those run out the receive
+  // stops, and is posted again by async_receive.
+  if (!m_handler) {
+    flush();
+    return;
+  }
+
+  if (!m_batch.empty()) {
+    // The handler may close the transport, which releases the buffer ring and
+    // the handler itself, so it runs from a local and nothing is touched after
+    // a close
+    BatchHandler handler = std::move(m_handler);
+    handler(m_batch);
+    if (m_ring_fd < 0) {
+      return;
+    }
+    if (!m_handler) {
+      m_handler = std::move(handler);
+    }
+  }
+
+  // Hand the buffers back to the kernel once the handler is done with them
+  for (uint16_t buffer_id : m_batch_buffers) {
+    recycle_buffer(buffer_id);
+  }
+  m_batch.clear();
+  m_batch_buffers.clear();
+
+  if (!m_recv_armed && m_handler) {
+    arm_receive();
+  }
+
+  flush();
+}
+
+void UringTransport::async_receive(BatchHandler handler) {
+  if (m_ring_fd < 0) {
+    return;
+  }
+  m_handler = std::move(handler);
+  if (!m_recv_armed) {
+    arm_receive();
+  }
+  submit();
+
+  // Datagrams that arrived before there was a handler are handed over from
+  // the completion handler, never from inside this call
+  if (!m_batch.empty()) {
+    eventfd_write(m_event.native_handle(), 1);
+  }
+}
+
+void UringTransport::queue_send(const udp::endpoint &endpoint,
+                                std::vector<uint8_t> message) {
+  // A closed transport drops what it is given, as UDP would
+  if (m_ring_fd < 0) {
+    return;
+  }
+
+  auto op = std::make_unique<SendOp>();
+  op->message = std::move(message);
+  op->endpoint = endpoint;
+
+  op->iov.iov_base = op->message.data();
+  op->iov.iov_len = op->message.size();
+
+  op->msg = msghdr{};
+  op->msg.msg_name = op->endpoint.data();
+  op->msg.msg_namelen = static_cast<socklen_t>(op->endpoint.size());
+  op->msg.msg_iov = &op->iov;
+  op->msg.msg_iovlen = 1;
+
+  m_send_queue.push_back(std::move(op));
+}
+
+void UringTransport::flush() {
+  if (m_ring_fd < 0) {
+    return;
+  }
+
+  while (!m_send_queue.empty()) {
+    io_uring_sqe *sqe = get_sqe();
+    if (!sqe) {
+      // Make room by submitting what is already queued
+      submit();
+      sqe = get_sqe();
+      if (!sqe) {
+        break;
+      }
+    }
+
+    SendOp *op = m_send_queue.front().get();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = m_socket.native_handle();
+    sqe->addr = reinterpret_cast<uint64_t>(&op->msg);
+    sqe->len = 1;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+
+    m_in_flight.emplace(op, std::move(m_send_queue.front()));
+    m_send_queue.pop_front();
+  }
+
+  submit();
+}
+
+size_t UringTransport::backlog() const {
+  return m_send_queue.size() + m_in_flight.size();
+}
+
+udp::endpoint UringTransport::local_endpoint() const {
+  return m_socket.local_endpoint();
+}
+
+udp::socket::native_handle_type UringTransport::native_handle() {
+  return m_socket.native_handle();
+}
+
+void UringTransport::close() { release(); }
+
+} // namespace transport
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+#include "transport.h"
+
+#ifdef __linux__
+#include <deque>
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <unordered_map>
+
+namespace transport {
+
+/// @brief Transport built on an io_uring ring. A multishot recvmsg stays posted
+/// on the socket and fills buffers from a kernel provided buffer ring, so no
+/// system call is made per received datagram. Sends are submitted as sendmsg
+/// operations and never block. Completions are signalled through an eventfd
+/// that the io_context waits on.
+class UringTransport : public Transport {
+private:
+  // A sendmsg operation, kept alive until the kernel completes it
+  struct SendOp {
+    std::vector<uint8_t> message;
+    udp::endpoint endpoint;
+    iovec iov;
+    msghdr msg;
+  };
+
+  // The socket is opened and bound through asio, but all I/O on it goes
+  // through the ring
+  udp::socket m_socket;
+
+  // eventfd registered with the ring, readable whenever completions arrive
+  asio::posix::stream_descriptor m_event;
+
+  int m_ring_fd = -1;
+
+  // Submission queue ring
+  void *m_sq_ring = nullptr;
+  size_t m_sq_ring_size = 0;
+  unsigned *m_sq_head, *m_sq_tail, *m_sq_mask, *m_sq_array;
+  unsigned m_sq_entries;
+  io_uring_sqe *m_sqes = nullptr;
+  size_t m_sqes_size = 0;
+
+  // Completion queue ring (may share the submission queue mapping)
+  void *m_cq_ring = nullptr;
+  size_t m_cq_ring_size = 0;
+  unsigned *m_cq_head, *m_cq_tail, *m_cq_mask;
+  io_uring_cqe *m_cqes;
+
+  // Provided buffer ring the multishot receive picks buffers from
+  void *m_buf_ring = nullptr;
+  size_t m_buf_ring_size = 0;
+  std::vector<uint8_t> m_buffers;
+  unsigned m_buf_tail = 0;
+
+  // Header describing the layout of each received buffer
+  msghdr m_recv_msg{};
+
+  // Whether the multishot receive is currently posted
+  bool m_recv_armed = false;
+
+  BatchHandler m_handler;
+
+  // Datagrams reaped from the completion queue, and the buffers they use
+  std::vector<Datagram> m_batch;
+  std::vector<uint16_t> m_batch_buffers;
+
+  // Sends waiting for a submission queue entry, and sends in the kernel
+  std::deque<std::unique_ptr<SendOp>> m_send_queue;
+  std::unordered_map<SendOp *, std::unique_ptr<SendOp>> m_in_flight;
+
+  // Sets up the rings, throwing std::system_error on failure
+  void setup_ring(unsigned entries);
+
+  // Checks the kernel supports the operations the transport needs and posts
+  // the multishot receive, throwing std::system_error with ENOSYS if not
+  void probe_features();
+
+  // Gets a free submission queue entry, or nullptr if the queue is full
+  io_uring_sqe *get_sqe();
+
+  // Submits every prepared entry to the kernel
+  void submit();
+
+  // Posts the multishot receive
+  void arm_receive();
+
+  // Returns a buffer to the provided buffer ring
+  void recycle_buffer(uint16_t buffer_id);
+
+  // Waits for the eventfd, then processes every completion
+  void wait_for_completions();
+  void reap_completions();
+
+  void release();
+
+public:
+  /// @brief Constructor for UringTransport
+  /// @param io_context Context the completions are delivered on
+  /// @param endpoint Local endpoint to bind to
+  /// @param options Socket options to apply before binding
+  /// @throws std::system_error if the kernel does not support the required
+  /// io_uring features
+  UringTransport(asio::io_context &io_context, const udp::endpoint &endpoint,
+                 const BindOptions &options = {});
+  ~UringTransport() override;
+
+  UringTransport(const UringTransport &other) = delete;
+  UringTransport &operator=(const UringTransport &other) = delete;
+
+  void async_receive(BatchHandler handler) override;
+  void queue_send(const udp::endpoint &endpoint,
+                  std::vector<uint8_t> message) override;
+  void flush() override;
+  size_t backlog() const override;
+  udp::endpoint local_endpoint() const override;
+  udp::socket::native_handle_type native_handle() override;
+  void close() override;
+};
+
+} // namespace transport
+#endif
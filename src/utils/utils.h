@@ -1,6 +1,7 @@
 #pragma once
 #include "protocols.h"
 
+#include <algorithm>
 #include <any>
 #include <asio/detail/socket_ops.hpp>
 #include <cstdint>
@@ -65,6 +66,19 @@ template <typename T> std::vector<uint8_t> struct_to_bytes(const T &data) {
   return bytes;
 }
 
+/// @brief Converts a vector of bytes back to a struct. Missing trailing bytes
+/// (such as the zeros Reed-Solomon decoding strips) are read as zero.
+/// @tparam T Struct Type
+/// @param bytes Bytes of the struct
+/// @return the struct
+template <typename T> T bytes_to_struct(const std::vector<uint8_t> &bytes) {
+  T result;
+  std::memset(reinterpret_cast<void *>(&result), 0, sizeof(T));
+  std::memcpy(reinterpret_cast<void *>(&result), bytes.data(),
+              std::min(bytes.size(), sizeof(T)));
+  return result;
+}
+
 /// @brief Gets current time of computer
 /// @return current time in 64-bit epoch time
 uint64_t current_time();
@@ -0,0 +1,112 @@
+#include "dispatcher.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+class ResponseDispatcherTest : public ::testing::Test {
+protected:
+  asio::io_context m_io_context;
+  timer::TimerService m_timers{m_io_context, 1ms};
+  std::vector<uint32_t> m_timed_out;
+  ResponseDispatcher m_dispatcher{
+      m_timers, [this](const std::shared_ptr<PendingRequest> &request) {
+        m_timed_out.push_back(request->request_id);
+      }};
+
+  void run_for(std::chrono::milliseconds duration) {
+    m_io_context.run_for(duration);
+    m_io_context.restart();
+  }
+
+  uint32_t add() {
+    return m_dispatcher.add(std::make_shared<PendingRequest>());
+  }
+
+  // Makes the next ID tried the given one, as if that many had been used
+  void set_next_id(uint32_t request_id) {
+    m_dispatcher.m_next_id = request_id;
+  }
+};
+
+TEST_F(ResponseDispatcherTest, AssignsIdsInTurn) {
+  auto request = std::make_shared<PendingRequest>();
+  uint32_t first = m_dispatcher.add(request);
+  EXPECT_EQ(first, 1u);
+  EXPECT_EQ(request->request_id, first);
+  EXPECT_EQ(add(), 2u);
+  EXPECT_EQ(m_dispatcher.outstanding(), 2u);
+  EXPECT_EQ(m_dispatcher.find(first), request);
+}
+
+TEST_F(ResponseDispatcherTest, SkipsReservedIds) {
+  set_next_id(BULK_REQUEST_ID - 1);
+  EXPECT_EQ(add(), BULK_REQUEST_ID - 1);
+
+  // Neither marker, nor 0 after wrapping around, is ever handed out
+  uint32_t next = add();
+  EXPECT_NE(next, BULK_REQUEST_ID);
+  EXPECT_NE(next, BATCH_REQUEST_ID);
+  EXPECT_EQ(next, 1u);
+}
+
+TEST_F(ResponseDispatcherTest, SkipsLiveIdsAfterWraparound) {
+  uint32_t first = add();
+  uint32_t second = add();
+  EXPECT_TRUE(m_dispatcher.take(second));
+
+  // Wrapping around reaches the first request, still awaiting its response
+  set_next_id(BULK_REQUEST_ID - 1);
+  EXPECT_EQ(add(), BULK_REQUEST_ID - 1);
+  EXPECT_EQ(add(), second);
+  EXPECT_EQ(add(), second + 1);
+  EXPECT_EQ(m_dispatcher.find(first)->request_id, first);
+}
+
+TEST_F(ResponseDispatcherTest, StaleIdsAreNotTaken) {
+  uint32_t request_id = add();
+  m_dispatcher.arm(request_id, 5ms);
+
+  auto request = m_dispatcher.take(request_id);
+  ASSERT_TRUE(request);
+  EXPECT_EQ(request->request_id, request_id);
+  EXPECT_EQ(m_dispatcher.outstanding(), 0u);
+  EXPECT_EQ(m_timers.size(), 0u) << "deadline left behind";
+
+  // A late response, and one for an ID never handed out, are dropped
+  EXPECT_FALSE(m_dispatcher.take(request_id));
+  EXPECT_FALSE(m_dispatcher.find(request_id));
+  EXPECT_FALSE(m_dispatcher.take(request_id + 100));
+
+  run_for(20ms);
+  EXPECT_TRUE(m_timed_out.empty());
+}
+
+TEST_F(ResponseDispatcherTest, TimedOutRequestsStayOutstanding) {
+  uint32_t request_id = add();
+  m_dispatcher.arm(request_id, 5ms);
+  run_for(30ms);
+
+  ASSERT_EQ(m_timed_out, std::vector<uint32_t>{request_id});
+  EXPECT_TRUE(m_dispatcher.find(request_id));
+}
+
+TEST_F(ResponseDispatcherTest, ReArmingReplacesTheDeadline) {
+  uint32_t request_id = add();
+  m_dispatcher.arm(request_id, 10ms);
+  m_dispatcher.arm(request_id, 200ms);
+  EXPECT_EQ(m_timers.size(), 1u);
+
+  run_for(50ms);
+  EXPECT_TRUE(m_timed_out.empty()) << "the first deadline fired";
+
+  // Brought forward, it fires once at the new deadline
+  m_dispatcher.arm(request_id, 5ms);
+  run_for(30ms);
+  EXPECT_EQ(m_timed_out, std::vector<uint32_t>{request_id});
+  run_for(250ms);
+  EXPECT_EQ(m_timed_out.size(), 1u);
+}
@@ -0,0 +1,324 @@
+#include "earth.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// A rover answering the Earth base over loopback, with one socket for
+// movement requests and one for status requests. A silent rover only counts
+// the requests it receives.
+class FakeRover {
+private:
+  udp::socket m_movement, m_status;
+  bool m_answers;
+  std::array<uint8_t, MAX_PACKET_SIZE> m_buffer;
+  udp::endpoint m_sender;
+
+  void receive(udp::socket &socket) {
+    socket.async_receive_from(
+        asio::buffer(m_buffer), m_sender,
+        [this, &socket](const asio::error_code &ec, size_t size) {
+          if (ec) {
+            return;
+          }
+          received++;
+          if (m_answers) {
+            answer(socket, size);
+          }
+          receive(socket);
+        });
+  }
+
+  void answer(udp::socket &socket, size_t size) {
+    auto packet = reed_solomon::decode_packet(
+        std::vector<uint8_t>(m_buffer.data(), m_buffer.data() + size),
+        RS_LEVELS[0]);
+    if (!packet) {
+      return;
+    }
+
+    std::vector<uint8_t> reply;
+    if (&socket == &m_status) {
+      auto req = util::bytes_to_struct<StatusRequest>(*packet);
+      StatusResponse resp;
+      resp.rover_id = req.rover_id;
+      resp.request_id = req.request_id;
+      resp.battery_level = 87.5f;
+      resp.temperature = -40.0f;
+      resp.emergency = false;
+      resp.timestamp = req.timestamp;
+      reply = reed_solomon::encode_packet(resp, RS_LEVELS[0]);
+    } else {
+      auto req = util::bytes_to_struct<MoveRequest>(*packet);
+      MoveResponse resp;
+      resp.rover_id = req.rover_id;
+      resp.request_id = req.request_id;
+      resp.moved = true;
+      resp.sequence_num = req.sequence_num;
+      resp.x = static_cast<int>(req.rover_id);
+      resp.y = req.direction == UP ? 1 : -1;
+      resp.timestamp = req.timestamp;
+      reply = reed_solomon::encode_packet(resp, RS_LEVELS[0]);
+    }
+    socket.send_to(asio::buffer(reply),
+                   udp::endpoint(asio::ip::address_v4::loopback(),
+                                 PORTS::MOVEMENT_RESP));
+  }
+
+public:
+  std::atomic<int> received{0}; // Requests received, including retries
+
+  FakeRover(asio::io_context &io_context, bool answers)
+      : m_movement(io_context,
+                   udp::endpoint(asio::ip::address_v4::loopback(), 0)),
+        m_status(io_context,
+                 udp::endpoint(asio::ip::address_v4::loopback(), 0)),
+        m_answers(answers) {
+    receive(m_movement);
+    receive(m_status);
+  }
+
+  // The registry record the Earth base restores the rover from
+  RegistryRecord record(uint32_t rover_id) const {
+    RegistryRecord record{};
+    record.rover_id = rover_id;
+    record.movement_port = m_movement.local_endpoint().port();
+    record.status_port = m_status.local_endpoint().port();
+    record.set_endpoint(m_movement.local_endpoint());
+    return record;
+  }
+};
+
+// An Earth base on the well-known ports, knowing the fake rovers from a
+// registry snapshot. Rovers 0 and 1 answer, rover 2 stays silent and there
+// is no rover 3.
+class EarthBaseTest : public ::testing::Test {
+protected:
+  static constexpr uint32_t SILENT_ROVER = 2;
+  static constexpr uint32_t MISSING_ROVER = 3;
+
+  std::filesystem::path m_dir;
+
+  asio::io_context m_rover_context;
+  std::vector<std::unique_ptr<FakeRover>> m_rovers;
+  std::thread m_rover_thread;
+
+  asio::io_context m_io_context;
+  std::optional<asio::executor_work_guard<asio::io_context::executor_type>>
+      m_work;
+  std::unique_ptr<EarthBase> m_earth;
+  std::thread m_earth_thread;
+
+  void SetUp() override {
+    const auto *test = ::testing::UnitTest::GetInstance()->current_test_info();
+    m_dir = std::filesystem::temp_directory_path() /
+            ("earth_test_" + std::string(test->name()));
+    std::filesystem::remove_all(m_dir);
+    std::filesystem::create_directories(m_dir);
+
+    std::vector<RegistryRecord> records;
+    for (uint32_t rover_id = 0; rover_id < MISSING_ROVER; ++rover_id) {
+      m_rovers.push_back(std::make_unique<FakeRover>(
+          m_rover_context, rover_id != SILENT_ROVER));
+      records.push_back(m_rovers.back()->record(rover_id));
+    }
+    const std::string registry = (m_dir / "registry.bin").string();
+    ASSERT_TRUE(registry::save_snapshot(registry, records));
+    m_rover_thread = std::thread([this]() { m_rover_context.run(); });
+
+    m_work.emplace(m_io_context.get_executor());
+    m_earth = std::make_unique<EarthBase>(
+        m_io_context, transport::Backend::ASIO, 1,
+        (m_dir / "telemetry").string(), registry);
+    m_earth->start();
+    m_earth_thread = std::thread([this]() { m_io_context.run(); });
+  }
+
+  void TearDown() override {
+    if (m_earth_thread.joinable()) {
+      m_work.reset();
+      m_io_context.stop();
+      m_earth_thread.join();
+    }
+    m_earth.reset();
+
+    m_rover_context.stop();
+    if (m_rover_thread.joinable()) {
+      m_rover_thread.join();
+    }
+    m_rovers.clear();
+    std::filesystem::remove_all(m_dir);
+  }
+};
+
+TEST_F(EarthBaseTest, AsyncMoveCompletesWithTheResponse) {
+  auto future = m_earth->send_movement_command_async(1, UP);
+  ASSERT_EQ(future.wait_for(5s), std::future_status::ready);
+
+  MoveResult result = future.get();
+  EXPECT_EQ(result.rover_idx, 1u);
+  ASSERT_TRUE(result.success);
+  EXPECT_EQ(result.response.rover_id, 1u);
+  EXPECT_TRUE(result.response.moved);
+  EXPECT_EQ(result.response.x, 1);
+  EXPECT_EQ(result.response.y, 1);
+}
+
+TEST_F(EarthBaseTest, MovesForOneRoverCompleteInOrder) {
+  std::mutex mutex;
+  std::vector<int> order;
+  std::vector<std::future<MoveResult>> futures;
+  for (int i = 0; i < 4; ++i) {
+    auto promise = std::make_shared<std::promise<MoveResult>>();
+    futures.push_back(promise->get_future());
+    m_earth->send_movement_command_async(
+        0, i % 2 == 0 ? UP : DOWN,
+        [&mutex, &order, i, promise](const MoveResult &result) {
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(i);
+          }
+          promise->set_value(result);
+        });
+  }
+
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(futures[i].wait_for(5s), std::future_status::ready);
+    MoveResult result = futures[i].get();
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(result.response.y, i % 2 == 0 ? 1 : -1);
+  }
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3}));
+}
+
+TEST_F(EarthBaseTest, MoveForAMissingRoverFailsStraightAway) {
+  auto future = m_earth->send_movement_command_async(MISSING_ROVER, UP);
+  ASSERT_EQ(future.wait_for(1s), std::future_status::ready);
+  EXPECT_FALSE(future.get().success);
+}
+
+TEST_F(EarthBaseTest, BroadcastTalliesEveryRoverInOrder) {
+  std::atomic<int> reported{0};
+  auto future = m_earth->broadcast_movement_command(
+      {1, MISSING_ROVER, 0}, DOWN,
+      [&reported](const MoveResult &) { reported++; });
+  ASSERT_EQ(future.wait_for(5s), std::future_status::ready);
+
+  auto results = future.get();
+  ASSERT_EQ(results.size(), 3u);
+  EXPECT_EQ(results[0].rover_idx, 1u);
+  EXPECT_TRUE(results[0].success);
+  EXPECT_EQ(results[0].response.y, -1);
+  EXPECT_EQ(results[1].rover_idx, MISSING_ROVER);
+  EXPECT_FALSE(results[1].success);
+  EXPECT_EQ(results[2].rover_idx, 0u);
+  EXPECT_TRUE(results[2].success);
+  EXPECT_EQ(reported, 3);
+}
+
+TEST_F(EarthBaseTest, BroadcastToNoRoversCompletesEmpty) {
+  auto future = m_earth->broadcast_movement_command({}, UP);
+  ASSERT_EQ(future.wait_for(0s), std::future_status::ready);
+  EXPECT_TRUE(future.get().empty());
+}
+
+TEST_F(EarthBaseTest, BroadcastReportsRoversThatNeverAnswer) {
+  auto future = m_earth->broadcast_movement_command({SILENT_ROVER, 0}, UP);
+  const auto give_up = MAX_RETRIES * std::chrono::milliseconds(MAX_TIMEOUT_MS);
+  ASSERT_EQ(future.wait_for(give_up + 5s), std::future_status::ready);
+
+  auto results = future.get();
+  ASSERT_EQ(results.size(), 2u);
+  EXPECT_FALSE(results[0].success);
+  EXPECT_TRUE(results[1].success);
+  EXPECT_EQ(m_rovers[SILENT_ROVER]->received, MAX_RETRIES);
+}
+
+// Runs a coroutine on its own context and waits for its result
+template <typename T>
+static std::optional<T> run_request(asio::awaitable<std::optional<T>> request,
+                                    std::thread::id *resumed_on = nullptr) {
+  asio::io_context caller;
+  auto future = asio::co_spawn(
+      caller,
+      [request = std::move(request),
+       resumed_on]() mutable -> asio::awaitable<std::optional<T>> {
+        auto result = co_await std::move(request);
+        if (resumed_on) {
+          *resumed_on = std::this_thread::get_id();
+        }
+        co_return result;
+      },
+      asio::use_future);
+  caller.run_for(20s);
+  return future.get();
+}
+
+TEST_F(EarthBaseTest, RequestResumesWithTheResponse) {
+  MoveRequest req{};
+  req.direction = DOWN;
+  std::thread::id resumed_on;
+  auto resp = run_request(
+      m_earth->request<MoveRequest, MoveResponse>(1, req), &resumed_on);
+
+  ASSERT_TRUE(resp.has_value());
+  EXPECT_EQ(resp->rover_id, 1u);
+  EXPECT_EQ(resp->y, -1);
+
+  // The coroutine carries on on the caller's executor, not the worker's
+  EXPECT_EQ(resumed_on, std::this_thread::get_id());
+}
+
+TEST_F(EarthBaseTest, StatusRequestGoesToTheStatusPort) {
+  StatusRequest req{};
+  auto resp =
+      run_request(m_earth->request<StatusRequest, StatusResponse>(0, req));
+
+  ASSERT_TRUE(resp.has_value());
+  EXPECT_EQ(resp->rover_id, 0u);
+  EXPECT_FLOAT_EQ(resp->battery_level, 87.5f);
+}
+
+TEST_F(EarthBaseTest, ManyRequestsCanBeAwaitedAtOnce) {
+  asio::io_context caller;
+  std::vector<std::future<std::optional<StatusResponse>>> futures;
+  for (int i = 0; i < 20; ++i) {
+    futures.push_back(asio::co_spawn(
+        caller,
+        m_earth->request<StatusRequest, StatusResponse>(i % 2, {}),
+        asio::use_future));
+  }
+  caller.run_for(10s);
+
+  for (int i = 0; i < 20; ++i) {
+    auto resp = futures[i].get();
+    ASSERT_TRUE(resp.has_value());
+    EXPECT_EQ(resp->rover_id, static_cast<uint32_t>(i % 2));
+  }
+}
+
+TEST_F(EarthBaseTest, RequestGivesUpAfterItsAttempts) {
+  const RetryPolicy policy{3, 50ms};
+  auto start = std::chrono::steady_clock::now();
+  auto resp = run_request(m_earth->request<StatusRequest, StatusResponse>(
+      SILENT_ROVER, {}, policy));
+
+  EXPECT_FALSE(resp.has_value());
+  EXPECT_EQ(m_rovers[SILENT_ROVER]->received, policy.max_attempts);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 2s);
+}
+
+TEST_F(EarthBaseTest, RequestForAMissingRoverResumesEmpty) {
+  auto resp = run_request(
+      m_earth->request<MoveRequest, MoveResponse>(MISSING_ROVER, {}));
+  EXPECT_FALSE(resp.has_value());
+}
@@ -0,0 +1,82 @@
+#include "protocols.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+// Number of moves a sequence of runs stands for
+size_t moves_in(const std::vector<PathRun> &runs) {
+  size_t moves = 0;
+  for (const PathRun &run : runs) {
+    moves += run.count;
+  }
+  return moves;
+}
+
+// Moves that alternate direction, so each needs a run of its own
+std::vector<DIRECTION> zigzag(size_t count) {
+  std::vector<DIRECTION> moves;
+  for (size_t idx = 0; idx < count; ++idx) {
+    moves.push_back(idx % 2 == 0 ? UP : RIGHT);
+  }
+  return moves;
+}
+} // namespace
+
+TEST(EncodePath, MergesRepeatedMoves) {
+  auto runs = encode_path({UP, UP, LEFT, DOWN, DOWN, DOWN});
+  ASSERT_TRUE(runs.has_value());
+  ASSERT_EQ(runs->size(), 3u);
+  EXPECT_EQ((*runs)[0].direction, UP);
+  EXPECT_EQ((*runs)[0].count, 2);
+  EXPECT_EQ((*runs)[1].direction, LEFT);
+  EXPECT_EQ((*runs)[1].count, 1);
+  EXPECT_EQ((*runs)[2].direction, DOWN);
+  EXPECT_EQ((*runs)[2].count, 3);
+  EXPECT_EQ(path_to_string(runs->data(), runs->size()), "u2l1d3");
+}
+
+TEST(EncodePath, EmptyPathHasNoRuns) {
+  auto runs = encode_path({});
+  ASSERT_TRUE(runs.has_value());
+  EXPECT_TRUE(runs->empty());
+}
+
+TEST(EncodePath, SplitsRunsAtTheLongestRun) {
+  std::vector<DIRECTION> moves(2 * MAX_RUN_LENGTH + 1, LEFT);
+  auto runs = encode_path(moves);
+  ASSERT_TRUE(runs.has_value());
+  ASSERT_EQ(runs->size(), 3u);
+  EXPECT_EQ((*runs)[0].count, MAX_RUN_LENGTH);
+  EXPECT_EQ((*runs)[1].count, MAX_RUN_LENGTH);
+  EXPECT_EQ((*runs)[2].count, 1);
+  for (const PathRun &run : *runs) {
+    EXPECT_EQ(run.direction, LEFT);
+  }
+}
+
+TEST(EncodePath, PrefixStopsAtTheMostRuns) {
+  auto moves = zigzag(MAX_PATH_RUNS + 10);
+  auto runs = encode_path_prefix(moves);
+  ASSERT_EQ(runs.size(), MAX_PATH_RUNS);
+  EXPECT_EQ(moves_in(runs), MAX_PATH_RUNS);
+
+  // The last run is still filled, only new runs are cut off
+  moves = zigzag(MAX_PATH_RUNS);
+  moves.push_back(moves.back());
+  runs = encode_path_prefix(moves);
+  ASSERT_EQ(runs.size(), MAX_PATH_RUNS);
+  EXPECT_EQ(runs.back().count, 2);
+  EXPECT_EQ(moves_in(runs), moves.size());
+}
+
+TEST(EncodePath, FailsWhenThePathNeedsTooManyRuns) {
+  EXPECT_TRUE(encode_path(zigzag(MAX_PATH_RUNS)).has_value());
+  EXPECT_FALSE(encode_path(zigzag(MAX_PATH_RUNS + 1)).has_value());
+
+  // Too long a straight line needs too many runs as well
+  std::vector<DIRECTION> straight(MAX_PATH_RUNS * MAX_RUN_LENGTH, DOWN);
+  EXPECT_TRUE(encode_path(straight).has_value());
+  straight.push_back(DOWN);
+  EXPECT_FALSE(encode_path(straight).has_value());
+}
@@ -0,0 +1,172 @@
+#include "registry.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+class RegistryTest : public ::testing::Test {
+protected:
+  std::string m_path;
+
+  void SetUp() override {
+    m_path = (std::filesystem::temp_directory_path() /
+              ("registry_test_" +
+               std::string(::testing::UnitTest::GetInstance()
+                               ->current_test_info()
+                               ->name())))
+                 .string();
+    std::filesystem::remove(m_path);
+  }
+  void TearDown() override { std::filesystem::remove(m_path); }
+
+  // Reads the whole snapshot file
+  std::vector<char> read_file() const {
+    std::ifstream file(m_path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>()};
+  }
+
+  void write_file(const std::vector<char> &bytes) const {
+    std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+
+  // Records of a few rovers, on both address families
+  static std::vector<RegistryRecord> records() {
+    std::vector<RegistryRecord> records(3);
+    for (uint32_t idx = 0; idx < records.size(); ++idx) {
+      RegistryRecord &record = records[idx];
+      std::memset(&record, 0, sizeof(record));
+      record.rover_id = idx;
+      record.movement_port = static_cast<uint16_t>(6000 + idx);
+      record.status_port = static_cast<uint16_t>(7000 + idx);
+      record.rs_level = static_cast<uint8_t>(idx);
+      record.flags = idx == 1 ? RegistryRecord::SEQUENCE : 0;
+      record.set_endpoint(udp::endpoint(
+          idx == 2 ? asio::ip::make_address("::1")
+                   : asio::ip::make_address("127.0.0." + std::to_string(idx)),
+          static_cast<uint16_t>(5000 + idx)));
+    }
+    return records;
+  }
+};
+
+TEST_F(RegistryTest, SnapshotRoundTrips) {
+  auto saved = records();
+  ASSERT_TRUE(registry::save_snapshot(m_path, saved));
+  EXPECT_FALSE(std::filesystem::exists(m_path + ".tmp"));
+
+  auto loaded = registry::load_snapshot(m_path);
+  ASSERT_TRUE(loaded.has_value());
+  ASSERT_EQ(loaded->size(), saved.size());
+  for (size_t idx = 0; idx < saved.size(); ++idx) {
+    EXPECT_EQ(std::memcmp(&(*loaded)[idx], &saved[idx], sizeof(saved[idx])),
+              0);
+    EXPECT_EQ((*loaded)[idx].endpoint(), saved[idx].endpoint());
+  }
+}
+
+TEST_F(RegistryTest, EmptySnapshotRoundTrips) {
+  ASSERT_TRUE(registry::save_snapshot(m_path, {}));
+  auto loaded = registry::load_snapshot(m_path);
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_TRUE(loaded->empty());
+}
+
+TEST_F(RegistryTest, SaveReplacesThePreviousSnapshot) {
+  ASSERT_TRUE(registry::save_snapshot(m_path, records()));
+  auto fewer = records();
+  fewer.pop_back();
+  ASSERT_TRUE(registry::save_snapshot(m_path, fewer));
+
+  auto loaded = registry::load_snapshot(m_path);
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_EQ(loaded->size(), fewer.size());
+}
+
+TEST_F(RegistryTest, MissingSnapshotIsIgnored) {
+  EXPECT_FALSE(registry::load_snapshot(m_path).has_value());
+}
+
+TEST_F(RegistryTest, BadMagicIsRejected) {
+  ASSERT_TRUE(registry::save_snapshot(m_path, records()));
+  auto bytes = read_file();
+  bytes[0] = 'X';
+  write_file(bytes);
+  EXPECT_FALSE(registry::load_snapshot(m_path).has_value());
+}
+
+TEST_F(RegistryTest, TruncatedSnapshotIsRejected) {
+  ASSERT_TRUE(registry::save_snapshot(m_path, records()));
+  auto bytes = read_file();
+
+  // Mid-record, and with the header alone
+  bytes.resize(bytes.size() - sizeof(RegistryRecord) / 2);
+  write_file(bytes);
+  EXPECT_FALSE(registry::load_snapshot(m_path).has_value());
+  bytes.resize(16);
+  write_file(bytes);
+  EXPECT_FALSE(registry::load_snapshot(m_path).has_value());
+  bytes.resize(8);
+  write_file(bytes);
+  EXPECT_FALSE(registry::load_snapshot(m_path).has_value());
+}
+
+TEST_F(RegistryTest, TrailingBytesAreRejected) {
+  ASSERT_TRUE(registry::save_snapshot(m_path, records()));
+  auto bytes = read_file();
+  bytes.push_back(0);
+  write_file(bytes);
+  EXPECT_FALSE(registry::load_snapshot(m_path).has_value());
+}
+
+TEST_F(RegistryTest, HugeCountIsRejectedBeforeAllocating) {
+  ASSERT_TRUE(registry::save_snapshot(m_path, records()));
+  auto bytes = read_file();
+
+  // The count follows the magic and version
+  uint32_t count = 0xFFFFFFFF;
+  std::memcpy(bytes.data() + 8, &count, sizeof(count));
+  write_file(bytes);
+  EXPECT_FALSE(registry::load_snapshot(m_path).has_value());
+}
+
+TEST_F(RegistryTest, ChecksumMismatchIsRejected) {
+  ASSERT_TRUE(registry::save_snapshot(m_path, records()));
+  auto bytes = read_file();
+  bytes.back() ^= 0x01;
+  write_file(bytes);
+  EXPECT_FALSE(registry::load_snapshot(m_path).has_value());
+}
+
+TEST_F(RegistryTest, CheckpointerWaitsForEveryWorker) {
+  {
+    RegistryCheckpointer checkpointer(m_path, 2);
+    checkpointer.publish(0, records());
+  }
+  EXPECT_FALSE(std::filesystem::exists(m_path));
+}
+
+TEST_F(RegistryTest, CheckpointerWritesTheNewestParts) {
+  // Parts published while a snapshot is being written replace it afterwards
+  for (int round = 0; round < 20; ++round) {
+    std::vector<RegistryRecord> last;
+    {
+      RegistryCheckpointer checkpointer(m_path, 2);
+      checkpointer.publish(0, records());
+      for (uint32_t count = 0; count < 200; ++count) {
+        last.assign(count + 1, records()[0]);
+        last.back().rover_id = count;
+        checkpointer.publish(1, last);
+      }
+    }
+
+    auto loaded = registry::load_snapshot(m_path);
+    ASSERT_TRUE(loaded.has_value());
+    ASSERT_EQ(loaded->size(), records().size() + last.size());
+    EXPECT_EQ(loaded->back().rover_id, last.back().rover_id);
+  }
+}
@@ -1,6 +1,7 @@
 #include "error_correction.h"
 #include "protocols.h"
 
+#include <cstring>
 #include <gtest/gtest.h>
 #include <string>
 #include <vector>
@@ -307,3 +308,105 @@ TEST_F(ReedSolomonTest, EncodeDecodeRoundtrip) {
   EXPECT_DOUBLE_EQ(result->value, original.value);
   EXPECT_STREQ(result->name, original.name);
 }
+
+TEST_F(ReedSolomonTest, DecodePacketCorruptedShortenedCode) {
+  // Heavily corrupted blocks of a shortened code must be rejected rather than
+  // "corrected" at positions outside the block
+  struct TestStruct {
+    uint32_t id;
+    char payload[60];
+  };
+  TestStruct original{7, "corruption"};
+
+  for (const auto &rscode : RS_LEVELS) {
+    auto encoded = reed_solomon::encode_packet(original, rscode);
+
+    for (uint8_t seed = 1; seed < 64; ++seed) {
+      auto corrupted = encoded;
+      for (size_t i = 0; i < 16; ++i) {
+        corrupted[(seed * 31 + i * 97) % corrupted.size()] ^= seed + i;
+      }
+
+      // Any result is fine as long as decoding stays within the packet
+      auto decoded = reed_solomon::decode_packet(corrupted, rscode);
+      if (decoded) {
+        EXPECT_LE(decoded->size(), static_cast<size_t>(rscode.k));
+      }
+    }
+  }
+}
+
+TEST_F(ReedSolomonTest, DecodePacketCountsCorrections) {
+  // The stats report how many symbols each block needed corrected
+  struct TwoBlocks {
+    char payload[300];
+  };
+  TwoBlocks original;
+  std::memset(original.payload, 'x', sizeof(original.payload));
+  RSCode rscode(239, 223);
+  auto encoded = reed_solomon::encode_packet(original, rscode);
+  ASSERT_EQ(encoded.size(), 2u * rscode.n);
+
+  encoded[3] ^= 0x10;
+  encoded[rscode.n + 1] ^= 0x01;
+  encoded[rscode.n + 2] ^= 0x02;
+  encoded[rscode.n + 100] ^= 0x04;
+
+  reed_solomon::DecodeStats stats;
+  auto decoded = reed_solomon::decode_packet(encoded, rscode, &stats);
+  ASSERT_TRUE(decoded.has_value());
+  EXPECT_EQ(stats.corrected, 4u);
+  EXPECT_EQ(stats.worst_block, 3u);
+
+  // A clean packet adds nothing
+  reed_solomon::DecodeStats clean;
+  ASSERT_TRUE(reed_solomon::decode_packet(
+      reed_solomon::encode_packet(original, rscode), rscode, &clean));
+  EXPECT_EQ(clean.corrected, 0u);
+  EXPECT_EQ(clean.worst_block, 0u);
+}
+
+TEST_F(ReedSolomonTest, NegotiationLevels) {
+  // The probe level has the most parity, and every level up to it can be
+  // told apart by the size of a single block
+  for (uint8_t level = 0; level <= PROBE_RS_LEVEL; ++level) {
+    EXPECT_LE(RS_LEVELS[level].n - RS_LEVELS[level].k,
+              RS_LEVELS[PROBE_RS_LEVEL].n - RS_LEVELS[PROBE_RS_LEVEL].k);
+    EXPECT_EQ(rs_level_for_size(RS_LEVELS[level].n), level);
+  }
+  EXPECT_FALSE(rs_level_for_size(RS_LEVELS[0].k).has_value());
+
+  // A clean link needs no parity, noisier ones get twice the headroom
+  EXPECT_EQ(recommend_rs_level(0), 0);
+  uint8_t previous = 0;
+  for (size_t corrected = 1; corrected < 20; ++corrected) {
+    uint8_t level = recommend_rs_level(corrected);
+    EXPECT_GE(level, previous);
+    if (level < PROBE_RS_LEVEL) {
+      EXPECT_GE((RS_LEVELS[level].n - RS_LEVELS[level].k) / 2, 2 * corrected);
+    }
+    previous = level;
+  }
+  EXPECT_EQ(recommend_rs_level(1000), PROBE_RS_LEVEL);
+}
+
+TEST_F(ReedSolomonTest, DecodePacketErrorAtEveryPosition) {
+  // A single error is correctable wherever it lands in the block
+  struct Payload {
+    char text[40];
+  };
+  Payload original{"every position"};
+
+  for (const auto &rscode : {RS_LEVELS[1], RS_LEVELS[PROBE_RS_LEVEL]}) {
+    auto encoded = reed_solomon::encode_packet(original, rscode);
+    for (size_t position = 0; position < encoded.size(); ++position) {
+      auto corrupted = encoded;
+      corrupted[position] ^= 0x5a;
+
+      auto decoded = reed_solomon::decode_packet(corrupted, rscode);
+      ASSERT_TRUE(decoded.has_value()) << "error at " << position;
+      EXPECT_STREQ(reinterpret_cast<const char *>(decoded->data()),
+                   original.text);
+    }
+  }
+}
@@ -0,0 +1,171 @@
+#include "navigation.h"
+
+#include <cstdlib>
+#include <deque>
+#include <gtest/gtest.h>
+#include <limits>
+#include <vector>
+
+namespace {
+constexpr int DX[] = {0, 0, -1, 1};
+constexpr int DY[] = {-1, 1, 0, 0};
+
+// Follows a plan's moves, checking that none of them lands on a rock
+bool follows_free_tiles(navigation::TileMap &map, int x, int y,
+                        const navigation::Plan &plan) {
+  for (DIRECTION move : plan.moves) {
+    x += DX[move];
+    y += DY[move];
+    if (map.blocked(x, y)) {
+      return false;
+    }
+  }
+  return x == plan.x && y == plan.y;
+}
+
+// Length of a shortest path by breadth first search within radius tiles of
+// the start, or -1 if there is none
+int shortest_path(navigation::TileMap &map, int from_x, int from_y, int to_x,
+                  int to_y, int radius) {
+  const int side = 2 * radius + 1;
+  std::vector<int> distance(side * side, -1);
+  auto at = [&](int x, int y) -> int & {
+    return distance[(y - from_y + radius) * side + (x - from_x + radius)];
+  };
+
+  std::deque<std::pair<int, int>> queue{{from_x, from_y}};
+  at(from_x, from_y) = 0;
+  while (!queue.empty()) {
+    auto [x, y] = queue.front();
+    queue.pop_front();
+    if (x == to_x && y == to_y) {
+      return at(x, y);
+    }
+    for (int move = 0; move < 4; ++move) {
+      int next_x = x + DX[move], next_y = y + DY[move];
+      if (std::abs(next_x - from_x) > radius ||
+          std::abs(next_y - from_y) > radius || at(next_x, next_y) != -1 ||
+          map.blocked(next_x, next_y)) {
+        continue;
+      }
+      at(next_x, next_y) = at(x, y) + 1;
+      queue.emplace_back(next_x, next_y);
+    }
+  }
+  return -1;
+}
+} // namespace
+
+TEST(PlanPath, GoesStraightOverOpenGround) {
+  TerrainGenerator terrain(0.0, 1);
+  navigation::TileMap map(terrain);
+  auto plan = navigation::plan_path(map, 0, 0, 7, -4);
+
+  EXPECT_TRUE(plan.reached);
+  EXPECT_EQ(plan.moves.size(), 11u);
+  EXPECT_EQ(plan.x, 7);
+  EXPECT_EQ(plan.y, -4);
+  EXPECT_TRUE(follows_free_tiles(map, 0, 0, plan));
+}
+
+TEST(PlanPath, StartingAtTheGoalNeedsNoMoves) {
+  TerrainGenerator terrain(0.2, 1);
+  navigation::TileMap map(terrain);
+  auto plan = navigation::plan_path(map, 3, 3, 3, 3);
+
+  EXPECT_TRUE(plan.reached);
+  EXPECT_TRUE(plan.moves.empty());
+  EXPECT_EQ(plan.expanded, 1u);
+}
+
+TEST(PlanPath, FindsShortestPathsAroundRocks) {
+  TerrainGenerator terrain(0.3, 8675309);
+  navigation::TileMap map(terrain);
+
+  const std::pair<int, int> goals[] = {{20, 3}, {-15, 12}, {6, -25}, {-9, -9}};
+  for (auto [x, y] : goals) {
+    if (map.blocked(x, y)) {
+      continue;
+    }
+    auto plan = navigation::plan_path(map, 0, 0, x, y);
+    int expected = shortest_path(map, 0, 0, x, y, 60);
+
+    ASSERT_EQ(plan.reached, expected != -1) << x << "," << y;
+    if (plan.reached) {
+      EXPECT_EQ(static_cast<int>(plan.moves.size()), expected);
+      EXPECT_TRUE(follows_free_tiles(map, 0, 0, plan));
+    }
+  }
+}
+
+TEST(PlanPath, StopsAtTheBudgetCloserToTheGoal) {
+  TerrainGenerator terrain(0.2, 8675309);
+  navigation::TileMap map(terrain);
+  auto plan = navigation::plan_path(map, 0, 0, 1000, 1000, 500);
+
+  EXPECT_FALSE(plan.reached);
+  EXPECT_EQ(plan.expanded, 500u);
+  EXPECT_LT(std::abs(1000 - plan.x) + std::abs(1000 - plan.y), 2000);
+  EXPECT_TRUE(follows_free_tiles(map, 0, 0, plan));
+}
+
+TEST(PlanPath, HeadsForAGoalAtTheEdgeOfTheWorld) {
+  TerrainGenerator terrain(0.2, 8675309);
+  navigation::TileMap map(terrain);
+
+  // The goal is further than an int on each axis and than a uint32_t overall
+  const int to_x = std::numeric_limits<int>::max();
+  const int to_y = std::numeric_limits<int>::min();
+  auto plan = navigation::plan_path(map, 0, 0, to_x, to_y, 500);
+
+  EXPECT_FALSE(plan.reached);
+  EXPECT_GT(plan.x, 0);
+  EXPECT_LT(plan.y, 0);
+  EXPECT_TRUE(follows_free_tiles(map, 0, 0, plan));
+
+  plan = navigation::plan_path(map, -10, 10, to_x, to_y, 500);
+  EXPECT_FALSE(plan.reached);
+  EXPECT_TRUE(follows_free_tiles(map, -10, 10, plan));
+}
+
+TEST(PlanPath, DoesNotStepPastTheEdgeOfTheWorld) {
+  TerrainGenerator terrain(0.0, 1);
+  navigation::TileMap map(terrain);
+
+  // One step right of the start would wrap around onto the goal
+  const int max = std::numeric_limits<int>::max();
+  const int min = std::numeric_limits<int>::min();
+  auto plan = navigation::plan_path(map, max, 0, min, 0, 100);
+
+  EXPECT_FALSE(plan.reached);
+  EXPECT_LT(plan.x, max);
+  EXPECT_TRUE(follows_free_tiles(map, max, 0, plan));
+}
+
+TEST(PlanPath, LeadsNextToAGoalOnARock) {
+  TerrainGenerator terrain(0.3, 8675309);
+  navigation::TileMap map(terrain);
+
+  // Find a rock reachable from the start
+  int rock_x = 10;
+  while (!map.blocked(rock_x, 0)) {
+    rock_x++;
+  }
+  auto plan = navigation::plan_path(map, 0, 0, rock_x, 0, 5000);
+
+  EXPECT_FALSE(plan.reached);
+  EXPECT_EQ(std::abs(rock_x - plan.x) + std::abs(plan.y), 1);
+  EXPECT_TRUE(follows_free_tiles(map, 0, 0, plan));
+}
+
+TEST(TileMap, MatchesTheGeneratedRegion) {
+  TerrainGenerator terrain(0.5, 42);
+  navigation::TileMap map(terrain);
+  auto region = terrain.getRegion(-13, -7, 27, 19);
+
+  for (int y = 0; y < 19; ++y) {
+    for (int x = 0; x < 27; ++x) {
+      EXPECT_EQ(map.blocked(x - 13, y - 7), region.get(x, y));
+    }
+  }
+}
@@ -0,0 +1,79 @@
+#include "faults.h"
+
+#include <gtest/gtest.h>
+
+using swarm::FaultInjector;
+
+constexpr int DRAWS = 100000;
+
+// Fraction of DRAWS datagrams the injector drops
+static double drop_rate(const FaultInjector &faults, std::mt19937 &rng) {
+  int dropped = 0;
+  for (int i = 0; i < DRAWS; ++i) {
+    dropped += faults.drop(rng);
+  }
+  return static_cast<double>(dropped) / DRAWS;
+}
+
+TEST(FaultInjector, NoLossDropsNothingAndDrawsNothing) {
+  FaultInjector faults(0, 0, 4);
+  std::mt19937 rng(1), untouched(1);
+  EXPECT_EQ(drop_rate(faults, rng), 0);
+  EXPECT_EQ(rng, untouched);
+}
+
+TEST(FaultInjector, FullLossDropsEverything) {
+  FaultInjector faults(1, 0, 4);
+  std::mt19937 rng(1);
+  EXPECT_EQ(drop_rate(faults, rng), 1);
+}
+
+TEST(FaultInjector, DropsAtTheGivenChance) {
+  FaultInjector faults(0.25, 0, 4);
+  std::mt19937 rng(1);
+  EXPECT_NEAR(drop_rate(faults, rng), 0.25, 0.01);
+}
+
+TEST(FaultInjector, CorruptsAtTheGivenChance) {
+  FaultInjector faults(0, 0.1, 1);
+  std::mt19937 rng(1);
+  int corrupted = 0;
+  for (int i = 0; i < DRAWS; ++i) {
+    std::vector<uint8_t> datagram(32, 0);
+    bool changed = faults.corrupt(datagram, rng);
+    corrupted += changed;
+
+    // One byte flips exactly when the datagram is said to be corrupted
+    int nonzero = 0;
+    for (uint8_t byte : datagram) {
+      nonzero += byte != 0;
+    }
+    ASSERT_EQ(nonzero, changed ? 1 : 0);
+  }
+  EXPECT_NEAR(static_cast<double>(corrupted) / DRAWS, 0.1, 0.01);
+}
+
+TEST(FaultInjector, NoCorruptionLeavesDatagramsAlone) {
+  FaultInjector faults(0, 0, 4);
+  std::mt19937 rng(1), untouched(1);
+  std::vector<uint8_t> datagram(32, 0xAB);
+  EXPECT_FALSE(faults.corrupt(datagram, rng));
+  EXPECT_EQ(datagram, std::vector<uint8_t>(32, 0xAB));
+  EXPECT_EQ(rng, untouched);
+}
+
+TEST(FaultInjector, EmptyDatagramsAreNeverCorrupted) {
+  FaultInjector faults(0, 1, 4);
+  std::mt19937 rng(1);
+  std::vector<uint8_t> datagram;
+  EXPECT_FALSE(faults.corrupt(datagram, rng));
+  EXPECT_TRUE(datagram.empty());
+}
+
+TEST(FaultInjector, ChancesAboveOneAreCertain) {
+  FaultInjector faults(2, 2, 1);
+  std::mt19937 rng(1);
+  EXPECT_EQ(drop_rate(faults, rng), 1);
+  std::vector<uint8_t> datagram(8, 0);
+  EXPECT_TRUE(faults.corrupt(datagram, rng));
+}
@@ -0,0 +1,45 @@
+#include "latency.h"
+
+#include <gtest/gtest.h>
+
+using swarm::LatencyRecorder;
+
+// Samples 1 to 10, recorded out of order
+static LatencyRecorder one_to_ten() {
+  LatencyRecorder recorder;
+  for (double sample : {7, 3, 10, 1, 5, 9, 2, 8, 6, 4}) {
+    recorder.add(sample);
+  }
+  return recorder;
+}
+
+TEST(LatencyRecorder, NoSamplesGiveZero) {
+  LatencyRecorder recorder;
+  EXPECT_EQ(recorder.count(), 0u);
+  EXPECT_EQ(recorder.percentile(50), 0);
+}
+
+TEST(LatencyRecorder, TakesTheNearestRank) {
+  auto recorder = one_to_ten();
+  EXPECT_EQ(recorder.count(), 10u);
+  EXPECT_EQ(recorder.percentile(10), 1);
+  EXPECT_EQ(recorder.percentile(50), 5);
+  EXPECT_EQ(recorder.percentile(51), 6);
+  EXPECT_EQ(recorder.percentile(90), 9);
+  EXPECT_EQ(recorder.percentile(99), 10);
+  EXPECT_EQ(recorder.percentile(100), 10);
+}
+
+TEST(LatencyRecorder, OutOfRangePercentilesClampToTheSamples) {
+  auto recorder = one_to_ten();
+  EXPECT_EQ(recorder.percentile(0), 1);
+  EXPECT_EQ(recorder.percentile(-5), 1);
+  EXPECT_EQ(recorder.percentile(150), 10);
+}
+
+TEST(LatencyRecorder, OneSampleIsEveryPercentile) {
+  LatencyRecorder recorder;
+  recorder.add(42);
+  EXPECT_EQ(recorder.percentile(1), 42);
+  EXPECT_EQ(recorder.percentile(99), 42);
+}
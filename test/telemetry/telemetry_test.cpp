@@ -0,0 +1,163 @@
+#include "columnar_log.h"
+#include "spsc_ring.h"
+#include "telemetry.h"
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TelemetryTest : public ::testing::Test {
+protected:
+  std::string m_directory;
+
+  void SetUp() override {
+    m_directory = (std::filesystem::temp_directory_path() /
+                   ("telemetry_test_" +
+                    std::string(::testing::UnitTest::GetInstance()
+                                    ->current_test_info()
+                                    ->name())))
+                      .string();
+    std::filesystem::remove_all(m_directory);
+  }
+  void TearDown() override { std::filesystem::remove_all(m_directory); }
+};
+
+TEST_F(TelemetryTest, RingRejectsPushWhenFull) {
+  telemetry::SpscRing<int, 4> ring;
+
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.try_push(i));
+  }
+  EXPECT_FALSE(ring.try_push(4));
+  EXPECT_EQ(ring.size(), 4u);
+
+  // Elements come out in the order they went in
+  for (int i = 0; i < 4; ++i) {
+    auto value = ring.try_pop();
+    ASSERT_TRUE(value.has_value());
+    EXPECT_EQ(*value, i);
+  }
+  EXPECT_FALSE(ring.try_pop().has_value());
+}
+
+TEST_F(TelemetryTest, RingPassesEveryElementBetweenThreads) {
+  telemetry::SpscRing<uint64_t, 16> ring;
+  constexpr uint64_t count = 10000;
+
+  std::thread producer([&ring]() {
+    for (uint64_t i = 0; i < count; ++i) {
+      while (!ring.try_push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint64_t expected = 0;
+  while (expected < count) {
+    if (auto value = ring.try_pop()) {
+      ASSERT_EQ(*value, expected);
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+}
+
+TEST_F(TelemetryTest, LogQueriesTimeRange) {
+  telemetry::ColumnarLog log(m_directory);
+
+  for (uint32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(log.append({1000 + i * 10, i % 4, 50.0f, 20.0f + i, 0}));
+  }
+  ASSERT_EQ(log.size(), 100u);
+
+  // [1100, 1200) holds rows 10 to 19
+  auto samples = log.query(1100, 1200);
+  ASSERT_EQ(samples.size(), 10u);
+  EXPECT_EQ(samples.front().timestamp, 1100u);
+  EXPECT_EQ(samples.back().timestamp, 1190u);
+  EXPECT_FLOAT_EQ(samples.front().temperature, 30.0f);
+
+  // Rows 10 to 19 with rover ID 2 are 10, 14 and 18
+  auto rover_samples = log.query(1100, 1200, 2);
+  ASSERT_EQ(rover_samples.size(), 3u);
+  for (const auto &sample : rover_samples) {
+    EXPECT_EQ(sample.rover_id, 2u);
+  }
+
+  EXPECT_TRUE(log.query(5000, 6000).empty());
+  EXPECT_TRUE(log.query(1200, 1100).empty());
+}
+
+TEST_F(TelemetryTest, LogKeepsTimestampsSorted) {
+  telemetry::ColumnarLog log(m_directory);
+
+  ASSERT_TRUE(log.append({2000, 1, 0, 0, 0}));
+  ASSERT_TRUE(log.append({1500, 2, 0, 0, 0}));
+
+  EXPECT_EQ(log.row(1).timestamp, 2000u);
+  EXPECT_EQ(log.query(2000, 2001).size(), 2u);
+}
+
+TEST_F(TelemetryTest, LogGrowsAndReopens) {
+  const size_t rows = telemetry::ColumnarLog::GROWTH_ROWS + 10;
+  {
+    telemetry::ColumnarLog log(m_directory);
+    for (size_t i = 0; i < rows; ++i) {
+      ASSERT_TRUE(log.append({i, 7, 1.0f, 2.0f, 3}));
+    }
+  }
+
+  // A new log in the same directory picks up where the last one stopped
+  telemetry::ColumnarLog log(m_directory);
+  ASSERT_EQ(log.size(), rows);
+  EXPECT_EQ(log.last_timestamp(), rows - 1);
+
+  auto sample = log.row(rows - 1);
+  EXPECT_EQ(sample.rover_id, 7u);
+  EXPECT_FLOAT_EQ(sample.battery, 1.0f);
+  EXPECT_EQ(sample.emergency, 3);
+
+  ASSERT_TRUE(log.append({rows, 8, 0, 0, 0}));
+  EXPECT_EQ(log.size(), rows + 1);
+}
+
+TEST_F(TelemetryTest, StoreWritesRecordedSamples) {
+  telemetry::TelemetryStore store(m_directory);
+  telemetry::Producer producer(store);
+
+  for (uint32_t rover = 0; rover < 3; ++rover) {
+    for (uint64_t i = 0; i < 5; ++i) {
+      EXPECT_TRUE(producer.record({100 + i, rover, 80.0f - i, 25.0f, 0}));
+    }
+  }
+  store.flush();
+
+  EXPECT_EQ(store.size(), 15u);
+  EXPECT_EQ(store.query(0, 1000, 1).size(), 5u);
+
+  auto latest = store.latest(2);
+  ASSERT_TRUE(latest.has_value());
+  EXPECT_EQ(latest->timestamp, 104u);
+  EXPECT_FLOAT_EQ(latest->battery, 76.0f);
+  EXPECT_FALSE(store.latest(3).has_value());
+}
+
+TEST_F(TelemetryTest, StoreDropsSamplesWhenRingIsFull) {
+  telemetry::TelemetryStore store(m_directory);
+  telemetry::Producer producer(store);
+
+  // Fill the ring faster than the writer can drain it, recording must not
+  // block however many samples arrive
+  size_t recorded = 0;
+  for (size_t i = 0; i < telemetry::RING_CAPACITY * 4; ++i) {
+    recorded += producer.record({i, 1, 0, 0, 0});
+  }
+  store.flush();
+
+  EXPECT_EQ(store.size() + store.dropped(), telemetry::RING_CAPACITY * 4);
+  EXPECT_EQ(store.size(), recorded);
+}
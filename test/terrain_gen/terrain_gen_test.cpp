@@ -0,0 +1,394 @@
+#include "terrain_gen.h"
+
+#include <algorithm>
+#include <atomic>
+#include <gtest/gtest.h>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+// Checks a window from getTerrain against the region around the same tile
+template <typename Generator>
+void expect_window_matches(Generator &terrain, int x, int y) {
+  const int side = Generator::WINDOW, radius = Generator::RADIUS;
+  auto window = terrain.getTerrain(x, y);
+  auto region = terrain.getRegion(x - radius, y - radius, side, side);
+
+  for (int row = 0; row < side; ++row) {
+    for (int column = 0; column < side; ++column) {
+      EXPECT_EQ(window[row][column], region.get(column, row))
+          << "at (" << x << "," << y << ") row " << row << " column "
+          << column;
+    }
+  }
+}
+} // namespace
+
+TEST(TerrainGenerator, SpawnChunkIsClear) {
+  TerrainGenerator terrain(1.0, 3);
+  EXPECT_EQ(terrain.getChunk(0, 0).count(), 0);
+  EXPECT_EQ(terrain.getChunk(1, 0).count(), CHUNK_SIZE * CHUNK_SIZE);
+}
+
+TEST(TerrainGenerator, WindowFollowsAWalk) {
+  for (auto algorithm :
+       {TerrainAlgorithm::HASHED, TerrainAlgorithm::MERSENNE_TWISTER}) {
+    TerrainGenerator terrain(0.4, 8675309, algorithm);
+
+    // Across chunk boundaries in every direction, including negative ones
+    int x = 0, y = 0;
+    const int moves[][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+    for (int step = 0; step < 200; ++step) {
+      auto [dx, dy] = moves[(step / 13 + step % 3) % 4];
+      x += dx;
+      y += dy;
+      expect_window_matches(terrain, x, y);
+    }
+  }
+}
+
+TEST(TerrainGenerator, RegionMatchesChunks) {
+  TerrainGenerator terrain(0.3, 11);
+  auto region = terrain.getRegion(-12, -8, 31, 17);
+
+  // Chunk holding a coordinate, rounding down for negatives
+  auto chunk_of = [](int coordinate) {
+    return coordinate < 0 ? (coordinate + 1) / CHUNK_SIZE - 1
+                          : coordinate / CHUNK_SIZE;
+  };
+
+  size_t rocks = 0;
+  for (int y = -8; y < 9; ++y) {
+    for (int x = -12; x < 19; ++x) {
+      int chunk_x = chunk_of(x), chunk_y = chunk_of(y);
+      auto chunk = terrain.getChunk(chunk_x, chunk_y);
+      bool rock =
+          chunk[y - chunk_y * CHUNK_SIZE][x - chunk_x * CHUNK_SIZE];
+      EXPECT_EQ(region.get(x + 12, y + 8), rock);
+      rocks += rock;
+    }
+  }
+  EXPECT_EQ(region.count(), rocks);
+}
+
+TEST(TerrainGenerator, HashedTilesMatchTheirChunks) {
+  TerrainGenerator terrain(0.3, 5);
+  for (int chunk_y = -3; chunk_y < 3; ++chunk_y) {
+    for (int chunk_x = -3; chunk_x < 3; ++chunk_x) {
+      auto chunk = terrain.getChunk(chunk_x, chunk_y);
+      for (int i = 0; i < CHUNK_SIZE; ++i) {
+        for (int j = 0; j < CHUNK_SIZE; ++j) {
+          EXPECT_EQ(chunk[i][j], terrain.getTile(chunk_x * CHUNK_SIZE + j,
+                                                 chunk_y * CHUNK_SIZE + i));
+        }
+      }
+    }
+  }
+}
+
+TEST(TerrainGenerator, HashedTerrainIsTheSameEverywhere) {
+  // Fixed values, so a change to the hash or a platform difference shows
+  TerrainGenerator terrain(0.2, 8675309);
+  EXPECT_EQ(terrain.getRegion(-50, -50, 100, 100).count(), 1983u);
+  auto chunk = terrain.getChunk(3, -2);
+  const uint64_t rows[] = {18, 8, 0, 2, 0};
+  for (int i = 0; i < CHUNK_SIZE; ++i) {
+    EXPECT_EQ(chunk.getRow(i), rows[i]);
+  }
+
+  // Other generators of the same world agree
+  TerrainGenerator other(0.2, 8675309);
+  EXPECT_EQ(other.getChunk(3, -2), chunk);
+  EXPECT_NE(TerrainGenerator(0.2, 1).getChunk(3, -2), chunk);
+}
+
+TEST(TerrainGenerator, HashedRocksFollowTheProbability) {
+  for (double chance : {0.0, 0.1, 0.5, 1.0}) {
+    TerrainGenerator terrain(chance, 17);
+    auto region = terrain.getRegion(100, 100, 400, 250);
+    double fraction = static_cast<double>(region.count()) / (400 * 250);
+    EXPECT_NEAR(fraction, chance, 0.01) << chance;
+  }
+}
+
+TEST(TerrainGenerator, LegacyTerrainReproducesOldMaps) {
+  // Maps generated before hashed terrain, with the rovers' seed. They depend
+  // on the standard library's distribution, as they always did.
+  TerrainGenerator terrain(0.2, 8675309, TerrainAlgorithm::MERSENNE_TWISTER);
+  EXPECT_EQ(terrain.getRegion(-50, -50, 100, 100).count(), 1957u);
+  auto chunk = terrain.getChunk(3, -2);
+  const uint64_t rows[] = {2, 20, 2, 0, 8};
+  for (int i = 0; i < CHUNK_SIZE; ++i) {
+    EXPECT_EQ(chunk.getRow(i), rows[i]);
+  }
+  EXPECT_EQ(terrain.getTile(3 * CHUNK_SIZE + 1, -2 * CHUNK_SIZE), true);
+}
+
+TEST(TerrainGenerator, ParsesAlgorithmNames) {
+  EXPECT_EQ(parseTerrainAlgorithm("hashed"), TerrainAlgorithm::HASHED);
+  EXPECT_EQ(parseTerrainAlgorithm("legacy"),
+            TerrainAlgorithm::MERSENNE_TWISTER);
+  EXPECT_FALSE(parseTerrainAlgorithm("perlin").has_value());
+}
+
+TEST(TerrainGenerator, WindowSurvivesArbitraryJumps) {
+  TerrainGenerator terrain(0.4, 99, TerrainAlgorithm::HASHED, 8);
+  const int jumps[][2] = {{0, 0},       {1000, -3},   {-77, 512}, {3, 3},
+                          {-1000, 999}, {-2, -2},     {1001, -3}, {0, 0},
+                          {123, 456},   {-123, -456}, {4, 5},     {5, 4}};
+  for (auto [x, y] : jumps) {
+    expect_window_matches(terrain, x, y);
+  }
+  EXPECT_LE(terrain.getCache().size(), 8u);
+}
+
+TEST(TerrainGenerator, PacingBackAndForthHitsTheCache) {
+  for (auto algorithm :
+       {TerrainAlgorithm::HASHED, TerrainAlgorithm::MERSENNE_TWISTER}) {
+    TerrainGenerator terrain(0.2, 8675309, algorithm);
+    for (int x = 0; x < 40; ++x) {
+      terrain.getTerrain(x, 0);
+    }
+    size_t misses = terrain.getCache().getMisses();
+
+    // Every chunk on the way back was generated on the way out
+    for (int pass = 0; pass < 5; ++pass) {
+      for (int x = 40; x-- > 0;) {
+        expect_window_matches(terrain, x, 0);
+      }
+    }
+    EXPECT_EQ(terrain.getCache().getMisses(), misses);
+    EXPECT_GT(terrain.getCache().getHits(), 0u);
+  }
+}
+
+TEST(TerrainGenerator, TinyCacheStillGivesTheRightWindow) {
+  TerrainGenerator terrain(0.5, 4, TerrainAlgorithm::MERSENNE_TWISTER, 1);
+  for (int step = 0; step < 30; ++step) {
+    expect_window_matches(terrain, step * 2 - 7, step - 13);
+  }
+  EXPECT_EQ(terrain.getCache().size(), 1u);
+}
+
+TEST(ChunkCache, EvictsTheLeastRecentlyUsedChunk) {
+  int generated = 0;
+  auto generate = [&generated](int chunk_x, int chunk_y) {
+    generated++;
+    return chunk_x * 100 + chunk_y;
+  };
+
+  ChunkCache<int> cache(2);
+  EXPECT_EQ(cache.get(1, 1, generate), 101);
+  EXPECT_EQ(cache.get(2, -2, generate), 198);
+  EXPECT_EQ(cache.get(1, 1, generate), 101); // Now (2, -2) is the oldest
+  EXPECT_EQ(cache.get(3, 0, generate), 300);
+
+  EXPECT_TRUE(cache.contains(1, 1));
+  EXPECT_FALSE(cache.contains(2, -2));
+  EXPECT_TRUE(cache.contains(3, 0));
+  EXPECT_EQ(generated, 3);
+  EXPECT_EQ(cache.getHits(), 1u);
+  EXPECT_EQ(cache.getMisses(), 3u);
+  EXPECT_EQ(cache.size(), 2u);
+}
+
+TEST(ChunkCache, AThrowingGeneratorLeavesTheCacheIntact) {
+  auto generate = [](int chunk_x, int chunk_y) {
+    return chunk_x * 100 + chunk_y;
+  };
+  auto fail = [](int, int) -> int { throw std::runtime_error("no terrain"); };
+
+  ChunkCache<int> cache(2);
+  cache.get(1, 1, generate);
+  cache.get(2, 2, generate);
+  EXPECT_THROW(cache.get(3, 3, fail), std::runtime_error);
+
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_TRUE(cache.contains(1, 1));
+  EXPECT_TRUE(cache.contains(2, 2));
+  EXPECT_FALSE(cache.contains(3, 3));
+  EXPECT_EQ(cache.get(3, 3, generate), 303);
+  EXPECT_EQ(cache.get(2, 2, generate), 202);
+  EXPECT_FALSE(cache.contains(1, 1));
+}
+
+TEST(TerrainGenerator, PointQueriesMatchTheRegion) {
+  for (auto algorithm :
+       {TerrainAlgorithm::HASHED, TerrainAlgorithm::MERSENNE_TWISTER}) {
+    TerrainGenerator terrain(0.35, 21, algorithm, 16);
+    auto region = terrain.getRegion(-17, -9, 33, 21);
+
+    std::vector<TileCoord> tiles;
+    for (int y = 0; y < 21; ++y) {
+      for (int x = 0; x < 33; ++x) {
+        EXPECT_EQ(terrain.isBlocked(x - 17, y - 9), region.get(x, y));
+        tiles.push_back({x - 17, y - 9});
+      }
+    }
+
+    // Both in row order and scattered, so chunks change between tiles
+    std::reverse(tiles.begin() + tiles.size() / 2, tiles.end());
+    std::swap(tiles[3], tiles[400]);
+    auto blocked = std::make_unique<bool[]>(tiles.size());
+    terrain.queryTiles(tiles, {blocked.get(), tiles.size()});
+    for (size_t i = 0; i < tiles.size(); ++i) {
+      EXPECT_EQ(blocked[i], region.get(tiles[i].x + 17, tiles[i].y + 9));
+    }
+  }
+}
+
+TEST(TerrainGenerator, LegacyPointQueriesShareTheCache) {
+  TerrainGenerator terrain(0.2, 8675309, TerrainAlgorithm::MERSENNE_TWISTER);
+  terrain.getTerrain(12, 12);
+  size_t misses = terrain.getCache().getMisses();
+
+  // Neighbours of the window's centre are in chunks it already covers
+  const TileCoord tiles[] = {{12, 11}, {12, 13}, {11, 12}, {13, 12}};
+  bool blocked[4];
+  terrain.queryTiles(tiles, blocked);
+  EXPECT_EQ(terrain.isBlocked(12, 11), blocked[0]);
+  EXPECT_EQ(terrain.getCache().getMisses(), misses);
+}
+
+TEST(BasicTerrainGenerator, PowerOfTwoChunksAddressNegativeTiles) {
+  // 64 tile chunks are found with shifts, which must round down too
+  BasicTerrainGenerator<64, 4> terrain(0.3, 8675309);
+  EXPECT_EQ(terrain.getChunk(0, 0).count(), 0);
+  EXPECT_FALSE(terrain.isBlocked(63, 63));
+
+  auto region = terrain.getRegion(-70, -70, 140, 140);
+  for (int y = -70; y < 70; y += 3) {
+    for (int x = -70; x < 70; x += 1) {
+      EXPECT_EQ(terrain.isBlocked(x, y), region.get(x + 70, y + 70));
+    }
+  }
+  for (int step = -100; step < 100; step += 7) {
+    expect_window_matches(terrain, step, -step / 2);
+  }
+}
+
+TEST(BasicTerrainGenerator, HashedTilesDoNotDependOnChunkSize) {
+  // Away from the clear chunk at spawn, any chunk size gives the same world
+  TerrainGenerator small(0.25, 31);
+  BasicTerrainGenerator<64, VIEW_RADIUS> large(0.25, 31);
+  for (int y = 64; y < 96; ++y) {
+    for (int x = -40; x < 40; ++x) {
+      EXPECT_EQ(small.isBlocked(x, y), large.isBlocked(x, y));
+    }
+  }
+}
+
+TEST(BasicTerrainGenerator, ViewsWiderThanAChunk) {
+  // A 13 tile window spans up to five 3 tile chunks
+  BasicTerrainGenerator<3, 6> hashed(0.4, 2);
+  BasicTerrainGenerator<3, 6> legacy(0.4, 2,
+                                     TerrainAlgorithm::MERSENNE_TWISTER);
+  for (int step = 0; step < 40; ++step) {
+    expect_window_matches(hashed, step - 20, 3 - step);
+    expect_window_matches(legacy, 20 - step, step);
+  }
+}
+
+TEST(BasicTerrainGenerator, ViewOfASingleTile) {
+  BasicTerrainGenerator<8, 0> terrain(0.5, 6);
+  for (int x = -20; x < 20; ++x) {
+    auto window = terrain.getTerrain(x, 9);
+    EXPECT_EQ(window[0][0], terrain.isBlocked(x, 9));
+  }
+}
+
+TEST(SharedChunkStore, GeneratesEachChunkOnceAcrossThreads) {
+  for (auto algorithm :
+       {TerrainAlgorithm::HASHED, TerrainAlgorithm::MERSENNE_TWISTER}) {
+    auto store = std::make_shared<TerrainGenerator::Store>();
+    TerrainGenerator reference(0.3, 77, algorithm);
+    auto expected = reference.getRegion(-40, -40, 80, 80);
+
+    // Every thread walks the same tiles with a rover of its own
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+      threads.emplace_back([&, t] {
+        TerrainGenerator terrain(0.3, 77, algorithm, store);
+        for (int y = -38; y < 38; ++y) {
+          for (int i = 0; i < 76; ++i) {
+            int x = (t % 2 == 0 ? i : 75 - i) - 38;
+            auto window = terrain.getTerrain(x, y);
+            mismatches += window[VIEW_RADIUS][VIEW_RADIUS + 1] !=
+                          expected.get(x + 41, y + 40);
+            mismatches += terrain.isBlocked(x, y) != expected.get(x + 40,
+                                                                  y + 40);
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    EXPECT_EQ(mismatches, 0);
+    EXPECT_EQ(store->getGenerated(), 16u * 16u); // Chunks -8 to 7 each way
+  }
+}
+
+TEST(SharedChunkStore, RefusesGeneratorsOfAnotherWorld) {
+  auto store = std::make_shared<TerrainGenerator::Store>();
+  TerrainGenerator first(0.3, 77, TerrainAlgorithm::HASHED, store);
+  TerrainGenerator second(0.3, 77, TerrainAlgorithm::HASHED, store);
+  EXPECT_THROW(TerrainGenerator(0.3, 78, TerrainAlgorithm::HASHED, store),
+               std::invalid_argument);
+  EXPECT_THROW(TerrainGenerator(0.4, 77, TerrainAlgorithm::HASHED, store),
+               std::invalid_argument);
+  EXPECT_THROW(
+      TerrainGenerator(0.3, 77, TerrainAlgorithm::MERSENNE_TWISTER, store),
+      std::invalid_argument);
+
+  // Without a store a generator keeps its own cache
+  TerrainGenerator alone(0.3, 78, TerrainAlgorithm::HASHED, nullptr);
+  EXPECT_EQ(alone.getStore(), nullptr);
+  EXPECT_EQ(first.getStore(), store);
+}
+
+TEST(TerrainGenerator, ParallelRegionsMatchTiles) {
+  for (auto algorithm :
+       {TerrainAlgorithm::HASHED, TerrainAlgorithm::MERSENNE_TWISTER}) {
+    TerrainGenerator terrain(0.3, 4242, algorithm);
+
+    // Straddles spawn, and rows take more than one word
+    const int x0 = -101, y0 = -67, width = 203, height = 141;
+    std::vector<uint64_t> bits(TileGrid::rowWords(width) * height, ~0ull);
+    terrain.generateRegion(x0, y0, width, height, bits, 4);
+
+    const size_t stride = TileGrid::rowWords(width);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        bool rock = (bits[y * stride + x / 64] >> (x % 64)) & 1;
+        ASSERT_EQ(rock, terrain.getTile(x0 + x, y0 + y))
+            << "at (" << x0 + x << "," << y0 + y << ")";
+      }
+      // Padding past the last tile of a row is cleared
+      EXPECT_EQ(bits[y * stride + stride - 1] >> (width % 64), 0u);
+    }
+  }
+}
+
+TEST(TerrainGenerator, RegionIsTheSameOnAnyNumberOfThreads) {
+  BasicTerrainGenerator<64, VIEW_RADIUS> terrain(0.45, 9);
+  const int width = 1000, height = 777;
+  std::vector<uint64_t> one(TileGrid::rowWords(width) * height);
+  std::vector<uint64_t> many(one.size());
+  terrain.generateRegion(-500, 12, width, height, one, 1);
+  terrain.generateRegion(-500, 12, width, height, many, 0);
+  EXPECT_EQ(one, many);
+}
+
+TEST(TerrainGenerator, RegionNeedsRoomForEveryRow) {
+  TerrainGenerator terrain(0.2, 1);
+  std::vector<uint64_t> bits(2 * 9);
+  EXPECT_NO_THROW(terrain.generateRegion(0, 0, 128, 9, bits));
+  EXPECT_THROW(terrain.generateRegion(0, 0, 129, 9, bits),
+               std::invalid_argument);
+  EXPECT_NO_THROW(terrain.generateRegion(0, 0, -5, 9, {}));
+}
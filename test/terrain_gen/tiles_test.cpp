@@ -0,0 +1,69 @@
+#include "tiles.h"
+
+#include <gtest/gtest.h>
+
+TEST(TileSquare, RowsStraddlingWordsRoundTrip) {
+  // 9 * 9 tiles take two words, so some rows are split between them
+  TileSquare<9> square;
+  for (int row = 0; row < 9; ++row) {
+    square.setRow(row, 0x1FF ^ (1u << row));
+  }
+  for (int row = 0; row < 9; ++row) {
+    EXPECT_EQ(square.getRow(row), 0x1FFu ^ (1u << row)) << row;
+    for (int column = 0; column < 9; ++column) {
+      EXPECT_EQ(square[row][column], column != row);
+    }
+  }
+  EXPECT_EQ(square.count(), 9 * 8);
+}
+
+TEST(TileSquare, SetRowLeavesOtherRowsAlone) {
+  TileSquare<5> square;
+  square.setRow(2, ~uint64_t{0});
+  square.set(4, 4, true);
+  square.setRow(2, 0b10101);
+
+  EXPECT_EQ(square.getRow(1), 0u);
+  EXPECT_EQ(square.getRow(2), 0b10101u);
+  EXPECT_EQ(square.getRow(3), 0u);
+  EXPECT_TRUE(square[4][4]);
+  EXPECT_EQ(square.count(), 4);
+
+  square.set(4, 4, false);
+  EXPECT_EQ(square.count(), 3);
+}
+
+TEST(TileGrid, OrBitsAcrossWords) {
+  TileGrid grid(150, 3);
+  grid.orBits(60, 1, 0xFF, 8);
+  grid.orBits(140, 2, ~uint64_t{0}, 10);
+
+  for (int x = 0; x < 150; ++x) {
+    EXPECT_EQ(grid.get(x, 0), false);
+    EXPECT_EQ(grid.get(x, 1), x >= 60 && x < 68) << x;
+    EXPECT_EQ(grid.get(x, 2), x >= 140) << x;
+  }
+  EXPECT_EQ(grid.count(), 18u);
+}
+
+TEST(TileGrid, PacksRowsWithoutPadding) {
+  TileGrid grid(70, 3);
+  for (int y = 0; y < 3; ++y) {
+    for (int x = 0; x < 70; ++x) {
+      grid.set(x, y, (x * 7 + y * 3) % 5 == 0);
+    }
+  }
+
+  auto packed = grid.pack();
+  ASSERT_EQ(packed.size(), (70u * 3 + 7) / 8);
+  for (size_t tile = 0; tile < 70 * 3; ++tile) {
+    bool rock = (packed[tile / 8] >> (tile % 8)) & 1;
+    EXPECT_EQ(rock, grid.get(tile % 70, tile / 70)) << tile;
+  }
+}
+
+TEST(TileGrid, EmptyGridPacksToNothing) {
+  EXPECT_TRUE(TileGrid(0, 10).pack().empty());
+  EXPECT_TRUE(TileGrid(-3, 4).pack().empty());
+  EXPECT_EQ(TileGrid(3, 1).pack().size(), 1u);
+}
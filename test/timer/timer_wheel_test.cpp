@@ -0,0 +1,138 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <vector>
+
+class TimerWheelTest : public ::testing::Test {
+protected:
+  timer::TimerWheel m_wheel;
+  std::vector<uint64_t> m_fired; // Tick each fired timer was scheduled for
+
+  // Schedules a timer that records its tick when it fires
+  timer::TimerId schedule(uint64_t expires) {
+    return m_wheel.schedule(expires,
+                            [this, expires]() { m_fired.push_back(expires); });
+  }
+
+  // Checks a timer fires on exactly its tick
+  void expect_fires_at(uint64_t expires) {
+    schedule(expires);
+    m_wheel.advance(expires - 1);
+    EXPECT_TRUE(m_fired.empty()) << "fired early";
+    m_wheel.advance(expires);
+    ASSERT_EQ(m_fired.size(), 1u) << "did not fire on tick " << expires;
+    m_fired.clear();
+  }
+};
+
+TEST_F(TimerWheelTest, FiresOnExpiryAtEveryLevel) {
+  // Root wheel, each outer wheel, and past the longest representable delay
+  for (uint64_t delay : {uint64_t{5}, uint64_t{300}, uint64_t{20000},
+                         uint64_t{2000000}, timer::TimerWheel::MAX_DELAY + 5}) {
+    expect_fires_at(m_wheel.current() + delay);
+  }
+  EXPECT_EQ(m_wheel.size(), 0u);
+}
+
+TEST_F(TimerWheelTest, FiresInExpiryOrder) {
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<uint64_t> delay(1, 100000);
+
+  std::multiset<uint64_t> expected;
+  for (int i = 0; i < 10000; ++i) {
+    uint64_t expires = delay(rng);
+    expected.insert(expires);
+    schedule(expires);
+  }
+  EXPECT_EQ(m_wheel.size(), 10000u);
+
+  // Advance in uneven steps, every timer must fire and none early
+  for (uint64_t now = 0; now <= 100000; now += 777) {
+    m_wheel.advance(now);
+    for (uint64_t fired : m_fired) {
+      EXPECT_LE(fired, now);
+    }
+  }
+  m_wheel.advance(100000);
+
+  ASSERT_EQ(m_fired.size(), expected.size());
+  EXPECT_TRUE(std::is_sorted(m_fired.begin(), m_fired.end()));
+  EXPECT_EQ(m_wheel.size(), 0u);
+}
+
+TEST_F(TimerWheelTest, CancelledTimersDoNotFire) {
+  auto near = schedule(10);
+  auto far = schedule(50000);
+  schedule(20);
+
+  EXPECT_TRUE(m_wheel.cancel(near));
+  EXPECT_TRUE(m_wheel.cancel(far));
+  EXPECT_FALSE(m_wheel.cancel(near));
+  EXPECT_EQ(m_wheel.size(), 1u);
+
+  m_wheel.advance(60000);
+  ASSERT_EQ(m_fired.size(), 1u);
+  EXPECT_EQ(m_fired[0], 20u);
+}
+
+TEST_F(TimerWheelTest, StaleIdDoesNotCancelReusedNode) {
+  auto first = schedule(10);
+  m_wheel.advance(10);
+
+  // The fired timer's node is reused by the next one
+  schedule(20);
+  EXPECT_FALSE(m_wheel.cancel(first));
+  EXPECT_FALSE(m_wheel.cancel(0));
+
+  m_wheel.advance(20);
+  EXPECT_EQ(m_fired.size(), 2u);
+}
+
+TEST_F(TimerWheelTest, CallbacksCanScheduleAndCancel) {
+  timer::TimerId victim = 0;
+
+  // Fires first on tick 5, and cancels the other timer due on the same tick
+  m_wheel.schedule(5, [this, &victim]() {
+    m_fired.push_back(5);
+    m_wheel.cancel(victim);
+
+    // Due in the past, so it fires on the next tick processed
+    m_wheel.schedule(0, [this]() { m_fired.push_back(0); });
+  });
+  victim = schedule(5);
+
+  m_wheel.advance(5);
+  ASSERT_EQ(m_fired.size(), 1u);
+  EXPECT_EQ(m_wheel.size(), 1u);
+
+  m_wheel.advance(6);
+  ASSERT_EQ(m_fired.size(), 2u);
+  EXPECT_EQ(m_fired[1], 0u);
+}
+
+TEST_F(TimerWheelTest, NextTickFindsDueSlotOrCascade) {
+  timer::TimerWheel wheel(1);
+  wheel.schedule(40, []() {});
+  EXPECT_EQ(wheel.next_tick(), 40u);
+
+  // Outer wheel timers are found by waking at the next cascade
+  timer::TimerWheel outer(1);
+  outer.schedule(100000, []() {});
+  EXPECT_EQ(outer.next_tick(), 256u);
+}
+
+TEST_F(TimerWheelTest, SkipToMovesIdleWheel) {
+  m_wheel.skip_to(1000);
+  EXPECT_EQ(m_wheel.current(), 1000u);
+
+  // Not moved while timers are pending
+  schedule(1010);
+  m_wheel.skip_to(5000);
+  EXPECT_EQ(m_wheel.current(), 1000u);
+
+  m_wheel.advance(1010);
+  EXPECT_EQ(m_fired.size(), 1u);
+}
@@ -0,0 +1,121 @@
+#include "batch_socket.h"
+
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Batches datagrams between two loopback sockets, with recvmmsg/sendmmsg and
+// with the one-call-per-datagram fallback
+class BatchSocketTest : public ::testing::TestWithParam<bool> {
+protected:
+  static constexpr size_t BATCH_SIZE = 4;
+
+  asio::io_context m_io_context;
+  udp::socket m_receiver{m_io_context,
+                         udp::endpoint(asio::ip::address_v4::loopback(), 0)};
+  udp::socket m_sender{m_io_context,
+                       udp::endpoint(asio::ip::address_v4::loopback(), 0)};
+  transport::BatchSocket m_batch_receiver{m_receiver, BATCH_SIZE, GetParam()};
+  transport::BatchSocket m_batch_sender{m_sender, BATCH_SIZE, GetParam()};
+
+  static std::vector<uint8_t> message(uint32_t value, size_t size = 100) {
+    std::vector<uint8_t> bytes(size, static_cast<uint8_t>(value));
+    std::memcpy(bytes.data(), &value, sizeof(value));
+    return bytes;
+  }
+
+  static uint32_t value_of(const transport::Datagram &datagram) {
+    uint32_t value = 0;
+    std::memcpy(&value, datagram.data, sizeof(value));
+    return value;
+  }
+
+  // Receives batches until the given number of datagrams has arrived or time
+  // runs out, returning the values in order of arrival
+  std::vector<uint32_t> receive(size_t count) {
+    std::vector<uint32_t> values;
+    auto end = std::chrono::steady_clock::now() + 2s;
+    while (values.size() < count && std::chrono::steady_clock::now() < end) {
+      asio::error_code ec;
+      auto batch = m_batch_receiver.receive_batch(ec);
+      EXPECT_FALSE(ec) << ec.message();
+      EXPECT_LE(batch.size(), BATCH_SIZE);
+      for (const auto &datagram : batch) {
+        EXPECT_EQ(datagram.sender, m_sender.local_endpoint());
+        values.push_back(value_of(datagram));
+      }
+    }
+    return values;
+  }
+};
+
+TEST_P(BatchSocketTest, SendsAndReceivesInBatches) {
+  for (uint32_t value = 0; value < 10; ++value) {
+    m_batch_sender.queue_send(m_receiver.local_endpoint(), message(value));
+  }
+  EXPECT_EQ(m_batch_sender.queued(), 10u);
+
+  // Ten datagrams take two full batches and a partial one
+  EXPECT_EQ(m_batch_sender.flush(), 10u);
+  EXPECT_EQ(m_batch_sender.queued(), 0u);
+
+  std::vector<uint32_t> expected{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  EXPECT_EQ(receive(10), expected);
+}
+
+TEST_P(BatchSocketTest, ReceivingWithNothingWaitingIsNotAnError) {
+  asio::error_code ec;
+  EXPECT_TRUE(m_batch_receiver.receive_batch(ec).empty());
+  EXPECT_FALSE(ec) << ec.message();
+}
+
+TEST_P(BatchSocketTest, RefusedDatagramIsDroppedAndTheRestAreSent) {
+  // The kernel takes the first two of the batch, then refuses the oversized
+  // one. It is dropped and the datagrams after it still go out.
+  m_batch_sender.queue_send(m_receiver.local_endpoint(), message(0));
+  m_batch_sender.queue_send(m_receiver.local_endpoint(), message(1));
+  m_batch_sender.queue_send(m_receiver.local_endpoint(), message(2, 70000));
+  m_batch_sender.queue_send(m_receiver.local_endpoint(), message(3));
+
+  EXPECT_EQ(m_batch_sender.flush(), 3u);
+  EXPECT_EQ(m_batch_sender.queued(), 0u);
+
+  std::vector<uint32_t> expected{0, 1, 3};
+  EXPECT_EQ(receive(3), expected);
+}
+
+TEST_P(BatchSocketTest, AsyncReceiveDeliversEveryBatch) {
+  std::vector<uint32_t> values;
+  m_batch_receiver.async_receive(
+      [&values](std::span<const transport::Datagram> batch) {
+        for (const auto &datagram : batch) {
+          values.push_back(value_of(datagram));
+        }
+      });
+
+  for (uint32_t value = 0; value < 6; ++value) {
+    m_batch_sender.queue_send(m_receiver.local_endpoint(), message(value));
+  }
+  m_batch_sender.flush();
+
+  auto end = std::chrono::steady_clock::now() + 2s;
+  while (values.size() < 6 && std::chrono::steady_clock::now() < end) {
+    m_io_context.run_for(1ms);
+    m_io_context.restart();
+  }
+  std::vector<uint32_t> expected{0, 1, 2, 3, 4, 5};
+  EXPECT_EQ(values, expected);
+
+  // Closing the socket ends the receive loop
+  m_receiver.close();
+  m_io_context.run_for(10ms);
+}
+
+INSTANTIATE_TEST_SUITE_P(BatchSocket, BatchSocketTest,
+                         ::testing::Values(true, false),
+                         [](const ::testing::TestParamInfo<bool> &info) {
+                           return info.param ? "Mmsg" : "Fallback";
+                         });
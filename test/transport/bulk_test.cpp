@@ -0,0 +1,268 @@
+#include "bulk.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Connects a receiver and a sender through queues the test delivers from, so
+// it decides what is lost and when anything arrives
+class BulkTest : public ::testing::Test {
+protected:
+  asio::io_context m_io_context;
+  transport::BulkOptions m_options;
+
+  std::vector<std::vector<uint8_t>> m_to_sender, m_to_receiver;
+  std::unique_ptr<transport::BulkReceiver> m_receiver;
+  std::unique_ptr<transport::BulkSender> m_sender;
+  std::vector<uint8_t> m_content;
+
+  std::optional<std::optional<std::vector<uint8_t>>> m_received;
+  std::optional<bool> m_delivered;
+
+  void SetUp() override {
+    m_options.initial_rto = 50ms;
+    m_options.min_rto = 20ms;
+    m_options.max_rto = 100ms;
+  }
+
+  static std::vector<uint8_t> content(size_t size) {
+    std::vector<uint8_t> bytes(size);
+    for (size_t idx = 0; idx < size; ++idx) {
+      bytes[idx] = static_cast<uint8_t>(idx * 31 + idx / 256);
+    }
+    return bytes;
+  }
+
+  // Opens a transfer, taking the OPEN to a new sender of the given content
+  void open(std::vector<uint8_t> data) {
+    m_content = data;
+    m_receiver = std::make_unique<transport::BulkReceiver>(
+        m_io_context, 7, 42, BulkContent::TERRAIN,
+        [this](std::vector<uint8_t> message) {
+          m_to_sender.push_back(std::move(message));
+        },
+        [this](std::optional<std::vector<uint8_t>> data) {
+          m_received = std::move(data);
+        },
+        m_options);
+    m_receiver->start();
+
+    ASSERT_EQ(m_to_sender.size(), 1u);
+    auto header = transport::peek_bulk_header(m_to_sender[0]);
+    ASSERT_TRUE(header.has_value());
+    EXPECT_EQ(header->kind, BulkKind::OPEN);
+    EXPECT_EQ(header->transfer_id, 42u);
+    EXPECT_EQ(header->content, BulkContent::TERRAIN);
+    m_to_sender.clear();
+
+    m_sender = std::make_unique<transport::BulkSender>(
+        m_io_context, *header, std::move(data),
+        [this](std::vector<uint8_t> message) {
+          m_to_receiver.push_back(std::move(message));
+        },
+        [this](bool delivered) { m_delivered = delivered; }, m_options);
+    m_sender->start();
+  }
+
+  // Hands over everything queued in both directions, dropping messages the
+  // filter rejects, until both queues are empty or the deadline passes
+  template <typename Filter>
+  void exchange(Filter keep, std::chrono::milliseconds deadline = 2s) {
+    auto end = std::chrono::steady_clock::now() + deadline;
+    size_t count = 0;
+    while (std::chrono::steady_clock::now() < end && (!m_delivered ||
+                                                      !m_received)) {
+      auto to_receiver = std::move(m_to_receiver);
+      m_to_receiver.clear();
+      for (auto &message : to_receiver) {
+        if (keep(message, count++)) {
+          m_receiver->handle_segment(message);
+        }
+      }
+
+      auto to_sender = std::move(m_to_sender);
+      m_to_sender.clear();
+      for (auto &message : to_sender) {
+        if (!keep(message, count++)) {
+          continue;
+        }
+        auto header = transport::peek_bulk_header(message);
+        if (header->kind == BulkKind::ACK) {
+          BulkAck ack{};
+          std::memcpy(&ack, message.data(),
+                      std::min(message.size(), sizeof(ack)));
+          m_sender->handle_ack(ack);
+        } else if (header->kind == BulkKind::ABORT) {
+          m_sender->cancel();
+        }
+      }
+
+      m_io_context.run_for(1ms);
+      m_io_context.restart();
+    }
+  }
+
+  // Filter that loses nothing
+  static bool keep_all(const std::vector<uint8_t> &, size_t) { return true; }
+
+  void exchange() { exchange(keep_all); }
+
+  // Timeouts long enough that a test starved of the CPU, e.g. under a
+  // parallel ctest, does not see segments in flight as lost
+  void slow_timers() {
+    m_options.initial_rto = 500ms;
+    m_options.min_rto = 200ms;
+    m_options.max_rto = 1s;
+  }
+};
+
+TEST_F(BulkTest, TransfersContentSpanningManySegments) {
+  slow_timers();
+  open(content(200 * transport::BULK_SEGMENT_SIZE + 123));
+  exchange(keep_all, 10s);
+
+  ASSERT_TRUE(m_delivered.has_value());
+  EXPECT_TRUE(*m_delivered);
+  ASSERT_TRUE(m_received.has_value() && m_received->has_value());
+  EXPECT_EQ(**m_received, m_content);
+  EXPECT_EQ(m_sender->segment_count(), 201u);
+
+  // Nothing is lost, though a stalled test may time out now and then
+  EXPECT_LT(m_sender->retransmits(), m_sender->segment_count());
+}
+
+TEST_F(BulkTest, EmptyContentIsStillDelivered) {
+  open({});
+  exchange();
+
+  ASSERT_TRUE(m_received.has_value() && m_received->has_value());
+  EXPECT_TRUE((*m_received)->empty());
+  EXPECT_TRUE(m_delivered.value_or(false));
+}
+
+TEST_F(BulkTest, SenderKeepsWithinTheReceiversWindow) {
+  m_options.window = 8;
+  open(content(100 * transport::BULK_SEGMENT_SIZE));
+
+  // Nothing more is sent until the receiver answers
+  EXPECT_EQ(m_to_receiver.size(), 8u);
+  m_io_context.run_for(5ms);
+  m_io_context.restart();
+  EXPECT_EQ(m_to_receiver.size(), 8u);
+
+  exchange();
+  ASSERT_TRUE(m_received.has_value() && m_received->has_value());
+  EXPECT_EQ(**m_received, m_content);
+}
+
+TEST_F(BulkTest, OnlyLostSegmentsAreResent) {
+  slow_timers();
+  open(content(100 * transport::BULK_SEGMENT_SIZE));
+
+  // Every seventh message is lost the first time round, in both directions
+  std::vector<bool> dropped;
+  exchange([&dropped](const std::vector<uint8_t> &message, size_t count) {
+    auto header = transport::peek_bulk_header(message);
+    if (count % 7 == 3 && header->kind == BulkKind::DATA) {
+      dropped.push_back(true);
+      return false;
+    }
+    return count % 7 != 5;
+  }, 10s);
+
+  ASSERT_TRUE(m_received.has_value() && m_received->has_value());
+  EXPECT_EQ(**m_received, m_content);
+  EXPECT_TRUE(m_delivered.value_or(false));
+
+  // Selective repeat resends what was lost, not everything after it. The
+  // bound leaves room for timeouts of a stalled test.
+  EXPECT_GE(m_sender->retransmits(), dropped.size());
+  EXPECT_LT(m_sender->retransmits(), m_sender->segment_count());
+}
+
+TEST_F(BulkTest, SegmentsWithoutTheirTrailingZerosAreRestored) {
+  auto data = content(3 * transport::BULK_SEGMENT_SIZE);
+  std::fill(data.begin() + transport::BULK_SEGMENT_SIZE / 2, data.end(), 0);
+  open(data);
+
+  // Decoding strips trailing zeros from each datagram
+  exchange([](std::vector<uint8_t> &message, size_t) {
+    while (!message.empty() && message.back() == 0) {
+      message.pop_back();
+    }
+    return true;
+  });
+
+  ASSERT_TRUE(m_received.has_value() && m_received->has_value());
+  EXPECT_EQ(**m_received, m_content);
+}
+
+TEST_F(BulkTest, SenderGivesUpWhenNothingIsAcknowledged) {
+  m_options.max_attempts = 3;
+  open(content(10 * transport::BULK_SEGMENT_SIZE));
+
+  exchange([](const std::vector<uint8_t> &message, size_t) {
+    auto header = transport::peek_bulk_header(message);
+    return header->kind != BulkKind::ACK && header->kind != BulkKind::ABORT;
+  }, 500ms);
+
+  ASSERT_TRUE(m_delivered.has_value());
+  EXPECT_FALSE(*m_delivered);
+  EXPECT_TRUE(m_sender->done());
+  EXPECT_GT(m_sender->retransmits(), 0u);
+}
+
+TEST_F(BulkTest, ReceiverResendsOpenThenGivesUp) {
+  m_options.max_attempts = 3;
+  m_receiver = std::make_unique<transport::BulkReceiver>(
+      m_io_context, 7, 42, BulkContent::TERRAIN,
+      [this](std::vector<uint8_t> message) {
+        m_to_sender.push_back(std::move(message));
+      },
+      [this](std::optional<std::vector<uint8_t>> data) {
+        m_received = std::move(data);
+      },
+      m_options);
+  m_receiver->start();
+
+  m_io_context.run_for(500ms);
+  ASSERT_TRUE(m_received.has_value());
+  EXPECT_FALSE(m_received->has_value());
+
+  // Three OPENs, then an ABORT
+  ASSERT_EQ(m_to_sender.size(), 4u);
+  EXPECT_EQ(transport::peek_bulk_header(m_to_sender[2])->kind, BulkKind::OPEN);
+  EXPECT_EQ(transport::peek_bulk_header(m_to_sender[3])->kind,
+            BulkKind::ABORT);
+}
+
+TEST_F(BulkTest, FinishedReceiverStillAcknowledges) {
+  open(content(2 * transport::BULK_SEGMENT_SIZE));
+
+  // The last ACK is lost, so the sender resends
+  exchange([](const std::vector<uint8_t> &message, size_t) {
+    auto header = transport::peek_bulk_header(message);
+    return header->kind != BulkKind::ACK;
+  }, 30ms);
+  ASSERT_TRUE(m_received.has_value() && m_received->has_value());
+  EXPECT_FALSE(m_delivered.has_value());
+
+  exchange();
+  EXPECT_TRUE(m_delivered.value_or(false));
+}
+
+TEST(PeekBulkHeader, IgnoresOtherMessages) {
+  MessageHeader header{3, 10};
+  std::vector<uint8_t> message(sizeof(header));
+  std::memcpy(message.data(), &header, sizeof(header));
+  EXPECT_FALSE(transport::peek_bulk_header(message).has_value());
+
+  header.request_id = BULK_REQUEST_ID;
+  std::memcpy(message.data(), &header, sizeof(header));
+  auto bulk = transport::peek_bulk_header(message);
+  ASSERT_TRUE(bulk.has_value());
+  EXPECT_EQ(bulk->rover_id, 3u);
+}
@@ -0,0 +1,175 @@
+#include "coalescer.h"
+#include "error_correction.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <vector>
+
+class CoalescerTest : public ::testing::Test {
+protected:
+  asio::io_context m_io_context;
+  std::vector<std::vector<uint8_t>> m_sent; // Payload of each datagram
+  std::vector<bool> m_urgent;               // Whether each was urgent
+  transport::Coalescer m_coalescer{
+      m_io_context,
+      [this](std::vector<uint8_t> payload, bool urgent) {
+        m_sent.push_back(std::move(payload));
+        m_urgent.push_back(urgent);
+      },
+      std::chrono::milliseconds(5)};
+
+  // Builds a message from a rover with the given size, filled with a pattern
+  static std::vector<uint8_t> message(uint32_t rover_id, uint32_t request_id,
+                                      size_t size = 40) {
+    std::vector<uint8_t> bytes(size);
+    for (size_t idx = 0; idx < size; ++idx) {
+      bytes[idx] = static_cast<uint8_t>(idx * 7 + request_id);
+    }
+    MessageHeader header{rover_id, request_id};
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    return bytes;
+  }
+
+  // Runs the io_context until the coalescing delay has passed
+  void wait_for_delay() {
+    m_io_context.run_for(std::chrono::milliseconds(50));
+    m_io_context.restart();
+  }
+};
+
+TEST_F(CoalescerTest, LoneMessageIsSentUnframed) {
+  auto msg = message(3, 10);
+  m_coalescer.push(msg);
+  EXPECT_TRUE(m_sent.empty()) << "sent before the delay";
+
+  wait_for_delay();
+  ASSERT_EQ(m_sent.size(), 1u);
+  EXPECT_EQ(m_sent[0], msg);
+  EXPECT_FALSE(m_urgent[0]);
+  EXPECT_EQ(m_coalescer.pending(), 0u);
+}
+
+TEST_F(CoalescerTest, MessagesWithinTheDelayShareADatagram) {
+  std::vector<std::vector<uint8_t>> messages = {message(3, 10), message(3, 11),
+                                                message(3, 0, 100)};
+  for (const auto &msg : messages) {
+    m_coalescer.push(msg);
+  }
+
+  wait_for_delay();
+  ASSERT_EQ(m_sent.size(), 1u);
+
+  auto header = peek_header(m_sent[0].data(), m_sent[0].size());
+  ASSERT_TRUE(header.has_value());
+  EXPECT_EQ(header->rover_id, 3u);
+  EXPECT_EQ(header->request_id, BATCH_REQUEST_ID);
+
+  auto unpacked = transport::unpack_batch(m_sent[0]);
+  ASSERT_TRUE(unpacked.has_value());
+  EXPECT_EQ(*unpacked, messages);
+  EXPECT_EQ(m_coalescer.messages_sent(), 3u);
+  EXPECT_EQ(m_coalescer.datagrams_sent(), 1u);
+}
+
+TEST_F(CoalescerTest, UrgentMessageFlushesEverythingQueued) {
+  m_coalescer.push(message(3, 10));
+  m_coalescer.push(message(3, 0), true);
+
+  // Sent without running the io_context
+  ASSERT_EQ(m_sent.size(), 1u);
+  EXPECT_TRUE(m_urgent[0]);
+  auto unpacked = transport::unpack_batch(m_sent[0]);
+  ASSERT_TRUE(unpacked.has_value());
+  EXPECT_EQ(unpacked->size(), 2u);
+
+  // The cancelled delay sends nothing more
+  wait_for_delay();
+  EXPECT_EQ(m_sent.size(), 1u);
+}
+
+TEST_F(CoalescerTest, FullBatchesAreSentWithoutWaiting) {
+  std::vector<std::vector<uint8_t>> messages;
+  for (uint32_t id = 1; id <= 40; ++id) {
+    messages.push_back(message(3, id, 90));
+    m_coalescer.push(messages.back());
+  }
+  size_t sent_early = m_sent.size();
+  EXPECT_GE(sent_early, 3u);
+  wait_for_delay();
+
+  // Every datagram fits, and every message arrives once and in order
+  std::vector<std::vector<uint8_t>> received;
+  for (const auto &payload : m_sent) {
+    EXPECT_LE(payload.size(), MAX_PAYLOAD_SIZE);
+    auto unpacked = transport::unpack_batch(payload);
+    ASSERT_TRUE(unpacked.has_value());
+    received.insert(received.end(), unpacked->begin(), unpacked->end());
+  }
+  EXPECT_EQ(received, messages);
+}
+
+TEST_F(CoalescerTest, OversizedMessageIsSentAlone) {
+  m_coalescer.push(message(3, 10));
+  auto big = message(3, 11, MAX_PAYLOAD_SIZE);
+  m_coalescer.push(big);
+
+  ASSERT_EQ(m_sent.size(), 2u);
+  EXPECT_EQ(m_sent[0], message(3, 10));
+  EXPECT_EQ(m_sent[1], big);
+}
+
+TEST_F(CoalescerTest, BatchesHoldOneRoversMessages) {
+  m_coalescer.push(message(3, 10));
+  m_coalescer.push(message(4, 11));
+  wait_for_delay();
+
+  ASSERT_EQ(m_sent.size(), 2u);
+  EXPECT_EQ(m_sent[0], message(3, 10));
+  EXPECT_EQ(m_sent[1], message(4, 11));
+}
+
+TEST_F(CoalescerTest, BatchSurvivesEncodingAndDecoding) {
+  // The last message ends in zeros, which decoding strips
+  std::vector<std::vector<uint8_t>> messages = {message(3, 10, 60),
+                                                message(3, 11, 300)};
+  std::fill(messages[1].begin() + 20, messages[1].end(), 0);
+  for (const auto &msg : messages) {
+    m_coalescer.push(msg);
+  }
+  m_coalescer.flush();
+  ASSERT_EQ(m_sent.size(), 1u);
+
+  for (const auto &rscode : RS_LEVELS) {
+    auto pkt = reed_solomon::encode_bytes(m_sent[0], rscode);
+    EXPECT_LE(pkt.size(), static_cast<size_t>(MAX_PACKET_SIZE));
+    if (rscode.n - rscode.k >= 2) {
+      pkt[5] ^= 0x5A; // One symbol error, correctable with two parity symbols
+    }
+
+    auto decoded = reed_solomon::decode_packet(pkt, rscode);
+    ASSERT_TRUE(decoded.has_value());
+    EXPECT_LT(decoded->size(), m_sent[0].size());
+
+    auto unpacked = transport::unpack_batch(*decoded);
+    ASSERT_TRUE(unpacked.has_value());
+    EXPECT_EQ(*unpacked, messages);
+  }
+}
+
+TEST(UnpackBatch, RejectsPacketsThatAreNotBatches) {
+  MessageHeader header{3, 10};
+  std::vector<uint8_t> packet(sizeof(header) + 4, 1);
+  std::memcpy(packet.data(), &header, sizeof(header));
+  EXPECT_FALSE(transport::unpack_batch(packet).has_value());
+
+  // A batch with no messages
+  header.request_id = BATCH_REQUEST_ID;
+  packet.assign(sizeof(header), 0);
+  std::memcpy(packet.data(), &header, sizeof(header));
+  EXPECT_FALSE(transport::unpack_batch(packet).has_value());
+
+  // A frame longer than any datagram could carry
+  packet.push_back(0xFF);
+  packet.push_back(0xFF);
+  EXPECT_FALSE(transport::unpack_batch(packet).has_value());
+}
@@ -0,0 +1,258 @@
+#include "scheduler.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <vector>
+
+using transport::TrafficClass;
+
+namespace {
+// Records what is sent, with a backlog the test controls
+class FakeTransport : public transport::Transport {
+public:
+  std::vector<std::pair<udp::endpoint, std::vector<uint8_t>>> sent;
+  size_t stuck = 0; // Datagrams the kernel has not taken
+  size_t flushes = 0;
+
+  void async_receive(transport::BatchHandler) override {}
+  void queue_send(const udp::endpoint &endpoint,
+                  std::vector<uint8_t> message) override {
+    sent.emplace_back(endpoint, std::move(message));
+  }
+  void flush() override { flushes++; }
+  size_t backlog() const override { return stuck; }
+  udp::endpoint local_endpoint() const override { return {}; }
+  udp::socket::native_handle_type native_handle() override { return -1; }
+  void close() override {}
+};
+
+// Datagram whose first byte names its class
+std::vector<uint8_t> datagram(TrafficClass traffic_class, size_t size = 100) {
+  std::vector<uint8_t> bytes(size, 0);
+  bytes[0] = static_cast<uint8_t>(traffic_class);
+  return bytes;
+}
+} // namespace
+
+class SchedulerTest : public ::testing::Test {
+protected:
+  asio::io_context m_io_context;
+  FakeTransport m_transport;
+  udp::endpoint m_peer{asio::ip::make_address("127.0.0.1"), 9000};
+
+  void run_for(std::chrono::milliseconds duration) {
+    m_io_context.run_for(duration);
+    m_io_context.restart();
+  }
+
+  // Classes of the sent datagrams, in order
+  std::vector<TrafficClass> sent_classes() const {
+    std::vector<TrafficClass> classes;
+    for (const auto &[endpoint, bytes] : m_transport.sent) {
+      classes.push_back(static_cast<TrafficClass>(bytes[0]));
+    }
+    return classes;
+  }
+};
+
+TEST_F(SchedulerTest, DatagramsQueuedTogetherShareAFlush) {
+  transport::SendScheduler scheduler(m_io_context, m_transport);
+  for (int idx = 0; idx < 5; ++idx) {
+    scheduler.send(m_peer, datagram(TrafficClass::INTERACTIVE),
+                   TrafficClass::INTERACTIVE);
+  }
+  EXPECT_TRUE(m_transport.sent.empty()) << "sent before the handler returned";
+
+  run_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(m_transport.sent.size(), 5u);
+  EXPECT_EQ(m_transport.flushes, 1u);
+  EXPECT_EQ(scheduler.stats(TrafficClass::INTERACTIVE).sent, 5u);
+  EXPECT_EQ(scheduler.stats(TrafficClass::INTERACTIVE).bytes, 500u);
+}
+
+TEST_F(SchedulerTest, EmergencyOvertakesQueuedTraffic) {
+  transport::SchedulerOptions options;
+  options.bulk_rate = 0;
+  transport::SendScheduler scheduler(m_io_context, m_transport, options);
+
+  for (int idx = 0; idx < 10; ++idx) {
+    scheduler.send(m_peer, datagram(TrafficClass::BULK), TrafficClass::BULK);
+    scheduler.send(m_peer, datagram(TrafficClass::INTERACTIVE),
+                   TrafficClass::INTERACTIVE);
+  }
+  scheduler.send(m_peer, datagram(TrafficClass::EMERGENCY),
+                 TrafficClass::EMERGENCY);
+
+  run_for(std::chrono::milliseconds(5));
+  auto classes = sent_classes();
+  ASSERT_EQ(classes.size(), 21u);
+  EXPECT_EQ(classes[0], TrafficClass::EMERGENCY);
+}
+
+TEST_F(SchedulerTest, FullBacklogHoldsDatagramsForEmergencies) {
+  transport::SchedulerOptions options;
+  options.max_backlog = 4;
+  transport::SendScheduler scheduler(m_io_context, m_transport, options);
+
+  m_transport.stuck = options.max_backlog;
+  for (int idx = 0; idx < 10; ++idx) {
+    scheduler.send(m_peer, datagram(TrafficClass::INTERACTIVE),
+                   TrafficClass::INTERACTIVE);
+  }
+  run_for(std::chrono::milliseconds(5));
+  EXPECT_TRUE(m_transport.sent.empty());
+  EXPECT_EQ(scheduler.queued(TrafficClass::INTERACTIVE), 10u);
+
+  // Queued behind the others, but first out once the kernel has room
+  scheduler.send(m_peer, datagram(TrafficClass::EMERGENCY),
+                 TrafficClass::EMERGENCY);
+  m_transport.stuck = 0;
+  run_for(std::chrono::milliseconds(5));
+
+  auto classes = sent_classes();
+  ASSERT_EQ(classes.size(), 11u);
+  EXPECT_EQ(classes[0], TrafficClass::EMERGENCY);
+  EXPECT_EQ(scheduler.queued(TrafficClass::INTERACTIVE), 0u);
+}
+
+TEST_F(SchedulerTest, DrainWaitsForTheTransportBacklog) {
+  transport::SendScheduler scheduler(m_io_context, m_transport);
+  scheduler.send(m_peer, datagram(TrafficClass::INTERACTIVE),
+                 TrafficClass::INTERACTIVE);
+  m_transport.stuck = 1;
+
+  int drained = 0;
+  scheduler.async_wait_drained([&drained]() { drained++; });
+  EXPECT_EQ(drained, 0) << "called from inside async_wait_drained";
+  run_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(m_transport.sent.size(), 1u);
+  EXPECT_EQ(drained, 0) << "called while the kernel had a backlog";
+
+  m_transport.stuck = 0;
+  run_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(drained, 1);
+
+  // Called once, and straight away once nothing is waiting
+  run_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(drained, 1);
+  scheduler.async_wait_drained([&drained]() { drained++; });
+  run_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(drained, 2);
+}
+
+TEST_F(SchedulerTest, EmptyHandlerStopsTheDrainWait) {
+  transport::SendScheduler scheduler(m_io_context, m_transport);
+  m_transport.stuck = 1;
+
+  int drained = 0;
+  scheduler.async_wait_drained([&drained]() { drained++; });
+  run_for(std::chrono::milliseconds(5));
+  scheduler.async_wait_drained(nullptr);
+  m_transport.stuck = 0;
+  run_for(std::chrono::milliseconds(5));
+  EXPECT_EQ(drained, 0);
+}
+
+TEST_F(SchedulerTest, ClassesShareTheLinkByWeight) {
+  transport::SchedulerOptions options;
+  options.weights = {0, 4, 2, 1};
+  options.bulk_rate = 0;
+  transport::SendScheduler scheduler(m_io_context, m_transport, options);
+
+  for (int idx = 0; idx < 30; ++idx) {
+    for (auto cls : {TrafficClass::CONTROL, TrafficClass::INTERACTIVE,
+                     TrafficClass::BULK}) {
+      scheduler.send(m_peer, datagram(cls), cls);
+    }
+  }
+  run_for(std::chrono::milliseconds(5));
+
+  // While all three are waiting they are sent 4:2:1
+  auto classes = sent_classes();
+  ASSERT_EQ(classes.size(), 90u);
+  std::array<int, transport::TRAFFIC_CLASSES> counts{};
+  for (size_t idx = 0; idx < 14; ++idx) {
+    counts[static_cast<size_t>(classes[idx])]++;
+  }
+  EXPECT_EQ(counts[static_cast<size_t>(TrafficClass::CONTROL)], 8);
+  EXPECT_EQ(counts[static_cast<size_t>(TrafficClass::INTERACTIVE)], 4);
+  EXPECT_EQ(counts[static_cast<size_t>(TrafficClass::BULK)], 2);
+}
+
+TEST_F(SchedulerTest, BulkIsLimitedPerPeer) {
+  transport::SchedulerOptions options;
+  // Two datagrams put a peer's bucket in debt for half a second
+  options.bulk_rate = 100;
+  options.bulk_burst = 150;
+  transport::SendScheduler scheduler(m_io_context, m_transport, options);
+
+  udp::endpoint other{asio::ip::make_address("127.0.0.1"), 9001};
+  for (int idx = 0; idx < 10; ++idx) {
+    scheduler.send(m_peer, datagram(TrafficClass::BULK), TrafficClass::BULK);
+    scheduler.send(other, datagram(TrafficClass::BULK), TrafficClass::BULK);
+  }
+  for (int idx = 0; idx < 5; ++idx) {
+    scheduler.send(m_peer, datagram(TrafficClass::INTERACTIVE),
+                   TrafficClass::INTERACTIVE);
+  }
+  run_for(std::chrono::milliseconds(20));
+
+  // Commands are not held up, and each peer gets its own burst
+  size_t to_peer = 0, to_other = 0;
+  for (const auto &[endpoint, bytes] : m_transport.sent) {
+    if (static_cast<TrafficClass>(bytes[0]) == TrafficClass::BULK) {
+      (endpoint == m_peer ? to_peer : to_other)++;
+    }
+  }
+  EXPECT_EQ(scheduler.stats(TrafficClass::INTERACTIVE).sent, 5u);
+  EXPECT_EQ(to_peer, 2u);
+  EXPECT_EQ(to_other, 2u);
+  EXPECT_EQ(scheduler.queued(TrafficClass::BULK), 16u);
+}
+
+TEST_F(SchedulerTest, LinkRateSpacesDatagramsOut) {
+  transport::SchedulerOptions options;
+  options.link_rate = 100 * 1000; // One 100 byte datagram every millisecond
+  options.link_burst = 100;
+  transport::SendScheduler scheduler(m_io_context, m_transport, options);
+
+  for (int idx = 0; idx < 10; ++idx) {
+    scheduler.send(m_peer, datagram(TrafficClass::INTERACTIVE),
+                   TrafficClass::INTERACTIVE);
+  }
+  run_for(std::chrono::milliseconds(1));
+  EXPECT_LT(m_transport.sent.size(), 10u);
+
+  run_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(m_transport.sent.size(), 10u);
+  EXPECT_GE(scheduler.stats(TrafficClass::INTERACTIVE).max_wait,
+            std::chrono::milliseconds(5));
+}
+
+TEST(TokenBucket, WaitsOutItsDebt) {
+  auto start = transport::TokenBucket::Clock::now();
+  transport::TokenBucket bucket(1000, 100, start);
+  EXPECT_TRUE(bucket.ready(start));
+
+  // A datagram bigger than the burst still passes, then must be paid off
+  bucket.consume(300);
+  EXPECT_FALSE(bucket.ready(start));
+  auto wait = bucket.wait(start);
+  EXPECT_GE(wait, std::chrono::milliseconds(200));
+  EXPECT_LE(wait, std::chrono::milliseconds(202));
+  EXPECT_TRUE(bucket.ready(start + wait));
+
+  // Saved up tokens are capped at the burst
+  auto later = start + std::chrono::seconds(10);
+  EXPECT_TRUE(bucket.ready(later));
+  bucket.consume(101);
+  EXPECT_FALSE(bucket.ready(later));
+}
+
+TEST(TokenBucket, ZeroRateIsUnlimited) {
+  transport::TokenBucket bucket;
+  bucket.consume(1 << 20);
+  EXPECT_TRUE(bucket.ready(transport::TokenBucket::Clock::now()));
+  EXPECT_EQ(bucket.wait(transport::TokenBucket::Clock::now()),
+            transport::TokenBucket::Clock::duration::zero());
+}
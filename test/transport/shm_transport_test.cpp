@@ -0,0 +1,160 @@
+#include "shm_transport.h"
+
+#ifdef __linux__
+#include <chrono>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Runs a receiving and a sending transport on one io_context, recording what
+// arrives
+class ShmTransportTest : public ::testing::Test {
+protected:
+  asio::io_context m_io_context;
+  std::unique_ptr<transport::ShmTransport> m_receiver, m_sender;
+  std::vector<std::pair<udp::endpoint, std::vector<uint8_t>>> m_received;
+
+  void SetUp() override {
+    m_receiver = std::make_unique<transport::ShmTransport>(
+        m_io_context, udp::endpoint(udp::v4(), 0));
+    m_sender = std::make_unique<transport::ShmTransport>(
+        m_io_context, udp::endpoint(udp::v4(), 0));
+  }
+
+  void receive() {
+    m_receiver->async_receive(
+        [this](std::span<const transport::Datagram> batch) {
+          for (const auto &datagram : batch) {
+            m_received.emplace_back(
+                datagram.sender,
+                std::vector<uint8_t>(datagram.data,
+                                     datagram.data + datagram.size));
+          }
+        });
+  }
+
+  udp::endpoint receiver_endpoint() const {
+    return udp::endpoint(asio::ip::address_v4::loopback(),
+                         m_receiver->local_endpoint().port());
+  }
+
+  // Runs until the given number of datagrams has arrived or time runs out
+  void run_until(size_t count, std::chrono::milliseconds deadline = 2s) {
+    auto end = std::chrono::steady_clock::now() + deadline;
+    while (m_received.size() < count &&
+           std::chrono::steady_clock::now() < end) {
+      m_io_context.run_for(1ms);
+      m_io_context.restart();
+    }
+  }
+
+  static std::vector<uint8_t> message(uint32_t value, size_t size = 100) {
+    std::vector<uint8_t> bytes(size, static_cast<uint8_t>(value));
+    std::memcpy(bytes.data(), &value, sizeof(value));
+    return bytes;
+  }
+
+  static uint32_t value_of(const std::vector<uint8_t> &bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes.data(), sizeof(value));
+    return value;
+  }
+};
+
+TEST_F(ShmTransportTest, DeliversDatagramsFromTheSendersPort) {
+  receive();
+  m_sender->queue_send(receiver_endpoint(), message(1));
+  m_sender->queue_send(receiver_endpoint(), message(2, 3));
+  m_sender->flush();
+  run_until(2);
+
+  ASSERT_EQ(m_received.size(), 2u);
+  EXPECT_EQ(m_received[0].second, message(1));
+  EXPECT_EQ(m_received[1].second, message(2, 3));
+  EXPECT_EQ(m_received[0].first.port(), m_sender->local_endpoint().port());
+  EXPECT_TRUE(m_received[0].first.address().is_loopback());
+}
+
+TEST_F(ShmTransportTest, NothingArrivesBeforeAFlush) {
+  receive();
+  m_sender->queue_send(receiver_endpoint(), message(1));
+  run_until(1, 20ms);
+  EXPECT_TRUE(m_received.empty());
+
+  m_sender->flush();
+  run_until(1);
+  EXPECT_EQ(m_received.size(), 1u);
+}
+
+TEST_F(ShmTransportTest, FullRingIsBackloggedUntilDrained) {
+  // Many times what the ring holds, in order, while nothing is received
+  const uint32_t count = 4 * transport::SHM_RING_BYTES / 1000;
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    m_sender->queue_send(receiver_endpoint(), message(idx, 1000));
+  }
+  m_sender->flush();
+  EXPECT_GT(m_sender->backlog(), 0u);
+  EXPECT_LT(m_sender->backlog(), count);
+
+  receive();
+  run_until(count);
+  ASSERT_EQ(m_received.size(), count);
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    EXPECT_EQ(value_of(m_received[idx].second), idx);
+  }
+  EXPECT_EQ(m_sender->backlog(), 0u);
+}
+
+TEST_F(ShmTransportTest, SendersShareAReceiver) {
+  transport::ShmTransport other(m_io_context, udp::endpoint(udp::v4(), 0));
+  receive();
+  for (uint32_t idx = 0; idx < 100; ++idx) {
+    m_sender->send(receiver_endpoint(), message(idx));
+    other.send(receiver_endpoint(), message(1000 + idx));
+  }
+  run_until(200);
+
+  ASSERT_EQ(m_received.size(), 200u);
+  size_t from_other = 0;
+  for (const auto &[sender, bytes] : m_received) {
+    from_other += sender.port() == other.local_endpoint().port();
+  }
+  EXPECT_EQ(from_other, 100u);
+}
+
+TEST_F(ShmTransportTest, DatagramsToAnUnboundPortAreDropped) {
+  auto port = m_receiver->local_endpoint().port();
+  m_receiver.reset();
+  m_sender->send(udp::endpoint(asio::ip::address_v4::loopback(), port),
+                 message(1));
+  EXPECT_EQ(m_sender->backlog(), 0u);
+}
+
+TEST_F(ShmTransportTest, BoundPortCannotBeTaken) {
+  EXPECT_THROW(transport::ShmTransport(m_io_context,
+                                       m_receiver->local_endpoint()),
+               std::system_error);
+}
+
+TEST_F(ShmTransportTest, ReachesAReceiverThatReplacedAClosedOne) {
+  receive();
+  m_sender->send(receiver_endpoint(), message(1));
+  run_until(1);
+  ASSERT_EQ(m_received.size(), 1u);
+
+  // The sender notices the receiver going and hands the new one a ring
+  auto endpoint = m_receiver->local_endpoint();
+  m_receiver.reset();
+  m_io_context.run_for(10ms);
+  m_io_context.restart();
+  m_receiver =
+      std::make_unique<transport::ShmTransport>(m_io_context, endpoint);
+  receive();
+
+  m_sender->send(receiver_endpoint(), message(2));
+  run_until(2);
+  ASSERT_EQ(m_received.size(), 2u);
+  EXPECT_EQ(value_of(m_received[1].second), 2u);
+}
+#endif
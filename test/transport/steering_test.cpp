@@ -0,0 +1,113 @@
+#include "transport.h"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// A SO_REUSEPORT group of asio transports on one loopback port, steered by
+// the 32-bit value at the start of each datagram, as the Earth base steers
+// responses and alerts by rover ID. Skipped where steering is unavailable.
+class SteeringTest : public ::testing::Test {
+protected:
+  static constexpr unsigned GROUP_SIZE = 3;
+
+  asio::io_context m_io_context;
+  std::vector<std::unique_ptr<transport::Transport>> m_group;
+  std::array<std::vector<std::vector<uint8_t>>, GROUP_SIZE> m_received;
+  size_t m_count = 0;
+
+  void SetUp() override {
+    if (!transport::reuse_port_supported(transport::Backend::ASIO)) {
+      GTEST_SKIP() << "SO_REUSEPORT unsupported";
+    }
+
+    // The first socket picks the port, and the rest join it in index order
+    const transport::BindOptions options{true, true, 0};
+    udp::endpoint endpoint(asio::ip::address_v4::loopback(), 0);
+    for (unsigned idx = 0; idx < GROUP_SIZE; ++idx) {
+      m_group.push_back(transport::make_transport(
+          transport::Backend::ASIO, m_io_context, endpoint, options));
+      endpoint = m_group.front()->local_endpoint();
+
+      m_group.back()->async_receive(
+          [this, idx](std::span<const transport::Datagram> batch) {
+            for (const auto &datagram : batch) {
+              m_received[idx].emplace_back(datagram.data,
+                                           datagram.data + datagram.size);
+              m_count++;
+            }
+          });
+    }
+
+    if (!transport::steer_reuseport_group(*m_group.front(), 0, GROUP_SIZE)) {
+      GTEST_SKIP() << "SO_REUSEPORT steering unavailable";
+    }
+  }
+
+  // Runs until the given number of datagrams has arrived or time runs out
+  void run_until(size_t count) {
+    auto end = std::chrono::steady_clock::now() + 2s;
+    while (m_count < count && std::chrono::steady_clock::now() < end) {
+      m_io_context.run_for(1ms);
+      m_io_context.restart();
+    }
+  }
+
+  static std::vector<uint8_t> message(uint32_t rover_id) {
+    std::vector<uint8_t> bytes(16, 0xEE);
+    std::memcpy(bytes.data(), &rover_id, sizeof(rover_id));
+    return bytes;
+  }
+
+  static uint32_t rover_id_of(const std::vector<uint8_t> &bytes) {
+    uint32_t rover_id = 0;
+    std::memcpy(&rover_id, bytes.data(), sizeof(rover_id));
+    return rover_id;
+  }
+};
+
+TEST_F(SteeringTest, EachRoverIdAlwaysReachesTheSameSocket) {
+  constexpr uint32_t ROVERS = 30;
+  constexpr int ROUNDS = 4;
+
+  // Several senders, so the source port does not decide where datagrams go.
+  // The IDs include some past the 16-bit range, which use every byte.
+  std::vector<std::unique_ptr<transport::Transport>> senders;
+  for (int i = 0; i < 2; ++i) {
+    senders.push_back(transport::make_transport(
+        transport::Backend::ASIO, m_io_context,
+        udp::endpoint(asio::ip::address_v4::loopback(), 0)));
+  }
+
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (uint32_t rover = 0; rover < ROVERS; ++rover) {
+      uint32_t rover_id = rover < ROVERS / 2 ? rover : rover * 0x01010101u;
+      auto &sender = *senders[rover_id % senders.size()];
+      sender.send(m_group.front()->local_endpoint(), message(rover_id));
+    }
+    run_until(static_cast<size_t>(round + 1) * ROVERS);
+  }
+
+  ASSERT_EQ(m_count, static_cast<size_t>(ROUNDS) * ROVERS);
+  for (unsigned idx = 0; idx < GROUP_SIZE; ++idx) {
+    EXPECT_FALSE(m_received[idx].empty());
+    for (const auto &bytes : m_received[idx]) {
+      EXPECT_EQ(rover_id_of(bytes) % GROUP_SIZE, idx)
+          << "rover " << rover_id_of(bytes) << " reached socket " << idx;
+    }
+  }
+}
+
+TEST_F(SteeringTest, DatagramsTooShortToSteerStillArrive) {
+  auto sender = transport::make_transport(
+      transport::Backend::ASIO, m_io_context,
+      udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  sender->send(m_group.front()->local_endpoint(), {1, 2});
+  run_until(1);
+  EXPECT_EQ(m_count, 1u);
+}
@@ -0,0 +1,135 @@
+#include "uring_transport.h"
+
+#ifdef __linux__
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Runs a receiving and a sending transport on one io_context over loopback,
+// recording what arrives. Skipped where the kernel cannot run io_uring, as
+// make_transport would fall back to asio there.
+class UringTransportTest : public ::testing::Test {
+protected:
+  asio::io_context m_io_context;
+  std::unique_ptr<transport::UringTransport> m_receiver, m_sender;
+  std::vector<std::pair<udp::endpoint, std::vector<uint8_t>>> m_received;
+
+  void SetUp() override {
+    try {
+      m_receiver = std::make_unique<transport::UringTransport>(
+          m_io_context,
+          udp::endpoint(asio::ip::address_v4::loopback(), 0));
+      m_sender = std::make_unique<transport::UringTransport>(
+          m_io_context,
+          udp::endpoint(asio::ip::address_v4::loopback(), 0));
+    } catch (const std::system_error &e) {
+      GTEST_SKIP() << "io_uring unavailable: " << e.what();
+    }
+  }
+
+  void receive() {
+    m_receiver->async_receive(
+        [this](std::span<const transport::Datagram> batch) {
+          record(batch);
+        });
+  }
+
+  void record(std::span<const transport::Datagram> batch) {
+    for (const auto &datagram : batch) {
+      m_received.emplace_back(
+          datagram.sender, std::vector<uint8_t>(datagram.data,
+                                                datagram.data + datagram.size));
+    }
+  }
+
+  // Runs until the given number of datagrams has arrived or time runs out
+  void run_until(size_t count, std::chrono::milliseconds deadline = 2s) {
+    auto end = std::chrono::steady_clock::now() + deadline;
+    while (m_received.size() < count &&
+           std::chrono::steady_clock::now() < end) {
+      m_io_context.run_for(1ms);
+      m_io_context.restart();
+    }
+  }
+
+  static std::vector<uint8_t> message(uint32_t value, size_t size = 100) {
+    std::vector<uint8_t> bytes(size, static_cast<uint8_t>(value));
+    std::memcpy(bytes.data(), &value, sizeof(value));
+    return bytes;
+  }
+
+  static uint32_t value_of(const std::vector<uint8_t> &bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes.data(), sizeof(value));
+    return value;
+  }
+};
+
+TEST_F(UringTransportTest, DeliversDatagramsFromTheSendersPort) {
+  receive();
+  m_sender->queue_send(m_receiver->local_endpoint(), message(1));
+  m_sender->queue_send(m_receiver->local_endpoint(), message(2, 3));
+  m_sender->flush();
+  run_until(2);
+
+  ASSERT_EQ(m_received.size(), 2u);
+  EXPECT_EQ(m_received[0].second, message(1));
+  EXPECT_EQ(m_received[1].second, message(2, 3));
+  EXPECT_EQ(m_received[0].first, m_sender->local_endpoint());
+  EXPECT_EQ(m_sender->backlog(), 0u);
+}
+
+TEST_F(UringTransportTest, DatagramsArrivingBeforeAReceiveAreKept) {
+  // More than the ring has buffers for, so the receive runs out and stops
+  const uint32_t count = 300;
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    m_sender->queue_send(m_receiver->local_endpoint(), message(idx));
+  }
+  m_sender->flush();
+  m_io_context.run_for(50ms);
+  m_io_context.restart();
+  EXPECT_TRUE(m_received.empty());
+
+  receive();
+  EXPECT_TRUE(m_received.empty()) << "delivered from inside async_receive";
+  run_until(count);
+  ASSERT_EQ(m_received.size(), count);
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    EXPECT_EQ(value_of(m_received[idx].second), idx);
+  }
+}
+
+TEST_F(UringTransportTest, HandlerMayCloseTheTransport) {
+  size_t batches = 0;
+  m_receiver->async_receive(
+      [this, &batches](std::span<const transport::Datagram> batch) {
+        batches++;
+        record(batch);
+        m_receiver->close();
+      });
+  for (uint32_t idx = 0; idx < 10; ++idx) {
+    m_sender->queue_send(m_receiver->local_endpoint(), message(idx));
+  }
+  m_sender->flush();
+  run_until(10, 100ms);
+
+  EXPECT_EQ(batches, 1u);
+  ASSERT_FALSE(m_received.empty());
+  EXPECT_EQ(value_of(m_received[0].second), 0u);
+}
+
+TEST_F(UringTransportTest, SendsAfterCloseAreDropped) {
+  receive();
+  auto endpoint = m_receiver->local_endpoint();
+  m_sender->close();
+  m_sender->queue_send(endpoint, message(1));
+  m_sender->flush();
+  EXPECT_EQ(m_sender->backlog(), 0u);
+
+  run_until(1, 50ms);
+  EXPECT_TRUE(m_received.empty());
+}
+#endif